@@ -188,6 +188,7 @@ struct http_response_info
 	http_header_info m_header_info;
 	int m_http_ver_hi; // OUT paramter only
 	int m_http_ver_lo; // OUT paramter only
+	std::string m_handler; // JSON-RPC method which handled the request, not sent
 
 	void clear()
 	{
@@ -158,6 +158,7 @@
 
 #define PREPARE_OBJECTS_FROM_JSON(command_type)                                                                                                                                                \
 	handled = true;                                                                                                                                                                            \
+	response_info.m_handler = callback_name;                                                                                                                                                   \
 	boost::value_initialized<epee::json_rpc::request<command_type::request>> req_;                                                                                                             \
 	epee::json_rpc::request<command_type::request> &req = static_cast<epee::json_rpc::request<command_type::request> &>(req_);                                                                 \
 	if(!req.load(ps))                                                                                                                                                                          \
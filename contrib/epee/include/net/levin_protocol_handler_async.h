@@ -48,6 +48,11 @@
 #define MIN_BYTES_WANTED 512
 #endif
 
+// Largest body buffer a connection keeps around for the next message
+#ifndef LEVIN_RECV_BUFFER_KEEP
+#define LEVIN_RECV_BUFFER_KEEP (1024 * 1024)
+#endif
+
 namespace epee
 {
 namespace levin
@@ -142,7 +147,13 @@ class async_protocol_handler
 	config_type &m_config;
 	t_connection_context &m_connection_context;
 
-	std::string m_cache_in_buffer;
+	// A header split across reads is gathered in m_head_buf, a header that arrives
+	// whole is parsed straight from the read buffer. Bodies are copied once, into
+	// m_body, which is handed to the command handler and then reused.
+	char m_head_buf[sizeof(bucket_head2)];
+	size_t m_head_size;
+	std::string m_body;
+	size_t m_bytes_received;
 	stream_state m_state;
 
 	int32_t m_oponent_protocol_ver;
@@ -264,6 +275,8 @@ class async_protocol_handler
 																 m_pservice_endpoint(psnd_hndlr),
 																 m_config(config),
 																 m_connection_context(conn_context),
+																 m_head_size(0),
+																 m_bytes_received(0),
 																 m_state(stream_state_head)
 	{
 		m_close_called = 0;
@@ -363,15 +376,17 @@ class async_protocol_handler
 			return false;
 		}
 
-		if(m_cache_in_buffer.size() + cb > m_config.m_max_packet_size)
+		size_t pending = m_state == stream_state_head ? m_head_size : m_body.size();
+		if(pending + cb > m_config.m_max_packet_size)
 		{
 			MWARNING(m_connection_context << "Maximum packet size exceed!, m_max_packet_size = " << m_config.m_max_packet_size
-										  << ", packet received " << m_cache_in_buffer.size() + cb
+										  << ", packet received " << pending + cb
 										  << ", connection will be closed.");
 			return false;
 		}
 
-		m_cache_in_buffer.append((const char *)ptr, cb);
+		m_bytes_received += cb;
+		const char *data = (const char *)ptr;
 
 		bool is_continue = true;
 		while(is_continue)
@@ -379,10 +394,15 @@ class async_protocol_handler
 			switch(m_state)
 			{
 			case stream_state_body:
-				if(m_cache_in_buffer.size() < m_current_head.m_cb)
+			{
+				size_t take = std::min<size_t>(m_current_head.m_cb - m_body.size(), cb);
+				m_body.append(data, take);
+				data += take;
+				cb -= take;
+				if(m_body.size() < m_current_head.m_cb)
 				{
 					is_continue = false;
-					if(cb >= MIN_BYTES_WANTED)
+					if(take >= MIN_BYTES_WANTED)
 					{
 						CRITICAL_REGION_LOCAL(m_invoke_response_handlers_lock);
 						if(!m_invoke_response_handlers.empty())
@@ -390,20 +410,17 @@ class async_protocol_handler
 							//async call scenario
 							boost::shared_ptr<invoke_response_handler_base> response_handler = m_invoke_response_handlers.front();
 							response_handler->reset_timer();
-							MDEBUG(m_connection_context << "LEVIN_PACKET partial msg received. len=" << cb);
+							MDEBUG(m_connection_context << "LEVIN_PACKET partial msg received. len=" << take);
 						}
 					}
 					break;
 				}
 				{
+					// a handler may re-enter handle_recv through a sync invoke, so the body
+					// leaves m_body for the duration of the call
 					std::string buff_to_invoke;
-					if(m_cache_in_buffer.size() == m_current_head.m_cb)
-						buff_to_invoke.swap(m_cache_in_buffer);
-					else
-					{
-						buff_to_invoke.assign(m_cache_in_buffer, 0, (std::string::size_type)m_current_head.m_cb);
-						m_cache_in_buffer.erase(0, (std::string::size_type)m_current_head.m_cb);
-					}
+					buff_to_invoke.swap(m_body);
+					m_state = stream_state_head;
 
 					bool is_response = (m_oponent_protocol_ver == LEVIN_PROTOCOL_VER_1 && m_current_head.m_flags & LEVIN_PACKET_RESPONSE);
 
@@ -478,31 +495,53 @@ class async_protocol_handler
 						else
 							m_config.m_pcommands_handler->notify(m_current_head.m_command, buff_to_invoke, m_connection_context);
 					}
+					if(m_body.empty() && buff_to_invoke.capacity() <= LEVIN_RECV_BUFFER_KEEP)
+					{
+						buff_to_invoke.clear();
+						m_body.swap(buff_to_invoke);
+					}
 				}
-				m_state = stream_state_head;
 				break;
+			}
 			case stream_state_head:
 			{
-				if(m_cache_in_buffer.size() < sizeof(bucket_head2))
+				const char *head = data;
+				if(m_head_size == 0 && cb >= sizeof(bucket_head2))
+				{
+					data += sizeof(bucket_head2);
+					cb -= sizeof(bucket_head2);
+				}
+				else
 				{
-					if(m_cache_in_buffer.size() >= sizeof(uint64_t) && *((uint64_t *)m_cache_in_buffer.data()) != LEVIN_SIGNATURE)
+					size_t take = std::min(sizeof(bucket_head2) - m_head_size, cb);
+					memcpy(m_head_buf + m_head_size, data, take);
+					m_head_size += take;
+					data += take;
+					cb -= take;
+					if(m_head_size < sizeof(bucket_head2))
 					{
-						MWARNING(m_connection_context << "Signature mismatch, connection will be closed");
-						return false;
+						uint64_t signature = LEVIN_SIGNATURE;
+						if(m_head_size >= sizeof(signature))
+							memcpy(&signature, m_head_buf, sizeof(signature));
+						if(signature != LEVIN_SIGNATURE)
+						{
+							MWARNING(m_connection_context << "Signature mismatch, connection will be closed");
+							return false;
+						}
+						is_continue = false;
+						break;
 					}
-					is_continue = false;
-					break;
+					head = m_head_buf;
+					m_head_size = 0;
 				}
 
-				bucket_head2 *phead = (bucket_head2 *)m_cache_in_buffer.data();
-				if(LEVIN_SIGNATURE != phead->m_signature)
+				memcpy(&m_current_head, head, sizeof(bucket_head2));
+				if(LEVIN_SIGNATURE != m_current_head.m_signature)
 				{
 					LOG_ERROR_CC(m_connection_context, "Signature mismatch, connection will be closed");
 					return false;
 				}
-				m_current_head = *phead;
 
-				m_cache_in_buffer.erase(0, sizeof(bucket_head2));
 				m_state = stream_state_body;
 				m_oponent_protocol_ver = m_current_head.m_protocol_version;
 				if(m_current_head.m_cb > m_config.m_max_packet_size)
@@ -512,6 +551,7 @@ class async_protocol_handler
 																										   << ", connection will be closed.");
 					return false;
 				}
+				m_body.reserve(std::min<size_t>(m_current_head.m_cb, LEVIN_RECV_BUFFER_KEEP));
 			}
 			break;
 			default:
@@ -648,13 +688,13 @@ class async_protocol_handler
 									<< ", ver=" << head.m_protocol_version);
 
 		uint64_t ticks_start = misc_utils::get_tick_count();
-		size_t prev_size = 0;
+		size_t prev_size = m_bytes_received;
 
 		while(!boost::interprocess::ipcdetail::atomic_read32(&m_invoke_buf_ready) && !m_deletion_initiated && !m_protocol_released)
 		{
-			if(m_cache_in_buffer.size() - prev_size >= MIN_BYTES_WANTED)
+			if(m_bytes_received - prev_size >= MIN_BYTES_WANTED)
 			{
-				prev_size = m_cache_in_buffer.size();
+				prev_size = m_bytes_received;
 				ticks_start = misc_utils::get_tick_count();
 			}
 			if(misc_utils::get_tick_count() - ticks_start > m_config.m_invoke_timeout)
@@ -0,0 +1,695 @@
+// Copyright (c) 2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/mpl/contains.hpp>
+#include <deque>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "misc_language.h"
+#include "portable_storage_base.h"
+#include "portable_storage_from_bin.h"
+#include "portable_storage_to_bin.h"
+#include "portable_storage_val_converters.h"
+
+namespace epee
+{
+namespace serialization
+{
+template <class t_value>
+struct portable_type_code;
+template <>
+struct portable_type_code<int64_t> { static const uint8_t value = SERIALIZE_TYPE_INT64; };
+template <>
+struct portable_type_code<int32_t> { static const uint8_t value = SERIALIZE_TYPE_INT32; };
+template <>
+struct portable_type_code<int16_t> { static const uint8_t value = SERIALIZE_TYPE_INT16; };
+template <>
+struct portable_type_code<int8_t> { static const uint8_t value = SERIALIZE_TYPE_INT8; };
+template <>
+struct portable_type_code<uint64_t> { static const uint8_t value = SERIALIZE_TYPE_UINT64; };
+template <>
+struct portable_type_code<uint32_t> { static const uint8_t value = SERIALIZE_TYPE_UINT32; };
+template <>
+struct portable_type_code<uint16_t> { static const uint8_t value = SERIALIZE_TYPE_UINT16; };
+template <>
+struct portable_type_code<uint8_t> { static const uint8_t value = SERIALIZE_TYPE_UINT8; };
+template <>
+struct portable_type_code<double> { static const uint8_t value = SERIALIZE_TYPE_DUOBLE; };
+template <>
+struct portable_type_code<bool> { static const uint8_t value = SERIALIZE_TYPE_BOOL; };
+template <>
+struct portable_type_code<std::string> { static const uint8_t value = SERIALIZE_TYPE_STRING; };
+
+/************************************************************************/
+/* Writes the portable_storage binary format straight into a buffer as  */
+/* a KV_SERIALIZE map is stored, without building a section tree first. */
+/* Entries come out in the order they are stored rather than sorted by  */
+/* name, which readers don't care about since they look entries up by   */
+/* name. Sections and arrays must be filled in the order the KV maps    */
+/* do it: writing to a section closes any child section or array that   */
+/* was opened after it, and its entry count is patched in then.         */
+/************************************************************************/
+class portable_storage_writer
+{
+	struct string_sink
+	{
+		std::string &buf;
+		void write(const char *data, size_t size) { buf.append(data, size); }
+	};
+	struct frame
+	{
+		size_t count_pos;
+		size_t count;
+		uint8_t type; //0 for a section, element type | SERIALIZE_FLAG_ARRAY for an array
+	};
+
+  public:
+	typedef frame *hsection;
+	typedef frame *harray;
+	typedef storage_entry meta_entry;
+
+	portable_storage_writer();
+
+	hsection open_section(const char *section_name, hsection hparent_section, bool create_if_notexist = false);
+	template <class t_value>
+	bool set_value(const char *value_name, const t_value &target, hsection hparent_section);
+	bool set_value(const char *value_name, const storage_entry &target, hsection hparent_section);
+
+	template <class t_value>
+	harray insert_first_value(const char *value_name, const t_value &target, hsection hparent_section);
+	template <class t_value>
+	bool insert_next_value(harray hval_array, const t_value &target);
+	harray insert_first_section(const char *section_name, hsection &hinserted_childsection, hsection hparent_section);
+	bool insert_next_section(harray hsec_array, hsection &hinserted_childsection);
+
+	//closes every open section and array and hands the buffer over; the writer is spent afterwards
+	bool store_to_binary(binarybuffer &target);
+
+	//portable_storage's stream interface, so that pack_varint() and pack_entry_to_buff() can write here
+	void write(const char *data, size_t size) { m_buffer.append(data, size); }
+
+  private:
+	frame *begin_entry(const char *name, uint8_t type, hsection hparent_section);
+	frame *push_frame(uint8_t type);
+	bool close_down_to(frame *f);
+	void close_top();
+	template <class t_value>
+	void write_value(const t_value &v) { write((const char *)&v, sizeof(v)); }
+	void write_value(const std::string &v) { put_string(*this, v); }
+
+	std::string m_buffer;
+	std::deque<frame> m_frames;
+	bool m_failed;
+};
+
+inline portable_storage_writer::portable_storage_writer() : m_failed(false)
+{
+	m_buffer.reserve(4096);
+	uint32_t signature_a = PORTABLE_STORAGE_SIGNATUREA;
+	uint32_t signature_b = PORTABLE_STORAGE_SIGNATUREB;
+	uint8_t ver = PORTABLE_STORAGE_FORMAT_VER;
+	write((const char *)&signature_a, sizeof(signature_a));
+	write((const char *)&signature_b, sizeof(signature_b));
+	write((const char *)&ver, sizeof(ver));
+	push_frame(0);
+}
+//---------------------------------------------------------------------------------------------------------------
+inline portable_storage_writer::frame *portable_storage_writer::push_frame(uint8_t type)
+{
+	//one byte is enough for up to 63 entries, close_top() widens it for bigger counts
+	m_frames.push_back({m_buffer.size(), 0, type});
+	m_buffer.push_back(0);
+	return &m_frames.back();
+}
+//---------------------------------------------------------------------------------------------------------------
+inline void portable_storage_writer::close_top()
+{
+	const frame &f = m_frames.back();
+	std::string count;
+	string_sink sink{count};
+	pack_varint(sink, f.count);
+	if(count.size() > 1)
+		m_buffer.insert(f.count_pos + 1, count.size() - 1, '\0');
+	memcpy(&m_buffer[f.count_pos], count.data(), count.size());
+	m_frames.pop_back();
+}
+//---------------------------------------------------------------------------------------------------------------
+inline bool portable_storage_writer::close_down_to(frame *f)
+{
+	auto it = m_frames.rbegin();
+	while(it != m_frames.rend() && &*it != f)
+		++it;
+	if(it == m_frames.rend())
+	{
+		LOG_ERROR("portable_storage_writer: section or array is already closed");
+		m_failed = true;
+		return false;
+	}
+	while(&m_frames.back() != f)
+		close_top();
+	return true;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline portable_storage_writer::frame *portable_storage_writer::begin_entry(const char *name, uint8_t type, hsection hparent_section)
+{
+	CHECK_AND_ASSERT_MES(!m_frames.empty(), nullptr, "portable_storage_writer: already stored");
+	frame *parent = hparent_section ? hparent_section : &m_frames.front();
+	if(!close_down_to(parent))
+		return nullptr;
+	CHECK_AND_ASSERT_MES(parent->type == 0, nullptr, "portable_storage_writer: entry " << name << " added to an array");
+	size_t len = strlen(name);
+	if(len >= std::numeric_limits<uint8_t>::max())
+	{
+		LOG_ERROR("storage_entry_name is too long: " << len << ", val: " << name);
+		m_failed = true;
+		return nullptr;
+	}
+	uint8_t len8 = static_cast<uint8_t>(len);
+	write((const char *)&len8, sizeof(len8));
+	write(name, len);
+	if(type)
+		write((const char *)&type, sizeof(type));
+	++parent->count;
+	return parent;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline portable_storage_writer::hsection portable_storage_writer::open_section(const char *section_name, hsection hparent_section, bool create_if_notexist)
+{
+	if(!create_if_notexist || !begin_entry(section_name, SERIALIZE_TYPE_OBJECT, hparent_section))
+		return nullptr;
+	return push_frame(0);
+}
+//---------------------------------------------------------------------------------------------------------------
+template <class t_value>
+bool portable_storage_writer::set_value(const char *value_name, const t_value &v, hsection hparent_section)
+{
+	if(!begin_entry(value_name, portable_type_code<t_value>::value, hparent_section))
+		return false;
+	write_value(v);
+	return true;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline bool portable_storage_writer::set_value(const char *value_name, const storage_entry &v, hsection hparent_section)
+{
+	TRY_ENTRY();
+	if(!begin_entry(value_name, 0, hparent_section))
+		return false;
+	return pack_entry_to_buff(*this, v);
+	CATCH_ENTRY("portable_storage_writer::set_value", false);
+}
+//---------------------------------------------------------------------------------------------------------------
+template <class t_value>
+portable_storage_writer::harray portable_storage_writer::insert_first_value(const char *value_name, const t_value &target, hsection hparent_section)
+{
+	uint8_t type = portable_type_code<t_value>::value | SERIALIZE_FLAG_ARRAY;
+	if(!begin_entry(value_name, type, hparent_section))
+		return nullptr;
+	frame *arr = push_frame(type);
+	arr->count = 1;
+	write_value(target);
+	return arr;
+}
+//---------------------------------------------------------------------------------------------------------------
+template <class t_value>
+bool portable_storage_writer::insert_next_value(harray hval_array, const t_value &target)
+{
+	CHECK_AND_ASSERT(hval_array, false);
+	if(!close_down_to(hval_array))
+		return false;
+	CHECK_AND_ASSERT_MES(hval_array->type == (portable_type_code<t_value>::value | SERIALIZE_FLAG_ARRAY),
+						 false, "unexpected type in insert_next_value: " << typeid(t_value).name());
+	++hval_array->count;
+	write_value(target);
+	return true;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline portable_storage_writer::harray portable_storage_writer::insert_first_section(const char *section_name, hsection &hinserted_childsection, hsection hparent_section)
+{
+	uint8_t type = SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY;
+	if(!begin_entry(section_name, type, hparent_section))
+		return nullptr;
+	frame *arr = push_frame(type);
+	arr->count = 1;
+	hinserted_childsection = push_frame(0);
+	return arr;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline bool portable_storage_writer::insert_next_section(harray hsec_array, hsection &hinserted_childsection)
+{
+	CHECK_AND_ASSERT(hsec_array, false);
+	if(!close_down_to(hsec_array))
+		return false;
+	CHECK_AND_ASSERT_MES(hsec_array->type == (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY), false, "unexpected type(not 'section') in insert_next_section");
+	++hsec_array->count;
+	hinserted_childsection = push_frame(0);
+	return true;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline bool portable_storage_writer::store_to_binary(binarybuffer &target)
+{
+	TRY_ENTRY();
+	CHECK_AND_ASSERT_MES(!m_frames.empty(), false, "portable_storage_writer: already stored");
+	while(!m_frames.empty())
+		close_top();
+	CHECK_AND_ASSERT_MES(!m_failed, false, "portable_storage_writer: some entries failed to store");
+	target = std::move(m_buffer);
+	return true;
+	CATCH_ENTRY("portable_storage_writer::store_to_binary", false);
+}
+
+/************************************************************************/
+/* Pull parser for the portable_storage binary format. It checks the    */
+/* whole blob on load, the way portable_storage does, but only keeps an */
+/* index of where each entry of a section starts; values are decoded    */
+/* from the buffer when a KV_SERIALIZE map asks for them. The buffer    */
+/* must outlive the reader.                                             */
+/************************************************************************/
+class portable_storage_reader
+{
+	struct entry
+	{
+		const char *name;
+		uint8_t name_len;
+		uint8_t type;
+		const uint8_t *value;
+	};
+	struct section_index
+	{
+		size_t first;
+		size_t count;
+		size_t next; //where the next lookup starts, maps read entries in the order they were written
+	};
+	struct array_cursor
+	{
+		uint8_t type;
+		size_t remaining;
+		const uint8_t *pos;
+	};
+
+  public:
+	typedef section_index *hsection;
+	typedef array_cursor *harray;
+	typedef storage_entry meta_entry;
+
+	portable_storage_reader() : m_end(nullptr), m_root(nullptr) {}
+
+	bool load_from_binary(const binarybuffer &source);
+
+	hsection open_section(const char *section_name, hsection hparent_section, bool create_if_notexist = false);
+	template <class t_value>
+	bool get_value(const char *value_name, t_value &val, hsection hparent_section);
+	bool get_value(const char *value_name, storage_entry &val, hsection hparent_section);
+
+	template <class t_value>
+	harray get_first_value(const char *value_name, t_value &target, hsection hparent_section);
+	template <class t_value>
+	bool get_next_value(harray hval_array, t_value &target);
+	harray get_first_section(const char *section_name, hsection &h_child_section, hsection hparent_section);
+	bool get_next_section(harray hsec_array, hsection &h_child_section);
+
+  private:
+	const entry *find_entry(const char *name, hsection hparent_section);
+	section_index *index_section(const uint8_t *&p, size_t depth);
+	size_t read_varint(const uint8_t *&p) const;
+	void skip_value(uint8_t type, const uint8_t *&p, size_t depth) const;
+	void skip_array(uint8_t type, const uint8_t *&p, size_t depth) const;
+	void skip_section(const uint8_t *&p, size_t depth) const;
+	template <class t_value>
+	void read_value(uint8_t type, const uint8_t *&p, t_value &val) const;
+
+	template <class t_pod, class t_value>
+	static void read_pod(const uint8_t *&p, t_value &val)
+	{
+		t_pod v;
+		memcpy(&v, p, sizeof(v));
+		p += sizeof(v);
+		convert_t(v, val);
+	}
+	static void assign_string(const uint8_t *p, size_t len, std::string &val) { val.assign((const char *)p, len); }
+	template <class t_value>
+	static void assign_string(const uint8_t *p, size_t len, t_value &val) { convert_t(std::string((const char *)p, len), val); }
+	static size_t pod_size(uint8_t type);
+
+	const uint8_t *m_end;
+	std::vector<entry> m_entries;
+	std::deque<section_index> m_sections;
+	std::deque<array_cursor> m_arrays;
+	section_index *m_root;
+};
+
+inline size_t portable_storage_reader::pod_size(uint8_t type)
+{
+	switch(type)
+	{
+	case SERIALIZE_TYPE_INT64:
+	case SERIALIZE_TYPE_UINT64:
+	case SERIALIZE_TYPE_DUOBLE:
+		return 8;
+	case SERIALIZE_TYPE_INT32:
+	case SERIALIZE_TYPE_UINT32:
+		return 4;
+	case SERIALIZE_TYPE_INT16:
+	case SERIALIZE_TYPE_UINT16:
+		return 2;
+	case SERIALIZE_TYPE_INT8:
+	case SERIALIZE_TYPE_UINT8:
+	case SERIALIZE_TYPE_BOOL:
+		return 1;
+	default:
+		return 0;
+	}
+}
+//---------------------------------------------------------------------------------------------------------------
+inline bool portable_storage_reader::load_from_binary(const binarybuffer &source)
+{
+	static const size_t header_size = 2 * sizeof(uint32_t) + sizeof(uint8_t);
+	m_entries.clear();
+	m_sections.clear();
+	m_arrays.clear();
+	m_root = nullptr;
+	if(source.size() < header_size)
+	{
+		LOG_ERROR("portable_storage: wrong binary format, packet size = " << source.size() << " less than expected header size " << header_size);
+		return false;
+	}
+	uint32_t signature_a, signature_b;
+	memcpy(&signature_a, source.data(), sizeof(signature_a));
+	memcpy(&signature_b, source.data() + sizeof(signature_a), sizeof(signature_b));
+	if(signature_a != PORTABLE_STORAGE_SIGNATUREA || signature_b != PORTABLE_STORAGE_SIGNATUREB)
+	{
+		LOG_ERROR("portable_storage: wrong binary format - signature mismatch");
+		return false;
+	}
+	uint8_t ver = source[header_size - 1];
+	if(ver != PORTABLE_STORAGE_FORMAT_VER)
+	{
+		LOG_ERROR("portable_storage: wrong binary format - unknown format ver = " << (unsigned)ver);
+		return false;
+	}
+	TRY_ENTRY();
+	const uint8_t *p = (const uint8_t *)source.data() + header_size;
+	m_end = (const uint8_t *)source.data() + source.size();
+	m_root = index_section(p, 0);
+	return true;
+	CATCH_ENTRY("portable_storage_reader::load_from_binary", false);
+}
+//---------------------------------------------------------------------------------------------------------------
+inline size_t portable_storage_reader::read_varint(const uint8_t *&p) const
+{
+	CHECK_AND_ASSERT_THROW_MES(p < m_end, "empty buff, expected place for varint");
+	size_t v = 0;
+	switch(*p & PORTABLE_RAW_SIZE_MARK_MASK)
+	{
+	case PORTABLE_RAW_SIZE_MARK_BYTE:
+		v = *p++;
+		break;
+	case PORTABLE_RAW_SIZE_MARK_WORD:
+	{
+		CHECK_AND_ASSERT_THROW_MES(m_end - p >= 2, "varint goes out of remain storage len");
+		uint16_t w;
+		memcpy(&w, p, sizeof(w));
+		p += sizeof(w);
+		v = w;
+		break;
+	}
+	case PORTABLE_RAW_SIZE_MARK_DWORD:
+	{
+		CHECK_AND_ASSERT_THROW_MES(m_end - p >= 4, "varint goes out of remain storage len");
+		uint32_t dw;
+		memcpy(&dw, p, sizeof(dw));
+		p += sizeof(dw);
+		v = dw;
+		break;
+	}
+	default:
+	{
+		CHECK_AND_ASSERT_THROW_MES(m_end - p >= 8, "varint goes out of remain storage len");
+		uint64_t qw;
+		memcpy(&qw, p, sizeof(qw));
+		p += sizeof(qw);
+		v = qw;
+		break;
+	}
+	}
+	return v >> 2;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline void portable_storage_reader::skip_value(uint8_t type, const uint8_t *&p, size_t depth) const
+{
+	if(type & SERIALIZE_FLAG_ARRAY)
+		return skip_array(type & ~SERIALIZE_FLAG_ARRAY, p, depth);
+	size_t size = pod_size(type);
+	if(size)
+	{
+		CHECK_AND_ASSERT_THROW_MES(size_t(m_end - p) >= size, " attempt to read " << size << " bytes from buffer with " << m_end - p << " bytes remained");
+		p += size;
+		return;
+	}
+	switch(type)
+	{
+	case SERIALIZE_TYPE_STRING:
+	{
+		size_t len = read_varint(p);
+		CHECK_AND_ASSERT_THROW_MES(len < MAX_STRING_LEN_POSSIBLE, "to big string len value in storage: " << len);
+		CHECK_AND_ASSERT_THROW_MES(size_t(m_end - p) >= len, "string len count value " << len << " goes out of remain storage len " << m_end - p);
+		p += len;
+		return;
+	}
+	case SERIALIZE_TYPE_OBJECT:
+		return skip_section(p, depth + 1);
+	case SERIALIZE_TYPE_ARRAY:
+	{
+		CHECK_AND_ASSERT_THROW_MES(p < m_end, "empty buff, expected array type");
+		uint8_t ent_type = *p++;
+		CHECK_AND_ASSERT_THROW_MES(ent_type & SERIALIZE_FLAG_ARRAY, "wrong type sequenses");
+		return skip_array(ent_type & ~SERIALIZE_FLAG_ARRAY, p, depth + 1);
+	}
+	default:
+		ASSERT_MES_AND_THROW("unknown entry_type code = " << (unsigned)type);
+	}
+}
+//---------------------------------------------------------------------------------------------------------------
+inline void portable_storage_reader::skip_array(uint8_t type, const uint8_t *&p, size_t depth) const
+{
+	size_t count = read_varint(p);
+	size_t size = pod_size(type);
+	if(size)
+	{
+		CHECK_AND_ASSERT_THROW_MES(count <= size_t(m_end - p) / size, "array of " << count << " entries goes out of remain storage len " << m_end - p);
+		p += count * size;
+		return;
+	}
+	CHECK_AND_ASSERT_THROW_MES(type == SERIALIZE_TYPE_STRING || type == SERIALIZE_TYPE_OBJECT, (type == SERIALIZE_TYPE_ARRAY ? "Reading array entry is not supported" : "unknown entry_type code"));
+	while(count--)
+		skip_value(type, p, depth);
+}
+//---------------------------------------------------------------------------------------------------------------
+inline void portable_storage_reader::skip_section(const uint8_t *&p, size_t depth) const
+{
+	CHECK_AND_ASSERT_THROW_MES(depth < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+	size_t count = read_varint(p);
+	while(count--)
+	{
+		CHECK_AND_ASSERT_THROW_MES(p < m_end, "empty buff, expected entry name");
+		size_t name_len = *p++;
+		CHECK_AND_ASSERT_THROW_MES(size_t(m_end - p) > name_len, "entry name goes out of remain storage len");
+		p += name_len;
+		uint8_t type = *p++;
+		skip_value(type, p, depth);
+	}
+}
+//---------------------------------------------------------------------------------------------------------------
+inline portable_storage_reader::section_index *portable_storage_reader::index_section(const uint8_t *&p, size_t depth)
+{
+	CHECK_AND_ASSERT_THROW_MES(depth < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+	size_t count = read_varint(p);
+	m_sections.push_back({m_entries.size(), 0, 0});
+	section_index *sec = &m_sections.back();
+	while(count--)
+	{
+		CHECK_AND_ASSERT_THROW_MES(p < m_end, "empty buff, expected entry name");
+		entry e;
+		e.name_len = *p++;
+		CHECK_AND_ASSERT_THROW_MES(size_t(m_end - p) > e.name_len, "entry name goes out of remain storage len");
+		e.name = (const char *)p;
+		p += e.name_len;
+		e.type = *p++;
+		e.value = p;
+		skip_value(e.type, p, depth);
+		m_entries.push_back(e);
+	}
+	sec->count = m_entries.size() - sec->first;
+	return sec;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline const portable_storage_reader::entry *portable_storage_reader::find_entry(const char *name, hsection hparent_section)
+{
+	section_index *sec = hparent_section ? hparent_section : m_root;
+	CHECK_AND_ASSERT(sec, nullptr);
+	size_t len = strlen(name);
+	for(size_t i = 0; i < sec->count; ++i)
+	{
+		size_t n = (sec->next + i) % sec->count;
+		const entry &e = m_entries[sec->first + n];
+		if(e.name_len == len && !memcmp(e.name, name, len))
+		{
+			sec->next = (n + 1) % sec->count;
+			return &e;
+		}
+	}
+	return nullptr;
+}
+//---------------------------------------------------------------------------------------------------------------
+template <class t_value>
+void portable_storage_reader::read_value(uint8_t type, const uint8_t *&p, t_value &val) const
+{
+	switch(type)
+	{
+	case SERIALIZE_TYPE_INT64:
+		return read_pod<int64_t>(p, val);
+	case SERIALIZE_TYPE_INT32:
+		return read_pod<int32_t>(p, val);
+	case SERIALIZE_TYPE_INT16:
+		return read_pod<int16_t>(p, val);
+	case SERIALIZE_TYPE_INT8:
+		return read_pod<int8_t>(p, val);
+	case SERIALIZE_TYPE_UINT64:
+		return read_pod<uint64_t>(p, val);
+	case SERIALIZE_TYPE_UINT32:
+		return read_pod<uint32_t>(p, val);
+	case SERIALIZE_TYPE_UINT16:
+		return read_pod<uint16_t>(p, val);
+	case SERIALIZE_TYPE_UINT8:
+		return read_pod<uint8_t>(p, val);
+	case SERIALIZE_TYPE_DUOBLE:
+		return read_pod<double>(p, val);
+	case SERIALIZE_TYPE_BOOL:
+		return read_pod<bool>(p, val);
+	case SERIALIZE_TYPE_STRING:
+	{
+		//bounds were checked when the enclosing section was indexed
+		size_t len = read_varint(p);
+		assign_string(p, len, val);
+		p += len;
+		return;
+	}
+	default:
+		ASSERT_MES_AND_THROW("WRONG DATA CONVERSION: from type code=" << (unsigned)type << " to type " << typeid(t_value).name());
+	}
+}
+//---------------------------------------------------------------------------------------------------------------
+inline portable_storage_reader::hsection portable_storage_reader::open_section(const char *section_name, hsection hparent_section, bool create_if_notexist)
+{
+	const entry *e = find_entry(section_name, hparent_section);
+	if(!e || e->type != SERIALIZE_TYPE_OBJECT)
+		return nullptr;
+	const uint8_t *p = e->value;
+	return index_section(p, 0);
+}
+//---------------------------------------------------------------------------------------------------------------
+template <class t_value>
+bool portable_storage_reader::get_value(const char *value_name, t_value &val, hsection hparent_section)
+{
+	BOOST_MPL_ASSERT((boost::mpl::contains<storage_entry::types, t_value>));
+	const entry *e = find_entry(value_name, hparent_section);
+	if(!e)
+		return false;
+	const uint8_t *p = e->value;
+	read_value(e->type, p, val);
+	return true;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline bool portable_storage_reader::get_value(const char *value_name, storage_entry &val, hsection hparent_section)
+{
+	const entry *e = find_entry(value_name, hparent_section);
+	if(!e)
+		return false;
+	//the type byte sits right before the value
+	const uint8_t *p = e->value - 1;
+	throwable_buffer_reader buf_reader(p, m_end - p);
+	val = buf_reader.load_storage_entry();
+	return true;
+}
+//---------------------------------------------------------------------------------------------------------------
+template <class t_value>
+portable_storage_reader::harray portable_storage_reader::get_first_value(const char *value_name, t_value &target, hsection hparent_section)
+{
+	BOOST_MPL_ASSERT((boost::mpl::contains<storage_entry::types, t_value>));
+	const entry *e = find_entry(value_name, hparent_section);
+	if(!e || !(e->type & SERIALIZE_FLAG_ARRAY))
+		return nullptr;
+	const uint8_t *p = e->value;
+	size_t count = read_varint(p);
+	m_arrays.push_back({uint8_t(e->type & ~SERIALIZE_FLAG_ARRAY), count, p});
+	harray arr = &m_arrays.back();
+	if(!get_next_value(arr, target))
+		return nullptr;
+	return arr;
+}
+//---------------------------------------------------------------------------------------------------------------
+template <class t_value>
+bool portable_storage_reader::get_next_value(harray hval_array, t_value &target)
+{
+	BOOST_MPL_ASSERT((boost::mpl::contains<storage_entry::types, t_value>));
+	CHECK_AND_ASSERT(hval_array, false);
+	if(!hval_array->remaining)
+		return false;
+	read_value(hval_array->type, hval_array->pos, target);
+	--hval_array->remaining;
+	return true;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline portable_storage_reader::harray portable_storage_reader::get_first_section(const char *section_name, hsection &h_child_section, hsection hparent_section)
+{
+	const entry *e = find_entry(section_name, hparent_section);
+	if(!e || e->type != (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY))
+		return nullptr;
+	const uint8_t *p = e->value;
+	size_t count = read_varint(p);
+	m_arrays.push_back({SERIALIZE_TYPE_OBJECT, count, p});
+	harray arr = &m_arrays.back();
+	if(!get_next_section(arr, h_child_section))
+		return nullptr;
+	return arr;
+}
+//---------------------------------------------------------------------------------------------------------------
+inline bool portable_storage_reader::get_next_section(harray hsec_array, hsection &h_child_section)
+{
+	CHECK_AND_ASSERT(hsec_array, false);
+	if(hsec_array->type != SERIALIZE_TYPE_OBJECT || !hsec_array->remaining)
+		return false;
+	h_child_section = index_section(hsec_array->pos, 0);
+	--hsec_array->remaining;
+	return true;
+}
+}
+}
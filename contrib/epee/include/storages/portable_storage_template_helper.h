@@ -31,6 +31,7 @@
 #include "file_io_utils.h"
 #include "parserse_base_utils.h"
 #include "portable_storage.h"
+#include "portable_storage_stream.h"
 
 namespace epee
 {
@@ -86,7 +87,7 @@ bool store_t_to_json_file(t_struct &str_in, const std::string &fpath)
 template <class t_struct>
 bool load_t_from_binary(t_struct &out, const std::string &binary_buff)
 {
-	portable_storage ps;
+	portable_storage_reader ps;
 	bool rs = ps.load_from_binary(binary_buff);
 	if(!rs)
 		return false;
@@ -107,7 +108,7 @@ bool load_t_from_binary_file(t_struct &out, const std::string &binary_file)
 template <class t_struct>
 bool store_t_to_binary(t_struct &str_in, std::string &binary_buff, size_t indent = 0)
 {
-	portable_storage ps;
+	portable_storage_writer ps;
 	str_in.store(ps);
 	return ps.store_to_binary(binary_buff);
 }
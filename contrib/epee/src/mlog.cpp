@@ -32,6 +32,15 @@
 #include <atomic>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <fstream>
+#include <memory>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 #include <time.h>
 
 #undef RYO_DEFAULT_LOG_CATEGORY
@@ -41,6 +50,10 @@
 
 #define MLOG_LOG(x) CINFO(el::base::Writer, el::base::DispatchAction::FileOnlyLog, RYO_DEFAULT_LOG_CATEGORY) << x
 
+// log file lines queued for the writer thread before the less severe ones get dropped
+#define MLOG_ASYNC_MAX_QUEUED_BYTES (16 * 1024 * 1024)
+#define MLOG_ASYNC_ERROR_WAIT_MS 2000
+
 using namespace epee;
 
 static std::string generate_log_filename(const char *base)
@@ -64,6 +77,395 @@ static std::string generate_log_filename(const char *base)
 	return filename;
 }
 
+namespace
+{
+// bumped whenever the categories change, invalidates the per thread caches of mlog_enabled
+std::atomic<unsigned> categories_generation(1);
+
+int level_rank(el::Level level)
+{
+	switch(level)
+	{
+	case el::Level::Fatal:
+		return 1;
+	case el::Level::Error:
+		return 2;
+	case el::Level::Warning:
+		return 3;
+	case el::Level::Info:
+		return 4;
+	case el::Level::Debug:
+		return 5;
+	default:
+		return 6;
+	}
+}
+
+/**
+ * Writes the log file from its own thread.
+ *
+ * Callers format the line and push it on a lock free MPSC list, the writer thread takes whole
+ * batches off it and flushes once per batch. Once more than MLOG_ASYNC_MAX_QUEUED_BYTES are
+ * waiting, info and more verbose lines are dropped and counted, warnings and errors are
+ * always queued, and errors wait until they are on disk, or write themselves if the writer
+ * does not get to them in MLOG_ASYNC_ERROR_WAIT_MS.
+ *
+ * The writer starts with the first line. A forked child (eg. ryod --detach) has no writer
+ * thread, it drops the lines it inherited queued and starts its own writer.
+ */
+class async_file_sink
+{
+  public:
+	// never destroyed, lines may still come in during static destruction
+	static async_file_sink &instance()
+	{
+		static async_file_sink *s = new async_file_sink();
+		return *s;
+	}
+
+	void open(const std::string &filename, size_t max_file_size)
+	{
+		boost::lock_guard<boost::mutex> lock(m_file_lock);
+		m_filename = filename;
+		m_max_file_size = max_file_size;
+		m_file.close();
+		m_file.clear();
+		if(!m_filename.empty())
+		{
+			boost::system::error_code ec;
+			m_file.open(m_filename, std::ios::out | std::ios::app);
+			m_file_size = m_file.is_open() ? boost::filesystem::file_size(m_filename, ec) : 0;
+			if(ec)
+				m_file_size = 0;
+		}
+		m_has_file.store(m_file.is_open(), std::memory_order_relaxed);
+	}
+
+	bool has_file() const { return m_has_file.load(std::memory_order_relaxed); }
+
+	void push(std::string &&line, el::Level level)
+	{
+		const size_t bytes = line.size();
+		const bool severe = level_rank(level) <= level_rank(el::Level::Warning);
+		if(!m_running.load(std::memory_order_acquire) && !start())
+		{
+			// the writer has stopped at exit
+			boost::lock_guard<boost::mutex> lock(m_file_lock);
+			write_line(line);
+			m_file.flush();
+			return;
+		}
+		if(m_queued_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes > MLOG_ASYNC_MAX_QUEUED_BYTES && !severe)
+		{
+			m_queued_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		const bool wait = level_rank(level) <= level_rank(el::Level::Error);
+		std::shared_ptr<wait_state> state = wait ? std::make_shared<wait_state>() : nullptr;
+		node *n = new node(wait ? std::string(line) : std::move(line), state);
+		node *prev = m_head.exchange(n, std::memory_order_acq_rel);
+		prev->next.store(n, std::memory_order_release);
+
+		if(m_sleeping.load())
+		{
+			boost::lock_guard<boost::mutex> lock(m_wake_lock);
+			m_wake.notify_one();
+		}
+		if(wait)
+		{
+			const boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(MLOG_ASYNC_ERROR_WAIT_MS);
+			{
+				boost::unique_lock<boost::mutex> lock(m_written_lock);
+				while(!state->written.load(std::memory_order_acquire) && boost::chrono::steady_clock::now() < deadline)
+					m_written.wait_for(lock, boost::chrono::milliseconds(100));
+			}
+			if(!state->written.load(std::memory_order_acquire))
+			{
+				// the writer is stuck or gone, the line is written here and the writer skips it
+				boost::lock_guard<boost::mutex> lock(m_file_lock);
+				if(!state->written.load(std::memory_order_acquire))
+				{
+					state->taken_over = true;
+					write_line(line);
+					m_file.flush();
+				}
+			}
+		}
+	}
+
+	void stop()
+	{
+		if(!m_running.load(std::memory_order_acquire))
+			return;
+		m_stopping.store(true, std::memory_order_release);
+		{
+			boost::lock_guard<boost::mutex> lock(m_wake_lock);
+			m_wake.notify_one();
+		}
+		m_thread->join();
+
+		// whatever was pushed while the writer was exiting
+		boost::lock_guard<boost::mutex> lock(m_file_lock);
+		std::vector<std::shared_ptr<wait_state>> written;
+		for(node *n = pop(); n != nullptr; n = pop())
+			write_node(n, written);
+		m_file.flush();
+		mark_written(written);
+		m_stopped = true;
+		m_running.store(false, std::memory_order_release);
+		boost::lock_guard<boost::mutex> wlock(m_written_lock);
+		m_written.notify_all();
+	}
+
+  private:
+	// for lines a caller waits on, both flags are set under m_file_lock
+	struct wait_state
+	{
+		wait_state() : written(false), taken_over(false) {}
+		std::atomic<bool> written; // on disk
+		bool taken_over;		   // the caller gave up waiting and wrote it itself
+	};
+
+	struct node
+	{
+		node(std::string &&line, const std::shared_ptr<wait_state> &state) : next(nullptr), line(std::move(line)), state(state) {}
+		std::atomic<node *> next;
+		std::string line;
+		std::shared_ptr<wait_state> state;
+	};
+
+	async_file_sink() : m_head(new node(std::string(), nullptr)), m_queued_bytes(0), m_dropped(0), m_running(false), m_stopping(false),
+						m_sleeping(false), m_has_file(false), m_stopped(false), m_atexit(false), m_max_file_size(0), m_file_size(0)
+	{
+		m_tail = m_head.load(std::memory_order_relaxed);
+#ifndef _WIN32
+		pthread_atfork([] { instance().before_fork(); }, [] { instance().after_fork(false); }, [] { instance().after_fork(true); });
+#endif
+	}
+
+	// starts the writer unless it stopped at exit
+	bool start()
+	{
+		boost::lock_guard<boost::mutex> lock(m_file_lock);
+		if(m_stopped)
+			return false;
+		if(!m_running.load(std::memory_order_acquire))
+		{
+			m_thread.reset(new boost::thread(&async_file_sink::run, this));
+			m_running.store(true, std::memory_order_release);
+			if(!m_atexit)
+			{
+				m_atexit = true;
+				std::atexit([] { async_file_sink::instance().stop(); });
+			}
+		}
+		return true;
+	}
+
+	// no lock may be held by another thread when the process forks, the child would never see it released
+	void before_fork()
+	{
+		m_file_lock.lock();
+		m_wake_lock.lock();
+		m_written_lock.lock();
+	}
+
+	void after_fork(bool child)
+	{
+		if(child)
+		{
+			// the writer thread does not exist in the child, and lines that were being
+			// pushed when it forked may have left the list half linked, so start over
+			m_thread.release();
+			node *n = new node(std::string(), nullptr);
+			m_head.store(n, std::memory_order_relaxed);
+			m_tail = n;
+			m_queued_bytes.store(0, std::memory_order_relaxed);
+			m_dropped.store(0, std::memory_order_relaxed);
+			m_stopping.store(false, std::memory_order_relaxed);
+			m_sleeping.store(false, std::memory_order_relaxed);
+			m_running.store(false, std::memory_order_release);
+		}
+		m_written_lock.unlock();
+		m_wake_lock.unlock();
+		m_file_lock.unlock();
+	}
+
+	// consumer side of the list, the writer thread only
+	node *pop()
+	{
+		node *next = m_tail->next.load(std::memory_order_acquire);
+		if(next == nullptr)
+			return nullptr;
+		delete m_tail;
+		m_tail = next;
+		return next;
+	}
+
+	void write_line(const std::string &line)
+	{
+		if(!m_file.is_open())
+			return;
+		if(m_max_file_size && m_file_size + line.size() > m_max_file_size)
+		{
+			m_file.close();
+			std::string rname = generate_log_filename(m_filename.c_str());
+			rename(m_filename.c_str(), rname.c_str());
+			m_file.clear();
+			m_file.open(m_filename, std::ios::out | std::ios::trunc);
+			m_file_size = 0;
+		}
+		m_file.write(line.data(), line.size());
+		m_file_size += line.size();
+	}
+
+	// with m_file_lock held, lines a caller waits on go to written, to be marked once flushed
+	void write_node(node *n, std::vector<std::shared_ptr<wait_state>> &written)
+	{
+		if(n->state && n->state->taken_over)
+			return;
+		write_line(n->line);
+		if(n->state)
+			written.push_back(std::move(n->state));
+	}
+
+	static void mark_written(std::vector<std::shared_ptr<wait_state>> &written)
+	{
+		for(const std::shared_ptr<wait_state> &s : written)
+			s->written.store(true, std::memory_order_release);
+		written.clear();
+	}
+
+	void run()
+	{
+		std::vector<std::shared_ptr<wait_state>> written;
+		while(true)
+		{
+			size_t bytes = 0;
+			bool waiting = false;
+			{
+				boost::lock_guard<boost::mutex> lock(m_file_lock);
+				for(node *n = pop(); n != nullptr; n = pop())
+				{
+					bytes += n->line.size();
+					write_node(n, written);
+					std::string().swap(n->line);
+				}
+				if(bytes)
+					m_file.flush();
+				waiting = !written.empty();
+				mark_written(written);
+			}
+			if(bytes)
+				m_queued_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+			if(waiting)
+			{
+				boost::lock_guard<boost::mutex> lock(m_written_lock);
+				m_written.notify_all();
+			}
+			const uint64_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+			if(dropped)
+				MCLOG(el::Level::Warning, RYO_DEFAULT_LOG_CATEGORY, dropped << " log lines dropped, the log file writer fell behind");
+
+			if(bytes || dropped)
+				continue;
+			if(m_stopping.load(std::memory_order_acquire))
+				break;
+
+			boost::unique_lock<boost::mutex> lock(m_wake_lock);
+			m_sleeping.store(true);
+			if(m_tail->next.load() == nullptr && !m_stopping.load(std::memory_order_acquire))
+				m_wake.wait_for(lock, boost::chrono::milliseconds(100));
+			m_sleeping.store(false);
+		}
+	}
+
+	std::atomic<node *> m_head; // producers push here
+	node *m_tail;				// the writer pops here
+	std::atomic<size_t> m_queued_bytes;
+	std::atomic<uint64_t> m_dropped;
+	std::atomic<bool> m_running;
+	std::atomic<bool> m_stopping;
+	std::atomic<bool> m_sleeping;
+	std::atomic<bool> m_has_file;
+	bool m_stopped;
+	bool m_atexit;
+
+	std::unique_ptr<boost::thread> m_thread;
+	boost::mutex m_wake_lock;
+	boost::condition_variable m_wake;
+	boost::mutex m_written_lock;
+	boost::condition_variable m_written;
+
+	boost::mutex m_file_lock;
+	std::ofstream m_file;
+	std::string m_filename;
+	size_t m_max_file_size;
+	size_t m_file_size;
+};
+
+// replaces easylogging's default callback: console output stays synchronous, file output goes through the sink
+class async_log_dispatch_callback : public el::LogDispatchCallback
+{
+  protected:
+	void handle(const el::LogDispatchData *data) override
+	{
+		const el::LogMessage *msg = data->logMessage();
+		if(data->dispatchAction() != el::base::DispatchAction::NormalLog && data->dispatchAction() != el::base::DispatchAction::FileOnlyLog)
+			return;
+		async_file_sink &sink = async_file_sink::instance();
+		const bool console = data->dispatchAction() == el::base::DispatchAction::NormalLog && msg->logger()->typedConfigurations()->toStandardOutput(msg->level());
+		if(!console && !sink.has_file())
+			return;
+		std::string line = msg->logger()->logBuilder()->build(msg, true);
+		if(console)
+		{
+			std::string console_line = line;
+			if(ELPP->hasFlag(el::LoggingFlag::ColoredTerminalOutput))
+				msg->logger()->logBuilder()->convertToColoredOutput(&console_line, msg->level());
+			ELPP_COUT << ELPP_COUT_LINE(console_line);
+		}
+		if(sink.has_file())
+			sink.push(std::move(line), msg->level());
+	}
+};
+}
+
+bool mlog_enabled(el::Level level, const char *category)
+{
+	// before mlog_configure, and for verbose levels, easylogging decides
+	if(category == nullptr || level == el::Level::Verbose || !ELPP->hasFlag(el::LoggingFlag::HierarchicalLogging))
+		return true;
+
+	struct entry
+	{
+		unsigned generation = 0;
+		std::string category;
+		int max_rank = 0;
+	};
+	static thread_local entry cache[64];
+
+	uint32_t h = 2166136261u;
+	for(const char *c = category; *c; ++c)
+		h = (h ^ (unsigned char)*c) * 16777619u;
+	entry &e = cache[h % 64];
+	const unsigned generation = categories_generation.load(std::memory_order_acquire);
+	if(e.generation != generation || e.category != category)
+	{
+		e.max_rank = 0;
+		for(el::Level l : {el::Level::Fatal, el::Level::Error, el::Level::Warning, el::Level::Info, el::Level::Debug, el::Level::Trace})
+		{
+			if(ELPP->vRegistry()->allowed(l, category))
+				e.max_rank = level_rank(l);
+		}
+		e.category = category;
+		e.generation = generation;
+	}
+	return level_rank(level) <= e.max_rank;
+}
+
 std::string mlog_get_default_log_path(const char *default_filename)
 {
 	std::string process_name = epee::string_tools::get_current_module_name();
@@ -117,9 +519,13 @@ static const char *get_default_categories(int level)
 
 void mlog_configure(const std::string &filename_base, bool console, const std::size_t max_log_file_size)
 {
+	// RYO_LOG_SYNC=1 writes the log file on the logging thread, through easylogging
+	const char *log_sync = getenv("RYO_LOG_SYNC");
+	const bool async = !log_sync || !strcmp(log_sync, "0");
+
 	el::Configurations c;
 	c.setGlobally(el::ConfigurationType::Filename, filename_base);
-	c.setGlobally(el::ConfigurationType::ToFile, "true");
+	c.setGlobally(el::ConfigurationType::ToFile, async ? "false" : "true");
 	const char *log_format = getenv("RYO_LOG_FORMAT");
 	if(!log_format)
 		log_format = MLOG_BASE_FORMAT;
@@ -132,11 +538,24 @@ void mlog_configure(const std::string &filename_base, bool console, const std::s
 	el::Loggers::addFlag(el::LoggingFlag::CreateLoggerAutomatically);
 	el::Loggers::addFlag(el::LoggingFlag::DisableApplicationAbortOnFatalLog);
 	el::Loggers::addFlag(el::LoggingFlag::ColoredTerminalOutput);
-	el::Loggers::addFlag(el::LoggingFlag::StrictLogFileSizeCheck);
-	el::Helpers::installPreRollOutCallback([filename_base](const char *name, size_t) {
-		std::string rname = generate_log_filename(filename_base.c_str());
-		rename(name, rname.c_str());
-	});
+	if(async)
+	{
+		async_file_sink::instance().open(filename_base, max_log_file_size);
+		el::Helpers::installLogDispatchCallback<async_log_dispatch_callback>("AsyncFileLogDispatchCallback");
+		el::Helpers::uninstallLogDispatchCallback<el::base::DefaultLogDispatchCallback>("DefaultLogDispatchCallback");
+	}
+	else
+	{
+		if(async_file_sink::instance().has_file())
+			async_file_sink::instance().open(std::string(), 0);
+		el::Helpers::installLogDispatchCallback<el::base::DefaultLogDispatchCallback>("DefaultLogDispatchCallback");
+		el::Helpers::uninstallLogDispatchCallback<async_log_dispatch_callback>("AsyncFileLogDispatchCallback");
+		el::Loggers::addFlag(el::LoggingFlag::StrictLogFileSizeCheck);
+		el::Helpers::installPreRollOutCallback([filename_base](const char *name, size_t) {
+			std::string rname = generate_log_filename(filename_base.c_str());
+			rename(name, rname.c_str());
+		});
+	}
 	mlog_set_common_prefix();
 	const char *monero_log = getenv("RYO_LOGS");
 	if(!monero_log)
@@ -181,6 +600,7 @@ void mlog_set_categories(const char *categories)
 		}
 	}
 	el::Loggers::setCategories(new_categories.c_str(), true);
+	categories_generation.fetch_add(1, std::memory_order_acq_rel);
 	MLOG_LOG("New log categories: " << el::Loggers::getCategories());
 }
 
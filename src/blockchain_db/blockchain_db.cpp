@@ -77,6 +77,8 @@ const command_line::arg_descriptor<std::string> arg_db_sync_mode = {
 	"db-sync-mode", "Specify sync option, using format [safe|fast|fastest]:[sync|async]:[nblocks_per_sync].", "fast:async:1000"};
 const command_line::arg_descriptor<bool> arg_db_salvage = {
 	"db-salvage", "Try to salvage a blockchain database if it seems corrupted", false};
+const command_line::arg_descriptor<uint64_t> arg_db_mapsize = {
+	"db-mapsize", "Space to reserve for the database map in MB, 0 to reserve a multiple of the current database size", 0};
 
 BlockchainDB *new_db(const std::string &db_type)
 {
@@ -94,6 +96,7 @@ void BlockchainDB::init_options(boost::program_options::options_description &des
 	command_line::add_arg(desc, arg_db_type);
 	command_line::add_arg(desc, arg_db_sync_mode);
 	command_line::add_arg(desc, arg_db_salvage);
+	command_line::add_arg(desc, arg_db_mapsize);
 }
 
 void BlockchainDB::pop_block()
@@ -97,6 +97,7 @@ typedef std::pair<crypto::hash, uint64_t> tx_out_index;
 extern const command_line::arg_descriptor<std::string> arg_db_type;
 extern const command_line::arg_descriptor<std::string> arg_db_sync_mode;
 extern const command_line::arg_descriptor<bool, false> arg_db_salvage;
+extern const command_line::arg_descriptor<uint64_t> arg_db_mapsize;
 
 #pragma pack(push, 1)
 
@@ -571,6 +572,16 @@ class BlockchainDB
    */
 	virtual void open(const std::string &filename, const int db_flags = 0) = 0;
 
+	/**
+   * @brief sets how much space the BlockchainDB reserves when opened
+   *
+   * Only meaningful for backends which map their storage, such as LMDB.
+   * Must be called before open().
+   *
+   * @param map_size the size to reserve in bytes, or 0 to derive it from the current db size
+   */
+	virtual void set_map_size(uint64_t map_size) {}
+
 	/**
    * @brief Gets the current open/ready state of the BlockchainDB
    *
@@ -644,6 +655,41 @@ class BlockchainDB
    */
 	virtual std::string get_db_name() const = 0;
 
+	/**
+   * @brief copies the BlockchainDB's files to another folder
+   *
+   * The copy is a consistent view of the BlockchainDB as of the call, and
+   * can be opened as a BlockchainDB of the same type. Used to make snapshots.
+   *
+   * If any of this cannot be done, the subclass should throw the corresponding
+   * subclass of DB_EXCEPTION
+   *
+   * @param folder an existing, empty folder to copy to
+   * @param compact whether to leave out free space from the copy
+   */
+	virtual void copy(const std::string &folder, bool compact) const
+	{
+		throw DB_ERROR("Copying is not supported by this database type");
+	}
+
+	/**
+   * @brief computes a commitment to the chain state held in the BlockchainDB
+   *
+   * The commitment is a hash over the blocks, transactions, outputs, spent
+   * key images and hard fork versions up to the current height, in key order.
+   * The txpool and db properties are left out, so two databases which hold
+   * the same chain have the same commitment however they were built.
+   *
+   * If any of this cannot be done, the subclass should throw the corresponding
+   * subclass of DB_EXCEPTION
+   *
+   * @return the commitment
+   */
+	virtual crypto::hash get_state_commitment() const
+	{
+		throw DB_ERROR("State commitments are not supported by this database type");
+	}
+
 	// FIXME: these are just for functionality mocking, need to implement
 	// RAII-friendly and multi-read one-write friendly locking mechanism
 	//
@@ -0,0 +1,200 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+// Copyright (c) 2018, Ryo Currency Project
+// Portions copyright (c) 2014-2018, The Monero Project
+//
+// Portions of this file are available under BSD-3 license. Please see ORIGINAL-LICENSE for details
+// All rights reserved.
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "blockchain_snapshot.h"
+#include "blockchain_db.h"
+#include "string_tools.h"
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+//#undef RYO_DEFAULT_LOG_CATEGORY
+//#define RYO_DEFAULT_LOG_CATEGORY "blockchain.db"
+
+namespace cryptonote
+{
+namespace
+{
+// one entry per published snapshot, at a checkpoint height
+const struct
+{
+	network_type nettype;
+	uint64_t height;
+	const char *commitment;
+} trusted_snapshot_commitments[] = {
+	{MAINNET, 0, nullptr}};
+
+bool copy_stream(std::istream &in, std::ostream &out, uint64_t size)
+{
+	std::vector<char> buffer(4 * 1024 * 1024);
+	while(size > 0)
+	{
+		const size_t bytes = std::min<uint64_t>(size, buffer.size());
+		if(!in.read(buffer.data(), bytes) || !out.write(buffer.data(), bytes))
+			return false;
+		size -= bytes;
+	}
+	return true;
+}
+}
+
+bool write_blockchain_snapshot(const std::string &path, blockchain_snapshot_header &header, const std::string &db_folder)
+{
+	const boost::filesystem::path data_path = boost::filesystem::path(db_folder) / BLOCKCHAIN_SNAPSHOT_DATA_FILENAME;
+	boost::system::error_code ec;
+	const uint64_t data_size = boost::filesystem::file_size(data_path, ec);
+	if(ec)
+	{
+		MERROR("Failed to get size of " << data_path.string() << ": " << ec.message());
+		return false;
+	}
+
+	header.magic = BLOCKCHAIN_SNAPSHOT_MAGIC;
+	header.version = BLOCKCHAIN_SNAPSHOT_VERSION;
+	header.data_size = data_size;
+
+	// write to a temporary file, so an interrupted write never leaves a
+	// file which looks like a snapshot
+	const std::string tmp_path = path + ".tmp";
+	{
+		std::ifstream in(data_path.string(), std::ios::binary);
+		std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+		if(!in || !out)
+		{
+			MERROR("Failed to open " << (!in ? data_path.string() : tmp_path));
+			return false;
+		}
+		out.write((const char *)&header, sizeof(header));
+		if(!copy_stream(in, out, data_size) || !out.flush())
+		{
+			MERROR("Failed to write snapshot to " << tmp_path);
+			return false;
+		}
+	}
+	boost::filesystem::rename(tmp_path, path, ec);
+	if(ec)
+	{
+		MERROR("Failed to rename " << tmp_path << " to " << path << ": " << ec.message());
+		return false;
+	}
+	return true;
+}
+
+bool read_blockchain_snapshot_header(const std::string &path, blockchain_snapshot_header &header)
+{
+	std::ifstream in(path, std::ios::binary);
+	if(!in || !in.read((char *)&header, sizeof(header)))
+	{
+		MERROR("Failed to read snapshot header from " << path);
+		return false;
+	}
+	if(header.magic != BLOCKCHAIN_SNAPSHOT_MAGIC)
+	{
+		MERROR(path << " is not a blockchain snapshot");
+		return false;
+	}
+	if(header.version != BLOCKCHAIN_SNAPSHOT_VERSION)
+	{
+		MERROR("Unsupported blockchain snapshot version " << header.version);
+		return false;
+	}
+	header.db_name[sizeof(header.db_name) - 1] = 0;
+
+	boost::system::error_code ec;
+	const uint64_t file_size = boost::filesystem::file_size(path, ec);
+	if(ec || file_size != sizeof(header) + header.data_size)
+	{
+		MERROR("Blockchain snapshot " << path << " is truncated or has trailing data");
+		return false;
+	}
+	return true;
+}
+
+bool extract_blockchain_snapshot(const std::string &path, const std::string &db_folder, blockchain_snapshot_header &header)
+{
+	if(!read_blockchain_snapshot_header(path, header))
+		return false;
+
+	const boost::filesystem::path data_path = boost::filesystem::path(db_folder) / BLOCKCHAIN_SNAPSHOT_DATA_FILENAME;
+	boost::system::error_code ec;
+	if(boost::filesystem::exists(data_path, ec))
+	{
+		MERROR("Not extracting snapshot, " << data_path.string() << " already exists");
+		return false;
+	}
+	boost::filesystem::create_directories(db_folder, ec);
+
+	const std::string tmp_path = data_path.string() + ".tmp";
+	{
+		std::ifstream in(path, std::ios::binary);
+		std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+		if(!in || !out || !in.seekg(sizeof(header)))
+		{
+			MERROR("Failed to open " << (!out ? tmp_path : path));
+			return false;
+		}
+		if(!copy_stream(in, out, header.data_size) || !out.flush())
+		{
+			MERROR("Failed to extract snapshot to " << tmp_path);
+			out.close();
+			boost::filesystem::remove(tmp_path, ec);
+			return false;
+		}
+	}
+	boost::filesystem::rename(tmp_path, data_path, ec);
+	if(ec)
+	{
+		MERROR("Failed to rename " << tmp_path << " to " << data_path.string() << ": " << ec.message());
+		return false;
+	}
+	return true;
+}
+
+bool get_trusted_snapshot_commitment(network_type nettype, uint64_t height, crypto::hash &commitment)
+{
+	for(size_t n = 0; trusted_snapshot_commitments[n].commitment; ++n)
+	{
+		if(trusted_snapshot_commitments[n].nettype == nettype && trusted_snapshot_commitments[n].height == height)
+			return epee::string_tools::hex_to_pod(trusted_snapshot_commitments[n].commitment, commitment);
+	}
+	return false;
+}
+
+bool check_blockchain_snapshot(const BlockchainDB &db, const blockchain_snapshot_header &header)
+{
+	const uint64_t height = db.height();
+	if(height != header.height + 1)
+	{
+		MERROR("Snapshot database has " << height << " blocks, expected " << header.height + 1);
+		return false;
+	}
+	const crypto::hash top_hash = db.get_block_hash_from_height(header.height);
+	if(top_hash != header.top_hash)
+	{
+		MERROR("Snapshot database top block is " << top_hash << ", expected " << header.top_hash);
+		return false;
+	}
+	const crypto::hash commitment = db.get_state_commitment();
+	if(commitment != header.commitment)
+	{
+		MERROR("Snapshot database state commitment is " << commitment << ", expected " << header.commitment);
+		return false;
+	}
+	return true;
+}
+}
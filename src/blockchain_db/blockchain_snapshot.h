@@ -0,0 +1,99 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+// Copyright (c) 2018, Ryo Currency Project
+// Portions copyright (c) 2014-2018, The Monero Project
+//
+// Portions of this file are available under BSD-3 license. Please see ORIGINAL-LICENSE for details
+// All rights reserved.
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "crypto/hash.h"
+#include "cryptonote_config.h"
+#include <string>
+
+#define BLOCKCHAIN_SNAPSHOT_MAGIC 0x3173706e736f7972 // "ryosnps1"
+#define BLOCKCHAIN_SNAPSHOT_VERSION 1
+#define BLOCKCHAIN_SNAPSHOT_FILENAME "blockchain.snapshot"
+// snapshots carry a compacted LMDB environment, which is a single file
+#define BLOCKCHAIN_SNAPSHOT_DATA_FILENAME "data.mdb"
+
+namespace cryptonote
+{
+class BlockchainDB;
+
+/**
+ * A blockchain snapshot is this header, followed by data_size bytes of
+ * database file holding the chain up to and including block height.
+ */
+#pragma pack(push, 1)
+struct blockchain_snapshot_header
+{
+	uint64_t magic;
+	uint32_t version;
+	uint8_t nettype;
+	char db_name[15];		 // BlockchainDB::get_db_name() of the database in the snapshot
+	uint64_t height;		 // height of the top block
+	crypto::hash top_hash;	 // hash of the top block, a checkpoint
+	crypto::hash commitment; // BlockchainDB::get_state_commitment() of the database
+	uint64_t data_size;
+};
+#pragma pack(pop)
+
+/**
+ * @brief writes a snapshot of a database folder
+ *
+ * @param path the snapshot file to write
+ * @param header the snapshot header, data_size is filled in
+ * @param db_folder a folder holding a copy of the database, which must not be in use
+ *
+ * @return true on success
+ */
+bool write_blockchain_snapshot(const std::string &path, blockchain_snapshot_header &header, const std::string &db_folder);
+
+/**
+ * @brief reads and checks the header of a snapshot
+ *
+ * @return true if the file looks like a complete snapshot
+ */
+bool read_blockchain_snapshot_header(const std::string &path, blockchain_snapshot_header &header);
+
+/**
+ * @brief writes the database in a snapshot to a database folder
+ *
+ * The folder must not hold a database yet.
+ *
+ * @return true on success
+ */
+bool extract_blockchain_snapshot(const std::string &path, const std::string &db_folder, blockchain_snapshot_header &header);
+
+/**
+ * @brief the state commitment of a published snapshot, compiled in
+ *
+ * A snapshot's own header cannot vouch for its tables, so a snapshot is only
+ * loaded against a commitment from here or from the command line.
+ *
+ * @return true if there is a commitment for this network and height
+ */
+bool get_trusted_snapshot_commitment(network_type nettype, uint64_t height, crypto::hash &commitment);
+
+/**
+ * @brief checks that a database opened from a snapshot matches its header
+ *
+ * This recomputes the state commitment, so reads the whole database.
+ *
+ * @return true if the height, top block hash and state commitment match
+ */
+bool check_blockchain_snapshot(const BlockchainDB &db, const blockchain_snapshot_header &header);
+}
@@ -21,10 +21,13 @@
 #include <boost/current_function.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <chrono>
 #include <cstring> // memcpy
 #include <memory>  // std::unique_ptr
 #include <random>
 
+#include "common/metrics.h"
+#include "common/trace.h"
 #include "common/util.h"
 #include "crypto/crypto.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
@@ -203,10 +206,74 @@ const std::string lmdb_error(const std::string &error_string, int mdb_res)
 	return full_string;
 }
 
+// per table latency of the LMDB calls, the table is found from the dbi the call goes to
+constexpr size_t MAX_TIMED_TABLES = 32;
+struct table_metrics
+{
+	std::atomic<const tools::metrics::histogram *> read;
+	std::atomic<const tools::metrics::histogram *> write;
+};
+table_metrics g_table_metrics[MAX_TIMED_TABLES];
+
+inline void observe_table(MDB_dbi dbi, bool write, std::chrono::steady_clock::time_point start)
+{
+	if(dbi >= MAX_TIMED_TABLES)
+		return;
+	const tools::metrics::histogram *h = (write ? g_table_metrics[dbi].write : g_table_metrics[dbi].read).load(std::memory_order_relaxed);
+	if(h)
+		h->observe(std::chrono::steady_clock::now() - start);
+}
+
+inline int timed_get(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const int r = mdb_get(txn, dbi, key, data);
+	observe_table(dbi, false, start);
+	return r;
+}
+
+inline int timed_put(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data, unsigned int flags)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const int r = mdb_put(txn, dbi, key, data, flags);
+	observe_table(dbi, true, start);
+	return r;
+}
+
+inline int timed_cursor_get(MDB_cursor *cursor, MDB_val *key, MDB_val *data, MDB_cursor_op op)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const int r = mdb_cursor_get(cursor, key, data, op);
+	observe_table(mdb_cursor_dbi(cursor), false, start);
+	return r;
+}
+
+inline int timed_cursor_put(MDB_cursor *cursor, MDB_val *key, MDB_val *data, unsigned int flags)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const int r = mdb_cursor_put(cursor, key, data, flags);
+	observe_table(mdb_cursor_dbi(cursor), true, start);
+	return r;
+}
+
+inline int timed_cursor_del(MDB_cursor *cursor, unsigned int flags)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const int r = mdb_cursor_del(cursor, flags);
+	observe_table(mdb_cursor_dbi(cursor), true, start);
+	return r;
+}
+
 inline void lmdb_db_open(MDB_txn *txn, const char *name, int flags, MDB_dbi &dbi, const std::string &error_string)
 {
 	if(auto res = mdb_dbi_open(txn, name, flags, &dbi))
 		throw0(cryptonote::DB_OPEN_FAILURE((lmdb_error(error_string + " : ", res) + std::string(" - you may want to start with --db-salvage")).c_str()));
+	if(dbi < MAX_TIMED_TABLES)
+	{
+		const std::string label = std::string("table=\"") + name + "\"";
+		g_table_metrics[dbi].read = &tools::metrics::get_histogram("ombre_db_read_seconds", label, "Latency of LMDB reads, by table");
+		g_table_metrics[dbi].write = &tools::metrics::get_histogram("ombre_db_write_seconds", label, "Latency of LMDB writes and deletes, by table");
+	}
 }
 
 } // anonymous namespace
@@ -351,11 +418,15 @@ void mdb_txn_safe::commit(std::string message)
 		message = "Failed to commit a transaction to the db";
 	}
 
+	static const tools::metrics::histogram &metric_commit = tools::metrics::get_histogram("ombre_db_commit_seconds", "", "Latency of LMDB transaction commits");
+	TRACE_SCOPE(db_commit);
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 	if(auto result = mdb_txn_commit(m_txn))
 	{
 		m_txn = nullptr;
 		throw0(DB_ERROR(lmdb_error(message + ": ", result).c_str()));
 	}
+	metric_commit.observe(std::chrono::steady_clock::now() - start);
 	m_txn = nullptr;
 }
 
@@ -397,6 +468,7 @@ void mdb_txn_safe::allow_new_txns()
 
 void lmdb_resized(MDB_env *env)
 {
+	const auto stall_start = std::chrono::steady_clock::now();
 	mdb_txn_safe::prevent_new_txns();
 
 	MGINFO("LMDB map resize detected.");
@@ -415,11 +487,12 @@ void lmdb_resized(MDB_env *env)
 	mdb_env_info(env, &mei);
 	uint64_t new_mapsize = mei.me_mapsize;
 
+	mdb_txn_safe::allow_new_txns();
+
 	MGINFO("LMDB Mapsize increased."
 		   << "  Old: " << old / (1024 * 1024) << "MiB"
-		   << ", New: " << new_mapsize / (1024 * 1024) << "MiB");
-
-	mdb_txn_safe::allow_new_txns();
+		   << ", New: " << new_mapsize / (1024 * 1024) << "MiB"
+		   << ", txns stalled for " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - stall_start).count() << " ms");
 }
 
 inline int lmdb_txn_begin(MDB_env *env, MDB_txn *parent, unsigned int flags, MDB_txn **txn)
@@ -475,17 +548,23 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 
 	mdb_env_stat(m_env, &mst);
 
-	// add 1Gb per resize, instead of doing a percentage increase
+#if defined(__arm__)
+	// add 1Gb per resize, 32-bit address space is too small for geometric growth
 	uint64_t new_mapsize = (double)mei.me_mapsize + add_size;
+#else
+	// Grow geometrically so that resizes, which stall every txn, stay rare. The map
+	// is sparse, so the unused part costs address space but not disk space.
+	uint64_t new_mapsize = (double)mei.me_mapsize * MAPSIZE_GROWTH_FACTOR;
+#endif
 
-	// If given, use increase_size instead of above way of resizing.
-	// This is currently used for increasing by an estimated size at start of new
-	// batch txn.
+	// If given, grow by at least increase_size. This is currently used for increasing
+	// by an estimated size at start of new batch txn.
 	if(increase_size > 0)
-		new_mapsize = mei.me_mapsize + increase_size;
+		new_mapsize = std::max<uint64_t>(new_mapsize, mei.me_mapsize + increase_size);
 
 	new_mapsize += (new_mapsize % mst.ms_psize);
 
+	const auto stall_start = std::chrono::steady_clock::now();
 	mdb_txn_safe::prevent_new_txns();
 
 	if(m_write_txn != nullptr)
@@ -503,14 +582,55 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 	mdb_txn_safe::wait_no_active_txns();
 
 	int result = mdb_env_set_mapsize(m_env, new_mapsize);
+	mdb_txn_safe::allow_new_txns();
 	if(result)
 		throw0(DB_ERROR(lmdb_error("Failed to set new mapsize: ", result).c_str()));
+	m_resize_pending = false;
 
 	MGINFO("LMDB Mapsize increased."
 		   << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB"
-		   << ", New: " << new_mapsize / (1024 * 1024) << "MiB");
+		   << ", New: " << new_mapsize / (1024 * 1024) << "MiB"
+		   << ", txns stalled for " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - stall_start).count() << " ms");
+}
 
-	mdb_txn_safe::allow_new_txns();
+void BlockchainLMDB::set_map_size(uint64_t map_size)
+{
+	m_map_size_request = map_size;
+}
+
+void BlockchainLMDB::resize_monitor()
+{
+	const unsigned check_interval = RESIZE_CHECK_INTERVAL;
+	boost::unique_lock<boost::mutex> lock(m_resize_mutex);
+	while(!m_resize_stop)
+	{
+		m_resize_cv.wait_for(lock, boost::chrono::seconds(check_interval));
+		if(m_resize_stop)
+			break;
+		if(m_resize_pending)
+			continue;
+		MDB_envinfo mei;
+		MDB_stat mst;
+		mdb_env_info(m_env, &mei);
+		mdb_env_stat(m_env, &mst);
+		if((double)mst.ms_psize * mei.me_last_pgno / mei.me_mapsize > MAPSIZE_WATERMARK)
+		{
+			MDEBUG("LMDB map usage above watermark, growing it before the next write");
+			m_resize_pending = true;
+		}
+	}
+}
+
+void BlockchainLMDB::stop_resize_monitor()
+{
+	if(!m_resize_thread.joinable())
+		return;
+	{
+		boost::unique_lock<boost::mutex> lock(m_resize_mutex);
+		m_resize_stop = true;
+	}
+	m_resize_cv.notify_all();
+	m_resize_thread.join();
 }
 
 // threshold_size is used for batch transactions
@@ -536,8 +656,7 @@ bool BlockchainLMDB::need_resize(uint64_t threshold_size) const
 	LOG_PRINT_L1("Space used:      " << size_used);
 	LOG_PRINT_L1("Space remaining: " << mei.me_mapsize - size_used);
 	LOG_PRINT_L1("Size threshold:  " << threshold_size);
-	float resize_percent_old = RESIZE_PERCENT;
-	LOG_PRINT_L1(boost::format("Percent used: %.04f  Percent threshold: %.04f") % ((double)size_used / mei.me_mapsize) % resize_percent_old);
+	LOG_PRINT_L1(boost::format("Percent used: %.04f  Percent threshold: %.04f") % ((double)size_used / mei.me_mapsize) % double(MAPSIZE_WATERMARK));
 
 	if(threshold_size > 0)
 	{
@@ -550,11 +669,7 @@ bool BlockchainLMDB::need_resize(uint64_t threshold_size) const
 			return false;
 	}
 
-	std::mt19937 engine(std::random_device{}());
-	std::uniform_real_distribution<double> fdis(0.6, 0.9);
-	double resize_percent = fdis(engine);
-
-	if((double)size_used / mei.me_mapsize > resize_percent)
+	if((double)size_used / mei.me_mapsize > MAPSIZE_WATERMARK)
 	{
 		LOG_PRINT_L1("Threshold met (percent-based)");
 		return true;
@@ -591,7 +706,7 @@ void BlockchainLMDB::check_and_resize_for_batch(uint64_t batch_num_blocks, uint6
 	// if threshold_size is 0 (i.e. number of blocks for batch not passed in), it
 	// will fall back to the percent-based threshold check instead of the
 	// size-based check
-	if(need_resize(threshold_size))
+	if(m_resize_pending || need_resize(threshold_size))
 	{
 		MGINFO("[batch] DB resize needed");
 		do_resize(increase_size);
@@ -682,13 +797,13 @@ void BlockchainLMDB::add_block(const block &blk, const size_t &block_size, const
 	CURSOR(block_heights)
 	blk_height bh = {blk_hash, m_height};
 	MDB_val_set(val_h, bh);
-	if(mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH) == 0)
+	if(timed_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH) == 0)
 		throw1(BLOCK_EXISTS("Attempting to add block that's already in the db"));
 
 	if(m_height > 0)
 	{
 		MDB_val_set(parent_key, blk.prev_id);
-		int result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &parent_key, MDB_GET_BOTH);
+		int result = timed_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &parent_key, MDB_GET_BOTH);
 		if(result)
 		{
 			LOG_PRINT_L3("m_height: " << m_height);
@@ -709,7 +824,7 @@ void BlockchainLMDB::add_block(const block &blk, const size_t &block_size, const
 
 	// this call to mdb_cursor_put will change height()
 	MDB_val_copy<blobdata> blob(block_to_blob(blk));
-	result = mdb_cursor_put(m_cur_blocks, &key, &blob, MDB_APPEND);
+	result = timed_cursor_put(m_cur_blocks, &key, &blob, MDB_APPEND);
 	if(result)
 		throw0(DB_ERROR(lmdb_error("Failed to add block blob to db transaction: ", result).c_str()));
 
@@ -722,11 +837,11 @@ void BlockchainLMDB::add_block(const block &blk, const size_t &block_size, const
 	bi.bi_hash = blk_hash;
 
 	MDB_val_set(val, bi);
-	result = mdb_cursor_put(m_cur_block_info, (MDB_val *)&zerokval, &val, MDB_APPENDDUP);
+	result = timed_cursor_put(m_cur_block_info, (MDB_val *)&zerokval, &val, MDB_APPENDDUP);
 	if(result)
 		throw0(DB_ERROR(lmdb_error("Failed to add block info to db transaction: ", result).c_str()));
 
-	result = mdb_cursor_put(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, 0);
+	result = timed_cursor_put(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, 0);
 	if(result)
 		throw0(DB_ERROR(lmdb_error("Failed to add block height by hash to db transaction: ", result).c_str()));
 
@@ -751,7 +866,7 @@ void BlockchainLMDB::remove_block()
 	CURSOR(blocks)
 	MDB_val_copy<uint64_t> k(m_height - 1);
 	MDB_val h = k;
-	if((result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
+	if((result = timed_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
 		throw1(BLOCK_DNE(lmdb_error("Attempting to remove block that's not in the db: ", result).c_str()));
 
 	// must use h now; deleting from m_block_info will invalidate it
@@ -759,17 +874,17 @@ void BlockchainLMDB::remove_block()
 	blk_height bh = {bi->bi_hash, 0};
 	h.mv_data = (void *)&bh;
 	h.mv_size = sizeof(bh);
-	if((result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
+	if((result = timed_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
 		throw1(DB_ERROR(lmdb_error("Failed to locate block height by hash for removal: ", result).c_str()));
-	if((result = mdb_cursor_del(m_cur_block_heights, 0)))
+	if((result = timed_cursor_del(m_cur_block_heights, 0)))
 		throw1(DB_ERROR(lmdb_error("Failed to add removal of block height by hash to db transaction: ", result).c_str()));
 
-	if((result = mdb_cursor_get(m_cur_blocks, &k, NULL, MDB_SET)))
+	if((result = timed_cursor_get(m_cur_blocks, &k, NULL, MDB_SET)))
 		throw1(DB_ERROR(lmdb_error("Failed to locate block for removal: ", result).c_str()));
-	if((result = mdb_cursor_del(m_cur_blocks, 0)))
+	if((result = timed_cursor_del(m_cur_blocks, 0)))
 		throw1(DB_ERROR(lmdb_error("Failed to add removal of block to db transaction: ", result).c_str()));
 
-	if((result = mdb_cursor_del(m_cur_block_info, 0)))
+	if((result = timed_cursor_del(m_cur_block_info, 0)))
 		throw1(DB_ERROR(lmdb_error("Failed to add removal of block info to db transaction: ", result).c_str()));
 }
 
@@ -788,7 +903,7 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash &blk_hash, cons
 
 	MDB_val_set(val_tx_id, tx_id);
 	MDB_val_set(val_h, tx_hash);
-	result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH);
+	result = timed_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH);
 	if(result == 0)
 	{
 		txindex *tip = (txindex *)val_h.mv_data;
@@ -808,12 +923,12 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash &blk_hash, cons
 	val_h.mv_size = sizeof(ti);
 	val_h.mv_data = (void *)&ti;
 
-	result = mdb_cursor_put(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, 0);
+	result = timed_cursor_put(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, 0);
 	if(result)
 		throw0(DB_ERROR(lmdb_error("Failed to add tx data to db transaction: ", result).c_str()));
 
 	MDB_val_copy<blobdata> blob(tx_to_blob(tx));
-	result = mdb_cursor_put(m_cur_txs, &val_tx_id, &blob, MDB_APPEND);
+	result = timed_cursor_put(m_cur_txs, &val_tx_id, &blob, MDB_APPEND);
 	if(result)
 		throw0(DB_ERROR(lmdb_error("Failed to add tx blob to db transaction: ", result).c_str()));
 
@@ -836,33 +951,33 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash &tx_hash, const
 
 	MDB_val_set(val_h, tx_hash);
 
-	if(mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH))
+	if(timed_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH))
 		throw1(TX_DNE("Attempting to remove transaction that isn't in the db"));
 	txindex *tip = (txindex *)val_h.mv_data;
 	MDB_val_set(val_tx_id, tip->data.tx_id);
 
-	if((result = mdb_cursor_get(m_cur_txs, &val_tx_id, NULL, MDB_SET)))
+	if((result = timed_cursor_get(m_cur_txs, &val_tx_id, NULL, MDB_SET)))
 		throw1(DB_ERROR(lmdb_error("Failed to locate tx for removal: ", result).c_str()));
-	result = mdb_cursor_del(m_cur_txs, 0);
+	result = timed_cursor_del(m_cur_txs, 0);
 	if(result)
 		throw1(DB_ERROR(lmdb_error("Failed to add removal of tx to db transaction: ", result).c_str()));
 
 	remove_tx_outputs(tip->data.tx_id, tx);
 
-	result = mdb_cursor_get(m_cur_tx_outputs, &val_tx_id, NULL, MDB_SET);
+	result = timed_cursor_get(m_cur_tx_outputs, &val_tx_id, NULL, MDB_SET);
 	if(result == MDB_NOTFOUND)
 		LOG_PRINT_L1("tx has no outputs to remove: " << tx_hash);
 	else if(result)
 		throw1(DB_ERROR(lmdb_error("Failed to locate tx outputs for removal: ", result).c_str()));
 	if(!result)
 	{
-		result = mdb_cursor_del(m_cur_tx_outputs, 0);
+		result = timed_cursor_del(m_cur_tx_outputs, 0);
 		if(result)
 			throw1(DB_ERROR(lmdb_error("Failed to add removal of tx outputs to db transaction: ", result).c_str()));
 	}
 
 	// Don't delete the tx_indices entry until the end, after we're done with val_tx_id
-	if(mdb_cursor_del(m_cur_tx_indices, 0))
+	if(timed_cursor_del(m_cur_tx_indices, 0))
 		throw1(DB_ERROR("Failed to add removal of tx index to db transaction"));
 }
 
@@ -893,14 +1008,14 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash &tx_hash,
 	outtx ot = {m_num_outputs, tx_hash, local_index};
 	MDB_val_set(vot, ot);
 
-	result = mdb_cursor_put(m_cur_output_txs, (MDB_val *)&zerokval, &vot, MDB_APPENDDUP);
+	result = timed_cursor_put(m_cur_output_txs, (MDB_val *)&zerokval, &vot, MDB_APPENDDUP);
 	if(result)
 		throw0(DB_ERROR(lmdb_error("Failed to add output tx hash to db transaction: ", result).c_str()));
 
 	outkey ok;
 	MDB_val data;
 	MDB_val_copy<uint64_t> val_amount(tx_output.amount);
-	result = mdb_cursor_get(m_cur_output_amounts, &val_amount, &data, MDB_SET);
+	result = timed_cursor_get(m_cur_output_amounts, &val_amount, &data, MDB_SET);
 	if(!result)
 	{
 		mdb_size_t num_elems = 0;
@@ -922,7 +1037,7 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash &tx_hash,
 	data.mv_size = sizeof(ok);
 	data.mv_data = &ok;
 
-	if((result = mdb_cursor_put(m_cur_output_amounts, &val_amount, &data, MDB_APPENDDUP)))
+	if((result = timed_cursor_put(m_cur_output_amounts, &val_amount, &data, MDB_APPENDDUP)))
 		throw0(DB_ERROR(lmdb_error("Failed to add output pubkey to db transaction: ", result).c_str()));
 
 	return ok.amount_index;
@@ -945,7 +1060,7 @@ void BlockchainLMDB::add_tx_amount_output_indices(const uint64_t tx_id, const st
 	v.mv_size = sizeof(uint64_t) * num_outputs;
 	// LOG_PRINT_L1("tx_outputs[tx_hash] size: " << v.mv_size);
 
-	result = mdb_cursor_put(m_cur_tx_outputs, &k_tx_id, &v, MDB_APPEND);
+	result = timed_cursor_put(m_cur_tx_outputs, &k_tx_id, &v, MDB_APPEND);
 	if(result)
 		throw0(DB_ERROR(std::string("Failed to add <tx hash, amount output index array> to db transaction: ").append(mdb_strerror(result)).c_str()));
 }
@@ -983,7 +1098,7 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t &out_in
 	MDB_val_set(k, amount);
 	MDB_val_set(v, out_index);
 
-	auto result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+	auto result = timed_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
 	if(result == MDB_NOTFOUND)
 		throw1(OUTPUT_DNE("Attempting to get an output index by amount and amount index, but amount not found"));
 	else if(result)
@@ -991,7 +1106,7 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t &out_in
 
 	const pre_rct_outkey *ok = (const pre_rct_outkey *)v.mv_data;
 	MDB_val_set(otxk, ok->output_id);
-	result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &otxk, MDB_GET_BOTH);
+	result = timed_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &otxk, MDB_GET_BOTH);
 	if(result == MDB_NOTFOUND)
 	{
 		throw0(DB_ERROR("Unexpected: global output index not found in m_output_txs"));
@@ -1000,12 +1115,12 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t &out_in
 	{
 		throw1(DB_ERROR(lmdb_error("Error adding removal of output tx to db transaction", result).c_str()));
 	}
-	result = mdb_cursor_del(m_cur_output_txs, 0);
+	result = timed_cursor_del(m_cur_output_txs, 0);
 	if(result)
 		throw0(DB_ERROR(lmdb_error(std::string("Error deleting output index ").append(boost::lexical_cast<std::string>(out_index).append(": ")).c_str(), result).c_str()));
 
 	// now delete the amount
-	result = mdb_cursor_del(m_cur_output_amounts, 0);
+	result = timed_cursor_del(m_cur_output_amounts, 0);
 	if(result)
 		throw0(DB_ERROR(lmdb_error(std::string("Error deleting amount for output index ").append(boost::lexical_cast<std::string>(out_index).append(": ")).c_str(), result).c_str()));
 }
@@ -1019,7 +1134,7 @@ void BlockchainLMDB::add_spent_key(const crypto::key_image &k_image)
 	CURSOR(spent_keys)
 
 	MDB_val k = {sizeof(k_image), (void *)&k_image};
-	if(auto result = mdb_cursor_put(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_NODUPDATA))
+	if(auto result = timed_cursor_put(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_NODUPDATA))
 	{
 		if(result == MDB_KEYEXIST)
 			throw1(KEY_IMAGE_EXISTS("Attempting to add spent key image that's already in the db"));
@@ -1037,12 +1152,12 @@ void BlockchainLMDB::remove_spent_key(const crypto::key_image &k_image)
 	CURSOR(spent_keys)
 
 	MDB_val k = {sizeof(k_image), (void *)&k_image};
-	auto result = mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH);
+	auto result = timed_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH);
 	if(result != 0 && result != MDB_NOTFOUND)
 		throw1(DB_ERROR(lmdb_error("Error finding spent key to remove", result).c_str()));
 	if(!result)
 	{
-		result = mdb_cursor_del(m_cur_spent_keys, 0);
+		result = timed_cursor_del(m_cur_spent_keys, 0);
 		if(result)
 			throw1(DB_ERROR(lmdb_error("Error adding removal of key image to db transaction", result).c_str()));
 	}
@@ -1087,6 +1202,7 @@ BlockchainLMDB::~BlockchainLMDB()
 		batch_abort();
 	if(m_open)
 		close();
+	stop_resize_monitor();
 }
 
 BlockchainLMDB::BlockchainLMDB(bool batch_transactions) : BlockchainDB()
@@ -1103,6 +1219,10 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions) : BlockchainDB()
 	m_cum_size = 0;
 	m_cum_count = 0;
 
+	m_map_size_request = 0;
+	m_resize_pending = false;
+	m_resize_stop = false;
+
 	m_hardfork = nullptr;
 }
 
@@ -1175,6 +1295,15 @@ void BlockchainLMDB::open(const std::string &filename, const int db_flags)
 	mdb_env_info(m_env, &mei);
 	uint64_t cur_mapsize = (double)mei.me_mapsize;
 
+	// Reserve a large map up front, so that growing it (which stalls every txn)
+	// is rare. Only pages in use take disk space.
+	MDB_stat mst;
+	mdb_env_stat(m_env, &mst);
+	const uint64_t size_used = mst.ms_psize * mei.me_last_pgno;
+	mapsize = std::max<uint64_t>(mapsize, m_map_size_request ? m_map_size_request : size_used * MAPSIZE_RESERVE_FACTOR);
+	if(mapsize % mst.ms_psize)
+		mapsize += mst.ms_psize - mapsize % mst.ms_psize;
+
 	if(cur_mapsize < mapsize)
 	{
 		if(auto result = mdb_env_set_mapsize(m_env, mapsize))
@@ -1189,6 +1318,13 @@ void BlockchainLMDB::open(const std::string &filename, const int db_flags)
 		LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
 		do_resize();
 	}
+#if defined(ENABLE_AUTO_RESIZE)
+	if(!(mdb_flags & MDB_RDONLY))
+	{
+		m_resize_stop = false;
+		m_resize_thread = boost::thread(&BlockchainLMDB::resize_monitor, this);
+	}
+#endif
 
 	int txn_flags = 0;
 	if(mdb_flags & MDB_RDONLY)
@@ -1257,7 +1393,7 @@ void BlockchainLMDB::open(const std::string &filename, const int db_flags)
 
 	MDB_val_copy<const char *> k("version");
 	MDB_val v;
-	auto get_result = mdb_get(txn, m_properties, &k, &v);
+	auto get_result = timed_get(txn, m_properties, &k, &v);
 	if(get_result == MDB_SUCCESS)
 	{
 		if(*(const uint32_t *)v.mv_data > VERSION)
@@ -1304,7 +1440,7 @@ void BlockchainLMDB::open(const std::string &filename, const int db_flags)
 		{
 			MDB_val_copy<const char *> k("version");
 			MDB_val_copy<uint32_t> v(VERSION);
-			auto put_result = mdb_put(txn, m_properties, &k, &v, 0);
+			auto put_result = timed_put(txn, m_properties, &k, &v, 0);
 			if(put_result != MDB_SUCCESS)
 			{
 				txn.abort();
@@ -1331,6 +1467,7 @@ void BlockchainLMDB::close()
 		LOG_PRINT_L3("close() first calling batch_abort() due to active batch transaction");
 		batch_abort();
 	}
+	stop_resize_monitor();
 	this->sync();
 	m_tinfo.reset();
 
@@ -1394,7 +1531,7 @@ void BlockchainLMDB::reset()
 	// init with current version
 	MDB_val_copy<const char *> k("version");
 	MDB_val_copy<uint32_t> v(VERSION);
-	if(auto result = mdb_put(txn, m_properties, &k, &v, 0))
+	if(auto result = timed_put(txn, m_properties, &k, &v, 0))
 		throw0(DB_ERROR(lmdb_error("Failed to write version to database: ", result).c_str()));
 
 	txn.commit();
@@ -1510,7 +1647,7 @@ void BlockchainLMDB::add_txpool_tx(const transaction &tx, const txpool_tx_meta_t
 
 	MDB_val k = {sizeof(txid), (void *)&txid};
 	MDB_val v = {sizeof(meta), (void *)&meta};
-	if(auto result = mdb_cursor_put(m_cur_txpool_meta, &k, &v, MDB_NODUPDATA))
+	if(auto result = timed_cursor_put(m_cur_txpool_meta, &k, &v, MDB_NODUPDATA))
 	{
 		if(result == MDB_KEYEXIST)
 			throw1(DB_ERROR("Attempting to add txpool tx metadata that's already in the db"));
@@ -1518,7 +1655,7 @@ void BlockchainLMDB::add_txpool_tx(const transaction &tx, const txpool_tx_meta_t
 			throw1(DB_ERROR(lmdb_error("Error adding txpool tx metadata to db transaction: ", result).c_str()));
 	}
 	MDB_val_copy<cryptonote::blobdata> blob_val(tx_to_blob(tx));
-	if(auto result = mdb_cursor_put(m_cur_txpool_blob, &k, &blob_val, MDB_NODUPDATA))
+	if(auto result = timed_cursor_put(m_cur_txpool_blob, &k, &blob_val, MDB_NODUPDATA))
 	{
 		if(result == MDB_KEYEXIST)
 			throw1(DB_ERROR("Attempting to add txpool tx blob that's already in the db"));
@@ -1538,14 +1675,14 @@ void BlockchainLMDB::update_txpool_tx(const crypto::hash &txid, const txpool_tx_
 
 	MDB_val k = {sizeof(txid), (void *)&txid};
 	MDB_val v;
-	auto result = mdb_cursor_get(m_cur_txpool_meta, &k, &v, MDB_SET);
+	auto result = timed_cursor_get(m_cur_txpool_meta, &k, &v, MDB_SET);
 	if(result != 0)
 		throw1(DB_ERROR(lmdb_error("Error finding txpool tx meta to update: ", result).c_str()));
-	result = mdb_cursor_del(m_cur_txpool_meta, 0);
+	result = timed_cursor_del(m_cur_txpool_meta, 0);
 	if(result)
 		throw1(DB_ERROR(lmdb_error("Error adding removal of txpool tx metadata to db transaction: ", result).c_str()));
 	v = MDB_val({sizeof(meta), (void *)&meta});
-	if((result = mdb_cursor_put(m_cur_txpool_meta, &k, &v, MDB_NODUPDATA)) != 0)
+	if((result = timed_cursor_put(m_cur_txpool_meta, &k, &v, MDB_NODUPDATA)) != 0)
 	{
 		if(result == MDB_KEYEXIST)
 			throw1(DB_ERROR("Attempting to add txpool tx metadata that's already in the db"));
@@ -1583,7 +1720,7 @@ uint64_t BlockchainLMDB::get_txpool_tx_count(bool include_unrelayed_txes) const
 		MDB_cursor_op op = MDB_FIRST;
 		while(1)
 		{
-			result = mdb_cursor_get(m_cur_txpool_meta, &k, &v, op);
+			result = timed_cursor_get(m_cur_txpool_meta, &k, &v, op);
 			op = MDB_NEXT;
 			if(result == MDB_NOTFOUND)
 				break;
@@ -1608,7 +1745,7 @@ bool BlockchainLMDB::txpool_has_tx(const crypto::hash &txid) const
 	RCURSOR(txpool_meta)
 
 	MDB_val k = {sizeof(txid), (void *)&txid};
-	auto result = mdb_cursor_get(m_cur_txpool_meta, &k, NULL, MDB_SET);
+	auto result = timed_cursor_get(m_cur_txpool_meta, &k, NULL, MDB_SET);
 	if(result != 0 && result != MDB_NOTFOUND)
 		throw1(DB_ERROR(lmdb_error("Error finding txpool tx meta: ", result).c_str()));
 	TXN_POSTFIX_RDONLY();
@@ -1625,21 +1762,21 @@ void BlockchainLMDB::remove_txpool_tx(const crypto::hash &txid)
 	CURSOR(txpool_blob)
 
 	MDB_val k = {sizeof(txid), (void *)&txid};
-	auto result = mdb_cursor_get(m_cur_txpool_meta, &k, NULL, MDB_SET);
+	auto result = timed_cursor_get(m_cur_txpool_meta, &k, NULL, MDB_SET);
 	if(result != 0 && result != MDB_NOTFOUND)
 		throw1(DB_ERROR(lmdb_error("Error finding txpool tx meta to remove: ", result).c_str()));
 	if(!result)
 	{
-		result = mdb_cursor_del(m_cur_txpool_meta, 0);
+		result = timed_cursor_del(m_cur_txpool_meta, 0);
 		if(result)
 			throw1(DB_ERROR(lmdb_error("Error adding removal of txpool tx metadata to db transaction: ", result).c_str()));
 	}
-	result = mdb_cursor_get(m_cur_txpool_blob, &k, NULL, MDB_SET);
+	result = timed_cursor_get(m_cur_txpool_blob, &k, NULL, MDB_SET);
 	if(result != 0 && result != MDB_NOTFOUND)
 		throw1(DB_ERROR(lmdb_error("Error finding txpool tx blob to remove: ", result).c_str()));
 	if(!result)
 	{
-		result = mdb_cursor_del(m_cur_txpool_blob, 0);
+		result = timed_cursor_del(m_cur_txpool_blob, 0);
 		if(result)
 			throw1(DB_ERROR(lmdb_error("Error adding removal of txpool tx blob to db transaction: ", result).c_str()));
 	}
@@ -1655,7 +1792,7 @@ bool BlockchainLMDB::get_txpool_tx_meta(const crypto::hash &txid, txpool_tx_meta
 
 	MDB_val k = {sizeof(txid), (void *)&txid};
 	MDB_val v;
-	auto result = mdb_cursor_get(m_cur_txpool_meta, &k, &v, MDB_SET);
+	auto result = timed_cursor_get(m_cur_txpool_meta, &k, &v, MDB_SET);
 	if(result == MDB_NOTFOUND)
 		return false;
 	if(result != 0)
@@ -1676,7 +1813,7 @@ bool BlockchainLMDB::get_txpool_tx_blob(const crypto::hash &txid, cryptonote::bl
 
 	MDB_val k = {sizeof(txid), (void *)&txid};
 	MDB_val v;
-	auto result = mdb_cursor_get(m_cur_txpool_blob, &k, &v, MDB_SET);
+	auto result = timed_cursor_get(m_cur_txpool_blob, &k, &v, MDB_SET);
 	if(result == MDB_NOTFOUND)
 		return false;
 	if(result != 0)
@@ -1711,7 +1848,7 @@ bool BlockchainLMDB::for_all_txpool_txes(std::function<bool(const crypto::hash &
 	MDB_cursor_op op = MDB_FIRST;
 	while(1)
 	{
-		int result = mdb_cursor_get(m_cur_txpool_meta, &k, &v, op);
+		int result = timed_cursor_get(m_cur_txpool_meta, &k, &v, op);
 		op = MDB_NEXT;
 		if(result == MDB_NOTFOUND)
 			break;
@@ -1727,7 +1864,7 @@ bool BlockchainLMDB::for_all_txpool_txes(std::function<bool(const crypto::hash &
 		if(include_blob)
 		{
 			MDB_val b;
-			result = mdb_cursor_get(m_cur_txpool_blob, &k, &b, MDB_SET);
+			result = timed_cursor_get(m_cur_txpool_blob, &k, &b, MDB_SET);
 			if(result == MDB_NOTFOUND)
 				throw0(DB_ERROR("Failed to find txpool tx blob to match metadata"));
 			if(result)
@@ -1758,7 +1895,7 @@ bool BlockchainLMDB::block_exists(const crypto::hash &h, uint64_t *height) const
 
 	bool ret = false;
 	MDB_val_set(key, h);
-	auto get_result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 	{
 		LOG_PRINT_L3("Block with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
@@ -1796,7 +1933,7 @@ uint64_t BlockchainLMDB::get_block_height(const crypto::hash &h) const
 	RCURSOR(block_heights);
 
 	MDB_val_set(key, h);
-	auto get_result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 		throw1(BLOCK_DNE("Attempted to retrieve non-existent block height"));
 	else if(get_result)
@@ -1827,7 +1964,7 @@ cryptonote::blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t &
 
 	MDB_val_copy<uint64_t> key(height);
 	MDB_val result;
-	auto get_result = mdb_cursor_get(m_cur_blocks, &key, &result, MDB_SET);
+	auto get_result = timed_cursor_get(m_cur_blocks, &key, &result, MDB_SET);
 	if(get_result == MDB_NOTFOUND)
 	{
 		throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
@@ -1852,7 +1989,7 @@ uint64_t BlockchainLMDB::get_block_timestamp(const uint64_t &height) const
 	RCURSOR(block_info);
 
 	MDB_val_set(result, height);
-	auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 	{
 		throw0(BLOCK_DNE(std::string("Attempt to get timestamp from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- timestamp not in db").c_str()));
@@ -1890,7 +2027,7 @@ size_t BlockchainLMDB::get_block_size(const uint64_t &height) const
 	RCURSOR(block_info);
 
 	MDB_val_set(result, height);
-	auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 	{
 		throw0(BLOCK_DNE(std::string("Attempt to get block size from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
@@ -1913,7 +2050,7 @@ difficulty_type BlockchainLMDB::get_block_cumulative_difficulty(const uint64_t &
 	RCURSOR(block_info);
 
 	MDB_val_set(result, height);
-	auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 	{
 		throw0(BLOCK_DNE(std::string("Attempt to get cumulative difficulty from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- difficulty not in db").c_str()));
@@ -1953,7 +2090,7 @@ uint64_t BlockchainLMDB::get_block_already_generated_coins(const uint64_t &heigh
 	RCURSOR(block_info);
 
 	MDB_val_set(result, height);
-	auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 	{
 		throw0(BLOCK_DNE(std::string("Attempt to get generated coins from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
@@ -1976,7 +2113,7 @@ crypto::hash BlockchainLMDB::get_block_hash_from_height(const uint64_t &height)
 	RCURSOR(block_info);
 
 	MDB_val_set(result, height);
-	auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 	{
 		throw0(BLOCK_DNE(std::string("Attempt to get hash from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- hash not in db").c_str()));
@@ -2087,14 +2224,14 @@ bool BlockchainLMDB::tx_exists(const crypto::hash &h) const
 	bool tx_found = false;
 
 	TIME_MEASURE_START(time1);
-	auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
 	if(get_result == 0)
 		tx_found = true;
 	else if(get_result != MDB_NOTFOUND)
 		throw0(DB_ERROR(lmdb_error(std::string("DB error attempting to fetch transaction index from hash ") + epee::string_tools::pod_to_hex(h) + ": ", get_result).c_str()));
 
 	// This isn't needed as part of the check. we're not checking consistency of db.
-	// get_result = mdb_cursor_get(m_cur_txs, &val_tx_index, &result, MDB_SET);
+	// get_result = timed_cursor_get(m_cur_txs, &val_tx_index, &result, MDB_SET);
 	TIME_MEASURE_FINISH(time1);
 	time_tx_exists += time1;
 
@@ -2125,7 +2262,7 @@ bool BlockchainLMDB::tx_exists(const crypto::hash &h, uint64_t &tx_id) const
 	MDB_val_set(v, h);
 
 	TIME_MEASURE_START(time1);
-	auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
 	TIME_MEASURE_FINISH(time1);
 	time_tx_exists += time1;
 	if(!get_result)
@@ -2158,7 +2295,7 @@ uint64_t BlockchainLMDB::get_tx_unlock_time(const crypto::hash &h) const
 	RCURSOR(tx_indices);
 
 	MDB_val_set(v, h);
-	auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 		throw1(TX_DNE(lmdb_error(std::string("tx data with hash ") + epee::string_tools::pod_to_hex(h) + " not found in db: ", get_result).c_str()));
 	else if(get_result)
@@ -2181,12 +2318,12 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash &h, cryptonote::blobdata &bd
 
 	MDB_val_set(v, h);
 	MDB_val result;
-	auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
 	if(get_result == 0)
 	{
 		txindex *tip = (txindex *)v.mv_data;
 		MDB_val_set(val_tx_id, tip->data.tx_id);
-		get_result = mdb_cursor_get(m_cur_txs, &val_tx_id, &result, MDB_SET);
+		get_result = timed_cursor_get(m_cur_txs, &val_tx_id, &result, MDB_SET);
 	}
 	if(get_result == MDB_NOTFOUND)
 		return false;
@@ -2240,7 +2377,7 @@ uint64_t BlockchainLMDB::get_tx_block_height(const crypto::hash &h) const
 	RCURSOR(tx_indices);
 
 	MDB_val_set(v, h);
-	auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 	{
 		throw1(TX_DNE(std::string("tx_data_t with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str()));
@@ -2265,7 +2402,7 @@ uint64_t BlockchainLMDB::get_num_outputs(const uint64_t &amount) const
 	MDB_val_copy<uint64_t> k(amount);
 	MDB_val v;
 	mdb_size_t num_elems = 0;
-	auto result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
+	auto result = timed_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
 	if(result == MDB_SUCCESS)
 	{
 		mdb_cursor_count(m_cur_output_amounts, &num_elems);
@@ -2290,7 +2427,7 @@ output_data_t BlockchainLMDB::get_output_key(const uint64_t &global_index) const
 
 	output_data_t od;
 	MDB_val_set(v, global_index);
-	auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 		throw1(OUTPUT_DNE("output with given index not in db"));
 	else if(get_result)
@@ -2299,14 +2436,14 @@ output_data_t BlockchainLMDB::get_output_key(const uint64_t &global_index) const
 	outtx *ot = (outtx *)v.mv_data;
 
 	MDB_val_set(val_h, ot->tx_hash);
-	get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH);
+	get_result = timed_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH);
 	if(get_result)
 		throw0(DB_ERROR(lmdb_error(std::string("DB error attempting to fetch transaction index from hash ") + epee::string_tools::pod_to_hex(ot->tx_hash) + ": ", get_result).c_str()));
 
 	txindex *tip = (txindex *)val_h.mv_data;
 	MDB_val_set(val_tx_id, tip->data.tx_id);
 	MDB_val result;
-	get_result = mdb_cursor_get(m_cur_txs, &val_tx_id, &result, MDB_SET);
+	get_result = timed_cursor_get(m_cur_txs, &val_tx_id, &result, MDB_SET);
 	if(get_result == MDB_NOTFOUND)
 		throw1(TX_DNE(std::string("tx with hash ").append(epee::string_tools::pod_to_hex(ot->tx_hash)).append(" not found in db").c_str()));
 	else if(get_result)
@@ -2338,7 +2475,7 @@ output_data_t BlockchainLMDB::get_output_key(const uint64_t &amount, const uint6
 
 	MDB_val_set(k, amount);
 	MDB_val_set(v, index);
-	auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 		throw1(OUTPUT_DNE("Attempting to get output pubkey by index, but key does not exist"));
 	else if(get_result)
@@ -2371,7 +2508,7 @@ tx_out_index BlockchainLMDB::get_output_tx_and_index_from_global(const uint64_t
 
 	MDB_val_set(v, output_id);
 
-	auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+	auto get_result = timed_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
 	if(get_result == MDB_NOTFOUND)
 		throw1(OUTPUT_DNE("output with given index not in db"));
 	else if(get_result)
@@ -2411,7 +2548,7 @@ std::vector<uint64_t> BlockchainLMDB::get_tx_amount_output_indices(const uint64_
 	MDB_val v;
 	std::vector<uint64_t> amount_output_indices;
 
-	result = mdb_cursor_get(m_cur_tx_outputs, &k_tx_id, &v, MDB_SET);
+	result = timed_cursor_get(m_cur_tx_outputs, &k_tx_id, &v, MDB_SET);
 	if(result == MDB_NOTFOUND)
 		LOG_PRINT_L0("WARNING: Unexpected: tx has no amount indices stored in "
 					 "tx_outputs, but it should have an empty entry even if it's a tx without "
@@ -2445,7 +2582,7 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image &img) const
 	RCURSOR(spent_keys);
 
 	MDB_val k = {sizeof(img), (void *)&img};
-	ret = (mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH) == 0);
+	ret = (timed_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH) == 0);
 
 	TXN_POSTFIX_RDONLY();
 	return ret;
@@ -2466,7 +2603,7 @@ bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_ima
 	MDB_cursor_op op = MDB_FIRST;
 	while(1)
 	{
-		int ret = mdb_cursor_get(m_cur_spent_keys, &k, &v, op);
+		int ret = timed_cursor_get(m_cur_spent_keys, &k, &v, op);
 		op = MDB_NEXT;
 		if(ret == MDB_NOTFOUND)
 			break;
@@ -2485,6 +2622,132 @@ bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_ima
 	return fret;
 }
 
+void BlockchainLMDB::copy(const std::string &folder, bool compact) const
+{
+	LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+	check_open();
+
+	if(auto result = mdb_env_copy2(m_env, folder.c_str(), compact ? MDB_CP_COMPACT : 0))
+		throw0(DB_ERROR(lmdb_error("Failed to copy lmdb environment: ", result).c_str()));
+}
+
+namespace
+{
+// Hashes a table's records in key order. Records are buffered and hashed a
+// chunk at a time, each chunk prefixed with the hash of the previous ones.
+class table_hasher
+{
+  public:
+	table_hasher() : m_count(0), m_hash(crypto::null_hash)
+	{
+		m_buffer.reserve(CHUNK_SIZE + 4096);
+		m_buffer.resize(sizeof(crypto::hash));
+	}
+
+	void add(const MDB_val &k, const MDB_val &v)
+	{
+		append(k);
+		append(v);
+		++m_count;
+		if(m_buffer.size() >= CHUNK_SIZE)
+			flush();
+	}
+
+	uint64_t count() const { return m_count; }
+
+	const crypto::hash &finish()
+	{
+		flush();
+		return m_hash;
+	}
+
+  private:
+	static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+	void append(const MDB_val &val)
+	{
+		const uint32_t size = val.mv_size;
+		const uint8_t *data = (const uint8_t *)val.mv_data;
+		m_buffer.insert(m_buffer.end(), (const uint8_t *)&size, (const uint8_t *)&size + sizeof(size));
+		m_buffer.insert(m_buffer.end(), data, data + size);
+	}
+
+	void flush()
+	{
+		if(m_buffer.size() == sizeof(crypto::hash))
+			return;
+		memcpy(m_buffer.data(), &m_hash, sizeof(crypto::hash));
+		crypto::cn_fast_hash(m_buffer.data(), m_buffer.size(), m_hash);
+		m_buffer.resize(sizeof(crypto::hash));
+	}
+
+	uint64_t m_count;
+	crypto::hash m_hash;
+	std::vector<uint8_t> m_buffer;
+};
+}
+
+crypto::hash BlockchainLMDB::get_state_commitment() const
+{
+	LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+	check_open();
+
+	const uint64_t chain_height = height();
+
+	TXN_PREFIX_RDONLY();
+
+	// the txpool and properties tables are node local, and are left out
+	const std::pair<const char *, MDB_dbi> tables[] = {
+		{LMDB_BLOCKS, m_blocks},
+		{LMDB_BLOCK_HEIGHTS, m_block_heights},
+		{LMDB_BLOCK_INFO, m_block_info},
+		{LMDB_TXS, m_txs},
+		{LMDB_TX_INDICES, m_tx_indices},
+		{LMDB_TX_OUTPUTS, m_tx_outputs},
+		{LMDB_OUTPUT_TXS, m_output_txs},
+		{LMDB_OUTPUT_AMOUNTS, m_output_amounts},
+		{LMDB_SPENT_KEYS, m_spent_keys},
+		{LMDB_HF_VERSIONS, m_hf_versions},
+	};
+
+	std::string commitment_data((const char *)&chain_height, sizeof(chain_height));
+	for(const auto &table : tables)
+	{
+		MDB_cursor *cursor;
+		if(auto result = mdb_cursor_open(m_txn, table.second, &cursor))
+			throw0(DB_ERROR(lmdb_error("Failed to open cursor: ", result).c_str()));
+		std::unique_ptr<MDB_cursor, void (*)(MDB_cursor *)> cursor_guard(cursor, mdb_cursor_close);
+
+		table_hasher hasher;
+		MDB_val k, v;
+		MDB_cursor_op op = MDB_FIRST;
+		while(1)
+		{
+			int ret = timed_cursor_get(cursor, &k, &v, op);
+			op = MDB_NEXT;
+			if(ret == MDB_NOTFOUND)
+				break;
+			if(ret)
+				throw0(DB_ERROR(lmdb_error(std::string("Failed to enumerate ") + table.first + ": ", ret).c_str()));
+			// hard fork versions are not removed when blocks are popped
+			if(table.second == m_hf_versions && *(const uint64_t *)k.mv_data >= chain_height)
+				continue;
+			hasher.add(k, v);
+		}
+
+		const crypto::hash &table_hash = hasher.finish();
+		const uint64_t count = hasher.count();
+		commitment_data.append(table.first);
+		commitment_data.append((const char *)&count, sizeof(count));
+		commitment_data.append((const char *)&table_hash, sizeof(table_hash));
+		MDEBUG("State commitment: " << table.first << ": " << count << " records, " << table_hash);
+	}
+
+	TXN_POSTFIX_RDONLY();
+
+	return crypto::cn_fast_hash(commitment_data.data(), commitment_data.size());
+}
+
 bool BlockchainLMDB::for_blocks_range(const uint64_t &h1, const uint64_t &h2, std::function<bool(uint64_t, const crypto::hash &, const cryptonote::block &)> f) const
 {
 	LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -2509,7 +2772,7 @@ bool BlockchainLMDB::for_blocks_range(const uint64_t &h1, const uint64_t &h2, st
 	}
 	while(1)
 	{
-		int ret = mdb_cursor_get(m_cur_blocks, &k, &v, op);
+		int ret = timed_cursor_get(m_cur_blocks, &k, &v, op);
 		op = MDB_NEXT;
 		if(ret == MDB_NOTFOUND)
 			break;
@@ -2554,7 +2817,7 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash
 	MDB_cursor_op op = MDB_FIRST;
 	while(1)
 	{
-		int ret = mdb_cursor_get(m_cur_tx_indices, &k, &v, op);
+		int ret = timed_cursor_get(m_cur_tx_indices, &k, &v, op);
 		op = MDB_NEXT;
 		if(ret == MDB_NOTFOUND)
 			break;
@@ -2565,7 +2828,7 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash
 		const crypto::hash hash = ti->key;
 		k.mv_data = (void *)&ti->data.tx_id;
 		k.mv_size = sizeof(ti->data.tx_id);
-		ret = mdb_cursor_get(m_cur_txs, &k, &v, MDB_SET);
+		ret = timed_cursor_get(m_cur_txs, &k, &v, MDB_SET);
 		if(ret == MDB_NOTFOUND)
 			break;
 		if(ret)
@@ -2602,7 +2865,7 @@ bool BlockchainLMDB::for_all_outputs(std::function<bool(uint64_t amount, const c
 	MDB_cursor_op op = MDB_FIRST;
 	while(1)
 	{
-		int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+		int ret = timed_cursor_get(m_cur_output_amounts, &k, &v, op);
 		op = MDB_NEXT;
 		if(ret == MDB_NOTFOUND)
 			break;
@@ -2638,7 +2901,7 @@ bool BlockchainLMDB::for_all_outputs(uint64_t amount, const std::function<bool(u
 	MDB_cursor_op op = MDB_SET;
 	while(1)
 	{
-		int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+		int ret = timed_cursor_get(m_cur_output_amounts, &k, &v, op);
 		op = MDB_NEXT_DUP;
 		if(ret == MDB_NOTFOUND)
 			break;
@@ -2877,6 +3140,9 @@ void BlockchainLMDB::block_txn_start(bool readonly)
 		throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when write txn already exists in ") + __FUNCTION__).c_str()));
 	if(!m_batch_active)
 	{
+		// grow the map between write txns, before the writer needs the space
+		if(m_resize_pending)
+			do_resize();
 		m_writer = boost::this_thread::get_id();
 		m_write_txn = new mdb_txn_safe();
 		if(auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, *m_write_txn))
@@ -2955,14 +3221,13 @@ uint64_t BlockchainLMDB::add_block(const block &blk, const size_t &block_size, c
 	check_open();
 	uint64_t m_height = height();
 
-	if(m_height % 1000 == 0)
+	// the map cannot be resized while a write txn is open, so only flag it here. The block's own write
+	// txn, or the next one if the caller holds one already, grows it in block_txn_start. For batch mode,
+	// the DB resize check is done at start of batch transaction.
+	if(m_height % 1000 == 0 && !m_batch_active && !m_resize_pending && need_resize())
 	{
-		// for batch mode, DB resize check is done at start of batch transaction
-		if(!m_batch_active && need_resize())
-		{
-			LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
-			do_resize();
-		}
+		LOG_PRINT_L0("LMDB memory map needs to be resized, doing that before the next write txn.");
+		m_resize_pending = true;
 	}
 
 	try
@@ -3015,7 +3280,7 @@ void BlockchainLMDB::get_output_tx_and_index_from_global(const std::vector<uint6
 	{
 		MDB_val_set(v, output_id);
 
-		auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+		auto get_result = timed_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
 		if(get_result == MDB_NOTFOUND)
 			throw1(OUTPUT_DNE("output with given index not in db"));
 		else if(get_result)
@@ -3045,7 +3310,7 @@ void BlockchainLMDB::get_output_key(const uint64_t &amount, const std::vector<ui
 	{
 		MDB_val_set(v, index);
 
-		auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+		auto get_result = timed_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
 		if(get_result == MDB_NOTFOUND)
 		{
 			if(allow_partial)
@@ -3095,7 +3360,7 @@ void BlockchainLMDB::get_output_tx_and_index(const uint64_t &amount, const std::
 	{
 		MDB_val_set(v, index);
 
-		auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+		auto get_result = timed_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
 		if(get_result == MDB_NOTFOUND)
 			throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
 		else if(get_result)
@@ -3131,7 +3396,7 @@ std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get
 		MDB_cursor_op op = MDB_FIRST;
 		while(1)
 		{
-			int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+			int ret = timed_cursor_get(m_cur_output_amounts, &k, &v, op);
 			op = MDB_NEXT_NODUP;
 			if(ret == MDB_NOTFOUND)
 				break;
@@ -3149,7 +3414,7 @@ std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get
 		for(const auto &amount : amounts)
 		{
 			MDB_val_copy<uint64_t> k(amount);
-			int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
+			int ret = timed_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
 			if(ret == MDB_NOTFOUND)
 			{
 				if(0 >= min_count)
@@ -3231,7 +3496,7 @@ bool BlockchainLMDB::get_output_distribution(uint64_t amount, uint64_t from_heig
 	MDB_cursor_op op = MDB_SET;
 	while(1)
 	{
-		int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+		int ret = timed_cursor_get(m_cur_output_amounts, &k, &v, op);
 		op = MDB_NEXT_DUP;
 		if(ret == MDB_NOTFOUND)
 			break;
@@ -3283,9 +3548,9 @@ void BlockchainLMDB::set_hard_fork_version(uint64_t height, uint8_t version)
 	MDB_val_copy<uint64_t> val_key(height);
 	MDB_val_copy<uint8_t> val_value(version);
 	int result;
-	result = mdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, MDB_APPEND);
+	result = timed_put(*txn_ptr, m_hf_versions, &val_key, &val_value, MDB_APPEND);
 	if(result == MDB_KEYEXIST)
-		result = mdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, 0);
+		result = timed_put(*txn_ptr, m_hf_versions, &val_key, &val_value, 0);
 	if(result)
 		throw1(DB_ERROR(lmdb_error("Error adding hard fork version to db transaction: ", result).c_str()));
 
@@ -3302,7 +3567,7 @@ uint8_t BlockchainLMDB::get_hard_fork_version(uint64_t height) const
 
 	MDB_val_copy<uint64_t> val_key(height);
 	MDB_val val_ret;
-	auto result = mdb_cursor_get(m_cur_hf_versions, &val_key, &val_ret, MDB_SET);
+	auto result = timed_cursor_get(m_cur_hf_versions, &val_key, &val_ret, MDB_SET);
 	if(result == MDB_NOTFOUND || result)
 		throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a hard fork version at height " + boost::lexical_cast<std::string>(height) + " from the db: ", result).c_str()));
 
@@ -3337,7 +3602,7 @@ void BlockchainLMDB::fixup()
 	result = mdb_cursor_open(txn, 1, &c_cur);                                                   \
 	if(result)                                                                                  \
 		throw0(DB_ERROR(lmdb_error("Failed to open a cursor for " name ": ", result).c_str())); \
-	result = mdb_cursor_get(c_cur, &k, NULL, MDB_SET_KEY);                                      \
+	result = timed_cursor_get(c_cur, &k, NULL, MDB_SET_KEY);                                      \
 	if(result)                                                                                  \
 		throw0(DB_ERROR(lmdb_error("Failed to get DB record for " name ": ", result).c_str())); \
 	ptr = (char *)k.mv_data;                                                                    \
@@ -3431,7 +3696,7 @@ void BlockchainLMDB::migrate_0_1()
 					i = ms.ms_entries;
 				}
 			}
-			result = mdb_cursor_get(c_old, &k, &v, MDB_NEXT);
+			result = timed_cursor_get(c_old, &k, &v, MDB_NEXT);
 			if(result == MDB_NOTFOUND)
 			{
 				txn.commit();
@@ -3441,14 +3706,14 @@ void BlockchainLMDB::migrate_0_1()
 				throw0(DB_ERROR(lmdb_error("Failed to get a record from block_heights: ", result).c_str()));
 			bh.bh_hash = *(crypto::hash *)k.mv_data;
 			bh.bh_height = *(uint64_t *)v.mv_data;
-			result = mdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
+			result = timed_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to put a record into block_heightr: ", result).c_str()));
 			/* we delete the old records immediately, so the overall DB and mapsize should not grow.
        * This is a little slower than just letting mdb_drop() delete it all at the end, but
        * it saves a significant amount of disk space.
        */
-			result = mdb_cursor_del(c_old, 0);
+			result = timed_cursor_del(c_old, 0);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_heights: ", result).c_str()));
 			i++;
@@ -3542,7 +3807,7 @@ void BlockchainLMDB::migrate_0_1()
 					i = ms.ms_entries;
 				}
 			}
-			result = mdb_cursor_get(c_coins, &k, &v, MDB_NEXT);
+			result = timed_cursor_get(c_coins, &k, &v, MDB_NEXT);
 			if(result == MDB_NOTFOUND)
 			{
 				break;
@@ -3551,41 +3816,41 @@ void BlockchainLMDB::migrate_0_1()
 				throw0(DB_ERROR(lmdb_error("Failed to get a record from block_coins: ", result).c_str()));
 			bi.bi_height = *(uint64_t *)k.mv_data;
 			bi.bi_coins = *(uint64_t *)v.mv_data;
-			result = mdb_cursor_get(c_diffs, &k, &v, MDB_NEXT);
+			result = timed_cursor_get(c_diffs, &k, &v, MDB_NEXT);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to get a record from block_diffs: ", result).c_str()));
 			bi.bi_diff = *(uint64_t *)v.mv_data;
-			result = mdb_cursor_get(c_hashes, &k, &v, MDB_NEXT);
+			result = timed_cursor_get(c_hashes, &k, &v, MDB_NEXT);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to get a record from block_hashes: ", result).c_str()));
 			bi.bi_hash = *(crypto::hash *)v.mv_data;
-			result = mdb_cursor_get(c_sizes, &k, &v, MDB_NEXT);
+			result = timed_cursor_get(c_sizes, &k, &v, MDB_NEXT);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to get a record from block_sizes: ", result).c_str()));
 			if(v.mv_size == sizeof(uint32_t))
 				bi.bi_size = *(uint32_t *)v.mv_data;
 			else
 				bi.bi_size = *(uint64_t *)v.mv_data; // this is a 32/64 compat bug in version 0
-			result = mdb_cursor_get(c_timestamps, &k, &v, MDB_NEXT);
+			result = timed_cursor_get(c_timestamps, &k, &v, MDB_NEXT);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to get a record from block_timestamps: ", result).c_str()));
 			bi.bi_timestamp = *(uint64_t *)v.mv_data;
-			result = mdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
+			result = timed_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to put a record into block_info: ", result).c_str()));
-			result = mdb_cursor_del(c_coins, 0);
+			result = timed_cursor_del(c_coins, 0);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_coins: ", result).c_str()));
-			result = mdb_cursor_del(c_diffs, 0);
+			result = timed_cursor_del(c_diffs, 0);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_diffs: ", result).c_str()));
-			result = mdb_cursor_del(c_hashes, 0);
+			result = timed_cursor_del(c_hashes, 0);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_hashes: ", result).c_str()));
-			result = mdb_cursor_del(c_sizes, 0);
+			result = timed_cursor_del(c_sizes, 0);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_sizes: ", result).c_str()));
-			result = mdb_cursor_del(c_timestamps, 0);
+			result = timed_cursor_del(c_timestamps, 0);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_timestamps: ", result).c_str()));
 			i++;
@@ -3671,7 +3936,7 @@ void BlockchainLMDB::migrate_0_1()
 					i = ms.ms_entries;
 				}
 			}
-			result = mdb_cursor_get(c_old, &k, &v, MDB_NEXT);
+			result = timed_cursor_get(c_old, &k, &v, MDB_NEXT);
 			if(result == MDB_NOTFOUND)
 			{
 				txn.commit();
@@ -3679,10 +3944,10 @@ void BlockchainLMDB::migrate_0_1()
 			}
 			else if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to get a record from hf_versions: ", result).c_str()));
-			result = mdb_cursor_put(c_cur, &k, &v, MDB_APPEND);
+			result = timed_cursor_put(c_cur, &k, &v, MDB_APPEND);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to put a record into hf_versionr: ", result).c_str()));
-			result = mdb_cursor_del(c_old, 0);
+			result = timed_cursor_del(c_old, 0);
 			if(result)
 				throw0(DB_ERROR(lmdb_error("Failed to delete a record from hf_versions: ", result).c_str()));
 			i++;
@@ -3813,7 +4078,7 @@ void BlockchainLMDB::migrate_0_1()
 					}
 					MDB_val_set(pk, "txblk");
 					MDB_val_set(pv, m_height);
-					result = mdb_cursor_put(c_props, &pk, &pv, 0);
+					result = timed_cursor_put(c_props, &pk, &pv, 0);
 					if(result)
 						throw0(DB_ERROR(lmdb_error("Failed to update txblk property: ", result).c_str()));
 					txn.commit();
@@ -3841,7 +4106,7 @@ void BlockchainLMDB::migrate_0_1()
 					if(i)
 					{
 						MDB_val_set(pk, "txblk");
-						result = mdb_cursor_get(c_props, &pk, &k, MDB_SET);
+						result = timed_cursor_get(c_props, &pk, &k, MDB_SET);
 						if(result)
 							throw0(DB_ERROR(lmdb_error("Failed to get a record from properties: ", result).c_str()));
 						m_height = *(uint64_t *)k.mv_data;
@@ -3849,19 +4114,19 @@ void BlockchainLMDB::migrate_0_1()
 				}
 				if(i)
 				{
-					result = mdb_cursor_get(c_blocks, &k, &v, MDB_SET);
+					result = timed_cursor_get(c_blocks, &k, &v, MDB_SET);
 					if(result)
 						throw0(DB_ERROR(lmdb_error("Failed to get a record from blocks: ", result).c_str()));
 				}
 			}
-			result = mdb_cursor_get(c_blocks, &k, &v, MDB_NEXT);
+			result = timed_cursor_get(c_blocks, &k, &v, MDB_NEXT);
 			if(result == MDB_NOTFOUND)
 			{
 				MDB_val_set(pk, "txblk");
-				result = mdb_cursor_get(c_props, &pk, &v, MDB_SET);
+				result = timed_cursor_get(c_props, &pk, &v, MDB_SET);
 				if(result)
 					throw0(DB_ERROR(lmdb_error("Failed to get a record from props: ", result).c_str()));
-				result = mdb_cursor_del(c_props, 0);
+				result = timed_cursor_del(c_props, 0);
 				if(result)
 					throw0(DB_ERROR(lmdb_error("Failed to delete a record from props: ", result).c_str()));
 				batch_stop();
@@ -3879,14 +4144,14 @@ void BlockchainLMDB::migrate_0_1()
 			{
 				transaction tx;
 				hk.mv_data = &b.tx_hashes[j];
-				result = mdb_cursor_get(c_txs, &hk, &v, MDB_SET);
+				result = timed_cursor_get(c_txs, &hk, &v, MDB_SET);
 				if(result)
 					throw0(DB_ERROR(lmdb_error("Failed to get record from txs: ", result).c_str()));
 				bd.assign(reinterpret_cast<char *>(v.mv_data), v.mv_size);
 				if(!parse_and_validate_tx_from_blob(bd, tx))
 					throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
 				add_transaction(null_hash, tx, &b.tx_hashes[j]);
-				result = mdb_cursor_del(c_txs, 0);
+				result = timed_cursor_del(c_txs, 0);
 				if(result)
 					throw0(DB_ERROR(lmdb_error("Failed to get record from txs: ", result).c_str()));
 			}
@@ -3916,7 +4181,7 @@ void BlockchainLMDB::migrate_0_1()
 	result = mdb_txn_begin(m_env, NULL, 0, txn);
 	if(result)
 		throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-	result = mdb_put(txn, m_properties, &vk, &v, 0);
+	result = timed_put(txn, m_properties, &vk, &v, 0);
 	if(result)
 		throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
 	txn.commit();
@@ -22,6 +22,9 @@
 #include "blockchain_db/blockchain_db.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/thread/tss.hpp>
 
 #include <lmdb.h>
@@ -164,6 +167,10 @@ class BlockchainLMDB : public BlockchainDB
 
 	virtual std::string get_db_name() const;
 
+	virtual void copy(const std::string &folder, bool compact) const;
+
+	virtual crypto::hash get_state_commitment() const;
+
 	virtual bool lock();
 
 	virtual void unlock();
@@ -280,10 +287,14 @@ class BlockchainLMDB : public BlockchainDB
 
 	bool get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
 
+	virtual void set_map_size(uint64_t map_size);
+
   private:
 	void do_resize(uint64_t size_increase = 0);
 
 	bool need_resize(uint64_t threshold_size = 0) const;
+	void resize_monitor();
+	void stop_resize_monitor();
 	void check_and_resize_for_batch(uint64_t batch_num_blocks, uint64_t batch_bytes);
 	uint64_t get_estimated_batch_size(uint64_t batch_num_blocks, uint64_t batch_bytes) const;
 
@@ -390,6 +401,15 @@ class BlockchainLMDB : public BlockchainDB
 	mdb_txn_cursors m_wcursors;
 	mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
 
+	// map growth: the monitor thread flags a resize when usage crosses the
+	// watermark, and the writer performs it at its next txn boundary
+	uint64_t m_map_size_request;
+	std::atomic<bool> m_resize_pending;
+	boost::thread m_resize_thread;
+	boost::mutex m_resize_mutex;
+	boost::condition_variable m_resize_cv;
+	bool m_resize_stop;
+
 #if defined(__arm__)
 	// force a value so it can compile with 32-bit ARM
 	constexpr static uint64_t DEFAULT_MAPSIZE = 1LL << 31;
@@ -401,7 +421,12 @@ class BlockchainLMDB : public BlockchainDB
 #endif
 #endif
 
-	constexpr static float RESIZE_PERCENT = 0.8f;
+	// reserve this multiple of the used size when opening, and grow by this factor
+	constexpr static uint64_t MAPSIZE_RESERVE_FACTOR = 2;
+	constexpr static double MAPSIZE_GROWTH_FACTOR = 2.0;
+	// fraction of the map in use that triggers growth, and how often it is checked
+	constexpr static double MAPSIZE_WATERMARK = 0.75;
+	constexpr static unsigned RESIZE_CHECK_INTERVAL = 10; // seconds
 };
 
 } // namespace cryptonote
@@ -22,6 +22,7 @@
 #include "blocksdat_file.h"
 #include "bootstrap_file.h"
 #include "common/command_line.h"
+#include "common/util.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "cryptonote_core/tx_pool.h"
 #include "version.h"
@@ -69,6 +70,9 @@ int main(int argc, char *argv[])
 	const command_line::arg_descriptor<std::string> arg_database = {
 		"database", available_dbs.c_str(), default_db_type};
 	const command_line::arg_descriptor<bool> arg_blocks_dat = {"blocksdat", "Output in blocks.dat format", blocks_dat};
+	const command_line::arg_descriptor<uint32_t> arg_bootstrap_version = {"bootstrap-version", "Bootstrap file format, 1 or 2 (chunked and indexed)", 1};
+	const command_line::arg_descriptor<uint32_t> arg_chunk_blocks = {"chunk-blocks", "Blocks per chunk in a version 2 bootstrap file", NUM_BLOCKS_PER_CHUNK_V2};
+	const command_line::arg_descriptor<size_t> arg_export_threads = {"export-threads", "Number of threads reading and serializing blocks (0 = auto)", 0};
 
 	command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
 	command_line::add_arg(desc_cmd_sett, arg_output_file);
@@ -78,6 +82,9 @@ int main(int argc, char *argv[])
 	command_line::add_arg(desc_cmd_sett, arg_database);
 	command_line::add_arg(desc_cmd_sett, arg_block_stop);
 	command_line::add_arg(desc_cmd_sett, arg_blocks_dat);
+	command_line::add_arg(desc_cmd_sett, arg_bootstrap_version);
+	command_line::add_arg(desc_cmd_sett, arg_chunk_blocks);
+	command_line::add_arg(desc_cmd_sett, arg_export_threads);
 
 	command_line::add_arg(desc_cmd_only, command_line::arg_help);
 
@@ -117,6 +124,12 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 	bool opt_blocks_dat = command_line::get_arg(vm, arg_blocks_dat);
+	const uint32_t bootstrap_version = command_line::get_arg(vm, arg_bootstrap_version);
+	if(bootstrap_version != 1 && bootstrap_version != 2)
+	{
+		std::cerr << "Error: bootstrap-version must be 1 or 2" << ENDL;
+		return 1;
+	}
 
 	std::string m_config_folder;
 
@@ -187,7 +200,11 @@ int main(int argc, char *argv[])
 	else
 	{
 		BootstrapFile bootstrap;
-		r = bootstrap.store_blockchain_raw(core_storage, NULL, output_file_path, block_stop);
+		size_t export_threads = command_line::get_arg(vm, arg_export_threads);
+		if(export_threads == 0)
+			export_threads = tools::get_max_concurrency();
+		r = bootstrap.store_blockchain_raw(core_storage, NULL, output_file_path, block_stop, bootstrap_version,
+										   command_line::get_arg(vm, arg_chunk_blocks), export_threads);
 	}
 	CHECK_AND_ASSERT_MES(r, 1, "Failed to export blockchain raw data");
 	LOG_PRINT_L0("Blockchain raw data exported OK");
@@ -25,6 +25,7 @@
 #include "blockchain_db/db_types.h"
 #include "bootstrap_file.h"
 #include "bootstrap_serialization.h"
+#include "common/util.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "include_base_utils.h"
@@ -33,6 +34,11 @@
 #include "serialization/json_utils.h"   // dump_json()
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 //#undef RYO_DEFAULT_LOG_CATEGORY
 //#define RYO_DEFAULT_LOG_CATEGORY "bcutil"
@@ -59,6 +65,10 @@ uint64_t db_batch_size = 100;
 // frequently saved
 uint64_t db_batch_size_verify = 5000;
 
+// threads deserializing bootstrap chunks ahead of the import, 0 = one per core
+// less the importing thread
+size_t decode_threads = 0;
+
 std::string refresh_string = "\r                                    \r";
 }
 
@@ -151,7 +161,7 @@ int pop_blocks(cryptonote::core &core, int num_blocks)
 	return num_blocks;
 }
 
-int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks, bool force)
+int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks, std::list<crypto::hash> &hashes, bool force)
 {
 	if(blocks.empty())
 		return 0;
@@ -163,19 +173,7 @@ int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks,
 	if(!force && new_height % HASH_OF_HASHES_STEP)
 		return 0;
 
-	std::list<crypto::hash> hashes;
-	for(const auto &b : blocks)
-	{
-		cryptonote::block block;
-		if(!parse_and_validate_block_from_blob(b.block, block))
-		{
-			MERROR("Failed to parse block: "
-				   << epee::string_tools::pod_to_hex(get_blob_hash(b.block)));
-			core.cleanup_handle_incoming_blocks();
-			return 1;
-		}
-		hashes.push_back(cryptonote::get_block_hash(block));
-	}
+	// block hashes were computed by the chunk decoder threads
 	core.prevalidate_block_hashes(core.get_blockchain_storage().get_db().height(), hashes);
 
 	core.prepare_handle_incoming_blocks(blocks);
@@ -221,9 +219,183 @@ int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks,
 		return 1;
 
 	blocks.clear();
+	hashes.clear();
 	return 0;
 }
 
+// index of the chunk holding the block at the given height
+size_t find_chunk(const bootstrap::chunk_index &index, uint64_t height)
+{
+	auto it = std::upper_bound(index.chunks.begin(), index.chunks.end(), height,
+							   [](uint64_t h, const bootstrap::chunk_index_entry &entry) { return h < entry.block_first; });
+	return it == index.chunks.begin() ? 0 : it - index.chunks.begin() - 1;
+}
+
+// approximate size of the next num_blocks blocks, used to size db batches
+uint64_t count_batch_bytes(const bootstrap::chunk_index &index, uint64_t height, uint64_t num_blocks)
+{
+	uint64_t bytes = 0;
+	for(size_t i = find_chunk(index, height); i < index.chunks.size() && index.chunks[i].block_first < height + num_blocks; ++i)
+		bytes += index.chunks[i].size;
+	return bytes;
+}
+
+struct decoded_chunk
+{
+	bool ok = false;
+	uint32_t num_blocks = 0;
+	std::vector<crypto::hash> hashes;
+
+	// block packages when adding blocks directly, blobs when verifying
+	std::vector<bootstrap::block_package> packages;
+	std::vector<block_complete_entry> entries;
+};
+
+// Decodes the chunks of a memory mapped bootstrap file on worker threads and hands
+// them out in file order. Workers stay at most read_ahead chunks ahead of the
+// consumer, so the next batch is decoded while the current one is verified.
+class chunk_decoder
+{
+  public:
+	chunk_decoder(const char *data, const bootstrap::chunk_index &index, size_t first_chunk, bool multi_block,
+				  bool make_blobs, size_t num_threads, size_t read_ahead) :
+		m_data(data), m_index(index), m_multi_block(multi_block), m_make_blobs(make_blobs),
+		m_slots(std::max<size_t>(read_ahead, 1)), m_next_claim(first_chunk), m_next_consume(first_chunk), m_stop(false)
+	{
+		for(size_t i = 0; i < std::max<size_t>(num_threads, 1); ++i)
+			m_threads.create_thread(boost::bind(&chunk_decoder::worker, this));
+	}
+
+	~chunk_decoder()
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_space_cv.notify_all();
+		m_threads.join_all();
+	}
+
+	// returns false once all chunks have been handed out
+	bool next(decoded_chunk &chunk)
+	{
+		boost::unique_lock<boost::mutex> lock(m_mutex);
+		if(m_next_consume >= m_index.chunks.size())
+			return false;
+		slot &s = m_slots[m_next_consume % m_slots.size()];
+		while(!s.ready)
+			m_ready_cv.wait(lock);
+		chunk = std::move(s.chunk);
+		s.chunk = decoded_chunk();
+		s.ready = false;
+		++m_next_consume;
+		lock.unlock();
+		m_space_cv.notify_all();
+		return true;
+	}
+
+  private:
+	struct slot
+	{
+		bool ready = false;
+		decoded_chunk chunk;
+	};
+
+	void worker()
+	{
+		while(true)
+		{
+			size_t chunk_idx;
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				while(!m_stop && m_next_claim < m_index.chunks.size() && m_next_claim >= m_next_consume + m_slots.size())
+					m_space_cv.wait(lock);
+				if(m_stop || m_next_claim >= m_index.chunks.size())
+					return;
+				chunk_idx = m_next_claim++;
+			}
+
+			decoded_chunk chunk;
+			decode(m_index.chunks[chunk_idx], chunk);
+
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				slot &s = m_slots[chunk_idx % m_slots.size()];
+				s.chunk = std::move(chunk);
+				s.ready = true;
+			}
+			m_ready_cv.notify_all();
+		}
+	}
+
+	void decode(const bootstrap::chunk_index_entry &entry, decoded_chunk &chunk)
+	{
+		try
+		{
+			const std::string str1(m_data + entry.offset, entry.size);
+			if(m_multi_block)
+			{
+				if(crypto::cn_fast_hash(str1.data(), str1.size()) != entry.checksum)
+				{
+					MERROR("Checksum mismatch for chunk at height " << entry.block_first);
+					return;
+				}
+				bootstrap::chunk_package cp;
+				if(!::serialization::parse_binary(str1, cp))
+					return;
+				chunk.packages = std::move(cp.blocks);
+			}
+			else
+			{
+				chunk.packages.resize(1);
+				if(!::serialization::parse_binary(str1, chunk.packages.back()))
+					return;
+			}
+			if(chunk.packages.size() != entry.num_blocks)
+				return;
+
+			chunk.num_blocks = entry.num_blocks;
+			chunk.hashes.reserve(chunk.num_blocks);
+			for(const bootstrap::block_package &bp : chunk.packages)
+				chunk.hashes.push_back(cryptonote::get_block_hash(bp.block));
+
+			if(m_make_blobs)
+			{
+				chunk.entries.resize(chunk.num_blocks);
+				for(size_t i = 0; i < chunk.num_blocks; ++i)
+				{
+					cryptonote::block_to_blob(chunk.packages[i].block, chunk.entries[i].block);
+					for(const auto &tx : chunk.packages[i].txs)
+					{
+						chunk.entries[i].txs.push_back(cryptonote::blobdata());
+						cryptonote::tx_to_blob(tx, chunk.entries[i].txs.back());
+					}
+				}
+				chunk.packages.clear();
+			}
+			chunk.ok = true;
+		}
+		catch(const std::exception &e)
+		{
+			MERROR("Exception while decoding chunk at height " << entry.block_first << ": " << e.what());
+		}
+	}
+
+	const char *m_data;
+	const bootstrap::chunk_index &m_index;
+	const bool m_multi_block;
+	const bool m_make_blobs;
+
+	boost::mutex m_mutex;
+	boost::condition_variable m_ready_cv;
+	boost::condition_variable m_space_cv;
+	std::vector<slot> m_slots;
+	size_t m_next_claim;
+	size_t m_next_consume;
+	bool m_stop;
+	boost::thread_group m_threads;
+};
+
 int import_from_file(cryptonote::core &core, const std::string &import_file_path, uint64_t block_stop = 0)
 {
 	// Reset stats, in case we're using newly created db, accumulating stats
@@ -239,18 +411,21 @@ int import_from_file(cryptonote::core &core, const std::string &import_file_path
 		return false;
 	}
 
-	uint64_t start_height = 1, seek_height;
+	uint64_t start_height = 1;
 	if(opt_resume)
 		start_height = core.get_blockchain_storage().get_current_blockchain_height();
 
-	seek_height = start_height;
 	BootstrapFile bootstrap;
-	std::streampos pos;
-	// BootstrapFile bootstrap(import_file_path);
-	uint64_t total_source_blocks = bootstrap.count_blocks(import_file_path, pos, seek_height);
+	bootstrap::chunk_index index;
+	if(!bootstrap.load_chunk_index(import_file_path, index))
+	{
+		MFATAL("Failed to read bootstrap file chunks");
+		return 2;
+	}
+	uint64_t total_source_blocks = index.chunks.empty() ? 0 : index.chunks.back().block_first + index.chunks.back().num_blocks;
 	MINFO("bootstrap file last block number: " << total_source_blocks - 1 << " (zero-based height)  total blocks: " << total_source_blocks);
 
-	if(total_source_blocks - 1 <= start_height)
+	if(total_source_blocks == 0 || total_source_blocks - 1 <= start_height)
 	{
 		return false;
 	}
@@ -259,27 +434,28 @@ int import_from_file(cryptonote::core &core, const std::string &import_file_path
 	std::cout << "Preparing to read blocks..." << ENDL;
 	std::cout << ENDL;
 
-	std::ifstream import_file;
-	import_file.open(import_file_path, std::ios_base::binary | std::ifstream::in);
-
-	uint64_t h = 0;
-	uint64_t num_imported = 0;
-	if(import_file.fail())
+	boost::interprocess::file_mapping import_mapping;
+	boost::interprocess::mapped_region import_region;
+	try
+	{
+		import_mapping = boost::interprocess::file_mapping(import_file_path.c_str(), boost::interprocess::read_only);
+		import_region = boost::interprocess::mapped_region(import_mapping, boost::interprocess::read_only);
+		import_region.advise(boost::interprocess::mapped_region::advice_sequential);
+	}
+	catch(const std::exception &e)
 	{
-		MFATAL("import_file.open() fail");
+		MFATAL("Failed to map bootstrap file: " << e.what());
 		return false;
 	}
+	const char *import_data = static_cast<const char *>(import_region.get_address());
+	if(import_region.get_size() < index.chunks.back().offset + index.chunks.back().size)
+	{
+		MFATAL("bootstrap file is shorter than its chunk index");
+		return 2;
+	}
 
-	// 4 byte magic + (currently) 1024 byte header structures
-	bootstrap.seek_to_first_chunk(import_file);
-
-	std::string str1;
-	char buffer1[1024];
-	char buffer_block[BUFFER_SIZE];
-	block b;
-	transaction tx;
+	uint64_t num_imported = 0;
 	int quit = 0;
-	uint64_t bytes_read;
 
 	// Note that a new blockchain will start with block number 0 (total blocks: 1)
 	// due to genesis block being added at initialization.
@@ -295,145 +471,75 @@ int import_from_file(cryptonote::core &core, const std::string &import_file_path
 
 	bool use_batch = opt_batch && !opt_verify;
 
-	MINFO("Reading blockchain from bootstrap file...");
+	// keep about one db batch decoded ahead of the blocks being imported
+	size_t first_chunk = find_chunk(index, start_height);
+	uint64_t h = index.chunks[first_chunk].block_first;
+	uint64_t blocks_per_chunk = std::max<uint64_t>(total_source_blocks / index.chunks.size(), 1);
+	size_t read_ahead = std::max<size_t>(decode_threads * 4, (db_batch_size + blocks_per_chunk - 1) / blocks_per_chunk);
+	MINFO("Reading blockchain from bootstrap file v" << unsigned(bootstrap.get_format_version()) << " with "
+		  << decode_threads << " decoder threads, " << read_ahead << " chunks read ahead...");
 	std::cout << ENDL;
 
 	std::list<block_complete_entry> blocks;
-
-	// Skip to start_height before we start adding.
-	{
-		bool q2 = false;
-		import_file.seekg(pos);
-		bytes_read = bootstrap.count_bytes(import_file, start_height - seek_height, h, q2);
-		if(q2)
-		{
-			quit = 2;
-			goto quitting;
-		}
-		h = start_height;
-	}
+	std::list<crypto::hash> hashes;
 
 	if(use_batch)
-	{
-		uint64_t bytes, h2;
-		bool q2;
-		pos = import_file.tellg();
-		bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
-		if(import_file.eof())
-			import_file.clear();
-		import_file.seekg(pos);
-		core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
-	}
-	while(!quit)
-	{
-		uint32_t chunk_size;
-		import_file.read(buffer1, sizeof(chunk_size));
-		// TODO: bootstrap.read_chunk();
-		if(!import_file)
-		{
-			std::cout << refresh_string;
-			MINFO("End of file reached");
-			quit = 1;
-			break;
-		}
-		bytes_read += sizeof(chunk_size);
-
-		str1.assign(buffer1, sizeof(chunk_size));
-		if(!::serialization::parse_binary(str1, chunk_size))
-		{
-			throw std::runtime_error("Error in deserialization of chunk size");
-		}
-		MDEBUG("chunk_size: " << chunk_size);
+		core.get_blockchain_storage().get_db().batch_start(db_batch_size, count_batch_bytes(index, start_height, db_batch_size));
 
-		if(chunk_size > BUFFER_SIZE)
-		{
-			MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
-			throw std::runtime_error("Aborting: chunk size exceeds buffer size");
-		}
-		if(chunk_size > CHUNK_SIZE_WARNING_THRESHOLD)
-		{
-			MINFO("NOTE: chunk_size " << chunk_size << " > " << CHUNK_SIZE_WARNING_THRESHOLD);
-		}
-		else if(chunk_size == 0)
-		{
-			MFATAL("ERROR: chunk_size == 0");
-			return 2;
-		}
-		import_file.read(buffer_block, chunk_size);
-		if(!import_file)
+	{
+		chunk_decoder decoder(import_data, index, first_chunk, bootstrap.get_format_version() >= 2, opt_verify, decode_threads, read_ahead);
+		decoded_chunk chunk;
+		while(!quit)
 		{
-			if(import_file.eof())
+			if(!decoder.next(chunk))
 			{
 				std::cout << refresh_string;
-				MINFO("End of file reached - file was truncated");
+				MINFO("End of file reached");
 				quit = 1;
 				break;
 			}
-			else
+			if(!chunk.ok)
 			{
-				MFATAL("ERROR: unexpected end of file: bytes read before error: "
-					   << import_file.gcount() << " of chunk_size " << chunk_size);
+				std::cout << refresh_string;
+				MFATAL("Error in deserialization of chunk, height=" << h);
 				return 2;
 			}
-		}
-		bytes_read += chunk_size;
-		MDEBUG("Total bytes read: " << bytes_read);
-
-		if(h > block_stop)
-		{
-			std::cout << refresh_string << "block " << h - 1
-					  << " / " << block_stop
-					  << std::flush;
-			std::cout << ENDL << ENDL;
-			MINFO("Specified block number reached - stopping.  block: " << h - 1 << "  total blocks: " << h);
-			quit = 1;
-			break;
-		}
-
-		try
-		{
-			str1.assign(buffer_block, chunk_size);
-			bootstrap::block_package bp;
-			if(!::serialization::parse_binary(str1, bp))
-				throw std::runtime_error("Error in deserialization of chunk");
 
 			int display_interval = 1000;
 			int progress_interval = 10;
-			// NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
-			for(int chunk_ind = 0; chunk_ind < NUM_BLOCKS_PER_CHUNK; ++chunk_ind)
+			for(uint32_t chunk_ind = 0; chunk_ind < chunk.num_blocks; ++chunk_ind, ++h)
 			{
-				++h;
-				if((h - 1) % display_interval == 0)
+				if(h < start_height)
+					continue;
+				if(h > block_stop)
 				{
-					std::cout << refresh_string;
-					MDEBUG("loading block number " << h - 1);
+					std::cout << refresh_string << "block " << h - 1
+							  << " / " << block_stop
+							  << std::flush;
+					std::cout << ENDL << ENDL;
+					MINFO("Specified block number reached - stopping.  block: " << h - 1 << "  total blocks: " << h);
+					quit = 1;
+					break;
 				}
-				else
+
+				if(h % display_interval == 0)
 				{
-					MDEBUG("loading block number " << h - 1);
+					std::cout << refresh_string;
 				}
-				b = bp.block;
-				MDEBUG("block prev_id: " << b.prev_id << ENDL);
+				MDEBUG("loading block number " << h);
 
-				if((h - 1) % progress_interval == 0)
+				if(h % progress_interval == 0)
 				{
-					std::cout << refresh_string << "block " << h - 1
+					std::cout << refresh_string << "block " << h
 							  << " / " << block_stop
 							  << std::flush;
 				}
 
 				if(opt_verify)
 				{
-					cryptonote::blobdata block;
-					cryptonote::block_to_blob(bp.block, block);
-					std::list<cryptonote::blobdata> txs;
-					for(const auto &tx : bp.txs)
-					{
-						txs.push_back(cryptonote::blobdata());
-						cryptonote::tx_to_blob(tx, txs.back());
-					}
-					blocks.push_back({block, txs});
-					int ret = check_flush(core, blocks, false);
+					blocks.push_back(std::move(chunk.entries[chunk_ind]));
+					hashes.push_back(chunk.hashes[chunk_ind]);
+					int ret = check_flush(core, blocks, hashes, false);
 					if(ret)
 					{
 						quit = 2; // make sure we don't commit partial block data
@@ -442,37 +548,13 @@ int import_from_file(cryptonote::core &core, const std::string &import_file_path
 				}
 				else
 				{
-					std::vector<transaction> txs;
-					std::vector<transaction> archived_txs;
-
-					archived_txs = bp.txs;
-
-					// tx number 1: coinbase tx
-					// tx number 2 onwards: archived_txs
-					for(const transaction &tx : archived_txs)
-					{
-						// add blocks with verification.
-						// for Blockchain and blockchain_storage add_new_block().
-						// for add_block() method, without (much) processing.
-						// don't add coinbase transaction to txs.
-						//
-						// because add_block() calls
-						// add_transaction(blk_hash, blk.miner_tx) first, and
-						// then a for loop for the transactions in txs.
-						txs.push_back(tx);
-					}
-
-					size_t block_size;
-					difficulty_type cumulative_difficulty;
-					uint64_t coins_generated;
-
-					block_size = bp.block_size;
-					cumulative_difficulty = bp.cumulative_difficulty;
-					coins_generated = bp.coins_generated;
-
+					// add_block() adds the coinbase transaction itself, txs holds
+					// only the block's regular transactions
+					const bootstrap::block_package &bp = chunk.packages[chunk_ind];
+					MDEBUG("block prev_id: " << bp.block.prev_id << ENDL);
 					try
 					{
-						core.get_blockchain_storage().get_db().add_block(b, block_size, cumulative_difficulty, coins_generated, txs);
+						core.get_blockchain_storage().get_db().add_block(bp.block, bp.block_size, bp.cumulative_difficulty, bp.coins_generated, bp.txs);
 					}
 					catch(const std::exception &e)
 					{
@@ -484,18 +566,13 @@ int import_from_file(cryptonote::core &core, const std::string &import_file_path
 
 					if(use_batch)
 					{
-						if((h - 1) % db_batch_size == 0)
+						if(h % db_batch_size == 0)
 						{
-							uint64_t bytes, h2;
-							bool q2;
 							std::cout << refresh_string;
 							// zero-based height
-							std::cout << ENDL << "[- batch commit at height " << h - 1 << " -]" << ENDL;
+							std::cout << ENDL << "[- batch commit at height " << h << " -]" << ENDL;
 							core.get_blockchain_storage().get_db().batch_stop();
-							pos = import_file.tellg();
-							bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
-							import_file.seekg(pos);
-							core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
+							core.get_blockchain_storage().get_db().batch_start(db_batch_size, count_batch_bytes(index, h + 1, db_batch_size));
 							std::cout << ENDL;
 							core.get_blockchain_storage().get_db().show_stats();
 						}
@@ -503,21 +580,12 @@ int import_from_file(cryptonote::core &core, const std::string &import_file_path
 				}
 				++num_imported;
 			}
-		}
-		catch(const std::exception &e)
-		{
-			std::cout << refresh_string;
-			MFATAL("exception while reading from file, height=" << h << ": " << e.what());
-			return 2;
-		}
-	} // while
-
-quitting:
-	import_file.close();
+		} // while
+	}
 
 	if(opt_verify)
 	{
-		int ret = check_flush(core, blocks, true);
+		int ret = check_flush(core, blocks, hashes, true);
 		if(ret)
 			return ret;
 	}
@@ -582,6 +650,7 @@ int main(int argc, char *argv[])
 	const command_line::arg_descriptor<std::string> arg_log_level = {"log-level", "0-4 or categories", ""};
 	const command_line::arg_descriptor<uint64_t> arg_block_stop = {"block-stop", "Stop at block number", block_stop};
 	const command_line::arg_descriptor<uint64_t> arg_batch_size = {"batch-size", "", db_batch_size};
+	const command_line::arg_descriptor<size_t> arg_decode_threads = {"decode-threads", "Number of threads decoding the bootstrap file ahead of the import (0 = auto)", decode_threads};
 	const command_line::arg_descriptor<uint64_t> arg_pop_blocks = {"pop-blocks", "Remove blocks from end of blockchain", num_blocks};
 	const command_line::arg_descriptor<bool> arg_drop_hf = {"drop-hard-fork", "Drop hard fork subdbs", false};
 	const command_line::arg_descriptor<bool> arg_count_blocks = {
@@ -599,6 +668,7 @@ int main(int argc, char *argv[])
 	command_line::add_arg(desc_cmd_sett, arg_log_level);
 	command_line::add_arg(desc_cmd_sett, arg_database);
 	command_line::add_arg(desc_cmd_sett, arg_batch_size);
+	command_line::add_arg(desc_cmd_sett, arg_decode_threads);
 	command_line::add_arg(desc_cmd_sett, arg_block_stop);
 
 	command_line::add_arg(desc_cmd_only, arg_count_blocks);
@@ -628,6 +698,9 @@ int main(int argc, char *argv[])
 	opt_resume = command_line::get_arg(vm, arg_resume);
 	block_stop = command_line::get_arg(vm, arg_block_stop);
 	db_batch_size = command_line::get_arg(vm, arg_batch_size);
+	decode_threads = command_line::get_arg(vm, arg_decode_threads);
+	if(decode_threads == 0)
+		decode_threads = std::max<unsigned>(tools::get_max_concurrency(), 2) - 1;
 
 	if(command_line::get_arg(vm, command_line::arg_help))
 	{
@@ -0,0 +1,221 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+// Copyright (c) 2018, Ryo Currency Project
+// Portions copyright (c) 2014-2018, The Monero Project
+//
+// Portions of this file are available under BSD-3 license. Please see ORIGINAL-LICENSE for details
+// All rights reserved.
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/blockchain_snapshot.h"
+#include "blockchain_db/db_types.h"
+#include "checkpoints/checkpoints.h"
+#include "common/command_line.h"
+#include "common/util.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "version.h"
+
+//#undef RYO_DEFAULT_LOG_CATEGORY
+//#define RYO_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+int main(int argc, char *argv[])
+{
+#ifdef WIN32
+	std::vector<char*> argptrs;
+	command_line::set_console_utf8();
+	if(command_line::get_windows_args(argptrs))
+	{
+		argc = argptrs.size();
+		argv = argptrs.data();
+	}
+#endif
+
+	TRY_ENTRY();
+
+	epee::string_tools::set_module_name_and_folder(argv[0]);
+
+	std::string default_db_type = "lmdb";
+
+	uint32_t log_level = 0;
+
+	tools::on_startup();
+
+	po::options_description desc_cmd_only("Command line options");
+	po::options_description desc_cmd_sett("Command line options and settings options");
+	const command_line::arg_descriptor<std::string> arg_output_file = {"output-file", "Specify output file", "", true};
+	const command_line::arg_descriptor<std::string> arg_log_level = {"log-level", "0-4 or categories", ""};
+	const command_line::arg_descriptor<std::string> arg_database = {
+		"database", "available: lmdb", default_db_type};
+	const command_line::arg_descriptor<uint64_t> arg_height = {"height", "Checkpoint height to snapshot at (0 = highest checkpoint in the chain)", 0};
+
+	command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
+	command_line::add_arg(desc_cmd_sett, arg_output_file);
+	command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
+	command_line::add_arg(desc_cmd_sett, cryptonote::arg_stagenet_on);
+	command_line::add_arg(desc_cmd_sett, arg_log_level);
+	command_line::add_arg(desc_cmd_sett, arg_database);
+	command_line::add_arg(desc_cmd_sett, arg_height);
+
+	command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+	po::options_description desc_options("Allowed options");
+	desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+	po::variables_map vm;
+	bool r = command_line::handle_error_helper(desc_options, [&]() {
+		po::store(po::parse_command_line(argc, argv, desc_options), vm);
+		po::notify(vm);
+		return true;
+	});
+	if(!r)
+		return 1;
+
+	if(command_line::get_arg(vm, command_line::arg_help))
+	{
+		std::cout << "Ombre '" << RYO_RELEASE_NAME << "' (" << RYO_VERSION_FULL << ")" << ENDL << ENDL;
+		std::cout << desc_options << std::endl;
+		return 0;
+	}
+
+	mlog_configure(mlog_get_default_log_path("ryo-blockchain-snapshot.log"), true);
+	if(!command_line::is_arg_defaulted(vm, arg_log_level))
+		mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+	else
+		mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+
+	LOG_PRINT_L0("Starting...");
+
+	bool opt_testnet = command_line::get_arg(vm, cryptonote::arg_testnet_on);
+	bool opt_stagenet = command_line::get_arg(vm, cryptonote::arg_stagenet_on);
+	if(opt_testnet && opt_stagenet)
+	{
+		std::cerr << "Can't specify more than one of --testnet and --stagenet" << std::endl;
+		return 1;
+	}
+	const network_type nettype = opt_testnet ? TESTNET : opt_stagenet ? STAGENET : MAINNET;
+
+	std::string m_config_folder = command_line::get_arg(vm, cryptonote::arg_data_dir);
+
+	std::string db_type = command_line::get_arg(vm, arg_database);
+	if(db_type != "lmdb")
+	{
+		std::cerr << "Snapshots are only supported for lmdb" << std::endl;
+		return 1;
+	}
+
+	boost::filesystem::path output_file_path;
+	if(command_line::has_arg(vm, arg_output_file))
+		output_file_path = boost::filesystem::path(command_line::get_arg(vm, arg_output_file));
+	else
+		output_file_path = boost::filesystem::path(m_config_folder) / "export" / BLOCKCHAIN_SNAPSHOT_FILENAME;
+	LOG_PRINT_L0("Snapshot output file: " << output_file_path.string());
+
+	const boost::filesystem::path work_folder = output_file_path.string() + ".work";
+	const boost::filesystem::path copy_folder = work_folder / "copy";
+	const boost::filesystem::path compact_folder = work_folder / "compact";
+	boost::filesystem::remove_all(work_folder);
+	if(!boost::filesystem::create_directories(copy_folder) || !boost::filesystem::create_directories(compact_folder))
+	{
+		LOG_ERROR("Failed to create " << work_folder.string());
+		return 1;
+	}
+
+	checkpoints default_checkpoints;
+	default_checkpoints.init_default_checkpoints(nettype);
+
+	blockchain_snapshot_header header = boost::value_initialized<blockchain_snapshot_header>();
+	header.nettype = nettype;
+
+	// copy the source db, so the node it belongs to can keep running
+	{
+		std::unique_ptr<BlockchainDB> db(new_db(db_type));
+		const boost::filesystem::path folder = boost::filesystem::path(m_config_folder) / db->get_db_name();
+		LOG_PRINT_L0("Loading blockchain from folder " << folder.string() << " ...");
+		try
+		{
+			db->open(folder.string(), DBF_RDONLY);
+		}
+		catch(const std::exception &e)
+		{
+			LOG_PRINT_L0("Error opening database: " << e.what());
+			return 1;
+		}
+
+		const uint64_t top_height = db->height() - 1;
+		uint64_t height = command_line::get_arg(vm, arg_height);
+		const auto &points = default_checkpoints.get_points();
+		if(height == 0)
+		{
+			for(const auto &p : points)
+				if(p.first <= top_height)
+					height = p.first;
+		}
+		const auto checkpoint = points.find(height);
+		if(checkpoint == points.end() || height > top_height)
+		{
+			LOG_ERROR("Height " << height << " is not a checkpoint in the chain, which is " << top_height + 1 << " blocks long");
+			return 1;
+		}
+		if(db->get_block_hash_from_height(height) != checkpoint->second)
+		{
+			LOG_ERROR("Block " << height << " does not match its checkpoint " << checkpoint->second);
+			return 1;
+		}
+
+		strncpy(header.db_name, db->get_db_name().c_str(), sizeof(header.db_name) - 1);
+		header.height = height;
+		header.top_hash = checkpoint->second;
+
+		LOG_PRINT_L0("Copying database...");
+		db->copy(copy_folder.string(), true);
+	}
+
+	// pop the copy back to the checkpoint, and commit to its state
+	{
+		std::unique_ptr<BlockchainDB> db(new_db(db_type));
+		db->open(copy_folder.string(), DBF_FAST);
+		db->set_batch_transactions(true);
+
+		const uint64_t nblocks = db->height() - (header.height + 1);
+		LOG_PRINT_L0("Popping " << nblocks << " blocks above the checkpoint...");
+		block popped_block;
+		std::vector<transaction> popped_txs;
+		db->batch_start();
+		for(uint64_t n = 0; n < nblocks; ++n)
+			db->pop_block(popped_block, popped_txs);
+		db->batch_stop();
+
+		LOG_PRINT_L0("Computing state commitment...");
+		header.commitment = db->get_state_commitment();
+
+		db->copy(compact_folder.string(), true);
+		db->close();
+	}
+
+	r = write_blockchain_snapshot(output_file_path.string(), header, compact_folder.string());
+	boost::filesystem::remove_all(work_folder);
+	CHECK_AND_ASSERT_MES(r, 1, "Failed to write blockchain snapshot");
+
+	LOG_PRINT_L0("Blockchain snapshot written OK");
+	std::cout << "Snapshot at height " << header.height << ", block " << header.top_hash << std::endl;
+	std::cout << "State commitment: " << header.commitment << std::endl;
+	std::cout << "Start a new node with --snapshot-file " << output_file_path.string() << " --snapshot-commitment " << header.commitment << std::endl;
+	return 0;
+
+	CATCH_ENTRY("Snapshot error", 1);
+}
@@ -26,4 +26,9 @@
 #define BUFFER_SIZE 1000000
 #define CHUNK_SIZE_WARNING_THRESHOLD 500000
 #define NUM_BLOCKS_PER_CHUNK 1
+// v2 files carry many blocks per chunk, so allow far larger chunks
+#define NUM_BLOCKS_PER_CHUNK_V2 100
+#define BUFFER_SIZE_V2 256000000
+// blocks read and serialized by an export thread in one go
+#define EXPORT_BLOCKS_PER_TASK 100
 #define BLOCKCHAIN_RAW "blockchain.raw"
@@ -23,6 +23,11 @@
 
 #include "bootstrap_file.h"
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <map>
+
 //#undef RYO_DEFAULT_LOG_CATEGORY
 //#define RYO_DEFAULT_LOG_CATEGORY "bcutil"
 
@@ -38,6 +43,11 @@ namespace
 const uint32_t blockchain_raw_magic = 0x28721586;
 const uint32_t header_size = 1024;
 
+// v2 files end with the chunk index, its file position and this magic number
+const uint8_t bootstrap_v2_major_version = 2;
+const uint32_t bootstrap_index_magic = 0x6b4e4958;
+const size_t bootstrap_trailer_size = sizeof(uint64_t) + sizeof(uint32_t);
+
 std::string refresh_string = "\r                                    \r";
 }
 
@@ -77,7 +87,58 @@ bool BootstrapFile::open_writer(const boost::filesystem::path &file_path)
 	}
 	else
 	{
-		num_blocks = count_blocks(file_path.string());
+		const uint8_t requested_version = m_major_version;
+		if(m_major_version >= bootstrap_v2_major_version)
+		{
+			bootstrap::chunk_index index;
+			uint64_t index_pos;
+			std::ifstream import_file(file_path.string(), std::ios_base::binary | std::ifstream::in);
+			const uint64_t first_chunk_pos = seek_to_first_chunk(import_file);
+			if(m_major_version < bootstrap_v2_major_version)
+			{
+				MFATAL("Can only append to a bootstrap file of the same format version: " << file_path);
+				return false;
+			}
+			if(read_index_trailer(import_file, index, index_pos))
+			{
+				if(!index.chunks.empty())
+				{
+					// remember the last exported block to check it against the source chain
+					const bootstrap::chunk_index_entry &last = index.chunks.back();
+					std::string str1(last.size, '\0');
+					bootstrap::chunk_package cp;
+					import_file.clear();
+					import_file.seekg(last.offset);
+					import_file.read(&str1[0], last.size);
+					if(!import_file || !::serialization::parse_binary(str1, cp) || cp.blocks.empty())
+					{
+						MFATAL("Failed to read the last chunk of " << file_path);
+						return false;
+					}
+					m_last_block_hash = get_block_hash(cp.blocks.back().block);
+				}
+			}
+			else
+			{
+				MWARNING("No chunk index in " << file_path << ", resuming after its last intact chunk");
+				index_pos = recover_index(import_file, first_chunk_pos, index);
+			}
+			import_file.close();
+
+			// new chunks overwrite the old index, which is rewritten on close
+			boost::filesystem::resize_file(file_path, index_pos);
+			m_index = std::move(index);
+			num_blocks = m_index.chunks.empty() ? 0 : m_index.chunks.back().block_first + m_index.chunks.back().num_blocks;
+		}
+		else
+		{
+			num_blocks = count_blocks(file_path.string());
+			if(m_major_version != requested_version)
+			{
+				MFATAL("Can only append to a bootstrap file of the same format version: " << file_path);
+				return false;
+			}
+		}
 		MDEBUG("appending to existing file with height: " << num_blocks - 1 << "  total blocks: " << num_blocks);
 	}
 	m_height = num_blocks;
@@ -90,10 +151,6 @@ bool BootstrapFile::open_writer(const boost::filesystem::path &file_path)
 	if(m_raw_data_file->fail())
 		return false;
 
-	m_output_stream = new boost::iostreams::stream<boost::iostreams::back_insert_device<buffer_type>>(m_buffer);
-	if(m_output_stream == nullptr)
-		return false;
-
 	if(do_initialize_file)
 		initialize_file();
 
@@ -112,8 +169,8 @@ bool BootstrapFile::initialize_file()
 	*m_raw_data_file << blob;
 
 	bootstrap::file_info bfi;
-	bfi.major_version = 0;
-	bfi.minor_version = 1;
+	bfi.major_version = m_major_version;
+	bfi.minor_version = m_major_version >= bootstrap_v2_major_version ? 0 : 1;
 	bfi.header_size = header_size;
 
 	bootstrap::blocks_info bbi;
@@ -156,15 +213,17 @@ bool BootstrapFile::initialize_file()
 	return true;
 }
 
-void BootstrapFile::flush_chunk()
+void BootstrapFile::write_chunk(const serialized_chunk &chunk)
 {
-	m_output_stream->flush();
+	const bool v2 = m_major_version >= bootstrap_v2_major_version;
+	m_cur_height = chunk.block_first;
 
-	uint32_t chunk_size = m_buffer.size();
+	uint32_t chunk_size = chunk.payload.size();
+	const uint32_t max_chunk_size = v2 ? BUFFER_SIZE_V2 : BUFFER_SIZE;
 	// MTRACE("chunk_size " << chunk_size);
-	if(chunk_size > BUFFER_SIZE)
+	if(chunk_size > max_chunk_size)
 	{
-		MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
+		MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << max_chunk_size);
 	}
 
 	std::string blob;
@@ -179,7 +238,7 @@ void BootstrapFile::flush_chunk()
 		m_max_chunk = chunk_size;
 	}
 	long pos_before = m_raw_data_file->tellp();
-	std::copy(m_buffer.begin(), m_buffer.end(), std::ostreambuf_iterator<char>(*m_raw_data_file));
+	m_raw_data_file->write(chunk.payload.data(), chunk.payload.size());
 	m_raw_data_file->flush();
 	long pos_after = m_raw_data_file->tellp();
 	long num_chars_written = pos_after - pos_before;
@@ -189,51 +248,249 @@ void BootstrapFile::flush_chunk()
 		throw std::runtime_error("Error writing chunk");
 	}
 
-	m_buffer.clear();
-	delete m_output_stream;
-	m_output_stream = new boost::iostreams::stream<boost::iostreams::back_insert_device<buffer_type>>(m_buffer);
+	if(v2)
+	{
+		bootstrap::chunk_index_entry entry;
+		entry.block_first = chunk.block_first;
+		entry.num_blocks = chunk.num_blocks;
+		entry.offset = pos_before;
+		entry.size = chunk_size;
+		entry.checksum = chunk.checksum;
+		m_index.chunks.push_back(entry);
+	}
 	MDEBUG("flushed chunk:  chunk_size: " << chunk_size);
 }
 
-void BootstrapFile::write_block(block &block)
+// Reads through the db only, so it can run on several threads at once
+void BootstrapFile::pack_block(uint64_t height, bootstrap::block_package &bp)
 {
-	bootstrap::block_package bp;
-	bp.block = block;
-
-	std::vector<transaction> txs;
-
-	uint64_t block_height = boost::get<txin_gen>(block.miner_tx.vin.front()).height;
+	BlockchainDB &db = m_blockchain_storage->get_db();
+	bp.block = db.get_block_from_height(height);
 
 	// now add all regular transactions
-	for(const auto &tx_id : block.tx_hashes)
+	bp.txs.clear();
+	bp.txs.reserve(bp.block.tx_hashes.size());
+	for(const auto &tx_id : bp.block.tx_hashes)
 	{
 		if(tx_id == crypto::null_hash)
 		{
 			throw std::runtime_error("Aborting: tx == null_hash");
 		}
-		transaction tx = m_blockchain_storage->get_db().get_tx(tx_id);
+		bp.txs.push_back(db.get_tx(tx_id));
+	}
 
-		txs.push_back(tx);
+	// These three attributes are currently necessary for a fast import that adds blocks without verification.
+	bp.block_size = db.get_block_size(height);
+	bp.cumulative_difficulty = db.get_block_cumulative_difficulty(height);
+	bp.coins_generated = db.get_block_already_generated_coins(height);
+}
+
+void BootstrapFile::serialize_chunks(uint64_t block_first, uint64_t num_blocks, std::vector<serialized_chunk> &chunks)
+{
+	const uint64_t block_end = block_first + num_blocks;
+	for(uint64_t first = block_first; first < block_end; first += m_blocks_per_chunk)
+	{
+		serialized_chunk chunk;
+		chunk.block_first = first;
+		chunk.num_blocks = std::min<uint64_t>(m_blocks_per_chunk, block_end - first);
+		if(m_major_version >= bootstrap_v2_major_version)
+		{
+			bootstrap::chunk_package cp;
+			cp.blocks.resize(chunk.num_blocks);
+			for(uint32_t i = 0; i < chunk.num_blocks; ++i)
+				pack_block(first + i, cp.blocks[i]);
+			chunk.payload = t_serializable_object_to_blob(cp);
+			chunk.checksum = crypto::cn_fast_hash(chunk.payload.data(), chunk.payload.size());
+		}
+		else
+		{
+			bootstrap::block_package bp;
+			pack_block(first, bp);
+			chunk.payload = t_serializable_object_to_blob(bp);
+			chunk.checksum = crypto::null_hash;
+		}
+		chunks.push_back(std::move(chunk));
 	}
+}
 
-	// these non-coinbase txs will be serialized using this structure
-	bp.txs = txs;
+void BootstrapFile::write_index_trailer()
+{
+	uint64_t index_pos = m_raw_data_file->tellp();
+	blobdata bd = t_serializable_object_to_blob(m_index);
+	uint32_t index_size = bd.size();
 
-	// These three attributes are currently necessary for a fast import that adds blocks without verification.
-	bool include_extra_block_data = true;
-	if(include_extra_block_data)
+	std::string blob;
+	if(!::serialization::dump_binary(index_size, blob))
+		throw std::runtime_error("Error in serialization of chunk index size");
+	*m_raw_data_file << blob;
+	*m_raw_data_file << bd;
+
+	if(!::serialization::dump_binary(index_pos, blob))
+		throw std::runtime_error("Error in serialization of chunk index position");
+	*m_raw_data_file << blob;
+
+	const uint32_t index_magic = bootstrap_index_magic;
+	if(!::serialization::dump_binary(index_magic, blob))
+		throw std::runtime_error("Error in serialization of chunk index magic");
+	*m_raw_data_file << blob;
+	MDEBUG("wrote chunk index: " << m_index.chunks.size() << " chunks, " << index_size << " bytes");
+}
+
+bool BootstrapFile::read_index_trailer(std::ifstream &import_file, bootstrap::chunk_index &index, uint64_t &index_pos)
+{
+	import_file.clear();
+	import_file.seekg(0, std::ios_base::end);
+	const uint64_t file_size = import_file.tellg();
+	if(file_size < bootstrap_trailer_size)
+		return false;
+
+	char buf1[bootstrap_trailer_size];
+	import_file.seekg(file_size - bootstrap_trailer_size);
+	import_file.read(buf1, bootstrap_trailer_size);
+	if(!import_file)
+		return false;
+
+	uint32_t index_magic;
+	if(!::serialization::parse_binary(std::string(buf1 + sizeof(uint64_t), sizeof(uint32_t)), index_magic) || index_magic != bootstrap_index_magic)
+	{
+		MERROR("bootstrap chunk index not found, the export was probably interrupted");
+		return false;
+	}
+	if(!::serialization::parse_binary(std::string(buf1, sizeof(uint64_t)), index_pos))
+		return false;
+
+	const uint64_t index_end = file_size - bootstrap_trailer_size;
+	uint32_t index_size;
+	if(index_pos + sizeof(index_size) > index_end)
+		return false;
+	import_file.seekg(index_pos);
+	import_file.read(buf1, sizeof(index_size));
+	if(!import_file || !::serialization::parse_binary(std::string(buf1, sizeof(index_size)), index_size))
+		return false;
+	if(index_pos + sizeof(index_size) + index_size != index_end)
+	{
+		MERROR("bootstrap chunk index size mismatch");
+		return false;
+	}
+
+	std::string str1(index_size, '\0');
+	import_file.read(&str1[0], index_size);
+	if(!import_file || !::serialization::parse_binary(str1, index))
+	{
+		MERROR("Error in deserialization of bootstrap chunk index");
+		return false;
+	}
+
+	uint64_t next_height = 0;
+	for(const bootstrap::chunk_index_entry &entry : index.chunks)
+	{
+		if(entry.block_first != next_height || entry.num_blocks == 0 || entry.size > BUFFER_SIZE_V2 ||
+		   entry.offset < sizeof(uint32_t) || entry.offset + entry.size > index_pos)
+		{
+			MERROR("Invalid bootstrap chunk index entry at height " << entry.block_first);
+			return false;
+		}
+		next_height += entry.num_blocks;
+	}
+	return true;
+}
+
+uint64_t BootstrapFile::recover_index(std::ifstream &import_file, uint64_t first_chunk_pos, bootstrap::chunk_index &index)
+{
+	index.chunks.clear();
+	import_file.clear();
+	import_file.seekg(first_chunk_pos);
+
+	uint64_t pos = first_chunk_pos;
+	uint64_t h = 0;
+	uint32_t chunk_size;
+	char buf1[sizeof(chunk_size)];
+	std::string str1;
+	while(import_file.read(buf1, sizeof(chunk_size)))
+	{
+		if(!::serialization::parse_binary(std::string(buf1, sizeof(chunk_size)), chunk_size) || chunk_size == 0 || chunk_size > BUFFER_SIZE_V2)
+			break;
+		str1.resize(chunk_size);
+		if(!import_file.read(&str1[0], chunk_size))
+			break;
+		bootstrap::chunk_package cp;
+		if(!::serialization::parse_binary(str1, cp) || cp.blocks.empty() || get_block_height(cp.blocks.front().block) != h)
+			break;
+
+		bootstrap::chunk_index_entry entry;
+		entry.block_first = h;
+		entry.num_blocks = cp.blocks.size();
+		entry.offset = pos + sizeof(chunk_size);
+		entry.size = chunk_size;
+		entry.checksum = crypto::cn_fast_hash(str1.data(), str1.size());
+		index.chunks.push_back(entry);
+
+		pos += sizeof(chunk_size) + chunk_size;
+		h += entry.num_blocks;
+		m_last_block_hash = get_block_hash(cp.blocks.back().block);
+	}
+	MINFO("Recovered " << index.chunks.size() << " chunks, " << h << " blocks");
+	return pos;
+}
+
+bool BootstrapFile::load_chunk_index(const std::string &import_file_path, bootstrap::chunk_index &index)
+{
+	index.chunks.clear();
+	boost::system::error_code ec;
+	const uint64_t file_size = boost::filesystem::file_size(import_file_path, ec);
+	if(ec)
 	{
-		size_t block_size = m_blockchain_storage->get_db().get_block_size(block_height);
-		difficulty_type cumulative_difficulty = m_blockchain_storage->get_db().get_block_cumulative_difficulty(block_height);
-		uint64_t coins_generated = m_blockchain_storage->get_db().get_block_already_generated_coins(block_height);
+		MFATAL("bootstrap file not found: " << import_file_path);
+		return false;
+	}
 
-		bp.block_size = block_size;
-		bp.cumulative_difficulty = cumulative_difficulty;
-		bp.coins_generated = coins_generated;
+	std::ifstream import_file(import_file_path, std::ios_base::binary | std::ifstream::in);
+	if(import_file.fail())
+	{
+		MFATAL("import_file.open() fail");
+		return false;
 	}
 
-	blobdata bd = t_serializable_object_to_blob(bp);
-	m_output_stream->write((const char *)bd.data(), bd.size());
+	uint64_t pos = seek_to_first_chunk(import_file);
+	if(m_major_version >= bootstrap_v2_major_version)
+	{
+		uint64_t index_pos;
+		return read_index_trailer(import_file, index, index_pos);
+	}
+
+	// v1 files have no index, so walk the chunk size prefixes
+	uint64_t h = 0;
+	uint32_t chunk_size;
+	char buf1[sizeof(chunk_size)];
+	while(import_file.read(buf1, sizeof(chunk_size)))
+	{
+		if(!::serialization::parse_binary(std::string(buf1, sizeof(chunk_size)), chunk_size))
+			throw std::runtime_error("Error in deserialization of chunk_size");
+		if(chunk_size == 0 || chunk_size > BUFFER_SIZE)
+		{
+			MFATAL("ERROR: invalid chunk_size " << chunk_size << "  height: " << h);
+			return false;
+		}
+		pos += sizeof(chunk_size);
+		if(pos + chunk_size > file_size)
+		{
+			MINFO("End of file reached - file was truncated");
+			break;
+		}
+
+		bootstrap::chunk_index_entry entry;
+		entry.block_first = h;
+		entry.num_blocks = NUM_BLOCKS_PER_CHUNK;
+		entry.offset = pos;
+		entry.size = chunk_size;
+		entry.checksum = crypto::null_hash;
+		index.chunks.push_back(entry);
+
+		import_file.seekg(chunk_size, std::ios_base::cur);
+		pos += chunk_size;
+		h += NUM_BLOCKS_PER_CHUNK;
+	}
+	return true;
 }
 
 bool BootstrapFile::close()
@@ -241,16 +498,30 @@ bool BootstrapFile::close()
 	if(m_raw_data_file->fail())
 		return false;
 
+	if(m_major_version >= bootstrap_v2_major_version)
+		write_index_trailer();
+
 	m_raw_data_file->flush();
-	delete m_output_stream;
 	delete m_raw_data_file;
 	return true;
 }
 
-bool BootstrapFile::store_blockchain_raw(Blockchain *_blockchain_storage, tx_memory_pool *_tx_pool, boost::filesystem::path &output_file, uint64_t requested_block_stop)
+bool BootstrapFile::store_blockchain_raw(Blockchain *_blockchain_storage, tx_memory_pool *_tx_pool, boost::filesystem::path &output_file, uint64_t requested_block_stop,
+										 uint8_t format_version, uint32_t blocks_per_chunk, size_t num_threads)
 {
 	uint64_t num_blocks_written = 0;
 	m_max_chunk = 0;
+	if(format_version >= 2)
+	{
+		m_major_version = bootstrap_v2_major_version;
+		m_blocks_per_chunk = std::max<uint32_t>(blocks_per_chunk, 1);
+	}
+	else
+	{
+		// v1 readers expect exactly one block per chunk
+		m_major_version = 0;
+		m_blocks_per_chunk = NUM_BLOCKS_PER_CHUNK;
+	}
 	m_blockchain_storage = _blockchain_storage;
 	m_tx_pool = _tx_pool;
 	uint64_t progress_interval = 100;
@@ -260,46 +531,154 @@ bool BootstrapFile::store_blockchain_raw(Blockchain *_blockchain_storage, tx_mem
 		MFATAL("failed to open raw file for write");
 		return false;
 	}
-	block b;
 
 	// block_start, block_stop use 0-based height. m_height uses 1-based height. So to resume export
 	// from last exported block, block_start doesn't need to add 1 here, as it's already at the next
 	// height.
 	uint64_t block_start = m_height;
 	uint64_t block_stop = 0;
-	MINFO("source blockchain height: " << m_blockchain_storage->get_current_blockchain_height() - 1);
-	if((requested_block_stop > 0) && (requested_block_stop < m_blockchain_storage->get_current_blockchain_height()))
+	const uint64_t source_height = m_blockchain_storage->get_current_blockchain_height();
+	MINFO("source blockchain height: " << source_height - 1);
+	if((requested_block_stop > 0) && (requested_block_stop < source_height))
 	{
 		MINFO("Using requested block height: " << requested_block_stop);
 		block_stop = requested_block_stop;
 	}
 	else
 	{
-		block_stop = m_blockchain_storage->get_current_blockchain_height() - 1;
+		block_stop = source_height - 1;
 		MINFO("Using block height of source blockchain: " << block_stop);
 	}
-	for(m_cur_height = block_start; m_cur_height <= block_stop; ++m_cur_height)
+
+	if(m_last_block_hash != crypto::null_hash &&
+	   (m_height > source_height || m_blockchain_storage->get_db().get_block_hash_from_height(m_height - 1) != m_last_block_hash))
 	{
-		// this method's height refers to 0-based height (genesis block = height 0)
-		crypto::hash hash = m_blockchain_storage->get_block_id_by_height(m_cur_height);
-		m_blockchain_storage->get_block_by_hash(hash, b);
-		write_block(b);
-		if(m_cur_height % NUM_BLOCKS_PER_CHUNK == 0)
+		MFATAL("Block " << m_height - 1 << " of " << output_file << " is not in the source blockchain, export to a new file instead");
+		BootstrapFile::close();
+		return false;
+	}
+
+	// Readers take height ranges of blocks_per_task blocks in turn and serialize them
+	// into chunks. The writer drains them in height order, and readers stay at most
+	// max_pending tasks ahead of it.
+	num_threads = std::max<size_t>(num_threads, 1);
+	const uint64_t blocks_per_task = (EXPORT_BLOCKS_PER_TASK + m_blocks_per_chunk - 1) / m_blocks_per_chunk * m_blocks_per_chunk;
+	const uint64_t num_tasks = block_start > block_stop ? 0 : (block_stop - block_start + blocks_per_task) / blocks_per_task;
+	const uint64_t max_pending = num_threads * 4;
+	MINFO("Exporting blocks " << block_start << "-" << block_stop << " with " << num_threads << " reader threads");
+
+	boost::mutex mutex;
+	boost::condition_variable ready_cv;
+	boost::condition_variable space_cv;
+	std::map<uint64_t, std::vector<serialized_chunk>> pending;
+	uint64_t next_task = 0;
+	uint64_t next_write = 0;
+	bool failed = false;
+
+	auto reader = [&]() {
+		BlockchainDB &db = m_blockchain_storage->get_db();
+		while(true)
 		{
-			flush_chunk();
-			num_blocks_written += NUM_BLOCKS_PER_CHUNK;
+			uint64_t task;
+			{
+				boost::unique_lock<boost::mutex> lock(mutex);
+				while(!failed && next_task < num_tasks && next_task >= next_write + max_pending)
+					space_cv.wait(lock);
+				if(failed || next_task >= num_tasks)
+					return;
+				task = next_task++;
+			}
+
+			const uint64_t first = block_start + task * blocks_per_task;
+			const uint64_t count = std::min<uint64_t>(blocks_per_task, block_stop + 1 - first);
+			std::vector<serialized_chunk> chunks;
+			bool ok = true;
+			bool in_txn = false;
+			try
+			{
+				// each task reads under its own read txn
+				db.block_txn_start(true);
+				in_txn = true;
+				serialize_chunks(first, count, chunks);
+				in_txn = false;
+				db.block_txn_stop();
+			}
+			catch(const std::exception &e)
+			{
+				MERROR("Failed to read blocks " << first << "-" << first + count - 1 << ": " << e.what());
+				if(in_txn)
+					db.block_txn_abort();
+				ok = false;
+			}
+
+			{
+				boost::unique_lock<boost::mutex> lock(mutex);
+				if(ok)
+					pending.emplace(task, std::move(chunks));
+				else
+					failed = true;
+			}
+			ready_cv.notify_all();
 		}
-		if(m_cur_height % progress_interval == 0)
+	};
+
+	boost::thread_group readers;
+	for(size_t i = 0; i < num_threads; ++i)
+		readers.create_thread(reader);
+
+	bool success = true;
+	m_cur_height = block_start;
+	for(uint64_t task = 0; task < num_tasks; ++task)
+	{
+		std::vector<serialized_chunk> chunks;
+		{
+			// tasks finished before a failure are still written, keeping the file resumable
+			boost::unique_lock<boost::mutex> lock(mutex);
+			while(!failed && pending.find(task) == pending.end())
+				ready_cv.wait(lock);
+			auto it = pending.find(task);
+			if(it == pending.end())
+			{
+				success = false;
+				break;
+			}
+			chunks = std::move(it->second);
+			pending.erase(it);
+			next_write = task + 1;
+		}
+		space_cv.notify_all();
+
+		try
+		{
+			for(const serialized_chunk &chunk : chunks)
+			{
+				write_chunk(chunk);
+				num_blocks_written += chunk.num_blocks;
+			}
+		}
+		catch(const std::exception &e)
+		{
+			MFATAL("Error writing chunks: " << e.what());
+			success = false;
+			break;
+		}
+
+		m_cur_height = chunks.back().block_first + chunks.back().num_blocks;
+		if(task % std::max<uint64_t>(progress_interval / blocks_per_task, 1) == 0)
 		{
 			std::cout << refresh_string;
-			std::cout << "block " << m_cur_height << "/" << block_stop << std::flush;
+			std::cout << "block " << m_cur_height - 1 << "/" << block_stop << std::flush;
 		}
 	}
-	// NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
-	if(m_cur_height % NUM_BLOCKS_PER_CHUNK != 0)
+
 	{
-		flush_chunk();
+		boost::unique_lock<boost::mutex> lock(mutex);
+		if(!success)
+			failed = true;
 	}
+	space_cv.notify_all();
+	readers.join_all();
+
 	// print message for last block, which may not have been printed yet due to progress_interval
 	std::cout << refresh_string;
 	std::cout << "block " << m_cur_height - 1 << "/" << block_stop << ENDL;
@@ -308,7 +687,8 @@ bool BootstrapFile::store_blockchain_raw(Blockchain *_blockchain_storage, tx_mem
 	if(num_blocks_written > 0)
 		MINFO("Largest chunk: " << m_max_chunk << " bytes");
 
-	return BootstrapFile::close();
+	// the index is written even after a failure, so the export can be resumed
+	return BootstrapFile::close() && success;
 }
 
 uint64_t BootstrapFile::seek_to_first_chunk(std::ifstream &import_file)
@@ -353,6 +733,9 @@ uint64_t BootstrapFile::seek_to_first_chunk(std::ifstream &import_file)
 	if(!::serialization::parse_binary(str1, bfi))
 		throw std::runtime_error("Error in deserialization of bootstrap::file_info");
 	MINFO("bootstrap file v" << unsigned(bfi.major_version) << "." << unsigned(bfi.minor_version));
+	if(bfi.major_version > bootstrap_v2_major_version)
+		throw std::runtime_error("Unsupported bootstrap file version");
+	m_major_version = bfi.major_version;
 	MINFO("bootstrap magic size: " << sizeof(file_magic));
 	MINFO("bootstrap header size: " << bfi.header_size);
 
@@ -455,6 +838,22 @@ uint64_t BootstrapFile::count_blocks(const std::string &import_file_path, std::s
 	uint64_t full_header_size; // 4 byte magic + length of header structures
 	full_header_size = seek_to_first_chunk(import_file);
 
+	if(m_major_version >= bootstrap_v2_major_version)
+	{
+		// v2 files are indexed, so there is nothing to scan
+		bootstrap::chunk_index index;
+		uint64_t index_pos;
+		if(!read_index_trailer(import_file, index, index_pos))
+			throw std::runtime_error("Aborting: failed to read bootstrap chunk index");
+		import_file.close();
+		start_pos = full_header_size;
+		seek_height = 0;
+		h = index.chunks.empty() ? 0 : index.chunks.back().block_first + index.chunks.back().num_blocks;
+		std::cout << "Number of chunks: " << index.chunks.size() << ENDL;
+		std::cout << "Number of blocks: " << h << ENDL;
+		return h;
+	}
+
 	MINFO("Scanning blockchain from bootstrap file...");
 	bool quit = false;
 	uint64_t bytes_read = 0, blocks;
@@ -39,6 +39,7 @@
 #include "version.h"
 
 #include "blockchain_utilities.h"
+#include "bootstrap_serialization.h"
 
 using namespace cryptonote;
 
@@ -50,8 +51,38 @@ class BootstrapFile
 	uint64_t count_blocks(const std::string &dir_path);
 	uint64_t seek_to_first_chunk(std::ifstream &import_file);
 
+	/**
+	 * @brief builds the chunk index of a bootstrap file
+	 *
+	 * v2 files store the index at the end of the file, v1 files are scanned
+	 * chunk by chunk (one block per chunk).
+	 *
+	 * @param import_file_path the bootstrap file
+	 * @param index return-by-reference the chunks, in height order
+	 *
+	 * @return false if the file or its index could not be read
+	 */
+	bool load_chunk_index(const std::string &import_file_path, bootstrap::chunk_index &index);
+
+	/**
+	 * @brief format version of the last file header read, 1 or 2
+	 */
+	uint8_t get_format_version() const { return m_major_version == 0 ? 1 : m_major_version; }
+
+	/**
+	 * @brief exports blocks to a bootstrap file, appending to it if it exists
+	 *
+	 * Chunks are read and serialized by num_threads workers, each reading its
+	 * share of the height range under its own db read txn, and are written in
+	 * height order. An existing v2 file is resumed from its index, or from its
+	 * last intact chunk if the previous export was interrupted.
+	 *
+	 * @return false if the file could not be written or does not match the source chain
+	 */
 	bool store_blockchain_raw(cryptonote::Blockchain *cs, cryptonote::tx_memory_pool *txp,
-							  boost::filesystem::path &output_file, uint64_t use_block_height = 0);
+							  boost::filesystem::path &output_file, uint64_t use_block_height = 0,
+							  uint8_t format_version = 1, uint32_t blocks_per_chunk = NUM_BLOCKS_PER_CHUNK,
+							  size_t num_threads = 1);
 
   protected:
 	Blockchain *m_blockchain_storage;
@@ -59,18 +90,35 @@ class BootstrapFile
 	tx_memory_pool *m_tx_pool;
 	typedef std::vector<char> buffer_type;
 	std::ofstream *m_raw_data_file;
-	buffer_type m_buffer;
-	boost::iostreams::stream<boost::iostreams::back_insert_device<buffer_type>> *m_output_stream;
+
+	struct serialized_chunk
+	{
+		uint64_t block_first;
+		uint32_t num_blocks;
+		blobdata payload;
+		crypto::hash checksum;
+	};
 
 	// open export file for write
 	bool open_writer(const boost::filesystem::path &file_path);
 	bool initialize_file();
 	bool close();
-	void write_block(block &block);
-	void flush_chunk();
+	void pack_block(uint64_t height, bootstrap::block_package &bp);
+	void serialize_chunks(uint64_t block_first, uint64_t num_blocks, std::vector<serialized_chunk> &chunks);
+	void write_chunk(const serialized_chunk &chunk);
+	bool read_index_trailer(std::ifstream &import_file, bootstrap::chunk_index &index, uint64_t &index_pos);
+	uint64_t recover_index(std::ifstream &import_file, uint64_t first_chunk_pos, bootstrap::chunk_index &index);
+	void write_index_trailer();
 
   private:
 	uint64_t m_height;
 	uint64_t m_cur_height; // tracks current height during export
 	uint32_t m_max_chunk;
+	uint8_t m_major_version = 0;
+	uint32_t m_blocks_per_chunk = NUM_BLOCKS_PER_CHUNK;
+
+	// v2 only: index of the written chunks, and hash of the last block already
+	// in the file when appending
+	bootstrap::chunk_index m_index;
+	crypto::hash m_last_block_hash = crypto::null_hash;
 };
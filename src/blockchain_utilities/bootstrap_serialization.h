@@ -72,5 +72,47 @@ struct block_package
 	VARINT_FIELD(coins_generated)
 	END_SERIALIZE()
 };
+
+// v2 chunk payload, a run of consecutive blocks
+struct chunk_package
+{
+	std::vector<block_package> blocks;
+
+	BEGIN_SERIALIZE()
+	FIELD(blocks)
+	END_SERIALIZE()
+};
+
+struct chunk_index_entry
+{
+	// zero-based height of the chunk's first block
+	uint64_t block_first;
+	uint32_t num_blocks;
+
+	// file position of the chunk payload (after its size prefix) and payload size
+	uint64_t offset;
+	uint32_t size;
+
+	// cn_fast_hash of the payload, null for v1 files
+	crypto::hash checksum;
+
+	BEGIN_SERIALIZE_OBJECT()
+	VARINT_FIELD(block_first)
+	VARINT_FIELD(num_blocks)
+	VARINT_FIELD(offset)
+	VARINT_FIELD(size)
+	FIELD(checksum)
+	END_SERIALIZE()
+};
+
+// v2 files end with this index, followed by its file position and a magic number
+struct chunk_index
+{
+	std::vector<chunk_index_entry> chunks;
+
+	BEGIN_SERIALIZE_OBJECT()
+	FIELD(chunks)
+	END_SERIALIZE()
+};
 }
 }
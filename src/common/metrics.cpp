@@ -0,0 +1,335 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "metrics.h"
+#include <algorithm>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace tools
+{
+namespace metrics
+{
+namespace
+{
+constexpr size_t CHUNK_SLOTS = 256;
+constexpr size_t MAX_CHUNKS = 1024;
+
+struct chunk
+{
+	chunk()
+	{
+		for(std::atomic<uint64_t> &s : slots)
+			s.store(0, std::memory_order_relaxed);
+	}
+	std::atomic<uint64_t> slots[CHUNK_SLOTS];
+};
+
+// slots of one thread, chunks are allocated by the owner as it first touches them
+struct shard
+{
+	shard()
+	{
+		for(std::atomic<chunk *> &c : chunks)
+			c.store(nullptr, std::memory_order_relaxed);
+	}
+	~shard()
+	{
+		for(std::atomic<chunk *> &c : chunks)
+			delete c.load(std::memory_order_relaxed);
+	}
+
+	// owner thread only
+	void add(size_t slot, uint64_t n)
+	{
+		std::atomic<chunk *> &c = chunks[slot / CHUNK_SLOTS];
+		chunk *p = c.load(std::memory_order_relaxed);
+		if(p == nullptr)
+		{
+			p = new chunk();
+			c.store(p, std::memory_order_release);
+		}
+		std::atomic<uint64_t> &v = p->slots[slot % CHUNK_SLOTS];
+		v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	uint64_t read(size_t slot) const
+	{
+		const chunk *p = chunks[slot / CHUNK_SLOTS].load(std::memory_order_acquire);
+		return p ? p->slots[slot % CHUNK_SLOTS].load(std::memory_order_relaxed) : 0;
+	}
+
+	std::atomic<chunk *> chunks[MAX_CHUNKS];
+};
+
+enum metric_type
+{
+	type_counter,
+	type_gauge,
+	type_histogram
+};
+
+const char *type_name(metric_type t)
+{
+	switch(t)
+	{
+	case type_counter:
+		return "counter";
+	case type_gauge:
+		return "gauge";
+	default:
+		return "histogram";
+	}
+}
+}
+
+class registry
+{
+  public:
+	// never destroyed, threads may still exit and fold their shards during static destruction
+	static registry &instance()
+	{
+		static registry *r = new registry();
+		return *r;
+	}
+
+	const counter &get_counter(const std::string &name, const std::string &labels, const std::string &help)
+	{
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		const void *&m = series(name, labels, help, type_counter);
+		if(m == nullptr)
+			m = new counter(allocate(1));
+		return *static_cast<const counter *>(m);
+	}
+
+	gauge &get_gauge(const std::string &name, const std::string &labels, const std::string &help)
+	{
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		const void *&m = series(name, labels, help, type_gauge);
+		if(m == nullptr)
+			m = new gauge();
+		return *const_cast<gauge *>(static_cast<const gauge *>(m));
+	}
+
+	const histogram &get_histogram(const std::string &name, const std::string &labels, const std::string &help)
+	{
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		const void *&m = series(name, labels, help, type_histogram);
+		if(m == nullptr)
+			m = new histogram(allocate(histogram::BUCKETS + 1));
+		return *static_cast<const histogram *>(m);
+	}
+
+	void add(size_t slot, uint64_t n)
+	{
+		local().add(slot, n);
+	}
+
+	uint64_t read(size_t slot)
+	{
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		return read_locked(slot);
+	}
+
+	std::string export_text()
+	{
+		std::ostringstream ss;
+		ss << std::setprecision(10);
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		for(const auto &f : m_families)
+		{
+			const std::string &name = f.first;
+			ss << "# HELP " << name << " " << f.second.help << "\n";
+			ss << "# TYPE " << name << " " << type_name(f.second.type) << "\n";
+			for(const auto &s : f.second.series)
+			{
+				const std::string &labels = s.first;
+				const std::string braced = labels.empty() ? std::string() : "{" + labels + "}";
+				if(f.second.type == type_counter)
+				{
+					ss << name << braced << " " << read_locked(static_cast<const counter *>(s.second)->m_slot) << "\n";
+				}
+				else if(f.second.type == type_gauge)
+				{
+					ss << name << braced << " " << static_cast<const gauge *>(s.second)->value() << "\n";
+				}
+				else
+				{
+					const size_t slot = static_cast<const histogram *>(s.second)->m_slot;
+					const std::string prefix = labels.empty() ? std::string() : labels + ",";
+					uint64_t cumulative = 0;
+					for(size_t b = 0; b < histogram::BUCKETS; ++b)
+					{
+						cumulative += read_locked(slot + b);
+						ss << name << "_bucket{" << prefix << "le=\"";
+						if(b + 1 < histogram::BUCKETS)
+							ss << (double)(uint64_t(1) << b) / 1e6;
+						else
+							ss << "+Inf";
+						ss << "\"} " << cumulative << "\n";
+					}
+					ss << name << "_sum" << braced << " " << read_locked(slot + histogram::BUCKETS) / 1e6 << "\n";
+					ss << name << "_count" << braced << " " << cumulative << "\n";
+				}
+			}
+		}
+		return ss.str();
+	}
+
+  private:
+	struct family
+	{
+		metric_type type;
+		std::string help;
+		std::map<std::string, const void *> series;
+	};
+
+	// registers the calling thread's shard for its lifetime
+	struct shard_owner
+	{
+		shard_owner() { registry::instance().attach(&s); }
+		~shard_owner() { registry::instance().detach(&s); }
+		shard s;
+	};
+
+	static shard &local()
+	{
+		static thread_local shard_owner owner;
+		return owner.s;
+	}
+
+	const void *&series(const std::string &name, const std::string &labels, const std::string &help, metric_type type)
+	{
+		auto it = m_families.find(name);
+		if(it == m_families.end())
+			it = m_families.emplace(name, family{type, help, {}}).first;
+		else if(it->second.type != type)
+			throw std::logic_error("metric " + name + " already exists as a " + type_name(it->second.type));
+		return it->second.series[labels];
+	}
+
+	size_t allocate(size_t n)
+	{
+		if(m_next_slot + n > CHUNK_SLOTS * MAX_CHUNKS)
+			throw std::runtime_error("too many metrics");
+		const size_t slot = m_next_slot;
+		m_next_slot += n;
+		m_retired.resize(m_next_slot, 0);
+		return slot;
+	}
+
+	uint64_t read_locked(size_t slot) const
+	{
+		uint64_t v = m_retired[slot];
+		for(const shard *s : m_shards)
+			v += s->read(slot);
+		return v;
+	}
+
+	void attach(shard *s)
+	{
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		m_shards.push_back(s);
+	}
+
+	void detach(shard *s)
+	{
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		for(size_t slot = 0; slot < m_next_slot; ++slot)
+			m_retired[slot] += s->read(slot);
+		m_shards.erase(std::remove(m_shards.begin(), m_shards.end(), s), m_shards.end());
+	}
+
+	registry() : m_next_slot(0) {}
+
+	boost::mutex m_lock;
+	std::map<std::string, family> m_families;
+	std::vector<shard *> m_shards;
+	std::vector<uint64_t> m_retired; // what exited threads counted
+	size_t m_next_slot;
+};
+
+void counter::inc(uint64_t n) const
+{
+	registry::instance().add(m_slot, n);
+}
+
+uint64_t counter::value() const
+{
+	return registry::instance().read(m_slot);
+}
+
+size_t histogram::bucket_of(uint64_t us)
+{
+	size_t b = 0;
+	while(us != 0 && b + 1 < BUCKETS)
+	{
+		us >>= 1;
+		++b;
+	}
+	return b;
+}
+
+void histogram::observe_us(uint64_t us) const
+{
+	registry &r = registry::instance();
+	r.add(m_slot + bucket_of(us), 1);
+	r.add(m_slot + BUCKETS, us);
+}
+
+uint64_t histogram::count() const
+{
+	uint64_t n = 0;
+	for(size_t b = 0; b < BUCKETS; ++b)
+		n += bucket(b);
+	return n;
+}
+
+uint64_t histogram::sum_us() const
+{
+	return registry::instance().read(m_slot + BUCKETS);
+}
+
+uint64_t histogram::bucket(size_t b) const
+{
+	return registry::instance().read(m_slot + b);
+}
+
+const counter &get_counter(const std::string &name, const std::string &labels, const std::string &help)
+{
+	return registry::instance().get_counter(name, labels, help);
+}
+
+gauge &get_gauge(const std::string &name, const std::string &labels, const std::string &help)
+{
+	return registry::instance().get_gauge(name, labels, help);
+}
+
+const histogram &get_histogram(const std::string &name, const std::string &labels, const std::string &help)
+{
+	return registry::instance().get_histogram(name, labels, help);
+}
+
+std::string export_text()
+{
+	return registry::instance().export_text();
+}
+}
+}
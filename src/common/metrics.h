@@ -0,0 +1,137 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace tools
+{
+namespace metrics
+{
+/*
+ * Process wide counters, gauges and latency histograms, exported in the Prometheus text format.
+ *
+ * Counters and histograms live in per thread slots: a thread only ever writes its own slots,
+ * with relaxed atomics and no lock, and an export sums the slots of all threads. The registry
+ * lock is only taken to create a metric, when a thread touches metrics for the first time,
+ * when it exits (its totals are folded into the registry) and to export.
+ *
+ * Metrics are never destroyed, so call sites keep the returned reference, usually in a static.
+ * Labels are passed preformatted, eg. method="get_info".
+ */
+
+class counter
+{
+  public:
+	void inc(uint64_t n = 1) const;
+	uint64_t value() const;
+
+  private:
+	friend class registry;
+	explicit counter(size_t slot) : m_slot(slot) {}
+	size_t m_slot;
+};
+
+class gauge
+{
+  public:
+	void set(int64_t v) { m_value.store(v, std::memory_order_relaxed); }
+	void add(int64_t d) { m_value.fetch_add(d, std::memory_order_relaxed); }
+	int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+  private:
+	friend class registry;
+	gauge() : m_value(0) {}
+	std::atomic<int64_t> m_value;
+};
+
+/**
+ * @brief latency histogram with one bucket per power of two microseconds
+ *
+ * Bucket b holds the observations below 2^b us, the last one everything from 2^(BUCKETS-2) us up.
+ */
+class histogram
+{
+  public:
+	static constexpr size_t BUCKETS = 32;
+
+	void observe_us(uint64_t us) const;
+	void observe(std::chrono::steady_clock::duration d) const { observe_us(std::chrono::duration_cast<std::chrono::microseconds>(d).count()); }
+
+	uint64_t count() const;
+	uint64_t sum_us() const;
+	uint64_t bucket(size_t b) const;
+
+	static size_t bucket_of(uint64_t us);
+
+  private:
+	friend class registry;
+	explicit histogram(size_t slot) : m_slot(slot) {}
+	size_t m_slot; // BUCKETS slots, then the sum
+};
+
+/**
+ * @brief observes the lifetime of the scope into a histogram
+ */
+class scoped_timer
+{
+  public:
+	explicit scoped_timer(const histogram &h) : m_histogram(h), m_start(std::chrono::steady_clock::now()) {}
+	~scoped_timer() { m_histogram.observe(std::chrono::steady_clock::now() - m_start); }
+
+  private:
+	const histogram &m_histogram;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * @brief times consecutive stages of a function, each lap goes to its own histogram
+ */
+class stage_timer
+{
+  public:
+	stage_timer() : m_start(std::chrono::steady_clock::now()) {}
+	void lap(const histogram &h)
+	{
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		h.observe(now - m_start);
+		m_start = now;
+	}
+	void restart() { m_start = std::chrono::steady_clock::now(); }
+
+  private:
+	std::chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * @brief get or create a metric
+ *
+ * A name is tied to the type and help text it was first created with,
+ * asking for it as another type throws.
+ */
+const counter &get_counter(const std::string &name, const std::string &labels, const std::string &help);
+gauge &get_gauge(const std::string &name, const std::string &labels, const std::string &help);
+const histogram &get_histogram(const std::string &name, const std::string &labels, const std::string &help);
+
+/**
+ * @brief all metrics in the Prometheus text exposition format, version 0.0.4
+ */
+std::string export_text();
+}
+}
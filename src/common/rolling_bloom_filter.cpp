@@ -0,0 +1,84 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "rolling_bloom_filter.h"
+#include "crypto/crypto.h"
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+namespace tools
+{
+rolling_bloom_filter::rolling_bloom_filter(size_t capacity, double false_positive_rate) : m_count(0)
+{
+	// each generation is sized for its share of the false positive rate, both are probed
+	m_generation_size = std::max<size_t>(capacity / 2, 1);
+	const double p = std::min(std::max(false_positive_rate / 2, 1e-12), 0.5);
+	const double ln2 = std::log(2.0);
+	const double bits = -(double)m_generation_size * std::log(p) / (ln2 * ln2);
+	m_bits = ((size_t)std::ceil(bits) + 63) & ~(size_t)63;
+	m_hashes = std::max<size_t>((size_t)std::lround(bits / m_generation_size * ln2), 1);
+	m_tweak[0] = crypto::rand<uint64_t>();
+	m_tweak[1] = crypto::rand<uint64_t>() | 1;
+}
+
+template <typename F>
+bool rolling_bloom_filter::for_each_bit(const crypto::hash &h, F f) const
+{
+	// double hashing, the input is already a uniform hash
+	uint64_t w[4];
+	memcpy(w, h.data, sizeof(w));
+	const uint64_t a = (w[0] ^ w[2]) + m_tweak[0];
+	const uint64_t b = ((w[1] ^ w[3]) * m_tweak[1]) | 1;
+	for(size_t i = 0; i < m_hashes; ++i)
+	{
+		const uint64_t bit = (a + i * b) % m_bits;
+		if(!f(bit >> 6, (uint64_t)1 << (bit & 63)))
+			return false;
+	}
+	return true;
+}
+
+void rolling_bloom_filter::insert(const crypto::hash &h)
+{
+	if(m_current.empty())
+		m_current.resize(m_bits / 64, 0);
+
+	if(m_count >= m_generation_size)
+	{
+		m_previous.swap(m_current);
+		m_current.assign(m_bits / 64, 0);
+		m_count = 0;
+	}
+
+	std::vector<uint64_t> &current = m_current;
+	for_each_bit(h, [&current](size_t word, uint64_t mask) { current[word] |= mask; return true; });
+	++m_count;
+}
+
+bool rolling_bloom_filter::contains(const crypto::hash &h) const
+{
+	const auto in = [&h, this](const std::vector<uint64_t> &bits) {
+		return !bits.empty() && for_each_bit(h, [&bits](size_t word, uint64_t mask) { return (bits[word] & mask) != 0; });
+	};
+	return in(m_current) || in(m_previous);
+}
+
+void rolling_bloom_filter::clear()
+{
+	m_current.clear();
+	m_previous.clear();
+	m_count = 0;
+}
+}
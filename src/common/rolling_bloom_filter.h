@@ -0,0 +1,56 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "crypto/hash.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tools
+{
+/**
+ * @brief a bloom filter over hashes which forgets the oldest ones as new ones come in
+ *
+ * Two generations of capacity / 2 hashes each are kept, so anything among the last
+ * capacity / 2 insertions is always found, and nothing older than capacity insertions is.
+ * Bits are only allocated on the first insertion, the bit positions are keyed with a
+ * random per-filter tweak so a peer cannot grind hashes that collide in our filter.
+ */
+class rolling_bloom_filter
+{
+  public:
+	rolling_bloom_filter(size_t capacity, double false_positive_rate);
+
+	void insert(const crypto::hash &h);
+	bool contains(const crypto::hash &h) const;
+	void clear();
+
+	size_t get_bit_count() const { return m_bits; }
+	size_t get_hash_count() const { return m_hashes; }
+
+  private:
+	template <typename F>
+	bool for_each_bit(const crypto::hash &h, F f) const;
+
+	size_t m_generation_size;
+	size_t m_bits;
+	size_t m_hashes;
+	uint64_t m_tweak[2];
+	size_t m_count;
+	std::vector<uint64_t> m_current;
+	std::vector<uint64_t> m_previous;
+};
+}
@@ -17,6 +17,7 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "common/threadpool.h"
+#include "common/trace.h"
 #include "misc_log_ex.h"
 
 #include <cassert>
@@ -136,7 +137,10 @@ void threadpool::run()
 		queue.pop_front();
 		lock.unlock();
 		++depth;
-		e.f();
+		{
+			TRACE_SCOPE(threadpool_task);
+			e.f();
+		}
 		--depth;
 
 		if(e.wo)
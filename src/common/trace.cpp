@@ -0,0 +1,207 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "trace.h"
+#include "perf_timer.h"
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace tools
+{
+namespace trace
+{
+namespace
+{
+struct event
+{
+	const char *name;
+	uint64_t start;
+	uint64_t end;
+	uint64_t arg;
+	bool has_arg;
+};
+
+// the lock is only ever contended by start() and dump_json()
+struct ring
+{
+	boost::mutex lock;
+	std::vector<event> events;
+	size_t capacity = 0;
+	uint64_t written = 0;
+	uint32_t tid = 0;
+};
+
+class registry
+{
+  public:
+	// never destroyed, threads may still record during static destruction
+	static registry &instance()
+	{
+		static registry *r = new registry();
+		return *r;
+	}
+
+	void start(size_t events_per_thread)
+	{
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		m_capacity = events_per_thread;
+		m_reserved = 0;
+		// rings of exited threads are only kept until the next session
+		std::vector<std::shared_ptr<ring>> live;
+		for(const std::shared_ptr<ring> &r : m_rings)
+		{
+			if(r.use_count() == 1)
+				continue;
+			boost::lock_guard<boost::mutex> rlock(r->lock);
+			r->events.clear();
+			r->events.shrink_to_fit();
+			r->capacity = reserve();
+			r->written = 0;
+			live.push_back(r);
+		}
+		m_rings.swap(live);
+		m_origin = get_tick_count();
+	}
+
+	void record(const event &e)
+	{
+		ring &r = local();
+		boost::lock_guard<boost::mutex> lock(r.lock);
+		if(r.capacity == 0)
+			return;
+		if(r.events.size() < r.capacity)
+			r.events.push_back(e);
+		else
+			r.events[r.written % r.capacity] = e;
+		++r.written;
+	}
+
+	std::string dump_json()
+	{
+		std::ostringstream ss;
+		ss << std::fixed << std::setprecision(3);
+		ss << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		for(const std::shared_ptr<ring> &r : m_rings)
+		{
+			boost::lock_guard<boost::mutex> rlock(r->lock);
+			for(const event &e : r->events)
+			{
+				// a scope may have been entered before the session started
+				const uint64_t start = e.start < m_origin ? m_origin : e.start;
+				const uint64_t end = e.end < start ? start : e.end;
+				ss << (first ? "" : ",") << "\n{\"name\":\"";
+				write_escaped(ss, e.name);
+				ss << "\",\"cat\":\"ombre\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r->tid
+				   << ",\"ts\":" << ticks_to_ns(start - m_origin) / 1000.0 << ",\"dur\":" << ticks_to_ns(end - start) / 1000.0;
+				if(e.has_arg)
+					ss << ",\"args\":{\"n\":" << e.arg << "}";
+				ss << "}";
+				first = false;
+			}
+		}
+		ss << "\n]}\n";
+		return ss.str();
+	}
+
+  private:
+	struct ring_owner
+	{
+		ring_owner() : r(registry::instance().attach()) {}
+		std::shared_ptr<ring> r;
+	};
+
+	static ring &local()
+	{
+		static thread_local ring_owner owner;
+		return *owner.r;
+	}
+
+	std::shared_ptr<ring> attach()
+	{
+		std::shared_ptr<ring> r = std::make_shared<ring>();
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		r->capacity = reserve();
+		r->tid = ++m_next_tid;
+		m_rings.push_back(r);
+		return r;
+	}
+
+	// the capacity of one more ring, under m_lock
+	size_t reserve()
+	{
+		const size_t capacity = std::min(m_capacity, MAX_EVENTS_TOTAL - m_reserved);
+		m_reserved += capacity;
+		return capacity;
+	}
+
+	static void write_escaped(std::ostringstream &ss, const char *s)
+	{
+		for(; *s; ++s)
+		{
+			if(*s == '"' || *s == '\\')
+				ss << '\\';
+			ss << *s;
+		}
+	}
+
+	registry() : m_capacity(0), m_reserved(0), m_origin(0), m_next_tid(0) {}
+
+	boost::mutex m_lock;
+	std::vector<std::shared_ptr<ring>> m_rings;
+	size_t m_capacity;
+	size_t m_reserved;
+	uint64_t m_origin;
+	uint32_t m_next_tid;
+};
+}
+
+namespace detail
+{
+std::atomic<bool> enabled(false);
+
+uint64_t now()
+{
+	return get_tick_count();
+}
+
+void record(const char *name, uint64_t start, uint64_t end, uint64_t arg, bool has_arg)
+{
+	registry::instance().record(event{name, start, end, arg, has_arg});
+}
+}
+
+void start(size_t events_per_thread)
+{
+	registry::instance().start(events_per_thread);
+	detail::enabled.store(events_per_thread != 0, std::memory_order_relaxed);
+}
+
+void stop()
+{
+	detail::enabled.store(false, std::memory_order_relaxed);
+}
+
+std::string dump_json()
+{
+	return registry::instance().dump_json();
+}
+}
+}
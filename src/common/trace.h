@@ -0,0 +1,96 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace tools
+{
+namespace trace
+{
+/*
+ * Scoped tracing into per thread ring buffers, dumped as Chrome trace JSON
+ * (chrome://tracing, ui.perfetto.dev).
+ *
+ * A scope records one complete event, its name, start and end in TSC ticks and an
+ * optional number, when it exits. Names are string literals and are not copied.
+ * While tracing is off a scope costs one relaxed load. Each thread keeps the last
+ * events_per_thread events, older ones are overwritten. A session hands out at most
+ * MAX_EVENTS_TOTAL, threads coming after that get what is left, possibly nothing.
+ */
+
+constexpr size_t DEFAULT_EVENTS_PER_THREAD = 16384;
+constexpr size_t MAX_EVENTS_PER_THREAD = 1 << 18; // 10MB a thread
+constexpr size_t MAX_EVENTS_TOTAL = 1 << 22;	  // 160MB over all threads
+
+namespace detail
+{
+extern std::atomic<bool> enabled;
+uint64_t now();
+void record(const char *name, uint64_t start, uint64_t end, uint64_t arg, bool has_arg);
+}
+
+inline bool is_enabled()
+{
+	return detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief starts tracing, dropping what an earlier session recorded
+ */
+void start(size_t events_per_thread = DEFAULT_EVENTS_PER_THREAD);
+void stop();
+
+/**
+ * @brief the recorded events in the Chrome trace event format, can be called while tracing
+ */
+std::string dump_json();
+
+class scope
+{
+  public:
+	explicit scope(const char *name) : m_name(is_enabled() ? name : nullptr), m_arg(0), m_has_arg(false)
+	{
+		if(m_name)
+			m_start = detail::now();
+	}
+	scope(const char *name, uint64_t arg) : m_name(is_enabled() ? name : nullptr), m_arg(arg), m_has_arg(true)
+	{
+		if(m_name)
+			m_start = detail::now();
+	}
+	~scope()
+	{
+		if(m_name)
+			detail::record(m_name, m_start, detail::now(), m_arg, m_has_arg);
+	}
+
+	scope(const scope &) = delete;
+	scope &operator=(const scope &) = delete;
+
+  private:
+	const char *m_name;
+	uint64_t m_start;
+	uint64_t m_arg;
+	bool m_has_arg;
+};
+}
+}
+
+#define TRACE_SCOPE(name) tools::trace::scope tr_##name(#name)
+#define TRACE_SCOPE_ARG(name, arg) tools::trace::scope tr_##name(#name, arg)
@@ -20,6 +20,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "crypto-ops.h"
@@ -1720,6 +1721,40 @@ void ge_p3_tobytes(unsigned char *s, const ge_p3 *h)
 	s[31] ^= fe_isnegative(x) << 7;
 }
 
+/* Encodes n points with a single inversion (Montgomery's trick), acc is n elements of scratch */
+
+void ge_p3_batch_tobytes(unsigned char *s, const ge_p3 *h, fe *acc, size_t n)
+{
+	fe inv;
+	fe recip;
+	fe x;
+	fe y;
+	size_t i;
+
+	if(n == 0)
+		return;
+
+	fe_copy(acc[0], h[0].Z);
+	for(i = 1; i < n; i++)
+		fe_mul(acc[i], acc[i - 1], h[i].Z);
+
+	fe_invert(inv, acc[n - 1]);
+	for(i = n; i-- > 0;)
+	{
+		if(i > 0)
+		{
+			fe_mul(recip, inv, acc[i - 1]);
+			fe_mul(inv, inv, h[i].Z);
+		}
+		else
+			fe_copy(recip, inv);
+		fe_mul(x, h[i].X, recip);
+		fe_mul(y, h[i].Y, recip);
+		fe_tobytes(s + 32 * i, y);
+		s[32 * i + 31] ^= fe_isnegative(x) << 7;
+	}
+}
+
 /* From ge_precomp_0.c */
 
 static void ge_precomp_0(ge_precomp *h)
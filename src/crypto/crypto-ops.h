@@ -107,6 +107,7 @@ void ge_p3_to_p2(ge_p2 *, const ge_p3 *);
 /* From ge_p3_tobytes.c */
 
 void ge_p3_tobytes(unsigned char *, const ge_p3 *);
+void ge_p3_batch_tobytes(unsigned char *, const ge_p3 *, fe *, size_t);
 
 /* From ge_scalarmult_base.c */
 
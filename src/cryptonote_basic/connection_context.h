@@ -20,18 +20,25 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #pragma once
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "common/rolling_bloom_filter.h"
 #include "copyable_atomic.h"
+#include "cryptonote_config.h"
+#include "crypto/hash.h"
+#include "cryptonote_basic/blobdatatype.h"
 #include "net/net_utils_base.h"
 #include <atomic>
 #include <unordered_set>
+#include <vector>
 
 namespace cryptonote
 {
-
 struct cryptonote_connection_context : public epee::net_utils::connection_context_base
 {
 	cryptonote_connection_context() : m_state(state_before_handshake), m_remote_blockchain_height(0), m_last_response_height(0),
-									  m_last_request_time(boost::posix_time::microsec_clock::universal_time()), m_callback_request_count(0), m_last_known_hash(crypto::null_hash) {}
+									  m_last_request_time(boost::posix_time::microsec_clock::universal_time()), m_callback_request_count(0), m_last_known_hash(crypto::null_hash),
+									  m_known_txs(P2P_KNOWN_TXS_PER_PEER, P2P_KNOWN_TXS_FALSE_POSITIVE_RATE) {}
 
 	enum state
 	{
@@ -50,6 +57,9 @@ struct cryptonote_connection_context : public epee::net_utils::connection_contex
 	boost::posix_time::ptime m_last_request_time;
 	epee::copyable_atomic m_callback_request_count; //in debug purpose: problem with double callback rise
 	crypto::hash m_last_known_hash;
+	tools::rolling_bloom_filter m_known_txs; //blob hashes of the txs this peer has or was sent
+	std::vector<blobdata> m_pending_txs;     //txs waiting for the next relay batch to this peer
+	boost::posix_time::ptime m_next_tx_relay_time;
 	//size_t m_score;  TODO: add score calculations
 };
 
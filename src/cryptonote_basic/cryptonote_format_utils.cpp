@@ -22,6 +22,8 @@
 #include "include_base_utils.h"
 using namespace epee;
 
+#include "common/int-util.h"
+#include "common/metrics.h"
 #include "crypto/pow_hash/cn_slow_hash.hpp"
 #include "crypto/crypto.h"
 #include "crypto/hash.h"
@@ -890,8 +892,16 @@ bool get_transaction_hash(const transaction &t, crypto::hash &res, size_t &blob_
 }
 //---------------------------------------------------------------
 blobdata get_block_hashing_blob(const block &b)
+{
+	size_t nonce_offset;
+	return get_block_hashing_blob(b, nonce_offset);
+}
+//---------------------------------------------------------------
+blobdata get_block_hashing_blob(const block &b, size_t &nonce_offset)
 {
 	blobdata blob = t_serializable_object_to_blob(static_cast<block_header>(b));
+	// nonce is the last field of the block header
+	nonce_offset = blob.size() - sizeof(b.nonce);
 	crypto::hash tree_root_hash = get_tx_tree_hash(b);
 	blob.append(reinterpret_cast<const char *>(&tree_root_hash), sizeof(tree_root_hash));
 	blob.append(tools::get_varint_data(b.tx_hashes.size() + 1));
@@ -934,30 +944,58 @@ crypto::hash get_block_hash(const block &b)
 //---------------------------------------------------------------
 bool get_block_longhash(network_type nettype, const block &b, cn_pow_hash_v2 &ctx, crypto::hash &res)
 {
-	block b_local = b; //workaround to avoid const errors with do_serialize
-	blobdata bd = get_block_hashing_blob(b);
-	
+	return get_block_longhash(nettype, b.major_version, get_block_hashing_blob(b), ctx, res);
+}
+//---------------------------------------------------------------
+namespace
+{
+inline void hash_blob_for_version(network_type nettype, uint8_t major_version, const blobdata &bd, cn_pow_hash_v2 &ctx, crypto::hash &res)
+{
 	uint8_t cn_heavy_v = get_fork_v(nettype, FORK_POW_CN_HEAVY);
 	//uint8_t cn_gpu_v = get_fork_v(nettype, FORK_POW_CN_GPU);
 
-	/*if(cn_gpu_v != hardfork_conf::FORK_ID_DISABLED && b_local.major_version >= cn_gpu_v)
+	/*if(cn_gpu_v != hardfork_conf::FORK_ID_DISABLED && major_version >= cn_gpu_v)
 	{
 		cn_pow_hash_v3 ctx_v3 = cn_pow_hash_v3::make_borrowed_v3(ctx);
 		ctx_v3.hash(bd.data(), bd.size(), res.data);
 	}
-	else*/ if(cn_heavy_v != hardfork_conf::FORK_ID_DISABLED && b_local.major_version >= cn_heavy_v)
+	else*/ if(cn_heavy_v != hardfork_conf::FORK_ID_DISABLED && major_version >= cn_heavy_v)
 	{
 		ctx.hash(bd.data(), bd.size(), res.data);
 	}
 	else
 	{
-		std::cout << "v1 hash" << std::endl;
 		cn_pow_hash_v1 ctx_v1 = cn_pow_hash_v1::make_borrowed(ctx);
 		ctx_v1.hash(bd.data(), bd.size(), res.data);
 	}
+}
+}
+//---------------------------------------------------------------
+bool get_block_longhash(network_type nettype, uint8_t major_version, const blobdata &hashing_blob, cn_pow_hash_v2 &ctx, crypto::hash &res)
+{
+	static const tools::metrics::histogram &metric = tools::metrics::get_histogram("ombre_pow_hash_seconds", "", "Time to compute the proof of work hash of a block");
+	tools::metrics::scoped_timer metric_timer(metric);
+	hash_blob_for_version(nettype, major_version, hashing_blob, ctx, res);
 	return true;
 }
 //---------------------------------------------------------------
+void set_hashing_blob_nonce(blobdata &hashing_blob, size_t nonce_offset, uint32_t nonce)
+{
+	nonce = SWAP32LE(nonce);
+	memcpy(&hashing_blob[nonce_offset], &nonce, sizeof(nonce));
+}
+//---------------------------------------------------------------
+void get_block_longhash_batch(network_type nettype, uint8_t major_version, blobdata &hashing_blob, size_t nonce_offset,
+							  uint32_t start_nonce, uint32_t stride, size_t count, cn_pow_hash_v2 &ctx, crypto::hash *res)
+{
+	uint32_t nonce = start_nonce;
+	for(size_t i = 0; i < count; i++, nonce += stride)
+	{
+		set_hashing_blob_nonce(hashing_blob, nonce_offset, nonce);
+		hash_blob_for_version(nettype, major_version, hashing_blob, ctx, res[i]);
+	}
+}
+//---------------------------------------------------------------
 std::vector<uint64_t> relative_output_offsets_to_absolute(const std::vector<uint64_t> &off)
 {
 	std::vector<uint64_t> res = off;
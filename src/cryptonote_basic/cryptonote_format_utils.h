@@ -97,10 +97,16 @@ bool get_transaction_hash(const transaction &t, crypto::hash &res, size_t &blob_
 bool get_transaction_hash(const transaction &t, crypto::hash &res, size_t *blob_size);
 bool calculate_transaction_hash(const transaction &t, crypto::hash &res, size_t *blob_size);
 blobdata get_block_hashing_blob(const block &b);
+blobdata get_block_hashing_blob(const block &b, size_t &nonce_offset);
 bool calculate_block_hash(const block &b, crypto::hash &res);
 bool get_block_hash(const block &b, crypto::hash &res);
 crypto::hash get_block_hash(const block &b);
 bool get_block_longhash(network_type nettype, const block &b, cn_pow_hash_v2 &ctx, crypto::hash &res);
+bool get_block_longhash(network_type nettype, uint8_t major_version, const blobdata &hashing_blob, cn_pow_hash_v2 &ctx, crypto::hash &res);
+//hashes `count` nonces (start_nonce, start_nonce + stride, ...) by patching the nonce bytes of a precomputed hashing blob
+void get_block_longhash_batch(network_type nettype, uint8_t major_version, blobdata &hashing_blob, size_t nonce_offset,
+							  uint32_t start_nonce, uint32_t stride, size_t count, cn_pow_hash_v2 &ctx, crypto::hash *res);
+void set_hashing_blob_nonce(blobdata &hashing_blob, size_t nonce_offset, uint32_t nonce);
 bool parse_and_validate_block_from_blob(const blobdata &b_blob, block &b);
 bool get_inputs_money_amount(const transaction &tx, uint64_t &money);
 uint64_t get_outs_money_amount(const transaction &tx);
@@ -136,54 +136,113 @@ bool check_hash(const crypto::hash &hash, difficulty_type difficulty)
   t=T*N/2 if t < T*N/2  # in case of startup weirdness, keep t reasonable
   next_D = d * k / t
   */
-  difficulty_type next_difficulty_v1(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds) {
-
-    if (timestamps.size() > common_config::DIFFICULTY_BLOCKS_COUNT_V1)
-    {
-      timestamps.resize(common_config::DIFFICULTY_BLOCKS_COUNT_V1);
-      cumulative_difficulties.resize(common_config::DIFFICULTY_BLOCKS_COUNT_V1);
-    }
-
-    size_t length = timestamps.size();
-    assert(length == cumulative_difficulties.size());
-    if (length <= 1) {
-      return 1;
-		}
-
-		uint64_t weighted_timespans = 0;
-		uint64_t target;
-
-		for (size_t i = 1; i < length; i++) {
-			uint64_t timespan;
-			if (timestamps[i - 1] >= timestamps[i]) {
-				timespan = 1;
-			} else {
-				timespan = timestamps[i] - timestamps[i - 1];
-			}
-			if (timespan > 10 * target_seconds) {
-				timespan = 10 * target_seconds;
-			}
-			weighted_timespans += i * timespan;
-		}
-		target = ((length + 1) / 2) * target_seconds;
-
-    uint64_t minimum_timespan = target_seconds * length / 2;
-    if (weighted_timespans < minimum_timespan) {
-      weighted_timespans = minimum_timespan;
-    }
-
-    difficulty_type total_work = cumulative_difficulties.back() - cumulative_difficulties.front();
-    assert(total_work > 0);
-
-    uint64_t low, high;
-    mul(total_work, target, low, high);
-    if (high != 0) {
-      return 0;
-    }
-
-    if (low / weighted_timespans == 0) {
-      return 1;
-    }
-    return low / weighted_timespans;
-  }
+template <typename TS, typename CD>
+static difficulty_type next_difficulty_wwhm(size_t length, const TS &timestamp, const CD &cumulative_difficulty, size_t target_seconds)
+{
+	if(length > common_config::DIFFICULTY_BLOCKS_COUNT_V1)
+		length = common_config::DIFFICULTY_BLOCKS_COUNT_V1;
+
+	if(length <= 1)
+		return 1;
+
+	uint64_t weighted_timespans = 0;
+	uint64_t target;
+
+	for(size_t i = 1; i < length; i++)
+	{
+		uint64_t timespan;
+		if(timestamp(i - 1) >= timestamp(i))
+			timespan = 1;
+		else
+			timespan = timestamp(i) - timestamp(i - 1);
+		if(timespan > 10 * target_seconds)
+			timespan = 10 * target_seconds;
+		weighted_timespans += i * timespan;
+	}
+	target = ((length + 1) / 2) * target_seconds;
+
+	uint64_t minimum_timespan = target_seconds * length / 2;
+	if(weighted_timespans < minimum_timespan)
+		weighted_timespans = minimum_timespan;
+
+	difficulty_type total_work = cumulative_difficulty(length - 1) - cumulative_difficulty(0);
+	assert(total_work > 0);
+
+	uint64_t low, high;
+	mul(total_work, target, low, high);
+	if(high != 0)
+		return 0;
+
+	if(low / weighted_timespans == 0)
+		return 1;
+	return low / weighted_timespans;
+}
+
+difficulty_type next_difficulty_v1(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds)
+{
+	assert(timestamps.size() == cumulative_difficulties.size());
+	return next_difficulty_wwhm(timestamps.size(),
+		[&timestamps](size_t i) { return timestamps[i]; },
+		[&cumulative_difficulties](size_t i) { return cumulative_difficulties[i]; },
+		target_seconds);
+}
+
+difficulty_type next_difficulty_v1(const difficulty_window &window, size_t target_seconds)
+{
+	return next_difficulty_wwhm(window.size(),
+		[&window](size_t i) { return window.timestamp(i); },
+		[&window](size_t i) { return window.cumulative_difficulty(i); },
+		target_seconds);
+}
+
+difficulty_window::difficulty_window(size_t capacity) : m_timestamps(capacity), m_difficulties(capacity), m_head(0), m_size(0)
+{
+}
+
+void difficulty_window::reset(size_t capacity)
+{
+	m_timestamps.assign(capacity, 0);
+	m_difficulties.assign(capacity, 0);
+	clear();
+}
+
+void difficulty_window::clear()
+{
+	m_head = 0;
+	m_size = 0;
+}
+
+void difficulty_window::push_back(uint64_t timestamp, difficulty_type cumulative_difficulty)
+{
+	if(m_timestamps.empty())
+		return;
+
+	if(full())
+	{
+		m_timestamps[m_head] = timestamp;
+		m_difficulties[m_head] = cumulative_difficulty;
+		m_head = index(1);
+		return;
+	}
+
+	size_t idx = index(m_size);
+	m_timestamps[idx] = timestamp;
+	m_difficulties[idx] = cumulative_difficulty;
+	++m_size;
+}
+
+void difficulty_window::push_front(uint64_t timestamp, difficulty_type cumulative_difficulty)
+{
+	assert(!full());
+	m_head = m_head == 0 ? m_timestamps.size() - 1 : m_head - 1;
+	m_timestamps[m_head] = timestamp;
+	m_difficulties[m_head] = cumulative_difficulty;
+	++m_size;
+}
+
+void difficulty_window::pop_back()
+{
+	assert(!empty());
+	--m_size;
+}
 }
@@ -42,7 +42,53 @@ typedef std::uint64_t difficulty_type;
    * @return true if valid, else false
    */
 bool check_hash(const crypto::hash &hash, difficulty_type difficulty);
+
+/**
+   * @brief fixed capacity ring buffer of (timestamp, cumulative difficulty) pairs
+   *
+   * Holds the difficulty window of a chain, oldest entry first. Appending to a
+   * full window drops the oldest entry, so moving the window by one block costs
+   * O(1). Copying the object is the cheap way to fork the window for an
+   * alternative chain.
+   */
+class difficulty_window
+{
+  public:
+	explicit difficulty_window(size_t capacity = 0);
+
+	void reset(size_t capacity);
+	void clear();
+
+	//! appends the newest entry, dropping the oldest one if the window is full
+	void push_back(std::uint64_t timestamp, difficulty_type cumulative_difficulty);
+	//! prepends an entry older than all others, the window must not be full
+	void push_front(std::uint64_t timestamp, difficulty_type cumulative_difficulty);
+	void pop_back();
+
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_timestamps.size(); }
+	bool empty() const { return m_size == 0; }
+	bool full() const { return m_size == m_timestamps.size(); }
+
+	//! i = 0 is the oldest entry
+	std::uint64_t timestamp(size_t i) const { return m_timestamps[index(i)]; }
+	difficulty_type cumulative_difficulty(size_t i) const { return m_difficulties[index(i)]; }
+
+  private:
+	size_t index(size_t i) const
+	{
+		size_t idx = m_head + i;
+		return idx < m_timestamps.size() ? idx : idx - m_timestamps.size();
+	}
+
+	std::vector<std::uint64_t> m_timestamps;
+	std::vector<difficulty_type> m_difficulties;
+	size_t m_head;
+	size_t m_size;
+};
+
 difficulty_type next_difficulty_v1(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
+difficulty_type next_difficulty_v1(const difficulty_window &window, size_t target_seconds);
 template<size_t N>
 void interpolate_timestamps(std::vector<uint64_t>& timestamps);
 }
@@ -21,6 +21,7 @@
 
 #include "boost/logic/tribool.hpp"
 #include "common/command_line.h"
+#include "common/trace.h"
 #include "cryptonote_basic_impl.h"
 #include "cryptonote_format_utils.h"
 #include "file_io_utils.h"
@@ -95,6 +96,7 @@ miner::miner(i_miner_handler *phandler) : m_stop(1),
 										  m_starter_nonce(0),
 										  m_last_hr_merge_time(0),
 										  m_hashes(0),
+										  m_threads_hashes_count(0),
 										  m_do_print_hashrate(false),
 										  m_do_mining(false),
 										  m_current_hash_rate(0),
@@ -132,6 +134,7 @@ bool miner::on_block_chain_update()
 //-----------------------------------------------------------------------------------------------------
 bool miner::request_block_template()
 {
+	TRACE_SCOPE(miner_request_block_template);
 	block bl = AUTO_VAL_INIT(bl);
 	difficulty_type di = AUTO_VAL_INIT(di);
 	uint64_t height = AUTO_VAL_INIT(height);
@@ -175,10 +178,14 @@ void miner::do_print_hashrate(bool do_hr)
 //-----------------------------------------------------------------------------------------------------
 void miner::merge_hr()
 {
+	CRITICAL_REGION_LOCAL(m_last_hash_rates_lock);
 	if(m_last_hr_merge_time && is_mining())
 	{
-		m_current_hash_rate = m_hashes * 1000 / ((misc_utils::get_tick_count() - m_last_hr_merge_time + 1));
-		CRITICAL_REGION_LOCAL(m_last_hash_rates_lock);
+		uint64_t elapsed = misc_utils::get_tick_count() - m_last_hr_merge_time + 1;
+		m_current_hash_rate = m_hashes * 1000 / elapsed;
+		m_threads_hash_rate.resize(m_threads_hashes_count);
+		for(size_t i = 0; i < m_threads_hashes_count; i++)
+			m_threads_hash_rate[i] = m_threads_hashes[i].exchange(0) * 1000 / elapsed;
 		m_last_hash_rates.push_back(m_current_hash_rate);
 		if(m_last_hash_rates.size() > 19)
 			m_last_hash_rates.pop_front();
@@ -190,6 +197,11 @@ void miner::merge_hr()
 			std::cout << "hashrate: " << std::setprecision(4) << std::fixed << hr << precision << ENDL;
 		}
 	}
+	else
+	{
+		for(size_t i = 0; i < m_threads_hashes_count; i++)
+			m_threads_hashes[i] = 0;
+	}
 	m_last_hr_merge_time = misc_utils::get_tick_count();
 	m_hashes = 0;
 }
@@ -301,6 +313,15 @@ bool miner::start(const account_public_address &adr, size_t threads_count, const
 
 	request_block_template(); //lets update block template
 
+	{
+		CRITICAL_REGION_LOCAL1(m_last_hash_rates_lock);
+		m_threads_hashes.reset(new std::atomic<uint64_t>[threads_count]);
+		for(size_t i = 0; i != threads_count; i++)
+			m_threads_hashes[i] = 0;
+		m_threads_hashes_count = threads_count;
+		m_threads_hash_rate.assign(threads_count, 0);
+	}
+
 	boost::interprocess::ipcdetail::atomic_write32(&m_stop, 0);
 	boost::interprocess::ipcdetail::atomic_write32(&m_thread_index, 0);
 	set_is_background_mining_enabled(do_background);
@@ -334,6 +355,15 @@ uint64_t miner::get_speed() const
 	}
 }
 //-----------------------------------------------------------------------------------------------------
+std::vector<uint64_t> miner::get_threads_speed() const
+{
+	if(!is_mining())
+		return std::vector<uint64_t>();
+
+	CRITICAL_REGION_LOCAL(m_last_hash_rates_lock);
+	return m_threads_hash_rate;
+}
+//-----------------------------------------------------------------------------------------------------
 void miner::send_stop_signal()
 {
 	boost::interprocess::ipcdetail::atomic_write32(&m_stop, 1);
@@ -372,17 +402,29 @@ bool miner::stop()
 bool miner::find_nonce_for_given_block(network_type nettype, block &bl, const difficulty_type &diffic, uint64_t height)
 {
 	cn_pow_hash_v2 hash_ctx;
-	for(; bl.nonce != std::numeric_limits<uint32_t>::max(); bl.nonce++)
+	size_t nonce_offset;
+	blobdata hashing_blob = get_block_hashing_blob(bl, nonce_offset);
+	crypto::hash hashes[NONCE_BATCH_SIZE];
+
+	uint64_t nonce = bl.nonce;
+	const uint64_t nonce_end = std::numeric_limits<uint32_t>::max();
+	while(nonce < nonce_end)
 	{
-		crypto::hash h;
-		get_block_longhash(nettype, bl, hash_ctx, h);
+		size_t count = std::min<uint64_t>(NONCE_BATCH_SIZE, nonce_end - nonce);
+		get_block_longhash_batch(nettype, bl.major_version, hashing_blob, nonce_offset, static_cast<uint32_t>(nonce), 1, count, hash_ctx, hashes);
 
-		if(check_hash(h, diffic))
+		for(size_t i = 0; i < count; i++)
 		{
-			bl.invalidate_hashes();
-			return true;
+			if(check_hash(hashes[i], diffic))
+			{
+				bl.nonce = static_cast<uint32_t>(nonce + i);
+				bl.invalidate_hashes();
+				return true;
+			}
 		}
+		nonce += count;
 	}
+	bl.nonce = std::numeric_limits<uint32_t>::max();
 	bl.invalidate_hashes();
 	return false;
 }
@@ -431,6 +473,9 @@ bool miner::worker_thread()
 	uint32_t local_template_ver = 0;
 	block b;
 	cn_pow_hash_v2 hash_ctx;
+	blobdata hashing_blob;
+	size_t nonce_offset = 0;
+	crypto::hash hashes[NONCE_BATCH_SIZE];
 
 	while(!m_stop)
 	{
@@ -463,6 +508,7 @@ bool miner::worker_thread()
 			CRITICAL_REGION_END();
 			local_template_ver = m_template_no;
 			nonce = m_starter_nonce + th_local_index;
+			hashing_blob = get_block_hashing_blob(b, nonce_offset);
 		}
 
 		if(!local_template_ver) //no any set_block_template call
@@ -472,15 +518,22 @@ bool miner::worker_thread()
 			continue;
 		}
 
-		b.nonce = nonce;
-		crypto::hash h;
-		get_block_longhash(m_nettype, b, hash_ctx, h);
+		{
+			TRACE_SCOPE_ARG(miner_hash_batch, nonce);
+			get_block_longhash_batch(m_nettype, b.major_version, hashing_blob, nonce_offset, nonce, m_threads_total, NONCE_BATCH_SIZE, hash_ctx, hashes);
+		}
 
-		if(check_hash(h, local_diff))
+		for(size_t i = 0; i < NONCE_BATCH_SIZE; i++)
 		{
+			if(!check_hash(hashes[i], local_diff))
+				continue;
+
 			//we lucky!
+			b.nonce = nonce + static_cast<uint32_t>(i) * m_threads_total;
+			b.invalidate_hashes();
 			++m_config.current_extra_message_index;
 			MGINFO_GREEN("Found block for difficulty: " << local_diff);
+			TRACE_SCOPE(miner_block_found);
 			if(!m_phandler->handle_block_found(b))
 			{
 				--m_config.current_extra_message_index;
@@ -491,9 +544,11 @@ bool miner::worker_thread()
 				if(!m_config_folder_path.empty())
 					epee::serialization::store_t_to_json_file(m_config, m_config_folder_path + "/" + MINER_CONFIG_FILE_NAME);
 			}
+			break;
 		}
-		nonce += m_threads_total;
-		++m_hashes;
+		nonce += m_threads_total * NONCE_BATCH_SIZE;
+		m_hashes += NONCE_BATCH_SIZE;
+		m_threads_hashes[th_local_index] += NONCE_BATCH_SIZE;
 	}
 	MGINFO("Miner thread stopped [" << th_local_index << "]");
 	return true;
@@ -26,6 +26,7 @@
 #include "math_helper.h"
 #include "cryptonote_basic/blobdatatype.h" 
 #include <atomic>
+#include <memory>
 #include <boost/logic/tribool_fwd.hpp>
 #include <boost/program_options.hpp>
 #ifdef _WIN32
@@ -63,6 +64,7 @@ class miner
 	bool on_block_chain_update();
 	bool start(const account_public_address &adr, size_t threads_count, const boost::thread::attributes &attrs, bool do_background = false, bool ignore_battery = false);
 	uint64_t get_speed() const;
+	std::vector<uint64_t> get_threads_speed() const;
 	uint32_t get_threads_count() const;
 	void send_stop_signal();
 	bool stop();
@@ -96,6 +98,7 @@ class miner
 	static constexpr uint8_t BACKGROUND_MINING_MINER_MONITOR_INVERVAL_IN_SECONDS = 10;
 	static constexpr uint64_t BACKGROUND_MINING_DEFAULT_MINER_EXTRA_SLEEP_MILLIS = 400; // ramp up
 	static constexpr uint64_t BACKGROUND_MINING_MIN_MINER_EXTRA_SLEEP_MILLIS = 5;
+	static constexpr size_t NONCE_BATCH_SIZE = 4; // nonces hashed per worker loop iteration
 
   private:
 	bool worker_thread();
@@ -136,8 +139,12 @@ class miner
 	std::atomic<uint64_t> m_last_hr_merge_time;
 	std::atomic<uint64_t> m_hashes;
 	std::atomic<uint64_t> m_current_hash_rate;
-	epee::critical_section m_last_hash_rates_lock;
+	mutable epee::critical_section m_last_hash_rates_lock;
 	std::list<uint64_t> m_last_hash_rates;
+	// per thread hash counters, indexed by the worker thread index and guarded by m_last_hash_rates_lock for (re)allocation
+	std::unique_ptr<std::atomic<uint64_t>[]> m_threads_hashes;
+	size_t m_threads_hashes_count;
+	std::vector<uint64_t> m_threads_hash_rate;
 	bool m_do_print_hashrate;
 	bool m_do_mining;
 
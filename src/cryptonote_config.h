@@ -57,6 +57,7 @@
 
 #define BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT 10000 //by default, blocks ids count in synchronizing
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT 10		 //by default, blocks count in blocks downloading
+#define BLOCKS_SYNCHRONIZING_MAX_COUNT 2048			 //max blocks count in blocks downloading, for fast peers
 #define CRYPTONOTE_PROTOCOL_HOP_RELAX_COUNT 3		 //value of hop, after which we use only announce of new block
 
 #define CRYPTONOTE_MEMPOOL_TX_LIVETIME 86400				 //seconds, one day
@@ -84,15 +85,30 @@
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL (5 * 60) //5 minutes
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS 0x01
-#define P2P_SUPPORT_FLAGS P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_COMPRESSION 0x02
+#define P2P_SUPPORT_FLAG_COMPACT_BLOCKS 0x04
+#define P2P_SUPPORT_FLAGS (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_COMPRESSION | P2P_SUPPORT_FLAG_COMPACT_BLOCKS)
+
+#define P2P_COMPRESSION_MIN_SIZE 4096 //notifications smaller than this are always sent as is
+#define P2P_COMPRESSION_LEVEL 3
+#define P2P_COMPRESSION_MIN_SAVING 0.05f //drop the compressed form unless it saves at least 5%
+
+#define P2P_KNOWN_TXS_PER_PEER 16384 //tx blobs remembered per peer, so relay and compact blocks can leave them out
+#define P2P_KNOWN_TXS_FALSE_POSITIVE_RATE 0.000001
+#define P2P_TX_RELAY_INTERVAL_MS 500 //mean delay before txs queued for a peer are sent as one batch
+#define P2P_TX_RELAY_TICK_MS 100
 
 #define ALLOW_DEBUG_COMMANDS
 
+#define BLOCKCHAIN_DEFAULT_MAX_ALT_BLOCKS 4096
+#define BLOCKCHAIN_MAX_INVALID_BLOCKS 1024
+
 #define CRYPTONOTE_NAME "ombre2"
 #define CRYPTONOTE_POOLDATA_FILENAME "poolstate.bin"
 #define CRYPTONOTE_BLOCKCHAINDATA_FILENAME "blockchain.bin"
 #define CRYPTONOTE_BLOCKCHAINDATA_LOCK_FILENAME "lock.mdb"
 #define P2P_NET_DATA_FILENAME "p2pstate.bin"
+#define CRYPTONOTE_ALT_BLOCKS_FILENAME "altblocks.bin"
 #define MINER_CONFIG_FILE_NAME "miner_conf.json"
 
 #define THREAD_STACK_SIZE 5 * 1024 * 1024
@@ -102,6 +118,8 @@
 #define HASH_OF_HASHES_STEP 256
 
 #define DEFAULT_TXPOOL_MAX_SIZE 648000000ull // 3 days at 300000, in bytes
+#define TXPOOL_DB_FLUSH_INTERVAL 10				// seconds between writes of the pool changes to the db
+#define TXPOOL_ARENA_COMPACT_INTERVAL 300		// seconds between compactions of the pool blob storage
 
 // coin emission change interval/speed configs
 #define COIN_EMISSION_MONTH_INTERVAL                    6  // months to change emission speed
@@ -23,11 +23,14 @@
 #include <boost/filesystem.hpp>
 #include <boost/range/adaptor/reversed.hpp>
 #include <cstdio>
+#include <queue>
 
 #include "blockchain.h"
 #include "blockchain_db/blockchain_db.h"
 #include "common/boost_serialization_helper.h"
 #include "common/int-util.h"
+#include "common/metrics.h"
+#include "common/trace.h"
 #include "common/perf_timer.h"
 #include "common/threadpool.h"
 #include "crypto/hash.h"
@@ -44,6 +47,9 @@
 #include "misc_language.h"
 #include "profile_tools.h"
 #include "ringct/rctSigs.h"
+#include "serialization/binary_utils.h"
+#include "serialization/string.h"
+#include "serialization/vector.h"
 #include "tx_pool.h"
 #include "warnings.h"
 #if defined(PER_BLOCK_CHECKPOINT)
@@ -117,9 +123,25 @@ static const struct
 	{3, 103580, 0, 1522540800} // April 01, 2018
 };
 
+static const tools::metrics::histogram &block_stage_metric(const char *stage)
+{
+	return tools::metrics::get_histogram("ombre_block_stage_seconds", std::string("stage=\"") + stage + "\"", "Time spent in each stage of adding a block to the main chain");
+}
+
+static const tools::metrics::histogram &metric_block_header = block_stage_metric("header");
+static const tools::metrics::histogram &metric_block_timestamp = block_stage_metric("timestamp");
+static const tools::metrics::histogram &metric_block_difficulty = block_stage_metric("difficulty");
+static const tools::metrics::histogram &metric_block_pow = block_stage_metric("pow");
+static const tools::metrics::histogram &metric_block_txs = block_stage_metric("txs");
+static const tools::metrics::histogram &metric_block_miner_tx = block_stage_metric("miner_tx");
+static const tools::metrics::histogram &metric_block_db_add = block_stage_metric("db_add");
+static const tools::metrics::histogram &metric_check_tx_inputs = tools::metrics::get_histogram("ombre_check_tx_inputs_seconds", "", "Time to check the inputs and signatures of a transaction");
+
 //------------------------------------------------------------------
-Blockchain::Blockchain(tx_memory_pool &tx_pool) : m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_current_block_cumul_sz_limit(0), m_current_block_cumul_sz_median(0),
-												  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_blocks_per_sync(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_cancel(false)
+Blockchain::Blockchain(tx_memory_pool &tx_pool) : m_db(), m_tx_pool(tx_pool), m_current_block_cumul_sz_limit(0), m_current_block_cumul_sz_median(0),
+												  m_db_sync_mode(db_async), m_fast_sync(true), m_show_time_stats(false), m_db_default_sync(false), m_db_blocks_per_sync(1), m_max_prepare_blocks_threads(4), m_sync_counter(0),
+												  m_difficulty_window(common_config::DIFFICULTY_BLOCKS_COUNT_V2), m_difficulty_window_height(0), m_max_alt_blocks(BLOCKCHAIN_DEFAULT_MAX_ALT_BLOCKS),
+												  m_enforce_dns_checkpoints(false), m_hardfork(NULL), m_cancel(false)
 {
 	LOG_PRINT_L3("Blockchain::" << __func__);
 }
@@ -476,7 +498,7 @@ bool Blockchain::init(BlockchainDB *db, const network_type nettype, bool offline
 	}
 	if(num_popped_blocks > 0)
 	{
-		m_timestamps_and_difficulties_height = 0;
+		m_difficulty_window_height = 0;
 		m_hardfork->reorganize_from_chain_height(get_current_blockchain_height());
 		m_tx_pool.on_blockchain_dec(m_db->height() - 1, get_tail_id());
 	}
@@ -544,6 +566,8 @@ bool Blockchain::deinit()
 		throw DB_ERROR("The db pointer is null in Blockchain, the blockchain may be corrupt!");
 	}
 
+	store_alternative_blocks();
+
 	try
 	{
 		m_db->close();
@@ -573,14 +597,13 @@ block Blockchain::pop_block_from_blockchain()
 	LOG_PRINT_L3("Blockchain::" << __func__);
 	CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-	m_timestamps_and_difficulties_height = 0;
-
 	block popped_block;
 	std::vector<transaction> popped_txs;
 
 	try
 	{
 		m_db->pop_block(popped_block, popped_txs);
+		update_difficulty_window_on_pop();
 	}
 	// anything that could cause this to throw is likely catastrophic,
 	// so we re-throw
@@ -630,7 +653,7 @@ bool Blockchain::reset_and_set_genesis_block(const block &b)
 {
 	LOG_PRINT_L3("Blockchain::" << __func__);
 	CRITICAL_REGION_LOCAL(m_blockchain_lock);
-	m_timestamps_and_difficulties_height = 0;
+	m_difficulty_window_height = 0;
 	m_alternative_chains.clear();
 	m_db->reset();
 	m_hardfork->init();
@@ -780,61 +803,77 @@ bool Blockchain::get_block_by_hash(const crypto::hash &h, block &blk, bool *orph
 	return false;
 }
 //------------------------------------------------------------------
-// This function aggregates the cumulative difficulties and timestamps of the
-// last DIFFICULTY_BLOCKS_COUNT blocks and passes them to next_difficulty,
-// returning the result of that call.  Ignores the genesis block, and can use
-// less blocks than desired if there aren't enough.
+// This function returns the difficulty for the next block from the cached
+// window of the last DIFFICULTY_BLOCKS_COUNT blocks. The window is moved along
+// with every added or popped block, so it only needs a full reload from the
+// database after a reset or an unexpected height change. Ignores the genesis
+// block, and can use less blocks than desired if there aren't enough.
 difficulty_type Blockchain::get_difficulty_for_next_block()
 {
 	LOG_PRINT_L3("Blockchain::" << __func__);
 	CRITICAL_REGION_LOCAL(m_blockchain_lock);
-	std::vector<uint64_t> timestamps;
-	std::vector<difficulty_type> difficulties;
-	uint64_t height = m_db->height();
 
-	size_t block_count;
-	block_count = common_config::DIFFICULTY_BLOCKS_COUNT_V2;
+	if(m_difficulty_window_height == 0 || m_difficulty_window_height != m_db->height())
+		load_difficulty_window();
 
-	// ND: Speedup
-	// 1. Keep a list of the last 735 (or less) blocks that is used to compute difficulty,
-	//    then when the next block difficulty is queried, push the latest height data and
-	//    pop the oldest one from the list. This only requires 1x read per height instead
-	//    of doing 735 (DIFFICULTY_BLOCKS_COUNT).
-	if(m_timestamps_and_difficulties_height != 0 && ((height - m_timestamps_and_difficulties_height) == 1) && timestamps.size() >= block_count && m_difficulties.size() >= block_count)
-	{
-		uint64_t index = height - 1;
-		m_timestamps.push_back(m_db->get_block_timestamp(index));
-		m_difficulties.push_back(m_db->get_block_cumulative_difficulty(index));
+	return next_difficulty_v1(m_difficulty_window, common_config::DIFFICULTY_TARGET);
+}
+//------------------------------------------------------------------
+void Blockchain::load_difficulty_window()
+{
+	LOG_PRINT_L3("Blockchain::" << __func__);
+	uint64_t height = m_db->height();
+	size_t block_count = common_config::DIFFICULTY_BLOCKS_COUNT_V2;
 
-		while(m_timestamps.size() > block_count)
-			m_timestamps.erase(m_timestamps.begin());
-		while(m_difficulties.size() > block_count)
-			m_difficulties.erase(m_difficulties.begin());
+	size_t offset = height - std::min<size_t>(height, block_count);
+	if(offset == 0)
+		++offset;
 
-		m_timestamps_and_difficulties_height = height;
-		timestamps = m_timestamps;
-		difficulties = m_difficulties;
+	m_difficulty_window.reset(block_count);
+	for(; offset < height; offset++)
+		m_difficulty_window.push_back(m_db->get_block_timestamp(offset), m_db->get_block_cumulative_difficulty(offset));
+
+	m_difficulty_window_height = height;
+}
+//------------------------------------------------------------------
+void Blockchain::update_difficulty_window_on_add(uint64_t timestamp, difficulty_type cumulative_difficulty, uint64_t new_height)
+{
+	if(new_height == 1)
+	{
+		// genesis block is not part of the window
+		m_difficulty_window.clear();
+		m_difficulty_window_height = 1;
+	}
+	else if(m_difficulty_window_height != 0 && m_difficulty_window_height + 1 == new_height)
+	{
+		m_difficulty_window.push_back(timestamp, cumulative_difficulty);
+		m_difficulty_window_height = new_height;
 	}
 	else
 	{
-		size_t offset = height - std::min<size_t>(height, block_count);
-		if(offset == 0)
-			++offset;
+		m_difficulty_window_height = 0;
+	}
+}
+//------------------------------------------------------------------
+void Blockchain::update_difficulty_window_on_pop()
+{
+	uint64_t height = m_db->height();
+	if(m_difficulty_window_height == 0 || m_difficulty_window_height != height + 1 || height == 0 || m_difficulty_window.empty())
+	{
+		m_difficulty_window_height = 0;
+		return;
+	}
 
-		timestamps.clear();
-		difficulties.clear();
-		for(; offset < height; offset++)
-		{
-			timestamps.push_back(m_db->get_block_timestamp(offset));
-			difficulties.push_back(m_db->get_block_cumulative_difficulty(offset));
-		}
+	m_difficulty_window.pop_back();
 
-		m_timestamps_and_difficulties_height = height;
-		m_timestamps = timestamps;
-		m_difficulties = difficulties;
+	// the window for height h covers [max(1, h - N), h - 1]
+	uint64_t block_count = m_difficulty_window.capacity();
+	if(height > block_count)
+	{
+		uint64_t index = height - block_count;
+		m_difficulty_window.push_front(m_db->get_block_timestamp(index), m_db->get_block_cumulative_difficulty(index));
 	}
-
-	return next_difficulty_v1(timestamps, difficulties, common_config::DIFFICULTY_TARGET);
+	m_difficulty_window_height = height;
 }
 
 //------------------------------------------------------------------
@@ -852,8 +891,6 @@ bool Blockchain::rollback_blockchain_switching(std::list<block> &original_chain,
 		return true;
 	}
 
-	m_timestamps_and_difficulties_height = 0;
-
 	// remove blocks from blockchain until we get back to where we should be.
 	while(m_db->height() != rollback_height)
 	{
@@ -905,8 +942,6 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
 	LOG_PRINT_L3("Blockchain::" << __func__);
 	CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-	m_timestamps_and_difficulties_height = 0;
-
 	// if empty alt chain passed (not sure how that could happen), return false
 	CHECK_AND_ASSERT_MES(alt_chain.size(), false, "switch_to_alternative_blockchain: empty chain passed");
 
@@ -1009,12 +1044,12 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
 			// looking into.
 			add_block_as_invalid(ch_ent->second, get_block_hash(ch_ent->second.bl));
 			LOG_PRINT_L1("The block was inserted as invalid while connecting new alternative chain, block_id: " << get_block_hash(ch_ent->second.bl));
-			m_alternative_chains.erase(*alt_ch_iter++);
+			erase_alternative_block(*alt_ch_iter++);
 
 			for(auto alt_ch_to_orph_iter = alt_ch_iter; alt_ch_to_orph_iter != alt_chain.end();)
 			{
 				add_block_as_invalid((*alt_ch_to_orph_iter)->second, (*alt_ch_to_orph_iter)->first);
-				m_alternative_chains.erase(*alt_ch_to_orph_iter++);
+				erase_alternative_block(*alt_ch_to_orph_iter++);
 			}
 			return false;
 		}
@@ -1035,12 +1070,15 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
 				// think this is bad enough to warrant that.
 			}
 		}
+
+		// alt branches that forked off the disconnected blocks now have an alt parent
+		count_alternative_children();
 	}
 
 	//removing alt_chain entries from alternative chains container
 	for(auto ch_ent : alt_chain)
 	{
-		m_alternative_chains.erase(ch_ent);
+		erase_alternative_block(ch_ent);
 	}
 
 	m_hardfork->reorganize_from_chain_height(split_height);
@@ -1054,14 +1092,21 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
 difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std::list<blocks_ext_by_hash::iterator> &alt_chain, block_extended_info &bei) const
 {
 	LOG_PRINT_L3("Blockchain::" << __func__);
-	std::vector<uint64_t> timestamps;
-	std::vector<difficulty_type> cumulative_difficulties;
-
+	difficulty_window window;
+	if(!get_alternative_chain_difficulty_window(alt_chain, bei, window))
+		return 0;
+	return next_difficulty_v1(window, common_config::DIFFICULTY_TARGET);
+}
+//------------------------------------------------------------------
+// This function builds the difficulty window for the block being added to
+// an alternate chain.
+bool Blockchain::get_alternative_chain_difficulty_window(const std::list<blocks_ext_by_hash::iterator> &alt_chain, const block_extended_info &bei, difficulty_window &window) const
+{
+	LOG_PRINT_L3("Blockchain::" << __func__);
 	size_t block_count;
 	block_count = common_config::DIFFICULTY_BLOCKS_COUNT_V2;
 
-	timestamps.reserve(block_count);
-	cumulative_difficulties.reserve(block_count);
+	window.reset(block_count);
 
 	// if the alt chain isn't long enough to calculate the difficulty target
 	// based on its blocks alone, need to get more blocks from the main chain
@@ -1078,43 +1123,49 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
 		if(!main_chain_start_offset)
 			++main_chain_start_offset; //skip genesis block
 
-		// get difficulties and timestamps from relevant main chain blocks
-		for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
-		{
-			timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
-			cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+		// fork the main chain window if the split point is within it, otherwise read the blocks from the db
+		uint64_t main_height = m_difficulty_window_height;
+		if(main_height != 0 && main_height == m_db->height() && main_height >= main_chain_stop_offset &&
+		   main_height - main_chain_stop_offset < m_difficulty_window.size())
+		{
+			// the forked window covers [stop - size, stop - 1], entries older than the start
+			// offset are evicted again when the alt chain blocks are appended below
+			window = m_difficulty_window;
+			for(uint64_t h = main_height; h > main_chain_stop_offset; h--)
+				window.pop_back();
+			size_t offset = main_chain_stop_offset - window.size();
+			while(offset > main_chain_start_offset)
+			{
+				--offset;
+				window.push_front(m_db->get_block_timestamp(offset), m_db->get_block_cumulative_difficulty(offset));
+			}
 		}
+		else
+		{
+			// get difficulties and timestamps from relevant main chain blocks
+			for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+				window.push_back(m_db->get_block_timestamp(main_chain_start_offset), m_db->get_block_cumulative_difficulty(main_chain_start_offset));
 
-		// make sure we haven't accidentally grabbed too many blocks...maybe don't need this check?
-		CHECK_AND_ASSERT_MES((alt_chain.size() + timestamps.size()) <= block_count, false, "Internal error, alt_chain.size()[" << alt_chain.size()
-																															   << "] + vtimestampsec.size()[" << timestamps.size() << "] NOT <= DIFFICULTY_WINDOW[]" << block_count);
+			// make sure we haven't accidentally grabbed too many blocks...maybe don't need this check?
+			CHECK_AND_ASSERT_MES((alt_chain.size() + window.size()) <= block_count, false, "Internal error, alt_chain.size()[" << alt_chain.size()
+																															   << "] + window.size()[" << window.size() << "] NOT <= DIFFICULTY_WINDOW[]" << block_count);
+		}
 
 		for(auto it : alt_chain)
-		{
-			timestamps.push_back(it->second.bl.timestamp);
-			cumulative_difficulties.push_back(it->second.cumulative_difficulty);
-		}
+			window.push_back(it->second.bl.timestamp, it->second.cumulative_difficulty);
 	}
 	// if the alt chain is long enough for the difficulty calc, grab difficulties
 	// and timestamps from it alone
 	else
 	{
-		timestamps.resize(block_count);
-		cumulative_difficulties.resize(block_count);
-		size_t count = 0;
-		size_t max_i = timestamps.size() - 1;
 		// get difficulties and timestamps from most recent blocks in alt chain
-		for(auto it : boost::adaptors::reverse(alt_chain))
-		{
-			timestamps[max_i - count] = it->second.bl.timestamp;
-			cumulative_difficulties[max_i - count] = it->second.cumulative_difficulty;
-			count++;
-			if(count >= block_count)
-				break;
-		}
+		auto it = alt_chain.end();
+		std::advance(it, -static_cast<ptrdiff_t>(block_count));
+		for(; it != alt_chain.end(); ++it)
+			window.push_back((*it)->second.bl.timestamp, (*it)->second.cumulative_difficulty);
 	}
 
-	return next_difficulty_v1(timestamps, cumulative_difficulties, common_config::DIFFICULTY_TARGET);
+	return true;
 }
 //------------------------------------------------------------------
 // This function does a sanity check on basic things that all miner
@@ -1457,8 +1508,8 @@ bool Blockchain::complete_timestamps_vector(uint64_t start_top_height, std::vect
 bool Blockchain::handle_alternative_block(const block &b, const crypto::hash &id, block_verification_context &bvc)
 {
 	LOG_PRINT_L3("Blockchain::" << __func__);
+	TRACE_SCOPE(handle_alternative_block);
 	CRITICAL_REGION_LOCAL(m_blockchain_lock);
-	m_timestamps_and_difficulties_height = 0;
 	uint64_t block_height = get_block_height(b);
 	if(0 == block_height)
 	{
@@ -1496,17 +1547,22 @@ bool Blockchain::handle_alternative_block(const block &b, const crypto::hash &id
 	{
 		//we have new block in alternative chain
 
+		// make sure inserting the new block below won't rehash and invalidate the iterators in alt_chain
+		m_alternative_chains.reserve(m_alternative_chains.size() + 1);
+
 		//build alternative subchain, front -> mainchain, back -> alternative head
 		blocks_ext_by_hash::iterator alt_it = it_prev; //m_alternative_chains.find()
 		std::list<blocks_ext_by_hash::iterator> alt_chain;
-		std::vector<uint64_t> timestamps;
 		while(alt_it != m_alternative_chains.end())
 		{
 			alt_chain.push_front(alt_it);
-			timestamps.push_back(alt_it->second.bl.timestamp);
 			alt_it = m_alternative_chains.find(alt_it->second.bl.prev_id);
 		}
 
+		// FIXME: consider moving away from block_extended_info at some point
+		alt_block_extended_info bei = boost::value_initialized<alt_block_extended_info>();
+		bei.bl = b;
+
 		// if block to be added connects to known blocks that aren't part of the
 		// main chain -- that is, if we're adding on to an alternate chain
 		if(alt_chain.size())
@@ -1525,7 +1581,11 @@ bool Blockchain::handle_alternative_block(const block &b, const crypto::hash &id
 			// make sure block connects correctly to the main chain
 			auto h = m_db->get_block_hash_from_height(alt_chain.front()->second.height - 1);
 			CHECK_AND_ASSERT_MES(h == alt_chain.front()->second.bl.prev_id, false, "alternative chain has wrong connection to main chain");
-			complete_timestamps_vector(m_db->get_block_height(alt_chain.front()->second.bl.prev_id), timestamps);
+
+			// the parent caches the windows of its branch
+			bei.height = it_prev->second.height + 1;
+			bei.timestamps = it_prev->second.timestamps;
+			bei.difficulty = it_prev->second.difficulty;
 		}
 		// if block not associated with known alternate chain
 		else
@@ -1534,11 +1594,16 @@ bool Blockchain::handle_alternative_block(const block &b, const crypto::hash &id
 			// we ignore it
 			CHECK_AND_ASSERT_MES(parent_in_main, false, "internal error: broken imperative condition: parent_in_main");
 
-			complete_timestamps_vector(m_db->get_block_height(b.prev_id), timestamps);
+			uint64_t parent_height = m_db->get_block_height(b.prev_id);
+			bei.height = parent_height + 1;
+			complete_timestamps_vector(parent_height, bei.timestamps);
+			std::reverse(bei.timestamps.begin(), bei.timestamps.end());
+			CHECK_AND_ASSERT_MES(get_alternative_chain_difficulty_window(alt_chain, bei, bei.difficulty), false, "Failed to get difficulty window for alternative block");
 		}
 
 		// verify that the block's timestamp is within the acceptable range
 		// (not earlier than the median of the last X blocks)
+		std::vector<uint64_t> timestamps = bei.timestamps;
 		if(!check_block_timestamp(timestamps, b))
 		{
 			MERROR_VER("Block with id: " << id << std::endl
@@ -1547,11 +1612,6 @@ bool Blockchain::handle_alternative_block(const block &b, const crypto::hash &id
 			return false;
 		}
 
-		// FIXME: consider moving away from block_extended_info at some point
-		block_extended_info bei = boost::value_initialized<block_extended_info>();
-		bei.bl = b;
-		bei.height = alt_chain.size() ? it_prev->second.height + 1 : m_db->get_block_height(b.prev_id) + 1;
-
 		bool is_a_checkpoint;
 		if(!m_checkpoints.check_block(bei.height, id, is_a_checkpoint))
 		{
@@ -1561,7 +1621,7 @@ bool Blockchain::handle_alternative_block(const block &b, const crypto::hash &id
 		}
 
 		// Check the block's hash against the difficulty target for its alt chain
-		difficulty_type current_diff = get_next_difficulty_for_alternative_chain(alt_chain, bei);
+		difficulty_type current_diff = next_difficulty_v1(bei.difficulty, common_config::DIFFICULTY_TARGET);
 		CHECK_AND_ASSERT_MES(current_diff, false, "!!!!!!! DIFFICULTY OVERHEAD !!!!!!!");
 		crypto::hash proof_of_work = null_hash;
 		get_block_longhash(m_nettype, bei.bl, m_pow_ctx, proof_of_work);
@@ -1596,17 +1656,27 @@ bool Blockchain::handle_alternative_block(const block &b, const crypto::hash &id
 		}
 		bei.cumulative_difficulty += current_diff;
 
+		// move the branch windows forward to include this block
+		bei.difficulty.push_back(b.timestamp, bei.cumulative_difficulty);
+		bei.timestamps.push_back(b.timestamp);
+		if(bei.timestamps.size() > common_config::BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW_V2)
+			bei.timestamps.erase(bei.timestamps.begin());
+		bei.children = 0;
+
 		// add block to alternate blocks storage,
 		// as well as the current "alt chain" container
-		auto i_res = m_alternative_chains.insert(blocks_ext_by_hash::value_type(id, bei));
+		auto i_res = m_alternative_chains.insert(blocks_ext_by_hash::value_type(id, std::move(bei)));
 		CHECK_AND_ASSERT_MES(i_res.second, false, "insertion of new alternative block returned as it already exist");
+		if(alt_chain.size())
+			++alt_chain.back()->second.children;
 		alt_chain.push_back(i_res.first);
+		const alt_block_extended_info &new_bei = i_res.first->second;
 
 		// FIXME: is it even possible for a checkpoint to show up not on the main chain?
 		if(is_a_checkpoint)
 		{
 			//do reorganize!
-			MGINFO_GREEN("###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_db->height() - 1 << ", checkpoint is found in alternative chain on height " << bei.height);
+			MGINFO_GREEN("###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_db->height() - 1 << ", checkpoint is found in alternative chain on height " << new_bei.height);
 
 			bool r = switch_to_alternative_blockchain(alt_chain, true);
 
@@ -1617,11 +1687,11 @@ bool Blockchain::handle_alternative_block(const block &b, const crypto::hash &id
 
 			return r;
 		}
-		else if(main_chain_cumulative_difficulty < bei.cumulative_difficulty) //check if difficulty bigger then in main chain
+		else if(main_chain_cumulative_difficulty < new_bei.cumulative_difficulty) //check if difficulty bigger then in main chain
 		{
 			//do reorganize!
 			MGINFO_GREEN("###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_db->height() - 1 << " with cum_difficulty " << m_db->get_block_cumulative_difficulty(m_db->height() - 1) << std::endl
-														 << " alternative blockchain size: " << alt_chain.size() << " with cum_difficulty " << bei.cumulative_difficulty);
+														 << " alternative blockchain size: " << alt_chain.size() << " with cum_difficulty " << new_bei.cumulative_difficulty);
 
 			bool r = switch_to_alternative_blockchain(alt_chain, false);
 			if(r)
@@ -1632,7 +1702,7 @@ bool Blockchain::handle_alternative_block(const block &b, const crypto::hash &id
 		}
 		else
 		{
-			MGINFO_BLUE("----- BLOCK ADDED AS ALTERNATIVE ON HEIGHT " << bei.height << std::endl
+			MGINFO_BLUE("----- BLOCK ADDED AS ALTERNATIVE ON HEIGHT " << new_bei.height << std::endl
 																	  << "id:\t" << id << std::endl
 																	  << "PoW:\t" << proof_of_work << std::endl
 																	  << "difficulty:\t" << current_diff);
@@ -1769,6 +1839,139 @@ size_t Blockchain::get_alternative_blocks_count() const
 	return m_alternative_chains.size();
 }
 //------------------------------------------------------------------
+void Blockchain::erase_alternative_block(blocks_ext_by_hash::iterator it)
+{
+	auto parent = m_alternative_chains.find(it->second.bl.prev_id);
+	if(parent != m_alternative_chains.end() && parent->second.children > 0)
+		--parent->second.children;
+	m_alternative_chains.erase(it);
+}
+//------------------------------------------------------------------
+void Blockchain::count_alternative_children()
+{
+	for(auto &alt_bl : m_alternative_chains)
+		alt_bl.second.children = 0;
+	for(const auto &alt_bl : m_alternative_chains)
+	{
+		auto parent = m_alternative_chains.find(alt_bl.second.bl.prev_id);
+		if(parent != m_alternative_chains.end())
+			++parent->second.children;
+	}
+}
+//------------------------------------------------------------------
+// Once the alternative block store is over its cap, branches are trimmed
+// from their tips, lowest cumulative difficulty first, down to 90% of the cap
+// so that a spam of alt blocks doesn't cause a full scan on every block.
+void Blockchain::prune_alternative_blocks()
+{
+	LOG_PRINT_L3("Blockchain::" << __func__);
+	CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+	if(m_alternative_chains.size() <= m_max_alt_blocks)
+		return;
+
+	const size_t target = m_max_alt_blocks - m_max_alt_blocks / 10;
+	typedef std::pair<difficulty_type, blocks_ext_by_hash::iterator> leaf_t;
+	auto cmp = [](const leaf_t &a, const leaf_t &b) { return a.first > b.first; };
+	std::priority_queue<leaf_t, std::vector<leaf_t>, decltype(cmp)> leaves(cmp);
+
+	for(auto it = m_alternative_chains.begin(); it != m_alternative_chains.end(); ++it)
+	{
+		if(it->second.children == 0)
+			leaves.push(leaf_t(it->second.cumulative_difficulty, it));
+	}
+
+	size_t evicted = 0;
+	while(m_alternative_chains.size() > target && !leaves.empty())
+	{
+		blocks_ext_by_hash::iterator leaf = leaves.top().second;
+		leaves.pop();
+
+		auto parent = m_alternative_chains.find(leaf->second.bl.prev_id);
+		erase_alternative_block(leaf);
+		++evicted;
+
+		if(parent != m_alternative_chains.end() && parent->second.children == 0)
+			leaves.push(leaf_t(parent->second.cumulative_difficulty, parent));
+	}
+
+	MINFO("Evicted " << evicted << " alternative blocks, " << m_alternative_chains.size() << " left");
+}
+//------------------------------------------------------------------
+namespace
+{
+struct alt_blocks_container
+{
+	std::vector<blobdata> blocks;
+
+	BEGIN_SERIALIZE_OBJECT()
+	FIELD(blocks)
+	END_SERIALIZE()
+};
+}
+//------------------------------------------------------------------
+bool Blockchain::store_alternative_blocks() const
+{
+	LOG_PRINT_L3("Blockchain::" << __func__);
+	if(m_alt_blocks_file.empty())
+		return true;
+
+	CRITICAL_REGION_LOCAL(m_blockchain_lock);
+	alt_blocks_container container;
+	container.blocks.reserve(m_alternative_chains.size());
+	for(const auto &alt_bl : m_alternative_chains)
+		container.blocks.push_back(block_to_blob(alt_bl.second.bl));
+
+	std::string blob;
+	if(!::serialization::dump_binary(container, blob) || !epee::file_io_utils::save_string_to_file(m_alt_blocks_file, blob))
+	{
+		MERROR("Failed to store alternative blocks to " << m_alt_blocks_file);
+		return false;
+	}
+
+	MINFO("Stored " << container.blocks.size() << " alternative blocks");
+	return true;
+}
+//------------------------------------------------------------------
+// The stored blocks are re-added through the regular alt block path, parents
+// first, which re-validates them and rebuilds the cached branch windows.
+bool Blockchain::load_alternative_blocks()
+{
+	LOG_PRINT_L3("Blockchain::" << __func__);
+	if(m_alt_blocks_file.empty() || m_db->is_read_only() || !boost::filesystem::exists(m_alt_blocks_file))
+		return true;
+
+	std::string blob;
+	alt_blocks_container container;
+	if(!epee::file_io_utils::load_file_to_string(m_alt_blocks_file, blob) || !::serialization::parse_binary(blob, container))
+	{
+		MERROR("Failed to load alternative blocks from " << m_alt_blocks_file);
+		return false;
+	}
+
+	std::vector<std::pair<uint64_t, block>> blocks;
+	blocks.reserve(container.blocks.size());
+	for(const auto &bl_blob : container.blocks)
+	{
+		block bl;
+		if(!parse_and_validate_block_from_blob(bl_blob, bl))
+			continue;
+		blocks.push_back(std::make_pair(get_block_height(bl), std::move(bl)));
+	}
+	std::sort(blocks.begin(), blocks.end(), [](const std::pair<uint64_t, block> &a, const std::pair<uint64_t, block> &b) { return a.first < b.first; });
+
+	size_t added = 0;
+	for(const auto &e : blocks)
+	{
+		block_verification_context bvc = boost::value_initialized<block_verification_context>();
+		if(add_new_block(e.second, bvc) && !bvc.m_verifivation_failed && !bvc.m_already_exists)
+			++added;
+	}
+
+	MINFO("Loaded " << added << " of " << blocks.size() << " stored alternative blocks");
+	return true;
+}
+//------------------------------------------------------------------
 // This function adds the output specified by <amount, i> to the result_outs container
 // unlocked and other such checks should be done by here.
 void Blockchain::add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount &result_outs, uint64_t amount, size_t i) const
@@ -2343,8 +2546,14 @@ bool Blockchain::add_block_as_invalid(const block_extended_info &bei, const cryp
 {
 	LOG_PRINT_L3("Blockchain::" << __func__);
 	CRITICAL_REGION_LOCAL(m_blockchain_lock);
-	auto i_res = m_invalid_blocks.insert(std::map<crypto::hash, block_extended_info>::value_type(h, bei));
+	auto i_res = m_invalid_blocks.insert(h);
 	CHECK_AND_ASSERT_MES(i_res.second, false, "at insertion invalid by tx returned status existed");
+	m_invalid_blocks_order.push_back(h);
+	while(m_invalid_blocks_order.size() > BLOCKCHAIN_MAX_INVALID_BLOCKS)
+	{
+		m_invalid_blocks.erase(m_invalid_blocks_order.front());
+		m_invalid_blocks_order.pop_front();
+	}
 	MINFO("BLOCK ADDED AS INVALID: " << h << std::endl
 									 << ", prev_id=" << bei.bl.prev_id << ", m_invalid_blocks count=" << m_invalid_blocks.size());
 	return true;
@@ -2686,6 +2895,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 bool Blockchain::check_tx_inputs(transaction &tx, tx_verification_context &tvc, uint64_t *pmax_used_block_height)
 {
 	PERF_TIMER(check_tx_inputs);
+	tools::metrics::scoped_timer metric_timer(metric_check_tx_inputs);
 	LOG_PRINT_L3("Blockchain::" << __func__);
 	size_t sig_index = 0;
 	if(pmax_used_block_height)
@@ -3273,10 +3483,12 @@ bool Blockchain::flush_txes_from_pool(const std::list<crypto::hash> &txids)
 bool Blockchain::handle_block_to_main_chain(const block &bl, const crypto::hash &id, block_verification_context &bvc)
 {
 	LOG_PRINT_L3("Blockchain::" << __func__);
+	TRACE_SCOPE(handle_block_to_main_chain);
 
 	TIME_MEASURE_START(block_processing_time);
 	CRITICAL_REGION_LOCAL(m_blockchain_lock);
 	TIME_MEASURE_START(t1);
+	tools::metrics::stage_timer stages;
 
 	static bool seen_future_version = false;
 
@@ -3314,6 +3526,7 @@ bool Blockchain::handle_block_to_main_chain(const block &bl, const crypto::hash
 	}
 
 	TIME_MEASURE_FINISH(t1);
+	stages.lap(metric_block_header);
 	TIME_MEASURE_START(t2);
 
 	// make sure block timestamp is not less than the median timestamp
@@ -3327,6 +3540,7 @@ bool Blockchain::handle_block_to_main_chain(const block &bl, const crypto::hash
 	}
 
 	TIME_MEASURE_FINISH(t2);
+	stages.lap(metric_block_timestamp);
 	//check proof of work
 	TIME_MEASURE_START(target_calculating_time);
 
@@ -3339,6 +3553,7 @@ bool Blockchain::handle_block_to_main_chain(const block &bl, const crypto::hash
 	CHECK_AND_ASSERT_MES(current_diffic, false, "!!!!!!!!! difficulty overhead !!!!!!!!!");
 
 	TIME_MEASURE_FINISH(target_calculating_time);
+	stages.lap(metric_block_difficulty);
 
 	TIME_MEASURE_START(longhash_calculating_time);
 
@@ -3415,6 +3630,7 @@ bool Blockchain::handle_block_to_main_chain(const block &bl, const crypto::hash
 	TIME_MEASURE_FINISH(longhash_calculating_time);
 	if(precomputed)
 		longhash_calculating_time += m_fake_pow_calc_time;
+	stages.lap(metric_block_pow);
 
 	TIME_MEASURE_START(t3);
 
@@ -3542,6 +3758,7 @@ bool Blockchain::handle_block_to_main_chain(const block &bl, const crypto::hash
 	}
 
 	m_blocks_txs_check.clear();
+	stages.lap(metric_block_txs);
 
 	TIME_MEASURE_START(vmt);
 	uint64_t base_reward = 0;
@@ -3556,6 +3773,7 @@ bool Blockchain::handle_block_to_main_chain(const block &bl, const crypto::hash
 	}
 
 	TIME_MEASURE_FINISH(vmt);
+	stages.lap(metric_block_miner_tx);
 	size_t block_size;
 	difficulty_type cumulative_difficulty;
 
@@ -3576,12 +3794,14 @@ bool Blockchain::handle_block_to_main_chain(const block &bl, const crypto::hash
 
 	m_db->block_txn_stop();
 	TIME_MEASURE_START(addblock);
+	stages.restart();
 	uint64_t new_height = 0;
 	if(!bvc.m_verifivation_failed)
 	{
 		try
 		{
 			new_height = m_db->add_block(bl, block_size, cumulative_difficulty, already_generated_coins, txs);
+			update_difficulty_window_on_add(bl.timestamp, cumulative_difficulty, new_height);
 		}
 		catch(const KEY_IMAGE_EXISTS &e)
 		{
@@ -3604,6 +3824,7 @@ bool Blockchain::handle_block_to_main_chain(const block &bl, const crypto::hash
 	}
 
 	TIME_MEASURE_FINISH(addblock);
+	stages.lap(metric_block_db_add);
 
 	// do this after updating the hard fork state since the size limit may change due to fork
 	update_next_cumulative_size_limit();
@@ -3651,6 +3872,7 @@ bool Blockchain::update_next_cumulative_size_limit()
 bool Blockchain::add_new_block(const block &bl_, block_verification_context &bvc)
 {
 	LOG_PRINT_L3("Blockchain::" << __func__);
+	TRACE_SCOPE(add_new_block);
 	//copy block here to let modify block.target
 	block bl = bl_;
 	crypto::hash id = get_block_hash(bl);
@@ -3674,6 +3896,7 @@ bool Blockchain::add_new_block(const block &bl_, block_verification_context &bvc
 		m_db->block_txn_stop();
 		bool r = handle_alternative_block(bl, id, bvc);
 		m_blocks_txs_check.clear();
+		prune_alternative_blocks();
 		return r;
 		//never relay alternative blocks
 	}
@@ -3764,6 +3987,7 @@ void Blockchain::set_enforce_dns_checkpoints(bool enforce_checkpoints)
 //------------------------------------------------------------------
 void Blockchain::block_longhash_worker(cn_pow_hash_v2 &hash_ctx, const std::vector<block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map)
 {
+	TRACE_SCOPE_ARG(block_longhash_worker, blocks.size());
 	TIME_MEASURE_START(t);
 
 	for(const auto &block : blocks)
@@ -3782,6 +4006,7 @@ void Blockchain::block_longhash_worker(cn_pow_hash_v2 &hash_ctx, const std::vect
 //------------------------------------------------------------------
 bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 {
+	TRACE_SCOPE(cleanup_handle_incoming_blocks);
 	bool success = false;
 
 	MTRACE("Blockchain::" << __func__);
@@ -3848,6 +4073,7 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 //FIXME: unused parameter txs
 void Blockchain::output_scan_worker(const uint64_t amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, std::unordered_map<crypto::hash, cryptonote::transaction> &txs) const
 {
+	TRACE_SCOPE_ARG(output_scan_worker, offsets.size());
 	try
 	{
 		m_db->get_output_key(amount, offsets, outputs, true);
@@ -3967,6 +4193,7 @@ uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::list<c
 bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_entry> &blocks_entry)
 {
 	MTRACE("Blockchain::" << __func__);
+	TRACE_SCOPE_ARG(prepare_handle_incoming_blocks, blocks_entry.size());
 	TIME_MEASURE_START(prepare);
 	bool stop_batch;
 	uint64_t bytes = 0;
@@ -4308,7 +4535,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
 	return true;
 }
 
-void Blockchain::add_txpool_tx(transaction &tx, const txpool_tx_meta_t &meta)
+void Blockchain::add_txpool_tx(const transaction &tx, const txpool_tx_meta_t &meta)
 {
 	m_db->add_txpool_tx(tx, meta);
 }
@@ -4361,6 +4588,12 @@ void Blockchain::set_user_options(uint64_t maxthreads, uint64_t blocks_per_sync,
 	m_max_prepare_blocks_threads = maxthreads;
 }
 
+void Blockchain::set_alt_blocks_options(size_t max_alt_blocks, const std::string &alt_blocks_file)
+{
+	m_max_alt_blocks = max_alt_blocks;
+	m_alt_blocks_file = alt_blocks_file;
+}
+
 void Blockchain::safesyncmode(const bool onoff)
 {
 	/* all of this is no-op'd if the user set a specific
@@ -29,6 +29,7 @@
 #include <boost/serialization/list.hpp>
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/version.hpp>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -91,6 +92,20 @@ class Blockchain
 		uint64_t already_generated_coins;	  //!< the total coins minted after that block
 	};
 
+	/**
+     * @brief an alternative chain block, with the state needed to extend its branch
+     *
+     * The difficulty and timestamp windows are those of the branch ending with
+     * this block, so a child block can be validated without walking back to
+     * the main chain.
+     */
+	struct alt_block_extended_info : public block_extended_info
+	{
+		difficulty_window difficulty;	  //!< difficulty window ending with this block
+		std::vector<uint64_t> timestamps; //!< the last BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW timestamps ending with this block, oldest first
+		size_t children;				  //!< number of alternative blocks built on top of this one
+	};
+
 	/**
      * @brief Blockchain constructor
      *
@@ -708,6 +723,26 @@ class Blockchain
 	void set_user_options(uint64_t maxthreads, uint64_t blocks_per_sync,
 						  blockchain_db_sync_mode sync_mode, bool fast_sync);
 
+	/**
+     * @brief sets the alternative block store options
+     *
+     * @param max_alt_blocks max number of alternative blocks kept in memory,
+     *        lowest work branches are evicted first
+     * @param alt_blocks_file file to keep the alternative blocks in across
+     *        restarts, empty to not persist them
+     */
+	void set_alt_blocks_options(size_t max_alt_blocks, const std::string &alt_blocks_file);
+
+	/**
+     * @brief re-adds the alternative blocks saved in the alt blocks file, if set
+     *
+     * They may cause a reorg, which hands transactions back to the pool, so
+     * this is called once both are initialized.
+     *
+     * @return false if the file could not be read
+     */
+	bool load_alternative_blocks();
+
 	/**
      * @brief Put DB in safe sync mode
      */
@@ -912,7 +947,7 @@ class Blockchain
      */
 	std::list<std::pair<block_extended_info, uint64_t>> get_alternative_chains() const;
 
-	void add_txpool_tx(transaction &tx, const txpool_tx_meta_t &meta);
+	void add_txpool_tx(const transaction &tx, const txpool_tx_meta_t &meta);
 	void update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta);
 	void remove_txpool_tx(const crypto::hash &txid);
 	uint64_t get_txpool_tx_count(bool include_unrelayed_txes = true) const;
@@ -948,7 +983,7 @@ class Blockchain
 
 	typedef std::vector<block_extended_info> blocks_container;
 
-	typedef std::unordered_map<crypto::hash, block_extended_info> blocks_ext_by_hash;
+	typedef std::unordered_map<crypto::hash, alt_block_extended_info> blocks_ext_by_hash;
 
 	typedef std::unordered_map<crypto::hash, block> blocks_by_hash;
 
@@ -989,19 +1024,22 @@ class Blockchain
 	uint64_t m_fake_pow_calc_time;
 	uint64_t m_fake_scan_time;
 	uint64_t m_sync_counter;
-	std::vector<uint64_t> m_timestamps;
-	std::vector<difficulty_type> m_difficulties;
-	uint64_t m_timestamps_and_difficulties_height;
+	// difficulty window of the main chain, valid for the chain height m_difficulty_window_height (0 if invalid)
+	difficulty_window m_difficulty_window;
+	uint64_t m_difficulty_window_height;
 
 	boost::asio::io_service m_async_service;
 	boost::thread_group m_async_pool;
 	std::unique_ptr<boost::asio::io_service::work> m_async_work_idle;
 
 	// all alternative chains
-	blocks_ext_by_hash m_alternative_chains; // crypto::hash -> block_extended_info
+	blocks_ext_by_hash m_alternative_chains; // crypto::hash -> alt_block_extended_info
+	size_t m_max_alt_blocks;
+	std::string m_alt_blocks_file;
 
-	// some invalid blocks
-	blocks_ext_by_hash m_invalid_blocks; // crypto::hash -> block_extended_info
+	// some invalid blocks, oldest are forgotten first
+	std::unordered_set<crypto::hash> m_invalid_blocks;
+	std::deque<crypto::hash> m_invalid_blocks_order;
 
 	cn_pow_hash_v2 m_pow_ctx;
 	std::vector<cn_pow_hash_v2> m_hash_ctxes_multi;
@@ -1333,6 +1371,65 @@ class Blockchain
      */
 	bool complete_timestamps_vector(uint64_t start_height, std::vector<uint64_t> &timestamps);
 
+	/**
+     * @brief rebuilds the main chain difficulty window from the database
+     *
+     * Loads the DIFFICULTY_BLOCKS_COUNT_V2 blocks (or less) below the current
+     * blockchain height, ignoring the genesis block.
+     */
+	void load_difficulty_window();
+
+	/**
+     * @brief moves the main chain difficulty window forward after a block was added
+     *
+     * @param timestamp the added block's timestamp
+     * @param cumulative_difficulty the added block's cumulative difficulty
+     * @param new_height the blockchain height after the block was added
+     */
+	void update_difficulty_window_on_add(uint64_t timestamp, difficulty_type cumulative_difficulty, uint64_t new_height);
+
+	/**
+     * @brief moves the main chain difficulty window back after the top block was popped
+     *
+     * Costs at most one database read, for the block that re-enters the window
+     * at its old end.
+     */
+	void update_difficulty_window_on_pop();
+
+	/**
+     * @brief builds the difficulty window for a block on an alternate chain
+     *
+     * @param alt_chain the chain to be added to
+     * @param bei the block being added (and metadata, see ::block_extended_info)
+     *
+     * @param window return-by-reference the window of the blocks preceding bei
+     *
+     * @return false on internal error, otherwise true
+     */
+	bool get_alternative_chain_difficulty_window(const std::list<blocks_ext_by_hash::iterator> &alt_chain, const block_extended_info &bei, difficulty_window &window) const;
+
+	/**
+     * @brief removes a block from the alternative block store, keeping the parent's child count
+     *
+     * @param it the block to remove
+     */
+	void erase_alternative_block(blocks_ext_by_hash::iterator it);
+
+	/**
+     * @brief recomputes the child count of every alternative block
+     */
+	void count_alternative_children();
+
+	/**
+     * @brief evicts the lowest work alternative branches, leaves first, once the store exceeds its cap
+     */
+	void prune_alternative_blocks();
+
+	/**
+     * @brief saves the alternative blocks to m_alt_blocks_file, if set
+     */
+	bool store_alternative_blocks() const;
+
 	/**
      * @brief calculate the block size limit for the next block to be added
      *
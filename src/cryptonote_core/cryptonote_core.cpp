@@ -26,11 +26,13 @@
 using namespace epee;
 
 #include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/blockchain_snapshot.h"
 #include "checkpoints/checkpoints.h"
 #include "common/command_line.h"
 #include "common/command_line.h"
 #include "common/download.h"
 #include "common/threadpool.h"
+#include "common/trace.h"
 #include "common/updates.h"
 #include "common/util.h"
 #include "crypto/crypto.h"
@@ -54,6 +56,7 @@ DISABLE_VS_WARNINGS(4355)
 #define MERROR_VER(x) MCERROR("verify", x)
 
 #define BAD_SEMANTICS_TXES_MAX_SIZE 100
+#define SEEN_TX_BLOBS_MAX_SIZE 16384
 
 namespace cryptonote
 {
@@ -97,6 +100,14 @@ static const command_line::arg_descriptor<bool> arg_no_fluffy_blocks = {
 	"no-fluffy-blocks", "Relay blocks as normal blocks", false};
 static const command_line::arg_descriptor<size_t> arg_max_txpool_size = {
 	"max-txpool-size", "Set maximum txpool size in bytes.", DEFAULT_TXPOOL_MAX_SIZE};
+static const command_line::arg_descriptor<size_t> arg_max_alt_blocks = {
+	"max-alt-blocks", "Set maximum number of alternative chain blocks kept in memory, lowest work branches are evicted first.", BLOCKCHAIN_DEFAULT_MAX_ALT_BLOCKS};
+static const command_line::arg_descriptor<bool> arg_keep_alt_blocks = {
+	"keep-alt-blocks", "Keep alternative chain blocks across restarts", false};
+static const command_line::arg_descriptor<std::string> arg_snapshot_file = {
+	"snapshot-file", "Start from a blockchain snapshot made by ryo-blockchain-snapshot, if there is no blockchain yet", ""};
+static const command_line::arg_descriptor<std::string> arg_snapshot_commitment = {
+	"snapshot-commitment", "State commitment published with the snapshot, which it must match, needed unless the snapshot's is compiled in", ""};
 
 //-----------------------------------------------------------------------------------------------
 core::core(i_cryptonote_protocol *pprotocol) : m_mempool(m_blockchain_storage),
@@ -205,6 +216,10 @@ void core::init_options(boost::program_options::options_description &desc)
 	command_line::add_arg(desc, arg_offline);
 	command_line::add_arg(desc, arg_disable_dns_checkpoints);
 	command_line::add_arg(desc, arg_max_txpool_size);
+	command_line::add_arg(desc, arg_max_alt_blocks);
+	command_line::add_arg(desc, arg_keep_alt_blocks);
+	command_line::add_arg(desc, arg_snapshot_file);
+	command_line::add_arg(desc, arg_snapshot_commitment);
 
 	miner::init_options(desc);
 	BlockchainDB::init_options(desc);
@@ -355,6 +370,55 @@ bool core::init(const boost::program_options::variables_map &vm, const char *con
 	blockchain_db_sync_mode sync_mode = db_defaultsync;
 	uint64_t blocks_per_sync = 1;
 
+	// start from a snapshot if we have no blockchain yet
+	const std::string snapshot_file = command_line::get_arg(vm, arg_snapshot_file);
+	blockchain_snapshot_header snapshot_header;
+	bool snapshot_loaded = false;
+	if(!snapshot_file.empty() && !boost::filesystem::exists(folder / BLOCKCHAIN_SNAPSHOT_DATA_FILENAME))
+	{
+		MGINFO("Loading blockchain snapshot from " << snapshot_file << " ...");
+		if(!read_blockchain_snapshot_header(snapshot_file, snapshot_header))
+			return false;
+		if(snapshot_header.nettype != m_nettype || db->get_db_name() != snapshot_header.db_name)
+		{
+			LOG_ERROR("Snapshot is for another network or database type");
+			return false;
+		}
+		checkpoints default_checkpoints;
+		default_checkpoints.init_default_checkpoints(m_nettype);
+		const auto checkpoint = default_checkpoints.get_points().find(snapshot_header.height);
+		if(checkpoint == default_checkpoints.get_points().end() || checkpoint->second != snapshot_header.top_hash)
+		{
+			LOG_ERROR("Snapshot top block " << snapshot_header.height << " " << snapshot_header.top_hash << " is not a checkpoint");
+			return false;
+		}
+		// the checkpoint only covers the top block, the tables are covered by the commitment,
+		// which has to come from somewhere other than the snapshot itself
+		const std::string snapshot_commitment = command_line::get_arg(vm, arg_snapshot_commitment);
+		crypto::hash commitment;
+		if(snapshot_commitment.empty())
+		{
+			if(!get_trusted_snapshot_commitment(m_nettype, snapshot_header.height, commitment))
+			{
+				LOG_ERROR("There is no known commitment for a snapshot at height " << snapshot_header.height << ", pass the published one with --" << arg_snapshot_commitment.name);
+				return false;
+			}
+		}
+		else if(!epee::string_tools::hex_to_pod(snapshot_commitment, commitment))
+		{
+			LOG_ERROR("Invalid --" << arg_snapshot_commitment.name << " " << snapshot_commitment);
+			return false;
+		}
+		if(commitment != snapshot_header.commitment)
+		{
+			LOG_ERROR("Snapshot commitment " << snapshot_header.commitment << " does not match " << commitment);
+			return false;
+		}
+		if(!extract_blockchain_snapshot(snapshot_file, filename, snapshot_header))
+			return false;
+		snapshot_loaded = true;
+	}
+
 	try
 	{
 		uint64_t db_flags = 0;
@@ -419,9 +483,23 @@ bool core::init(const boost::program_options::variables_map &vm, const char *con
 		if(db_salvage)
 			db_flags |= DBF_SALVAGE;
 
+		db->set_map_size(command_line::get_arg(vm, cryptonote::arg_db_mapsize) << 20);
 		db->open(filename, db_flags);
 		if(!db->m_open)
 			return false;
+
+		if(snapshot_loaded)
+		{
+			MGINFO("Verifying blockchain snapshot, this reads the whole database ...");
+			if(!check_blockchain_snapshot(*db, snapshot_header))
+			{
+				LOG_ERROR("Blockchain snapshot failed verification, removing it");
+				db->close();
+				boost::filesystem::remove(folder / BLOCKCHAIN_SNAPSHOT_DATA_FILENAME);
+				return false;
+			}
+			MGINFO("Blockchain snapshot verified at height " << snapshot_header.height << ", syncing the rest from the network");
+		}
 	}
 	catch(const DB_ERROR &e)
 	{
@@ -431,6 +509,8 @@ bool core::init(const boost::program_options::variables_map &vm, const char *con
 
 	m_blockchain_storage.set_user_options(blocks_threads,
 										  blocks_per_sync, sync_mode, fast_sync);
+	m_blockchain_storage.set_alt_blocks_options(command_line::get_arg(vm, arg_max_alt_blocks),
+												command_line::get_arg(vm, arg_keep_alt_blocks) ? (folder / CRYPTONOTE_ALT_BLOCKS_FILENAME).string() : std::string());
 
 	r = m_blockchain_storage.init(db.release(), m_nettype, m_offline, test_options);
 
@@ -441,6 +521,8 @@ bool core::init(const boost::program_options::variables_map &vm, const char *con
 	// transactions in the pool that do not conform to the current fork
 	m_mempool.validate();
 
+	m_blockchain_storage.load_alternative_blocks();
+
 	bool show_time_stats = command_line::get_arg(vm, arg_show_time_stats) != 0;
 	m_blockchain_storage.set_show_time_stats(show_time_stats);
 	CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
@@ -607,6 +689,7 @@ bool core::handle_incoming_tx_post(const blobdata &tx_blob, tx_verification_cont
 bool core::handle_incoming_txs(const std::list<blobdata> &tx_blobs, std::vector<tx_verification_context> &tvc, bool keeped_by_block, bool relayed, bool do_not_relay)
 {
 	TRY_ENTRY();
+	TRACE_SCOPE_ARG(handle_incoming_txs, tx_blobs.size());
 
 	struct result
 	{
@@ -616,15 +699,33 @@ bool core::handle_incoming_txs(const std::list<blobdata> &tx_blobs, std::vector<
 		crypto::hash prefix_hash;
 		bool in_txpool;
 		bool in_blockchain;
+		crypto::hash blob_hash;
+		bool seen;
 	};
 	std::vector<result> results(tx_blobs.size());
 
+	// txs relayed to us by several peers are only parsed once, later copies are dropped by blob hash
+	const bool check_seen = relayed && !keeped_by_block;
+
 	tvc.resize(tx_blobs.size());
 	tools::threadpool::waiter waiter;
 	std::list<blobdata>::const_iterator it = tx_blobs.begin();
 	for(size_t i = 0; i < tx_blobs.size(); i++, ++it)
 	{
 		m_threadpool.submit(&waiter, [&, i, it] {
+			results[i].seen = false;
+			if(check_seen)
+			{
+				results[i].blob_hash = get_blob_hash(*it);
+				boost::lock_guard<boost::mutex> lock(seen_tx_blobs_lock);
+				if(seen_tx_blobs[0].count(results[i].blob_hash) || seen_tx_blobs[1].count(results[i].blob_hash))
+				{
+					results[i].seen = true;
+					results[i].res = false;
+					return;
+				}
+			}
+			TRACE_SCOPE(handle_incoming_tx_pre);
 			try
 			{
 				results[i].res = handle_incoming_tx_pre(*it, tvc[i], results[i].tx, results[i].hash, results[i].prefix_hash, keeped_by_block, relayed, do_not_relay);
@@ -653,6 +754,7 @@ bool core::handle_incoming_txs(const std::list<blobdata> &tx_blobs, std::vector<
 		else
 		{
 			m_threadpool.submit(&waiter, [&, i, it] {
+				TRACE_SCOPE(handle_incoming_tx_post);
 				try
 				{
 					results[i].res = handle_incoming_tx_post(*it, tvc[i], results[i].tx, results[i].hash, results[i].prefix_hash, keeped_by_block, relayed, do_not_relay);
@@ -667,10 +769,16 @@ bool core::handle_incoming_txs(const std::list<blobdata> &tx_blobs, std::vector<
 	}
 	waiter.wait();
 
+	TRACE_SCOPE(add_new_txs);
 	bool ok = true;
 	it = tx_blobs.begin();
 	for(size_t i = 0; i < tx_blobs.size(); i++, ++it)
 	{
+		if(results[i].seen)
+		{
+			LOG_PRINT_L2("tx blob " << results[i].blob_hash << " already seen, skipped");
+			continue;
+		}
 		if(!results[i].res)
 		{
 			ok = false;
@@ -687,6 +795,18 @@ bool core::handle_incoming_txs(const std::list<blobdata> &tx_blobs, std::vector<
 			MERROR_VER("Transaction verification impossible: " << results[i].hash);
 		}
 
+		else if(check_seen)
+		{
+			seen_tx_blobs_lock.lock();
+			seen_tx_blobs[0].insert(results[i].blob_hash);
+			if(seen_tx_blobs[0].size() >= SEEN_TX_BLOBS_MAX_SIZE)
+			{
+				std::swap(seen_tx_blobs[0], seen_tx_blobs[1]);
+				seen_tx_blobs[0].clear();
+			}
+			seen_tx_blobs_lock.unlock();
+		}
+
 		if(tvc[i].m_added_to_pool)
 			MDEBUG("tx added: " << results[i].hash);
 	}
@@ -1123,6 +1243,7 @@ bool core::cleanup_handle_incoming_blocks(bool force_sync)
 bool core::handle_incoming_block(const blobdata &block_blob, block_verification_context &bvc, bool update_miner_blocktemplate)
 {
 	TRY_ENTRY();
+	TRACE_SCOPE(handle_incoming_block);
 
 	// load json & DNS checkpoints every 10min/hour respectively,
 	// and verify them with respect to what blocks we already have
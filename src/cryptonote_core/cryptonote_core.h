@@ -973,6 +973,9 @@ class core : public i_miner_handler
 	std::unordered_set<crypto::hash> bad_semantics_txes[2];
 	boost::mutex bad_semantics_txes_lock;
 
+	std::unordered_set<crypto::hash> seen_tx_blobs[2]; //!< blob hashes of relayed txs already handled, in two generations
+	boost::mutex seen_tx_blobs_lock;
+
 	tools::threadpool &m_threadpool;
 
 	enum
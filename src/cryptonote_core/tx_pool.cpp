@@ -28,6 +28,7 @@
 #include "blockchain_db/blockchain_db.h"
 #include "common/boost_serialization_helper.h"
 #include "common/int-util.h"
+#include "common/metrics.h"
 #include "common/perf_timer.h"
 #include "crypto/hash.h"
 #include "cryptonote_basic/cryptonote_boost_serialization.h"
@@ -71,6 +72,27 @@ uint64_t template_accept_threshold(uint64_t amount)
 	return amount * ACCEPT_THRESHOLD;
 }
 
+void erase_from_time_index(std::multimap<time_t, crypto::hash> &index, time_t t, const crypto::hash &id)
+{
+	const auto range = index.equal_range(t);
+	for(auto it = range.first; it != range.second; ++it)
+	{
+		if(it->second == id)
+		{
+			index.erase(it);
+			return;
+		}
+	}
+}
+
+void set_pool_metrics(size_t txs, size_t bytes)
+{
+	static tools::metrics::gauge &metric_txs = tools::metrics::get_gauge("ombre_txpool_transactions", "", "Transactions in the pool");
+	static tools::metrics::gauge &metric_bytes = tools::metrics::get_gauge("ombre_txpool_bytes", "", "Total blob size of the transactions in the pool");
+	metric_txs.set(txs);
+	metric_bytes.set(bytes);
+}
+
 // This class is meant to create a batch when none currently exists.
 // If a batch exists, it can't be from another thread, since we can
 // only be called with the txpool lock taken, and it is held during
@@ -103,17 +125,73 @@ class LockedTXN
 };
 }
 //---------------------------------------------------------------------------------
+constexpr size_t txpool_blob_arena::CHUNK_SIZE;
+//---------------------------------------------------------------------------------
+txpool_blob_arena::blob txpool_blob_arena::store(const char *data, size_t size)
+{
+	blob b;
+	if(size == 0)
+		return b;
+	std::shared_ptr<chunk> c;
+	if(size > CHUNK_SIZE / 4)
+	{
+		// big blobs get a chunk of their own, so they don't waste the current one
+		c = std::make_shared<chunk>();
+		c->capacity = size;
+	}
+	else
+	{
+		if(!m_current || m_current->capacity - m_current->used < size)
+		{
+			m_current = std::make_shared<chunk>();
+			m_current->capacity = CHUNK_SIZE;
+		}
+		c = m_current;
+	}
+	if(!c->data)
+	{
+		c->data.reset(new char[c->capacity]);
+		c->used = 0;
+		c->live = 0;
+	}
+	memcpy(c->data.get() + c->used, data, size);
+	b.m_chunk = c;
+	b.m_offset = c->used;
+	b.m_size = size;
+	c->used += size;
+	c->live += size;
+	m_live += size;
+	return b;
+}
 //---------------------------------------------------------------------------------
-tx_memory_pool::tx_memory_pool(Blockchain &bchs) : m_blockchain(bchs), m_txpool_max_size(DEFAULT_TXPOOL_MAX_SIZE), m_txpool_size(0)
+void txpool_blob_arena::release(const blob &b)
+{
+	if(!b.m_chunk)
+		return;
+	b.m_chunk->live -= b.m_size;
+	m_live -= b.m_size;
+}
+//---------------------------------------------------------------------------------
+bool txpool_blob_arena::is_fragmented(const blob &b) const
+{
+	if(!b.m_chunk || b.m_chunk == m_current)
+		return false;
+	return b.m_chunk->live * 4 < b.m_chunk->capacity;
+}
+//---------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------
+tx_memory_pool::tx_memory_pool(Blockchain &bchs) : m_pool_version(0), m_blockchain(bchs), m_txpool_max_size(DEFAULT_TXPOOL_MAX_SIZE), m_txpool_size(0)
 {
 }
 //---------------------------------------------------------------------------------
 bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_hash,*/ const crypto::hash &id, size_t blob_size, tx_verification_context &tvc, bool kept_by_block, bool relayed, bool do_not_relay)
 {
-	// this should already be called with that lock, but let's make it explicit for clarity
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-
+	// Validation below does not touch the pool's own state and runs without
+	// the pool lock, so readers and other writers are not held up by it. The
+	// lock is only taken to commit the transaction, once it is known good.
 	PERF_TIMER(add_tx);
+	static const tools::metrics::histogram &metric_add_tx = tools::metrics::get_histogram("ombre_txpool_add_tx_seconds", "", "Time to validate and add a transaction to the pool");
+	tools::metrics::scoped_timer metric_timer(metric_add_tx);
 	if(tx.version == 0)
 	{
 		// v0 never accepted
@@ -122,16 +200,6 @@ bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_has
 		return false;
 	}
 
-	// we do not accept transactions that timed out before, unless they're
-	// kept_by_block
-	if(!kept_by_block && m_timed_out_transactions.find(id) != m_timed_out_transactions.end())
-	{
-		// not clear if we should set that, since verifivation (sic) did not fail before, since
-		// the tx was accepted before timing out.
-		tvc.m_verifivation_failed = true;
-		return false;
-	}
-
 	if(!check_inputs_types_supported(tx))
 	{
 		tvc.m_verifivation_failed = true;
@@ -163,16 +231,14 @@ bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_has
 	// if the transaction came from a block popped from the chain,
 	// don't check if we have its key images as spent.
 	// TODO: Investigate why not?
-	if(!kept_by_block)
+	// This is only an early out, the check is repeated under the lock below.
+	if(!kept_by_block && have_tx_keyimges_as_spent(tx))
 	{
-		if(have_tx_keyimges_as_spent(tx))
-		{
-			mark_double_spend(tx);
-			LOG_PRINT_L1("Transaction with id= " << id << " used already spent key images");
-			tvc.m_verifivation_failed = true;
-			tvc.m_double_spend = true;
-			return false;
-		}
+		mark_double_spend(tx);
+		LOG_PRINT_L1("Transaction with id= " << id << " used already spent key images");
+		tvc.m_verifivation_failed = true;
+		tvc.m_double_spend = true;
+		return false;
 	}
 
 	if(!m_blockchain.check_tx_outputs(tx, tvc))
@@ -192,6 +258,39 @@ bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_has
 	uint64_t max_used_block_height = 0;
 	cryptonote::txpool_tx_meta_t meta;
 	bool ch_inp_res = m_blockchain.check_tx_inputs(tx, max_used_block_height, max_used_block_id, tvc, kept_by_block);
+	if(!ch_inp_res && !kept_by_block)
+	{
+		LOG_PRINT_L1("tx used wrong inputs, rejected");
+		tvc.m_verifivation_failed = true;
+		tvc.m_invalid_input = true;
+		return false;
+	}
+
+	const cryptonote::blobdata blob = tx_to_blob(tx);
+
+	CRITICAL_REGION_LOCAL(m_transactions_lock);
+
+	// we do not accept transactions that timed out before, unless they're
+	// kept_by_block
+	if(!kept_by_block && m_timed_out_transactions.find(id) != m_timed_out_transactions.end())
+	{
+		// not clear if we should set that, since verifivation (sic) did not fail before, since
+		// the tx was accepted before timing out.
+		tvc.m_verifivation_failed = true;
+		return false;
+	}
+
+	// another transaction spending the same key images may have been added, or
+	// mined, while this one was being verified
+	if(!kept_by_block && (have_tx_keyimges_as_spent(tx) || m_blockchain.have_tx_keyimges_as_spent(tx)))
+	{
+		mark_double_spend(tx);
+		LOG_PRINT_L1("Transaction with id= " << id << " used already spent key images");
+		tvc.m_verifivation_failed = true;
+		tvc.m_double_spend = true;
+		return false;
+	}
+
 	if(!ch_inp_res)
 	{
 		// if the transaction was valid before (kept_by_block), then it
@@ -211,30 +310,17 @@ bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_has
 			meta.do_not_relay = do_not_relay;
 			meta.double_spend_seen = have_tx_keyimges_as_spent(tx);
 			memset(meta.padding, 0, sizeof(meta.padding));
-			try
+			if(m_txes.find(id) != m_txes.end())
 			{
-				CRITICAL_REGION_LOCAL1(m_blockchain);
-				LockedTXN lock(m_blockchain);
-				m_blockchain.add_txpool_tx(tx, meta);
-				if(!insert_key_images(tx, kept_by_block))
-					return false;
-				m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)blob_size, receive_time), id);
-			}
-			catch(const std::exception &e)
-			{
-				MERROR("transaction already exists at inserting in memory pool: " << e.what());
+				MERROR("transaction already exists at inserting in memory pool: " << id);
 				return false;
 			}
+			if(!insert_key_images(tx, id, kept_by_block))
+				return false;
+			add_entry(id, tx, blob, meta);
 			tvc.m_verifivation_impossible = true;
 			tvc.m_added_to_pool = true;
 		}
-		else
-		{
-			LOG_PRINT_L1("tx used wrong inputs, rejected");
-			tvc.m_verifivation_failed = true;
-			tvc.m_invalid_input = true;
-			return false;
-		}
 	}
 	else
 	{
@@ -253,21 +339,11 @@ bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_has
 		meta.double_spend_seen = false;
 		memset(meta.padding, 0, sizeof(meta.padding));
 
-		try
-		{
-			CRITICAL_REGION_LOCAL1(m_blockchain);
-			LockedTXN lock(m_blockchain);
-			m_blockchain.remove_txpool_tx(get_transaction_hash(tx));
-			m_blockchain.add_txpool_tx(tx, meta);
-			if(!insert_key_images(tx, kept_by_block))
-				return false;
-			m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)blob_size, receive_time), id);
-		}
-		catch(const std::exception &e)
-		{
-			MERROR("internal error: transaction already exists at inserting in memory pool: " << e.what());
+		// a copy already in the pool is replaced
+		remove_entry(id);
+		if(!insert_key_images(tx, id, kept_by_block))
 			return false;
-		}
+		add_entry(id, tx, blob, meta);
 		tvc.m_added_to_pool = true;
 
 		if(meta.fee > 0 && !do_not_relay)
@@ -275,7 +351,6 @@ bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_has
 	}
 
 	tvc.m_verifivation_failed = false;
-	m_txpool_size += blob_size;
 
 	MINFO("Transaction added to pool: txid " << id << " bytes: " << blob_size << " fee/byte: " << (fee / (double)blob_size));
 
@@ -310,8 +385,9 @@ void tx_memory_pool::prune(size_t bytes)
 	CRITICAL_REGION_LOCAL(m_transactions_lock);
 	if(bytes == 0)
 		bytes = m_txpool_max_size;
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	LockedTXN lock(m_blockchain);
+
+	if(m_txs_by_fee_and_receive_time.empty())
+		return;
 
 	// this will never remove the first one, but we don't care
 	auto it = --m_txs_by_fee_and_receive_time.end();
@@ -319,51 +395,84 @@ void tx_memory_pool::prune(size_t bytes)
 	{
 		if(m_txpool_size <= bytes)
 			break;
-		try
+		const crypto::hash txid = it->second;
+		const auto entry_it = m_txes.find(txid);
+		if(entry_it == m_txes.end())
 		{
-			const crypto::hash &txid = it->second;
-			txpool_tx_meta_t meta;
-			if(!m_blockchain.get_txpool_tx_meta(txid, meta))
-			{
-				MERROR("Failed to find tx in txpool");
-				return;
-			}
-			// don't prune the kept_by_block ones, they're likely added because we're adding a block with those
-			if(meta.kept_by_block)
-			{
-				--it;
-				continue;
-			}
-			cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
-			cryptonote::transaction tx;
-			if(!parse_and_validate_tx_from_blob(txblob, tx))
-			{
-				MERROR("Failed to parse tx from txpool");
-				return;
-			}
-			// remove first, in case this throws, so key images aren't removed
-			MINFO("Pruning tx " << txid << " from txpool: size: " << it->first.second << ", fee/byte: " << it->first.first);
-			m_blockchain.remove_txpool_tx(txid);
-			m_txpool_size -= txblob.size();
-			remove_transaction_keyimages(tx);
-			MINFO("Pruned tx " << txid << " from txpool: size: " << it->first.second << ", fee/byte: " << it->first.first);
-			m_txs_by_fee_and_receive_time.erase(it--);
+			MERROR("Failed to find tx in txpool");
+			return;
 		}
-		catch(const std::exception &e)
+		// don't prune the kept_by_block ones, they're likely added because we're adding a block with those
+		if(entry_it->second.meta.kept_by_block)
 		{
-			MERROR("Error while pruning txpool: " << e.what());
-			return;
+			--it;
+			continue;
 		}
+		const auto prev = std::prev(it);
+		MINFO("Pruning tx " << txid << " from txpool: size: " << it->first.second << ", fee/byte: " << it->first.first);
+		remove_entry(txid);
+		it = prev;
 	}
 	if(m_txpool_size > bytes)
 		MINFO("Pool size after pruning is larger than limit: " << m_txpool_size << "/" << bytes);
 }
 //---------------------------------------------------------------------------------
-bool tx_memory_pool::insert_key_images(const transaction &tx, bool kept_by_block)
+void tx_memory_pool::add_entry(const crypto::hash &id, const transaction &tx, const cryptonote::blobdata &blob, const txpool_tx_meta_t &meta)
+{
+	std::shared_ptr<transaction> shared_tx = std::make_shared<transaction>(tx);
+	// make sure the cached hash is set now, readers share this object without locking
+	get_transaction_hash(*shared_tx);
+
+	txpool_entry &entry = m_txes[id];
+	entry.meta = meta;
+	entry.tx = shared_tx;
+	entry.blob = m_blobs.store(blob);
+	entry.sorted_it = m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(meta.fee / (double)meta.blob_size, meta.receive_time), id).first;
+	m_txs_by_receive_time.emplace(meta.receive_time, id);
+	m_txs_by_last_relayed_time.emplace(meta.last_relayed_time, id);
+	m_tx_ids.insert(id);
+	m_txpool_size += meta.blob_size;
+	m_db_dirty.insert(id);
+	++m_pool_version;
+	set_pool_metrics(m_txes.size(), m_txpool_size);
+}
+//---------------------------------------------------------------------------------
+bool tx_memory_pool::remove_entry(const crypto::hash &id)
+{
+	const auto it = m_txes.find(id);
+	if(it == m_txes.end())
+		return false;
+	const txpool_entry &entry = it->second;
+	const bool r = remove_transaction_keyimages(*entry.tx, id);
+	m_txs_by_fee_and_receive_time.erase(entry.sorted_it);
+	erase_from_time_index(m_txs_by_receive_time, entry.meta.receive_time, id);
+	erase_from_time_index(m_txs_by_last_relayed_time, entry.meta.last_relayed_time, id);
+	m_blobs.release(entry.blob);
+	m_txpool_size -= entry.meta.blob_size;
+	m_tx_ids.erase(id);
+	m_txes.erase(it);
+	m_db_dirty.insert(id);
+	++m_pool_version;
+	set_pool_metrics(m_txes.size(), m_txpool_size);
+	return r;
+}
+//---------------------------------------------------------------------------------
+void tx_memory_pool::update_entry(const crypto::hash &id, txpool_entry &entry, const txpool_tx_meta_t &meta)
+{
+	if(meta.last_relayed_time != entry.meta.last_relayed_time)
+	{
+		erase_from_time_index(m_txs_by_last_relayed_time, entry.meta.last_relayed_time, id);
+		m_txs_by_last_relayed_time.emplace(meta.last_relayed_time, id);
+	}
+	entry.meta = meta;
+	m_db_dirty.insert(id);
+	++m_pool_version;
+}
+//---------------------------------------------------------------------------------
+bool tx_memory_pool::insert_key_images(const transaction &tx, const crypto::hash &id, bool kept_by_block)
 {
 	for(const auto &in : tx.vin)
 	{
-		const crypto::hash id = get_transaction_hash(tx);
 		CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, txin, false);
 		std::unordered_set<crypto::hash> &kei_image_set = m_spent_key_images[txin.k_image];
 		CHECK_AND_ASSERT_MES(kept_by_block || kei_image_set.size() == 0, false, "internal error: kept_by_block=" << kept_by_block
@@ -371,6 +480,8 @@ bool tx_memory_pool::insert_key_images(const transaction &tx, bool kept_by_block
 																												 << "tx_id=" << id);
 		auto ins_res = kei_image_set.insert(id);
 		CHECK_AND_ASSERT_MES(ins_res.second, false, "internal error: try to insert duplicate iterator in key_image set");
+		if(kei_image_set.size() == 1)
+			m_spent_key_images_index.insert(txin.k_image);
 	}
 	return true;
 }
@@ -378,19 +489,15 @@ bool tx_memory_pool::insert_key_images(const transaction &tx, bool kept_by_block
 //FIXME: Can return early before removal of all of the key images.
 //       At the least, need to make sure that a false return here
 //       is treated properly.  Should probably not return early, however.
-bool tx_memory_pool::remove_transaction_keyimages(const transaction &tx)
+bool tx_memory_pool::remove_transaction_keyimages(const transaction &tx, const crypto::hash &actual_hash)
 {
 	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	// ND: Speedup
-	// 1. Move transaction hash calcuation outside of loop. ._.
-	crypto::hash actual_hash = get_transaction_hash(tx);
 	for(const txin_v &vi : tx.vin)
 	{
 		CHECKED_GET_SPECIFIC_VARIANT(vi, const txin_to_key, txin, false);
 		auto it = m_spent_key_images.find(txin.k_image);
 		CHECK_AND_ASSERT_MES(it != m_spent_key_images.end(), false, "failed to find transaction input in key images. img=" << txin.k_image << ENDL
-																														   << "transaction id = " << get_transaction_hash(tx));
+																														   << "transaction id = " << actual_hash);
 		std::unordered_set<crypto::hash> &key_image_set = it->second;
 		CHECK_AND_ASSERT_MES(key_image_set.size(), false, "empty key_image set, img=" << txin.k_image << ENDL
 																					  << "transaction id = " << actual_hash);
@@ -403,6 +510,7 @@ bool tx_memory_pool::remove_transaction_keyimages(const transaction &tx)
 		{
 			//it is now empty hash container for this key_image
 			m_spent_key_images.erase(it);
+			m_spent_key_images_index.erase(txin.k_image);
 		}
 	}
 	return true;
@@ -411,117 +519,56 @@ bool tx_memory_pool::remove_transaction_keyimages(const transaction &tx)
 bool tx_memory_pool::take_tx(const crypto::hash &id, transaction &tx, size_t &blob_size, uint64_t &fee, bool &relayed, bool &do_not_relay, bool &double_spend_seen)
 {
 	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
 
-	auto sorted_it = find_tx_in_sorted_container(id);
-	if(sorted_it == m_txs_by_fee_and_receive_time.end())
+	const auto it = m_txes.find(id);
+	if(it == m_txes.end())
 		return false;
 
-	try
-	{
-		LockedTXN lock(m_blockchain);
-		txpool_tx_meta_t meta;
-		if(!m_blockchain.get_txpool_tx_meta(id, meta))
-		{
-			MERROR("Failed to find tx in txpool");
-			return false;
-		}
-		cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(id);
-		if(!parse_and_validate_tx_from_blob(txblob, tx))
-		{
-			MERROR("Failed to parse tx from txpool");
-			return false;
-		}
-		blob_size = meta.blob_size;
-		fee = meta.fee;
-		relayed = meta.relayed;
-		do_not_relay = meta.do_not_relay;
-		double_spend_seen = meta.double_spend_seen;
-
-		// remove first, in case this throws, so key images aren't removed
-		m_blockchain.remove_txpool_tx(id);
-		m_txpool_size -= blob_size;
-		remove_transaction_keyimages(tx);
-	}
-	catch(const std::exception &e)
-	{
-		MERROR("Failed to remove tx from txpool: " << e.what());
-		return false;
-	}
+	const txpool_entry &entry = it->second;
+	tx = *entry.tx;
+	blob_size = entry.meta.blob_size;
+	fee = entry.meta.fee;
+	relayed = entry.meta.relayed;
+	do_not_relay = entry.meta.do_not_relay;
+	double_spend_seen = entry.meta.double_spend_seen;
 
-	m_txs_by_fee_and_receive_time.erase(sorted_it);
+	remove_entry(id);
 	return true;
 }
 //---------------------------------------------------------------------------------
 void tx_memory_pool::on_idle()
 {
 	m_remove_stuck_tx_interval.do_call([this]() { return remove_stuck_transactions(); });
-}
-//---------------------------------------------------------------------------------
-sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash &id) const
-{
-	return std::find_if(m_txs_by_fee_and_receive_time.begin(), m_txs_by_fee_and_receive_time.end(), [&](const sorted_tx_container::value_type &a) {
-		return a.second == id;
-	});
+	m_db_flush_interval.do_call([this]() { return flush_db(); });
+	m_compact_interval.do_call([this]() { return compact_blobs(); });
 }
 //---------------------------------------------------------------------------------
 //TODO: investigate whether boolean return is appropriate
 bool tx_memory_pool::remove_stuck_transactions()
 {
 	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	std::unordered_set<crypto::hash> remove;
-	m_blockchain.for_all_txpool_txes([this, &remove](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *) {
-		uint64_t tx_age = time(nullptr) - meta.receive_time;
-
-		if((tx_age > CRYPTONOTE_MEMPOOL_TX_LIVETIME && !meta.kept_by_block) ||
-		   (tx_age > CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME && meta.kept_by_block))
+	const uint64_t now = time(nullptr);
+	std::vector<crypto::hash> remove;
+	// oldest first, nothing younger than the shorter lifetime can be stuck
+	for(const auto &e : m_txs_by_receive_time)
+	{
+		uint64_t tx_age = now - e.first;
+		if(tx_age <= CRYPTONOTE_MEMPOOL_TX_LIVETIME)
+			break;
+		const auto it = m_txes.find(e.second);
+		if(it == m_txes.end())
+			continue;
+		if(!it->second.meta.kept_by_block || tx_age > CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME)
 		{
-			LOG_PRINT_L1("Tx " << txid << " removed from tx pool due to outdated, age: " << tx_age);
-			auto sorted_it = find_tx_in_sorted_container(txid);
-			if(sorted_it == m_txs_by_fee_and_receive_time.end())
-			{
-				LOG_PRINT_L1("Removing tx " << txid << " from tx pool, but it was not found in the sorted txs container!");
-			}
-			else
-			{
-				m_txs_by_fee_and_receive_time.erase(sorted_it);
-			}
-			m_timed_out_transactions.insert(txid);
-			remove.insert(txid);
+			LOG_PRINT_L1("Tx " << e.second << " removed from tx pool due to outdated, age: " << tx_age);
+			remove.push_back(e.second);
 		}
-		return true;
-	},
-									 false);
+	}
 
-	if(!remove.empty())
+	for(const crypto::hash &txid : remove)
 	{
-		LockedTXN lock(m_blockchain);
-		for(const crypto::hash &txid : remove)
-		{
-			try
-			{
-				cryptonote::blobdata bd = m_blockchain.get_txpool_tx_blob(txid);
-				cryptonote::transaction tx;
-				if(!parse_and_validate_tx_from_blob(bd, tx))
-				{
-					MERROR("Failed to parse tx from txpool");
-					// continue
-				}
-				else
-				{
-					// remove first, so we only remove key images if the tx removal succeeds
-					m_blockchain.remove_txpool_tx(txid);
-					m_txpool_size -= bd.size();
-					remove_transaction_keyimages(tx);
-				}
-			}
-			catch(const std::exception &e)
-			{
-				MWARNING("Failed to remove stuck transaction: " << txid);
-				// ignore error
-			}
-		}
+		m_timed_out_transactions.insert(txid);
+		remove_entry(txid);
 	}
 	return true;
 }
@@ -530,9 +577,16 @@ bool tx_memory_pool::remove_stuck_transactions()
 bool tx_memory_pool::get_relayable_transactions(std::list<std::pair<crypto::hash, cryptonote::blobdata>> &txs) const
 {
 	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
 	const uint64_t now = time(NULL);
-	m_blockchain.for_all_txpool_txes([this, now, &txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *) {
+	// least recently relayed first, the relay delay is never shorter than MIN_RELAY_TIME
+	for(const auto &e : m_txs_by_last_relayed_time)
+	{
+		if(now - e.first <= (uint64_t)MIN_RELAY_TIME)
+			break;
+		const auto it = m_txes.find(e.second);
+		if(it == m_txes.end())
+			continue;
+		const txpool_tx_meta_t &meta = it->second.meta;
 		// 0 fee transactions are never relayed
 		if(meta.fee > 0 && !meta.do_not_relay && now - meta.last_relayed_time > get_relay_delay(now, meta.receive_time))
 		{
@@ -541,109 +595,82 @@ bool tx_memory_pool::get_relayable_transactions(std::list<std::pair<crypto::hash
 			// flushed txes to be re-added when received from a node which was just about to flush it
 			uint64_t max_age = meta.kept_by_block ? CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME : CRYPTONOTE_MEMPOOL_TX_LIVETIME;
 			if(now - meta.receive_time <= max_age / 2)
-			{
-				try
-				{
-					cryptonote::blobdata bd = m_blockchain.get_txpool_tx_blob(txid);
-					txs.push_back(std::make_pair(txid, bd));
-				}
-				catch(const std::exception &e)
-				{
-					MERROR("Failed to get transaction blob from db");
-					// ignore error
-				}
-			}
+				txs.push_back(std::make_pair(e.second, it->second.blob.str()));
 		}
-		return true;
-	},
-									 false);
+	}
 	return true;
 }
 //---------------------------------------------------------------------------------
 void tx_memory_pool::set_relayed(const std::list<std::pair<crypto::hash, cryptonote::blobdata>> &txs)
 {
 	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
 	const time_t now = time(NULL);
-	LockedTXN lock(m_blockchain);
 	for(auto it = txs.begin(); it != txs.end(); ++it)
 	{
-		try
-		{
-			txpool_tx_meta_t meta;
-			if(m_blockchain.get_txpool_tx_meta(it->first, meta))
-			{
-				meta.relayed = true;
-				meta.last_relayed_time = now;
-				m_blockchain.update_txpool_tx(it->first, meta);
-			}
-		}
-		catch(const std::exception &e)
-		{
-			MERROR("Failed to update txpool transaction metadata: " << e.what());
-			// continue
-		}
+		const auto entry_it = m_txes.find(it->first);
+		if(entry_it == m_txes.end())
+			continue;
+		txpool_tx_meta_t meta = entry_it->second.meta;
+		meta.relayed = true;
+		meta.last_relayed_time = now;
+		update_entry(it->first, entry_it->second, meta);
 	}
 }
 //---------------------------------------------------------------------------------
 size_t tx_memory_pool::get_transactions_count(bool include_unrelayed_txes) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	return m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
+	std::shared_ptr<const txpool_snapshot> snapshot = get_snapshot();
+	if(include_unrelayed_txes)
+		return snapshot->txes.size();
+	return std::count_if(snapshot->txes.begin(), snapshot->txes.end(), [](const txpool_snapshot::entry &e) { return !e.meta.do_not_relay; });
 }
 //---------------------------------------------------------------------------------
 void tx_memory_pool::get_transactions(std::list<transaction> &txs, bool include_unrelayed_txes) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
-		transaction tx;
-		if(!parse_and_validate_tx_from_blob(*bd, tx))
-		{
-			MERROR("Failed to parse tx from txpool");
-			// continue
-			return true;
-		}
-		txs.push_back(tx);
-		return true;
-	},
-									 true, include_unrelayed_txes);
+	std::shared_ptr<const txpool_snapshot> snapshot = get_snapshot();
+	for(const auto &e : snapshot->txes)
+	{
+		if(include_unrelayed_txes || !e.meta.do_not_relay)
+			txs.push_back(*e.tx);
+	}
 }
 //------------------------------------------------------------------
 void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash> &txs, bool include_unrelayed_txes) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
-		txs.push_back(txid);
-		return true;
-	},
-									 false, include_unrelayed_txes);
+	std::shared_ptr<const txpool_snapshot> snapshot = get_snapshot();
+	txs.reserve(txs.size() + snapshot->txes.size());
+	for(const auto &e : snapshot->txes)
+	{
+		if(include_unrelayed_txes || !e.meta.do_not_relay)
+			txs.push_back(e.id);
+	}
 }
 //------------------------------------------------------------------
 void tx_memory_pool::get_transaction_backlog(std::vector<tx_backlog_entry> &backlog, bool include_unrelayed_txes) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
+	std::shared_ptr<const txpool_snapshot> snapshot = get_snapshot();
 	const uint64_t now = time(NULL);
-	m_blockchain.for_all_txpool_txes([&backlog, now](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
-		backlog.push_back({meta.blob_size, meta.fee, meta.receive_time - now});
-		return true;
-	},
-									 false, include_unrelayed_txes);
+	backlog.reserve(backlog.size() + snapshot->txes.size());
+	for(const auto &e : snapshot->txes)
+	{
+		const txpool_tx_meta_t &meta = e.meta;
+		if(include_unrelayed_txes || !meta.do_not_relay)
+			backlog.push_back({meta.blob_size, meta.fee, meta.receive_time - now});
+	}
 }
 //------------------------------------------------------------------
 void tx_memory_pool::get_transaction_stats(struct txpool_stats &stats, bool include_unrelayed_txes) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
+	std::shared_ptr<const txpool_snapshot> snapshot = get_snapshot();
 	const uint64_t now = time(NULL);
 	std::map<uint64_t, txpool_histo> agebytes;
-	stats.txs_total = m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
 	std::vector<uint32_t> sizes;
-	sizes.reserve(stats.txs_total);
-	m_blockchain.for_all_txpool_txes([&stats, &sizes, now, &agebytes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+	sizes.reserve(snapshot->txes.size());
+	for(const auto &e : snapshot->txes)
+	{
+		const txpool_tx_meta_t &meta = e.meta;
+		if(!include_unrelayed_txes && meta.do_not_relay)
+			continue;
 		sizes.push_back(meta.blob_size);
 		stats.bytes_total += meta.blob_size;
 		if(!stats.bytes_min || meta.blob_size < stats.bytes_min)
@@ -664,9 +691,8 @@ void tx_memory_pool::get_transaction_stats(struct txpool_stats &stats, bool incl
 		agebytes[age].bytes += meta.blob_size;
 		if(meta.double_spend_seen)
 			++stats.num_double_spends;
-		return true;
-	},
-									 false, include_unrelayed_txes);
+	}
+	stats.txs_total = sizes.size();
 	stats.bytes_med = epee::misc_utils::median(sizes);
 	if(stats.txs_total > 1)
 	{
@@ -717,19 +743,18 @@ void tx_memory_pool::get_transaction_stats(struct txpool_stats &stats, bool incl
 //TODO: investigate whether boolean return is appropriate
 bool tx_memory_pool::get_transactions_and_spent_keys_info(std::vector<tx_info> &tx_infos, std::vector<spent_key_image_info> &key_image_infos, bool include_sensitive_data) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos, include_sensitive_data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+	// json conversion is done on the snapshot, outside the pool lock
+	std::shared_ptr<const txpool_snapshot> snapshot = get_snapshot();
+	tx_infos.reserve(tx_infos.size() + snapshot->txes.size());
+	for(const auto &e : snapshot->txes)
+	{
+		const txpool_tx_meta_t &meta = e.meta;
+		if(!include_sensitive_data && meta.do_not_relay)
+			continue;
 		tx_info txi;
-		txi.id_hash = epee::string_tools::pod_to_hex(txid);
-		txi.tx_blob = *bd;
-		transaction tx;
-		if(!parse_and_validate_tx_from_blob(*bd, tx))
-		{
-			MERROR("Failed to parse tx from txpool");
-			// continue
-			return true;
-		}
+		txi.id_hash = epee::string_tools::pod_to_hex(e.id);
+		txi.tx_blob = e.blob.str();
+		transaction tx = *e.tx;
 		txi.tx_json = obj_to_json_str(tx);
 		txi.blob_size = meta.blob_size;
 		txi.fee = meta.fee;
@@ -745,38 +770,26 @@ bool tx_memory_pool::get_transactions_and_spent_keys_info(std::vector<tx_info> &
 		txi.last_relayed_time = include_sensitive_data ? meta.last_relayed_time : 0;
 		txi.do_not_relay = meta.do_not_relay;
 		txi.double_spend_seen = meta.double_spend_seen;
-		tx_infos.push_back(txi);
-		return true;
-	},
-									 true, include_sensitive_data);
+		tx_infos.push_back(std::move(txi));
+	}
 
-	txpool_tx_meta_t meta;
-	for(const key_images_container::value_type &kee : m_spent_key_images)
+	for(const auto &kee : snapshot->key_images)
 	{
-		const crypto::key_image &k_image = kee.first;
-		const std::unordered_set<crypto::hash> &kei_image_set = kee.second;
 		spent_key_image_info ki;
-		ki.id_hash = epee::string_tools::pod_to_hex(k_image);
-		for(const crypto::hash &tx_id_hash : kei_image_set)
+		ki.id_hash = epee::string_tools::pod_to_hex(kee.first);
+		for(const crypto::hash &tx_id_hash : kee.second)
 		{
 			if(!include_sensitive_data)
 			{
-				try
+				const auto it = snapshot->tx_index.find(tx_id_hash);
+				if(it == snapshot->tx_index.end())
 				{
-					if(!m_blockchain.get_txpool_tx_meta(tx_id_hash, meta))
-					{
-						MERROR("Failed to get tx meta from txpool");
-						return false;
-					}
-					if(!meta.relayed)
-						// Do not include that transaction if in restricted mode and it's not relayed
-						continue;
-				}
-				catch(const std::exception &e)
-				{
-					MERROR("Failed to get tx meta from txpool: " << e.what());
+					MERROR("Failed to get tx meta from txpool");
 					return false;
 				}
+				if(!snapshot->txes[it->second].meta.relayed)
+					// Do not include that transaction if in restricted mode and it's not relayed
+					continue;
 			}
 			ki.txs_hashes.push_back(epee::string_tools::pod_to_hex(tx_id_hash));
 		}
@@ -789,19 +802,14 @@ bool tx_memory_pool::get_transactions_and_spent_keys_info(std::vector<tx_info> &
 //---------------------------------------------------------------------------------
 bool tx_memory_pool::get_pool_for_rpc(std::vector<cryptonote::rpc::tx_in_pool> &tx_infos, cryptonote::rpc::key_images_with_tx_hashes &key_image_infos) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+	std::shared_ptr<const txpool_snapshot> snapshot = get_snapshot();
+	tx_infos.reserve(tx_infos.size() + snapshot->txes.size());
+	for(const auto &e : snapshot->txes)
+	{
+		const txpool_tx_meta_t &meta = e.meta;
 		cryptonote::rpc::tx_in_pool txi;
-		txi.tx_hash = txid;
-		transaction tx;
-		if(!parse_and_validate_tx_from_blob(*bd, tx))
-		{
-			MERROR("Failed to parse tx from txpool");
-			// continue
-			return true;
-		}
-		txi.tx = tx;
+		txi.tx_hash = e.id;
+		txi.tx = *e.tx;
 		txi.blob_size = meta.blob_size;
 		txi.fee = meta.fee;
 		txi.kept_by_block = meta.kept_by_block;
@@ -814,36 +822,21 @@ bool tx_memory_pool::get_pool_for_rpc(std::vector<cryptonote::rpc::tx_in_pool> &
 		txi.last_relayed_time = meta.last_relayed_time;
 		txi.do_not_relay = meta.do_not_relay;
 		txi.double_spend_seen = meta.double_spend_seen;
-		tx_infos.push_back(txi);
-		return true;
-	},
-									 true, false);
-
-	for(const key_images_container::value_type &kee : m_spent_key_images)
-	{
-		std::vector<crypto::hash> tx_hashes;
-		const std::unordered_set<crypto::hash> &kei_image_set = kee.second;
-		for(const crypto::hash &tx_id_hash : kei_image_set)
-		{
-			tx_hashes.push_back(tx_id_hash);
-		}
-
-		const crypto::key_image &k_image = kee.first;
-		key_image_infos[k_image] = tx_hashes;
+		tx_infos.push_back(std::move(txi));
 	}
+
+	for(const auto &kee : snapshot->key_images)
+		key_image_infos[kee.first] = kee.second;
 	return true;
 }
 //---------------------------------------------------------------------------------
 bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image> &key_images, std::vector<bool> spent) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-
 	spent.clear();
 
 	for(const auto &image : key_images)
 	{
-		spent.push_back(m_spent_key_images.find(image) == m_spent_key_images.end() ? false : true);
+		spent.push_back(m_spent_key_images_index.contains(image));
 	}
 
 	return true;
@@ -852,15 +845,11 @@ bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image> &
 bool tx_memory_pool::get_transaction(const crypto::hash &id, cryptonote::blobdata &txblob) const
 {
 	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	try
-	{
-		return m_blockchain.get_txpool_tx_blob(id, txblob);
-	}
-	catch(const std::exception &e)
-	{
+	const auto it = m_txes.find(id);
+	if(it == m_txes.end())
 		return false;
-	}
+	txblob = it->second.blob.str();
+	return true;
 }
 //---------------------------------------------------------------------------------
 bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash &top_block_id)
@@ -875,15 +864,11 @@ bool tx_memory_pool::on_blockchain_dec(uint64_t new_block_height, const crypto::
 //---------------------------------------------------------------------------------
 bool tx_memory_pool::have_tx(const crypto::hash &id) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	return m_blockchain.get_db().txpool_has_tx(id);
+	return m_tx_ids.contains(id);
 }
 //---------------------------------------------------------------------------------
 bool tx_memory_pool::have_tx_keyimges_as_spent(const transaction &tx) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
 	for(const auto &in : tx.vin)
 	{
 		CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, tokey_in, true); //should never fail
@@ -895,8 +880,55 @@ bool tx_memory_pool::have_tx_keyimges_as_spent(const transaction &tx) const
 //---------------------------------------------------------------------------------
 bool tx_memory_pool::have_tx_keyimg_as_spent(const crypto::key_image &key_im) const
 {
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	return m_spent_key_images.end() != m_spent_key_images.find(key_im);
+	return m_spent_key_images_index.contains(key_im);
+}
+//---------------------------------------------------------------------------------
+std::shared_ptr<const txpool_snapshot> tx_memory_pool::get_snapshot() const
+{
+	std::shared_ptr<const txpool_snapshot> snapshot;
+	{
+		boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+		snapshot = m_snapshot;
+	}
+	if(snapshot && snapshot->version == m_pool_version)
+		return snapshot;
+
+	// don't queue up behind a writer if there is something to serve already,
+	// the next reader after the writer is done will pick up the changes
+	if(snapshot)
+	{
+		if(!m_transactions_lock.tryLock())
+			return snapshot;
+	}
+	else
+		m_transactions_lock.lock();
+	epee::misc_utils::auto_scope_leave_caller pool_unlock = epee::misc_utils::create_scope_leave_handler([this]() { m_transactions_lock.unlock(); });
+
+	// another reader may have rebuilt it while we were waiting
+	{
+		boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+		if(m_snapshot && m_snapshot->version == m_pool_version)
+			return m_snapshot;
+	}
+
+	std::shared_ptr<txpool_snapshot> fresh = std::make_shared<txpool_snapshot>();
+	fresh->version = m_pool_version;
+	fresh->txes.reserve(m_txes.size());
+	for(const auto &e : m_txs_by_receive_time)
+	{
+		const auto it = m_txes.find(e.second);
+		if(it == m_txes.end())
+			continue;
+		fresh->tx_index.emplace(e.second, fresh->txes.size());
+		fresh->txes.push_back({e.second, it->second.meta, it->second.tx, it->second.blob});
+	}
+	fresh->key_images.reserve(m_spent_key_images.size());
+	for(const key_images_container::value_type &kee : m_spent_key_images)
+		fresh->key_images.emplace_back(kee.first, std::vector<crypto::hash>(kee.second.begin(), kee.second.end()));
+
+	boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+	m_snapshot = fresh;
+	return m_snapshot;
 }
 //---------------------------------------------------------------------------------
 void tx_memory_pool::lock() const
@@ -982,8 +1014,6 @@ bool tx_memory_pool::append_key_images(std::unordered_set<crypto::key_image> &k_
 void tx_memory_pool::mark_double_spend(const transaction &tx)
 {
 	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	LockedTXN lock(m_blockchain);
 	for(size_t i = 0; i != tx.vin.size(); i++)
 	{
 		CHECKED_GET_SPECIFIC_VARIANT(tx.vin[i], const txin_to_key, itk, void());
@@ -992,26 +1022,19 @@ void tx_memory_pool::mark_double_spend(const transaction &tx)
 		{
 			for(const crypto::hash &txid : it->second)
 			{
-				txpool_tx_meta_t meta;
-				if(!m_blockchain.get_txpool_tx_meta(txid, meta))
+				const auto entry_it = m_txes.find(txid);
+				if(entry_it == m_txes.end())
 				{
 					MERROR("Failed to find tx meta in txpool");
 					// continue, not fatal
 					continue;
 				}
-				if(!meta.double_spend_seen)
+				if(!entry_it->second.meta.double_spend_seen)
 				{
 					MDEBUG("Marking " << txid << " as double spending " << itk.k_image);
+					txpool_tx_meta_t meta = entry_it->second.meta;
 					meta.double_spend_seen = true;
-					try
-					{
-						m_blockchain.update_txpool_tx(txid, meta);
-					}
-					catch(const std::exception &e)
-					{
-						MERROR("Failed to update tx meta: " << e.what());
-						// continue, not fatal
-					}
+					update_entry(txid, entry_it->second, meta);
 				}
 			}
 		}
@@ -1021,18 +1044,14 @@ void tx_memory_pool::mark_double_spend(const transaction &tx)
 std::string tx_memory_pool::print_pool(bool short_format) const
 {
 	std::stringstream ss;
-	CRITICAL_REGION_LOCAL(m_transactions_lock);
-	CRITICAL_REGION_LOCAL1(m_blockchain);
-	m_blockchain.for_all_txpool_txes([&ss, short_format](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *txblob) {
-		ss << "id: " << txid << std::endl;
+	std::shared_ptr<const txpool_snapshot> snapshot = get_snapshot();
+	for(const auto &e : snapshot->txes)
+	{
+		const txpool_tx_meta_t &meta = e.meta;
+		ss << "id: " << e.id << std::endl;
 		if(!short_format)
 		{
-			cryptonote::transaction tx;
-			if(!parse_and_validate_tx_from_blob(*txblob, tx))
-			{
-				MERROR("Failed to parse tx from txpool");
-				return true; // continue
-			}
+			cryptonote::transaction tx = *e.tx;
 			ss << obj_to_json_str(tx) << std::endl;
 		}
 		ss << "blob_size: " << meta.blob_size << std::endl
@@ -1043,9 +1062,7 @@ std::string tx_memory_pool::print_pool(bool short_format) const
 		   << "max_used_block_id: " << meta.max_used_block_id << std::endl
 		   << "last_failed_height: " << meta.last_failed_height << std::endl
 		   << "last_failed_id: " << meta.last_failed_id << std::endl;
-		return true;
-	},
-									 !short_format);
+	}
 
 	return ss.str();
 }
@@ -1072,16 +1089,15 @@ bool tx_memory_pool::fill_block_template(block &bl, size_t median_size, uint64_t
 
 	LOG_PRINT_L2("Filling block template, median size " << median_size << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
 
-	LockedTXN lock(m_blockchain);
-
 	for(auto& tx_hash : m_txs_by_fee_and_receive_time)
 	{
-		txpool_tx_meta_t meta;
-		if(!m_blockchain.get_txpool_tx_meta(tx_hash.second, meta))
+		const auto entry_it = m_txes.find(tx_hash.second);
+		if(entry_it == m_txes.end())
 		{
 			MERROR("  failed to find tx meta");
 			continue;
 		}
+		txpool_tx_meta_t meta = entry_it->second.meta;
 		LOG_PRINT_L2("Considering " << tx_hash.second << ", size " << meta.blob_size << ", current block size " << total_size << "/" << max_total_size << ", current coinbase " << print_money(best_coinbase));
 
 		// Can not exceed maximum block size
@@ -1106,31 +1122,15 @@ bool tx_memory_pool::fill_block_template(block &bl, size_t median_size, uint64_t
 			continue;
 		}
 
-		cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(tx_hash.second);
-		cryptonote::transaction tx;
-		if(!parse_and_validate_tx_from_blob(txblob, tx))
-		{
-			MERROR("Failed to parse tx from txpool");
-			continue;
-		}
+		// checking the inputs may expand the tx, so work on a copy of the shared one
+		cryptonote::transaction tx = *entry_it->second.tx;
 
 		// Skip transactions that are not ready to be
 		// included into the blockchain or that are
 		// missing key images
-		const cryptonote::txpool_tx_meta_t original_meta = meta;
 		bool ready = is_transaction_ready_to_go(meta, tx);
-		if(memcmp(&original_meta, &meta, sizeof(meta)))
-		{
-			try
-			{
-				m_blockchain.update_txpool_tx(tx_hash.second, meta);
-			}
-			catch(const std::exception &e)
-			{
-				MERROR("Failed to update tx meta: " << e.what());
-				// continue, not fatal
-			}
-		}
+		if(memcmp(&entry_it->second.meta, &meta, sizeof(meta)))
+			update_entry(tx_hash.second, entry_it->second, meta);
 		if(!ready)
 		{
 			LOG_PRINT_L2("  not ready to go");
@@ -1162,61 +1162,30 @@ size_t tx_memory_pool::validate()
 	CRITICAL_REGION_LOCAL(m_transactions_lock);
 	CRITICAL_REGION_LOCAL1(m_blockchain);
 	size_t tx_size_limit = common_config::TRANSACTION_SIZE_LIMIT;
-	std::unordered_set<crypto::hash> remove;
+	std::vector<crypto::hash> remove;
 
-	m_txpool_size = 0;
-	m_blockchain.for_all_txpool_txes([this, &remove, tx_size_limit](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *) {
-		m_txpool_size += meta.blob_size;
-		if(meta.blob_size > tx_size_limit)
+	for(const auto &e : m_txes)
+	{
+		const crypto::hash &txid = e.first;
+		if(e.second.meta.blob_size > tx_size_limit)
 		{
-			LOG_PRINT_L1("Transaction " << txid << " is too big (" << meta.blob_size << " bytes), removing it from pool");
-			remove.insert(txid);
+			LOG_PRINT_L1("Transaction " << txid << " is too big (" << e.second.meta.blob_size << " bytes), removing it from pool");
+			remove.push_back(txid);
 		}
 		else if(m_blockchain.have_tx(txid))
 		{
 			LOG_PRINT_L1("Transaction " << txid << " is in the blockchain, removing it from pool");
-			remove.insert(txid);
+			remove.push_back(txid);
 		}
-		return true;
-	},
-									 false);
+	}
 
 	size_t n_removed = 0;
-	if(!remove.empty())
+	for(const crypto::hash &txid : remove)
 	{
-		LockedTXN lock(m_blockchain);
-		for(const crypto::hash &txid : remove)
-		{
-			try
-			{
-				cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
-				cryptonote::transaction tx;
-				if(!parse_and_validate_tx_from_blob(txblob, tx))
-				{
-					MERROR("Failed to parse tx from txpool");
-					continue;
-				}
-				// remove tx from db first
-				m_blockchain.remove_txpool_tx(txid);
-				m_txpool_size -= txblob.size();
-				remove_transaction_keyimages(tx);
-				auto sorted_it = find_tx_in_sorted_container(txid);
-				if(sorted_it == m_txs_by_fee_and_receive_time.end())
-				{
-					LOG_PRINT_L1("Removing tx " << txid << " from tx pool, but it was not found in the sorted txs container!");
-				}
-				else
-				{
-					m_txs_by_fee_and_receive_time.erase(sorted_it);
-				}
-				++n_removed;
-			}
-			catch(const std::exception &e)
-			{
-				MERROR("Failed to remove invalid tx from pool");
-				// continue
-			}
-		}
+		if(remove_entry(txid))
+			++n_removed;
+		else
+			MERROR("Failed to remove invalid tx from pool");
 	}
 	return n_removed;
 }
@@ -1227,9 +1196,18 @@ bool tx_memory_pool::init(size_t max_txpool_size)
 	CRITICAL_REGION_LOCAL1(m_blockchain);
 
 	m_txpool_max_size = max_txpool_size ? max_txpool_size : DEFAULT_TXPOOL_MAX_SIZE;
+	for(const auto &e : m_txes)
+		m_blobs.release(e.second.blob);
+	m_txes.clear();
+	m_tx_ids.clear();
 	m_txs_by_fee_and_receive_time.clear();
+	m_txs_by_receive_time.clear();
+	m_txs_by_last_relayed_time.clear();
 	m_spent_key_images.clear();
+	m_spent_key_images_index.clear();
 	m_txpool_size = 0;
+	++m_pool_version;
+	set_pool_metrics(0, 0);
 	std::vector<crypto::hash> remove;
 
 	// first add the not kept by block, then the kept by block,
@@ -1245,20 +1223,22 @@ bool tx_memory_pool::init(size_t max_txpool_size)
 			{
 				MWARNING("Failed to parse tx from txpool, removing");
 				remove.push_back(txid);
+				return true;
 			}
-			if(!insert_key_images(tx, meta.kept_by_block))
+			if(!insert_key_images(tx, txid, meta.kept_by_block))
 			{
 				MFATAL("Failed to insert key images from txpool tx");
 				return false;
 			}
-			m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(meta.fee / (double)meta.blob_size, meta.receive_time), txid);
-			m_txpool_size += meta.blob_size;
+			add_entry(txid, tx, *bd, meta);
 			return true;
 		},
 												  true);
 		if(!r)
 			return false;
 	}
+	// what was just loaded is what the db has
+	m_db_dirty.clear();
 	if(!remove.empty())
 	{
 		LockedTXN lock(m_blockchain);
@@ -1277,10 +1257,68 @@ bool tx_memory_pool::init(size_t max_txpool_size)
 	}
 	return true;
 }
+//---------------------------------------------------------------------------------
+bool tx_memory_pool::flush_db()
+{
+	CRITICAL_REGION_LOCAL(m_transactions_lock);
+	if(m_db_dirty.empty())
+		return true;
 
+	CRITICAL_REGION_LOCAL1(m_blockchain);
+	LockedTXN lock(m_blockchain);
+	for(const crypto::hash &txid : m_db_dirty)
+	{
+		try
+		{
+			txpool_tx_meta_t meta;
+			const bool in_db = m_blockchain.get_txpool_tx_meta(txid, meta);
+			const auto it = m_txes.find(txid);
+			if(it == m_txes.end())
+			{
+				if(in_db)
+					m_blockchain.remove_txpool_tx(txid);
+			}
+			else if(in_db)
+				m_blockchain.update_txpool_tx(txid, it->second.meta);
+			else
+				m_blockchain.add_txpool_tx(*it->second.tx, it->second.meta);
+		}
+		catch(const std::exception &e)
+		{
+			MERROR("Failed to write txpool tx " << txid << " to the db: " << e.what());
+			// continue, the db copy is only used on restart
+		}
+	}
+	MDEBUG("Wrote " << m_db_dirty.size() << " txpool changes to the db");
+	m_db_dirty.clear();
+	return true;
+}
 //---------------------------------------------------------------------------------
-bool tx_memory_pool::deinit()
+bool tx_memory_pool::compact_blobs()
 {
+	CRITICAL_REGION_LOCAL(m_transactions_lock);
+	size_t moved = 0;
+	for(auto &e : m_txes)
+	{
+		txpool_blob_arena::blob &blob = e.second.blob;
+		if(!m_blobs.is_fragmented(blob))
+			continue;
+		txpool_blob_arena::blob copy = m_blobs.store(blob.data(), blob.size());
+		m_blobs.release(blob);
+		blob = copy;
+		++moved;
+	}
+	if(moved)
+	{
+		MDEBUG("Moved " << moved << " txpool blobs out of fragmented storage");
+		// let the snapshot drop its references to the old chunks
+		++m_pool_version;
+	}
 	return true;
 }
+//---------------------------------------------------------------------------------
+bool tx_memory_pool::deinit()
+{
+	return flush_db();
+}
 }
@@ -23,7 +23,13 @@
 #include "include_base_utils.h"
 
 #include <boost/serialization/version.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/utility.hpp>
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
 #include <queue>
 #include <set>
 #include <unordered_map>
@@ -73,6 +79,183 @@ class txCompare
 //! container for sorting transactions by fee per unit size
 typedef std::set<tx_by_fee_and_receive_time_entry, txCompare> sorted_tx_container;
 
+/**
+   * @brief a set of hashes or key images split over independently locked shards
+   *
+   * Lookups and updates only lock the shard the key falls in, so checks
+   * from several threads do not serialize on one lock.
+   */
+template <typename T>
+class sharded_set : boost::noncopyable
+{
+  public:
+	static constexpr size_t SHARD_COUNT = 16;
+
+	/**
+     * @brief add a key to the set
+     *
+     * @return true if the key was not already present
+     */
+	bool insert(const T &k)
+	{
+		shard &s = m_shards[shard_index(k)];
+		boost::lock_guard<boost::mutex> lock(s.lock);
+		return s.keys.insert(k).second;
+	}
+
+	/**
+     * @brief remove a key from the set
+     *
+     * @return true if the key was present
+     */
+	bool erase(const T &k)
+	{
+		shard &s = m_shards[shard_index(k)];
+		boost::lock_guard<boost::mutex> lock(s.lock);
+		return s.keys.erase(k) != 0;
+	}
+
+	/**
+     * @brief check whether a key is in the set
+     */
+	bool contains(const T &k) const
+	{
+		const shard &s = m_shards[shard_index(k)];
+		boost::lock_guard<boost::mutex> lock(s.lock);
+		return s.keys.find(k) != s.keys.end();
+	}
+
+	size_t size() const
+	{
+		size_t n = 0;
+		for(const shard &s : m_shards)
+		{
+			boost::lock_guard<boost::mutex> lock(s.lock);
+			n += s.keys.size();
+		}
+		return n;
+	}
+
+	void clear()
+	{
+		for(shard &s : m_shards)
+		{
+			boost::lock_guard<boost::mutex> lock(s.lock);
+			s.keys.clear();
+		}
+	}
+
+  private:
+	struct shard
+	{
+		mutable boost::mutex lock;
+		std::unordered_set<T> keys;
+	};
+
+	static size_t shard_index(const T &k)
+	{
+		// keys are uniformly distributed, and the hash functor uses the leading bytes
+		return reinterpret_cast<const unsigned char *>(&k)[sizeof(T) - 1] % SHARD_COUNT;
+	}
+
+	std::array<shard, SHARD_COUNT> m_shards;
+};
+
+typedef sharded_set<crypto::key_image> sharded_key_image_set;
+
+/**
+   * @brief chunked storage for the pool's transaction blobs
+   *
+   * Blobs are appended to large chunks instead of each getting its own heap
+   * allocation. A chunk is freed once no blob handle refers to it any more,
+   * and blobs left alone in a mostly dead chunk can be moved out with
+   * store() so the chunk can go.
+   *
+   * Stored bytes never change, so a handle can be read without any lock
+   * while the pool keeps storing and releasing other blobs. Storing and
+   * releasing must be serialized by the caller.
+   */
+class txpool_blob_arena : boost::noncopyable
+{
+	struct chunk
+	{
+		std::unique_ptr<char[]> data;
+		size_t capacity;
+		size_t used;
+		size_t live; //!< bytes of the blobs stored here that were not released yet
+	};
+
+  public:
+	static constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+	//! handle to a stored blob, keeps its chunk alive
+	class blob
+	{
+	  public:
+		blob() : m_offset(0), m_size(0) {}
+
+		const char *data() const { return m_chunk ? m_chunk->data.get() + m_offset : nullptr; }
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+		cryptonote::blobdata str() const { return cryptonote::blobdata(data(), m_size); }
+
+	  private:
+		friend class txpool_blob_arena;
+		std::shared_ptr<chunk> m_chunk;
+		size_t m_offset;
+		size_t m_size;
+	};
+
+	txpool_blob_arena() : m_live(0) {}
+
+	/**
+     * @brief copy a blob into the arena
+     */
+	blob store(const char *data, size_t size);
+	blob store(const cryptonote::blobdata &bd) { return store(bd.data(), bd.size()); }
+
+	/**
+     * @brief mark a blob as no longer used by the pool
+     *
+     * The bytes stay readable through any handle still around.
+     */
+	void release(const blob &b);
+
+	/**
+     * @brief check whether a blob pins a chunk that is mostly dead space
+     */
+	bool is_fragmented(const blob &b) const;
+
+	//! bytes of all the blobs stored and not released
+	size_t live() const { return m_live; }
+
+  private:
+	std::shared_ptr<chunk> m_current;
+	size_t m_live;
+};
+
+/**
+   * @brief an immutable view of the pool, shared by readers
+   *
+   * Built from the pool under its lock, and reused by every reader until
+   * the pool changes.
+   */
+struct txpool_snapshot
+{
+	struct entry
+	{
+		crypto::hash id;
+		txpool_tx_meta_t meta;
+		std::shared_ptr<const transaction> tx;
+		txpool_blob_arena::blob blob;
+	};
+
+	uint64_t version; //!< the pool version this snapshot was taken at
+	std::vector<entry> txes;
+	std::unordered_map<crypto::hash, size_t> tx_index; //!< index into txes by tx hash
+	std::vector<std::pair<crypto::key_image, std::vector<crypto::hash>>> key_images;
+};
+
 /**
    * @brief Transaction pool, handles transactions which are not part of a block
    *
@@ -421,7 +604,7 @@ class tx_memory_pool : boost::noncopyable
      *
      * @return true on success, false on error
      */
-	bool insert_key_images(const transaction &tx, bool kept_by_block);
+	bool insert_key_images(const transaction &tx, const crypto::hash &id, bool kept_by_block);
 
 	/**
      * @brief remove old transactions from the pool
@@ -465,10 +648,11 @@ class tx_memory_pool : boost::noncopyable
      * a transaction from the pool.
      *
      * @param tx the transaction
+     * @param id the transaction's hash
      *
      * @return false if any key images to be removed cannot be found, otherwise true
      */
-	bool remove_transaction_keyimages(const transaction &tx);
+	bool remove_transaction_keyimages(const transaction &tx, const crypto::hash &id);
 
 	/**
      * @brief check if any of a transaction's spent key images are present in a given set
@@ -511,6 +695,54 @@ class tx_memory_pool : boost::noncopyable
      */
 	void prune(size_t bytes = 0);
 
+	struct txpool_entry;
+
+	/**
+     * @brief add a transaction to the in-memory pool and its indices
+     *
+     * Key images are not handled here, see insert_key_images.
+     */
+	void add_entry(const crypto::hash &id, const transaction &tx, const cryptonote::blobdata &blob, const txpool_tx_meta_t &meta);
+
+	/**
+     * @brief remove a transaction from the in-memory pool, its indices and its key images
+     *
+     * @return false if the transaction is not in the pool or its key images are inconsistent
+     */
+	bool remove_entry(const crypto::hash &id);
+
+	/**
+     * @brief replace the metadata of a transaction in the pool
+     */
+	void update_entry(const crypto::hash &id, txpool_entry &entry, const txpool_tx_meta_t &meta);
+
+	/**
+     * @brief write the pool changes to the db
+     *
+     * The db copy of the pool is only read back on startup, so this runs
+     * periodically from on_idle and on deinit rather than on each change.
+     *
+     * @return true
+     */
+	bool flush_db();
+
+	/**
+     * @brief move blobs out of mostly dead arena chunks
+     *
+     * @return true
+     */
+	bool compact_blobs();
+
+	/**
+     * @brief get the current pool snapshot, rebuilding it if the pool changed
+     *
+     * If a writer holds the pool lock and a previous snapshot exists, that
+     * snapshot is returned instead of waiting for the writer.
+     *
+     * @return the snapshot, never null
+     */
+	std::shared_ptr<const txpool_snapshot> get_snapshot() const;
+
 	//TODO: confirm the below comments and investigate whether or not this
 	//      is the desired behavior
 	//! map key images to transactions which spent them
@@ -525,7 +757,7 @@ class tx_memory_pool : boost::noncopyable
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
   public:
 #endif
-	mutable epee::critical_section m_transactions_lock; //!< lock for the pool
+	mutable epee::critical_section m_transactions_lock; //!< lock for changes to the pool, readers use the snapshot
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
   private:
 #endif
@@ -533,6 +765,15 @@ class tx_memory_pool : boost::noncopyable
 	//! container for spent key images from the transactions in the pool
 	key_images_container m_spent_key_images;
 
+	//! the keys of m_spent_key_images, readable without the pool lock
+	sharded_key_image_set m_spent_key_images_index;
+
+	//! bumped, under the pool lock, every time the pool contents change
+	std::atomic<uint64_t> m_pool_version;
+
+	mutable boost::mutex m_snapshot_lock; //!< guards m_snapshot
+	mutable std::shared_ptr<const txpool_snapshot> m_snapshot;
+
 	//TODO: this time should be a named constant somewhere, not hard-coded
 	//! interval on which to check for stale/"stuck" transactions
 	epee::math_helper::once_a_time_seconds<30> m_remove_stuck_tx_interval;
@@ -541,14 +782,38 @@ class tx_memory_pool : boost::noncopyable
 	//!< container for transactions organized by fee per size and receive time
 	sorted_tx_container m_txs_by_fee_and_receive_time;
 
-	/**
-     * @brief get an iterator to a transaction in the sorted container
-     *
-     * @param id the hash of the transaction to look for
-     *
-     * @return an iterator, possibly to the end of the container if not found
-     */
-	sorted_tx_container::iterator find_tx_in_sorted_container(const crypto::hash &id) const;
+	//! a pool transaction, as kept in memory
+	struct txpool_entry
+	{
+		txpool_tx_meta_t meta;
+		std::shared_ptr<const transaction> tx;
+		txpool_blob_arena::blob blob;
+		sorted_tx_container::iterator sorted_it; //!< this tx in m_txs_by_fee_and_receive_time
+	};
+
+	//! the pool's transactions, this is authoritative, the db copy is only for restarts
+	std::unordered_map<crypto::hash, txpool_entry> m_txes;
+
+	//! the keys of m_txes, readable without the pool lock
+	sharded_set<crypto::hash> m_tx_ids;
+
+	//! storage for the blobs of m_txes
+	txpool_blob_arena m_blobs;
+
+	//! transactions by receive time, oldest first
+	std::multimap<time_t, crypto::hash> m_txs_by_receive_time;
+
+	//! transactions by last relay time, least recently relayed first
+	std::multimap<time_t, crypto::hash> m_txs_by_last_relayed_time;
+
+	//! transactions whose db copy is out of date with m_txes
+	std::unordered_set<crypto::hash> m_db_dirty;
+
+	//! interval on which m_db_dirty is written to the db
+	epee::math_helper::once_a_time_seconds<TXPOOL_DB_FLUSH_INTERVAL> m_db_flush_interval;
+
+	//! interval on which blobs are moved out of mostly dead arena chunks
+	epee::math_helper::once_a_time_seconds<TXPOOL_ARENA_COMPACT_INTERVAL> m_compact_interval;
 
 	//! transactions which are unlikely to be included in blocks
 	/*! These transactions are kept in RAM in case they *are* included
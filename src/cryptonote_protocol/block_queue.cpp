@@ -23,6 +23,7 @@
 #include "cryptonote_protocol_defs.h"
 #include "string_tools.h"
 #include <boost/uuid/nil_generator.hpp>
+#include <limits>
 #include <unordered_map>
 #include <vector>
 
@@ -90,6 +91,13 @@ void block_queue::flush_stale_spans(const std::set<boost::uuids::uuid> &live_con
 			blocks.erase(j);
 		}
 	}
+	for(auto p = peers.begin(); p != peers.end();)
+	{
+		if(live_connections.find(p->first) == live_connections.end())
+			p = peers.erase(p);
+		else
+			++p;
+	}
 }
 
 bool block_queue::remove_span(uint64_t start_block_height, std::list<crypto::hash> *hashes)
@@ -409,4 +417,137 @@ bool block_queue::foreach(std::function<bool(const span &)> f, bool include_bloc
 			return false;
 	return true;
 }
+
+void block_queue::update_peer_stats(const boost::uuids::uuid &connection_id, size_t size, uint64_t nblocks, float seconds)
+{
+	if(nblocks == 0 || !(seconds > 0.0f))
+		return;
+
+	boost::unique_lock<boost::recursive_mutex> lock(mutex);
+	peer_stats &stats = peers[connection_id];
+	stats.samples.push_back(std::make_pair(size, seconds));
+	while(stats.samples.size() > BLOCK_QUEUE_PEER_SAMPLES)
+		stats.samples.pop_front();
+	const float block_size = size / (float)nblocks;
+	stats.block_size = stats.nspans == 0 ? block_size : (3 * stats.block_size + block_size) / 4;
+	++stats.nspans;
+
+	// least squares fit of seconds = latency + size / bandwidth
+	const double n = stats.samples.size();
+	double sx = 0, sy = 0, sxx = 0, sxy = 0, min_y = std::numeric_limits<double>::max();
+	for(const auto &s : stats.samples)
+	{
+		const double x = s.first, y = s.second;
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+		min_y = std::min(min_y, y);
+	}
+	const double mx = sx / n, my = sy / n;
+	const double vx = sxx / n - mx * mx, cxy = sxy / n - mx * my;
+
+	// spans need to vary in size for latency to be told apart from bandwidth,
+	// otherwise we keep the previous latency estimate
+	double latency = stats.latency;
+	if(n >= 2 && vx > 0.01 * mx * mx && cxy > 0)
+		latency = my - (cxy / vx) * mx;
+	latency = std::max(0.0, std::min(latency, min_y));
+
+	stats.latency = latency;
+	stats.bandwidth = sx / std::max(sy - n * latency, 1e-3 * n);
+	MDEBUG("Peer " << connection_id << ": " << stats.bandwidth / 1e3 << " kB/s, " << stats.latency * 1e3 << " ms latency, " << stats.block_size << " bytes/block");
+}
+
+void block_queue::remove_peer_stats(const boost::uuids::uuid &connection_id)
+{
+	boost::unique_lock<boost::recursive_mutex> lock(mutex);
+	peers.erase(connection_id);
+}
+
+bool block_queue::get_peer_stats(const boost::uuids::uuid &connection_id, peer_stats &stats) const
+{
+	boost::unique_lock<boost::recursive_mutex> lock(mutex);
+	std::map<boost::uuids::uuid, peer_stats>::const_iterator i = peers.find(connection_id);
+	if(i == peers.end())
+		return false;
+	stats = i->second;
+	return true;
+}
+
+bool block_queue::foreach_peer(std::function<bool(const boost::uuids::uuid &, const peer_stats &)> f) const
+{
+	boost::unique_lock<boost::recursive_mutex> lock(mutex);
+	for(const auto &p : peers)
+		if(!f(p.first, p.second))
+			return false;
+	return true;
+}
+
+uint64_t block_queue::get_span_size(const boost::uuids::uuid &connection_id, uint64_t default_blocks, uint64_t max_blocks) const
+{
+	boost::unique_lock<boost::recursive_mutex> lock(mutex);
+	std::map<boost::uuids::uuid, peer_stats>::const_iterator i = peers.find(connection_id);
+	if(i == peers.end() || i->second.nspans < 2 || !(i->second.bandwidth > 0.0f) || !(i->second.block_size > 0.0f))
+		return std::min(default_blocks, max_blocks);
+
+	// big enough to amortize the round trip, small enough not to leave
+	// the rest of the chain waiting on a slow peer
+	const peer_stats &stats = i->second;
+	const float seconds = std::max(BLOCK_QUEUE_SPAN_TARGET_TIME, BLOCK_QUEUE_SPAN_LATENCY_FACTOR * stats.latency);
+	const double nblocks = std::min<double>(stats.bandwidth * seconds, BLOCK_QUEUE_MAX_SPAN_SIZE) / stats.block_size;
+	if(nblocks >= max_blocks)
+		return max_blocks;
+	return std::max<uint64_t>(1, nblocks);
+}
+
+float block_queue::get_expected_time(const boost::uuids::uuid &connection_id, uint64_t nblocks) const
+{
+	boost::unique_lock<boost::recursive_mutex> lock(mutex);
+	std::map<boost::uuids::uuid, peer_stats>::const_iterator i = peers.find(connection_id);
+	if(i == peers.end() || !(i->second.bandwidth > 0.0f))
+		return -1.0f;
+	return i->second.latency + nblocks * i->second.block_size / i->second.bandwidth;
+}
+
+bool block_queue::is_straggler(const boost::uuids::uuid &span_connection_id, uint64_t nblocks, float elapsed, const boost::uuids::uuid &connection_id) const
+{
+	boost::unique_lock<boost::recursive_mutex> lock(mutex);
+	const float expected = get_expected_time(span_connection_id, nblocks);
+	const float ours = get_expected_time(connection_id, nblocks);
+	if(expected < 0.0f || ours < 0.0f)
+		return false;
+	if(elapsed > BLOCK_QUEUE_STRAGGLER_FACTOR * expected)
+		return true;
+	return BLOCK_QUEUE_STRAGGLER_FACTOR * ours < expected - elapsed;
+}
+
+size_t block_queue::get_scheduled_size() const
+{
+	boost::unique_lock<boost::recursive_mutex> lock(mutex);
+	size_t size = 0;
+	for(const auto &span : blocks)
+	{
+		if(!span.blocks.empty() || is_blockchain_placeholder(span))
+			continue;
+		std::map<boost::uuids::uuid, peer_stats>::const_iterator i = peers.find(span.connection_id);
+		if(i != peers.end())
+			size += span.nblocks * i->second.block_size;
+	}
+	return size;
+}
+
+size_t block_queue::get_download_target() const
+{
+	boost::unique_lock<boost::recursive_mutex> lock(mutex);
+	double bandwidth = 0;
+	for(const auto &p : peers)
+		bandwidth += p.second.bandwidth;
+	const double target = bandwidth * BLOCK_QUEUE_TARGET_TIME;
+	if(target <= BLOCK_QUEUE_MIN_TARGET_SIZE)
+		return BLOCK_QUEUE_MIN_TARGET_SIZE;
+	if(target >= BLOCK_QUEUE_MAX_TARGET_SIZE)
+		return BLOCK_QUEUE_MAX_TARGET_SIZE;
+	return target;
+}
 }
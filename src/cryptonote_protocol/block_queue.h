@@ -23,7 +23,10 @@
 
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/uuid/uuid.hpp>
+#include <deque>
+#include <functional>
 #include <list>
+#include <map>
 #include <set>
 #include <string>
 #include "crypto/hash.h"
@@ -31,6 +34,15 @@
 //#undef RYO_DEFAULT_LOG_CATEGORY
 //#define RYO_DEFAULT_LOG_CATEGORY "cn.block_queue"
 
+#define BLOCK_QUEUE_PEER_SAMPLES 8					  // spans remembered per peer to fit latency and bandwidth
+#define BLOCK_QUEUE_SPAN_TARGET_TIME 2.0f			  // seconds a span should take to download
+#define BLOCK_QUEUE_SPAN_LATENCY_FACTOR 4.0f		  // spans take at least that many round trips to download
+#define BLOCK_QUEUE_MAX_SPAN_SIZE (16 * 1024 * 1024)  // bytes, keeps responses well under the levin packet limit
+#define BLOCK_QUEUE_STRAGGLER_FACTOR 2.0f			  // a span is late when it takes that many times its expected time
+#define BLOCK_QUEUE_TARGET_TIME 20.0f				  // seconds of download kept queued ahead of validation
+#define BLOCK_QUEUE_MIN_TARGET_SIZE (8 * 1024 * 1024) // bytes
+#define BLOCK_QUEUE_MAX_TARGET_SIZE (100 * 1024 * 1024) // bytes
+
 namespace cryptonote
 {
 struct block_complete_entry;
@@ -56,6 +68,19 @@ class block_queue
 	};
 	typedef std::set<span> block_map;
 
+	// Download performance of a peer, fitted over its last few spans as
+	// download_time = latency + size / bandwidth
+	struct peer_stats
+	{
+		float bandwidth;  // bytes per second
+		float latency;	// seconds
+		float block_size; // average bytes per block
+		uint64_t nspans;
+		std::deque<std::pair<size_t, float>> samples; // size, seconds
+
+		peer_stats() : bandwidth(0.0f), latency(0.0f), block_size(0.0f), nspans(0) {}
+	};
+
   public:
 	void add_blocks(uint64_t height, std::list<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, float rate, size_t size);
 	void add_blocks(uint64_t height, uint64_t nblocks, const boost::uuids::uuid &connection_id, boost::posix_time::ptime time = boost::date_time::min_date_time);
@@ -82,8 +107,19 @@ class block_queue
 	bool foreach(std::function<bool(const span &)> f, bool include_blockchain_placeholder = false) const;
 	bool requested(const crypto::hash &hash) const;
 
+	void update_peer_stats(const boost::uuids::uuid &connection_id, size_t size, uint64_t nblocks, float seconds);
+	void remove_peer_stats(const boost::uuids::uuid &connection_id);
+	bool get_peer_stats(const boost::uuids::uuid &connection_id, peer_stats &stats) const;
+	bool foreach_peer(std::function<bool(const boost::uuids::uuid &, const peer_stats &)> f) const;
+	uint64_t get_span_size(const boost::uuids::uuid &connection_id, uint64_t default_blocks, uint64_t max_blocks) const;
+	float get_expected_time(const boost::uuids::uuid &connection_id, uint64_t nblocks) const;
+	bool is_straggler(const boost::uuids::uuid &span_connection_id, uint64_t nblocks, float elapsed, const boost::uuids::uuid &connection_id) const;
+	size_t get_scheduled_size() const;
+	size_t get_download_target() const;
+
   private:
 	block_map blocks;
+	std::map<boost::uuids::uuid, peer_stats> peers;
 	mutable boost::recursive_mutex mutex;
 };
 }
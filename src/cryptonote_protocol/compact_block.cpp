@@ -0,0 +1,128 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+// Copyright (c) 2018, Ryo Currency Project
+// Portions copyright (c) 2014-2018, The Monero Project
+//
+// Portions of this file are available under BSD-3 license. Please see ORIGINAL-LICENSE for details
+// All rights reserved.
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include <unordered_set>
+
+#include "compact_block.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "misc_log_ex.h"
+
+#undef RYO_DEFAULT_LOG_CATEGORY
+#define RYO_DEFAULT_LOG_CATEGORY "net.cn"
+
+namespace cryptonote
+{
+uint64_t get_short_tx_id(uint64_t salt, const crypto::hash &txid)
+{
+	char data[sizeof(salt) + sizeof(txid)];
+	memcpy(data, &salt, sizeof(salt));
+	memcpy(data + sizeof(salt), &txid, sizeof(txid));
+	crypto::hash h;
+	crypto::cn_fast_hash(data, sizeof(data), h);
+	uint64_t id = 0;
+	memcpy(&id, &h, COMPACT_BLOCK_SHORT_ID_SIZE);
+	return id;
+}
+
+bool make_compact_block(const block &b, const crypto::hash &block_hash, const std::unordered_map<crypto::hash, blobdata> &txs, uint64_t salt,
+						const std::function<bool(const crypto::hash &)> &peer_has, uint64_t current_blockchain_height, NOTIFY_NEW_COMPACT_BLOCK::request &arg)
+{
+	block header = b;
+	header.tx_hashes.clear();
+	arg.block = block_to_blob(header);
+	arg.block_hash = block_hash;
+	arg.salt = salt;
+	arg.tx_count = b.tx_hashes.size();
+	arg.short_ids.clear();
+	arg.prefilled_txs.clear();
+	arg.current_blockchain_height = current_blockchain_height;
+
+	for(size_t i = 0; i < b.tx_hashes.size(); ++i)
+	{
+		const crypto::hash &txid = b.tx_hashes[i];
+		if(peer_has(txid))
+		{
+			const uint64_t id = get_short_tx_id(salt, txid);
+			arg.short_ids.append((const char *)&id, COMPACT_BLOCK_SHORT_ID_SIZE);
+			continue;
+		}
+
+		auto it = txs.find(txid);
+		CHECK_AND_ASSERT_MES(it != txs.end(), false, "tx " << txid << " of block " << block_hash << " not given");
+		arg.prefilled_txs.push_back({i, it->second});
+	}
+	return true;
+}
+
+bool reconstruct_compact_block(const NOTIFY_NEW_COMPACT_BLOCK::request &arg, const std::vector<crypto::hash> &pool_tx_hashes,
+							   block &b, std::list<blobdata> &txs, std::vector<uint64_t> &missing)
+{
+	CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(arg.block, b), false, "Failed to parse compact block");
+	CHECK_AND_ASSERT_MES(b.tx_hashes.empty(), false, "Compact block carries tx hashes");
+	CHECK_AND_ASSERT_MES(arg.short_ids.size() % COMPACT_BLOCK_SHORT_ID_SIZE == 0, false, "Bad short id blob size " << arg.short_ids.size());
+	CHECK_AND_ASSERT_MES(arg.short_ids.size() / COMPACT_BLOCK_SHORT_ID_SIZE + arg.prefilled_txs.size() == arg.tx_count, false,
+						 "Compact block has " << arg.tx_count << " txs but " << arg.short_ids.size() / COMPACT_BLOCK_SHORT_ID_SIZE << " short ids and " << arg.prefilled_txs.size() << " prefilled txs");
+
+	b.tx_hashes.resize(arg.tx_count, crypto::null_hash);
+	std::vector<bool> prefilled(arg.tx_count, false);
+	txs.clear();
+	missing.clear();
+
+	uint64_t next_index = 0;
+	for(const prefilled_tx_entry &e : arg.prefilled_txs)
+	{
+		CHECK_AND_ASSERT_MES(e.index >= next_index && e.index < arg.tx_count, false, "Bad prefilled tx index " << e.index);
+		transaction tx;
+		crypto::hash tx_hash, tx_prefix_hash;
+		CHECK_AND_ASSERT_MES(parse_and_validate_tx_from_blob(e.tx, tx, tx_hash, tx_prefix_hash), false, "Failed to parse prefilled tx " << e.index);
+		b.tx_hashes[e.index] = tx_hash;
+		prefilled[e.index] = true;
+		txs.push_back(e.tx);
+		next_index = e.index + 1;
+	}
+
+	std::unordered_map<uint64_t, crypto::hash> pool_ids;
+	std::unordered_set<uint64_t> ambiguous;
+	pool_ids.reserve(pool_tx_hashes.size());
+	for(const crypto::hash &txid : pool_tx_hashes)
+	{
+		const uint64_t id = get_short_tx_id(arg.salt, txid);
+		if(!pool_ids.emplace(id, txid).second)
+			ambiguous.insert(id);
+	}
+
+	const char *short_id = arg.short_ids.data();
+	for(uint64_t i = 0; i < arg.tx_count; ++i)
+	{
+		if(prefilled[i])
+			continue;
+		uint64_t id = 0;
+		memcpy(&id, short_id, COMPACT_BLOCK_SHORT_ID_SIZE);
+		short_id += COMPACT_BLOCK_SHORT_ID_SIZE;
+
+		auto it = pool_ids.find(id);
+		if(it == pool_ids.end() || ambiguous.count(id))
+			missing.push_back(i);
+		else
+			b.tx_hashes[i] = it->second;
+	}
+	return true;
+}
+}
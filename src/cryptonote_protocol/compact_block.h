@@ -0,0 +1,73 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+// Copyright (c) 2018, Ryo Currency Project
+// Portions copyright (c) 2014-2018, The Monero Project
+//
+// Portions of this file are available under BSD-3 license. Please see ORIGINAL-LICENSE for details
+// All rights reserved.
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "cryptonote_protocol_defs.h"
+
+#define COMPACT_BLOCK_SHORT_ID_SIZE 6
+
+namespace cryptonote
+{
+/**
+ * @brief the short id of a tx in a compact block
+ *
+ * The first COMPACT_BLOCK_SHORT_ID_SIZE bytes of the hash of the salt and
+ * the txid. The salt is picked per block by the sender, so nobody can
+ * grind txs which collide in every block.
+ */
+uint64_t get_short_tx_id(uint64_t salt, const crypto::hash &txid);
+
+/**
+ * @brief build the compact form of a block for one peer
+ *
+ * @param b the block
+ * @param block_hash its hash
+ * @param txs the blobs of the block's txs
+ * @param salt the short id salt
+ * @param peer_has whether the peer most likely has a tx, the other ones are prefilled
+ * @param current_blockchain_height
+ * @param arg the message
+ *
+ * @return false if a tx of the block is not in txs
+ */
+bool make_compact_block(const block &b, const crypto::hash &block_hash, const std::unordered_map<crypto::hash, blobdata> &txs, uint64_t salt,
+						const std::function<bool(const crypto::hash &)> &peer_has, uint64_t current_blockchain_height, NOTIFY_NEW_COMPACT_BLOCK::request &arg);
+
+/**
+ * @brief rebuild the tx hash list of a compact block
+ *
+ * Short ids are matched against the pool; an id which matches several pool
+ * txs is left unresolved rather than guessed.
+ *
+ * @param arg the message
+ * @param pool_tx_hashes the txs in our pool
+ * @param b the block, complete if no index is missing
+ * @param txs the prefilled tx blobs
+ * @param missing the indices of the txs to request
+ *
+ * @return false if the message is malformed
+ */
+bool reconstruct_compact_block(const NOTIFY_NEW_COMPACT_BLOCK::request &arg, const std::vector<crypto::hash> &pool_tx_hashes,
+							   block &b, std::list<blobdata> &txs, std::vector<uint64_t> &missing);
+}
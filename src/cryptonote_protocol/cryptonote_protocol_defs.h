@@ -268,4 +268,49 @@ struct NOTIFY_REQUEST_FLUFFY_MISSING_TX
 		END_KV_SERIALIZE_MAP()
 	};
 };
+
+/************************************************************************/
+/*                                                                      */
+/************************************************************************/
+struct prefilled_tx_entry
+{
+	uint64_t index;
+	blobdata tx;
+
+	BEGIN_KV_SERIALIZE_MAP()
+	KV_SERIALIZE(index)
+	KV_SERIALIZE(tx)
+	END_KV_SERIALIZE_MAP()
+};
+
+/************************************************************************/
+/* A block whose txs are given as salted short ids, except for those    */
+/* the sender expects the peer not to have. Missing txs are requested   */
+/* with NOTIFY_REQUEST_FLUFFY_MISSING_TX like for a fluffy block.       */
+/************************************************************************/
+struct NOTIFY_NEW_COMPACT_BLOCK
+{
+	const static int ID = BC_COMMANDS_POOL_BASE + 10;
+
+	struct request
+	{
+		blobdata block; // without tx hashes, the miner tx is always included
+		crypto::hash block_hash;
+		uint64_t salt;
+		uint64_t tx_count;
+		std::string short_ids; // one per tx which is not prefilled, in block order
+		std::list<prefilled_tx_entry> prefilled_txs; // by increasing index
+		uint64_t current_blockchain_height;
+
+		BEGIN_KV_SERIALIZE_MAP()
+		KV_SERIALIZE(block)
+		KV_SERIALIZE_VAL_POD_AS_BLOB(block_hash)
+		KV_SERIALIZE(salt)
+		KV_SERIALIZE(tx_count)
+		KV_SERIALIZE(short_ids)
+		KV_SERIALIZE(prefilled_txs)
+		KV_SERIALIZE(current_blockchain_height)
+		END_KV_SERIALIZE_MAP()
+	};
+};
 }
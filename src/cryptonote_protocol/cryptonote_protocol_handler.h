@@ -29,6 +29,7 @@
 #include <string>
 
 #include "block_queue.h"
+#include "compact_block.h"
 #include "cryptonote_basic/connection_context.h"
 #include "cryptonote_basic/cryptonote_stat_info.h"
 #include "cryptonote_protocol_defs.h"
@@ -82,9 +83,11 @@ class t_cryptonote_protocol_handler : public i_cryptonote_protocol, cryptonote_p
 	HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
 	HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)
 	HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)
+	HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &cryptonote_protocol_handler::handle_notify_new_compact_block)
 	END_INVOKE_MAP2()
 
 	bool on_idle();
+	bool on_tx_relay_timer();
 	bool init(const boost::program_options::variables_map &vm);
 	bool deinit();
 	void set_p2p_endpoint(nodetool::i_p2p_endpoint<connection_context> *p2p);
@@ -112,6 +115,7 @@ class t_cryptonote_protocol_handler : public i_cryptonote_protocol, cryptonote_p
 	int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request &arg, cryptonote_connection_context &context);
 	int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request &arg, cryptonote_connection_context &context);
 	int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request &arg, cryptonote_connection_context &context);
+	int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request &arg, cryptonote_connection_context &context);
 
 	//----------------- i_bc_protocol_layout ---------------------------------------
 	virtual bool relay_block(NOTIFY_NEW_BLOCK::request &arg, cryptonote_connection_context &exclude_context);
@@ -134,6 +138,7 @@ class t_cryptonote_protocol_handler : public i_cryptonote_protocol, cryptonote_p
 	std::atomic<bool> m_synchronized;
 	std::atomic<bool> m_stopping;
 	boost::mutex m_sync_lock;
+	boost::mutex m_tx_relay_lock; //guards m_known_txs and m_pending_txs of every connection
 	block_queue m_block_queue;
 	epee::math_helper::once_a_time_seconds<30> m_idle_peer_kicker;
 
@@ -30,6 +30,7 @@
 #include <ctime>
 #include <list>
 
+#include "common/trace.h"
 #include "cryptonote_basic/verification_context.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "net/network_throttle-detail.hpp"
@@ -41,7 +42,6 @@
 #define MLOG_P2P_MESSAGE(x) MCINFO("net.p2p.msg", context << x)
 
 #define BLOCK_QUEUE_NBLOCKS_THRESHOLD 10					// chunks of N blocks
-#define BLOCK_QUEUE_SIZE_THRESHOLD (100 * 1024 * 1024)		// MB
 #define REQUEST_NEXT_SCHEDULED_SPAN_THRESHOLD (5 * 1000000) // microseconds
 #define IDLE_PEER_KICK_TIME (600 * 1000000)					// microseconds
 #define PASSIVE_PEER_KICK_TIME (60 * 1000000)				// microseconds
@@ -316,6 +316,7 @@ template <class t_core>
 int t_cryptonote_protocol_handler<t_core>::handle_notify_new_block(int command, NOTIFY_NEW_BLOCK::request &arg, cryptonote_connection_context &context)
 {
 	MLOG_P2P_MESSAGE("Received NOTIFY_NEW_BLOCK (" << arg.b.txs.size() << " txes)");
+	TRACE_SCOPE_ARG(handle_notify_new_block, arg.b.txs.size());
 	if(context.m_state != cryptonote_connection_context::state_normal)
 		return 1;
 	if(!is_synchronized()) // can happen if a peer connection goes to normal but another thread still hasn't finished adding queued blocks
@@ -377,6 +378,7 @@ template <class t_core>
 int t_cryptonote_protocol_handler<t_core>::handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request &arg, cryptonote_connection_context &context)
 {
 	MLOG_P2P_MESSAGE("Received NOTIFY_NEW_FLUFFY_BLOCK (height " << arg.current_blockchain_height << ", " << arg.b.txs.size() << " txes)");
+	TRACE_SCOPE_ARG(handle_notify_new_fluffy_block, arg.current_blockchain_height);
 	if(context.m_state != cryptonote_connection_context::state_normal)
 		return 1;
 	if(!is_synchronized()) // can happen if a peer connection goes to normal but another thread still hasn't finished adding queued blocks
@@ -716,9 +718,66 @@ int t_cryptonote_protocol_handler<t_core>::handle_request_fluffy_missing_tx(int
 }
 //------------------------------------------------------------------------------------------------------------------------
 template <class t_core>
+int t_cryptonote_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request &arg, cryptonote_connection_context &context)
+{
+	MLOG_P2P_MESSAGE("Received NOTIFY_NEW_COMPACT_BLOCK (height " << arg.current_blockchain_height << ", " << arg.tx_count << " txes, " << arg.prefilled_txs.size() << " prefilled)");
+	TRACE_SCOPE_ARG(handle_notify_new_compact_block, arg.current_blockchain_height);
+	if(context.m_state != cryptonote_connection_context::state_normal)
+		return 1;
+	if(!is_synchronized())
+	{
+		LOG_DEBUG_CC(context, "Received new block while syncing, ignored");
+		return 1;
+	}
+
+	std::vector<crypto::hash> pool_tx_hashes;
+	m_core.get_pool_transaction_hashes(pool_tx_hashes);
+
+	block new_block;
+	std::list<blobdata> txs;
+	std::vector<uint64_t> need_tx_indices;
+	if(!reconstruct_compact_block(arg, pool_tx_hashes, new_block, txs, need_tx_indices))
+	{
+		LOG_ERROR_CCONTEXT("sent wrong compact block " << arg.block_hash << ", dropping connection");
+		drop_connection(context, false, false);
+		return 1;
+	}
+
+	if(need_tx_indices.empty())
+	{
+		if(get_block_hash(new_block) == arg.block_hash)
+		{
+			// from here on it is a fluffy block whose txs all are in the pool or given
+			NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
+			fluffy_arg.b.block = block_to_blob(new_block);
+			fluffy_arg.b.txs = std::move(txs);
+			fluffy_arg.current_blockchain_height = arg.current_blockchain_height;
+			return handle_notify_new_fluffy_block(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffy_arg, context);
+		}
+
+		// a short id matched the wrong pool tx, take all the short id ones from the peer
+		MDEBUG("Compact block " << arg.block_hash << " does not match its txes, requesting them");
+		for(const prefilled_tx_entry &e : arg.prefilled_txs)
+			new_block.tx_hashes[e.index] = crypto::null_hash;
+		for(size_t i = 0; i < new_block.tx_hashes.size(); ++i)
+			if(new_block.tx_hashes[i] != crypto::null_hash)
+				need_tx_indices.push_back(i);
+	}
+
+	MDEBUG("We are missing " << need_tx_indices.size() << " txes for this compact block");
+	NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing_tx_req;
+	missing_tx_req.block_hash = arg.block_hash;
+	missing_tx_req.current_blockchain_height = arg.current_blockchain_height;
+	missing_tx_req.missing_tx_indices = std::move(need_tx_indices);
+	post_notify<NOTIFY_REQUEST_FLUFFY_MISSING_TX>(missing_tx_req, context);
+	return 1;
+}
+//------------------------------------------------------------------------------------------------------------------------
+template <class t_core>
 int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request &arg, cryptonote_connection_context &context)
 {
 	MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTIONS (" << arg.txs.size() << " txes)");
+	TRACE_SCOPE_ARG(handle_notify_new_transactions, arg.txs.size());
 	if(context.m_state != cryptonote_connection_context::state_normal)
 		return 1;
 
@@ -731,6 +790,12 @@ int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transactions(int co
 		return 1;
 	}
 
+	{
+		CRITICAL_REGION_LOCAL(m_tx_relay_lock);
+		for(const blobdata &tx_blob : arg.txs)
+			context.m_known_txs.insert(get_blob_hash(tx_blob));
+	}
+
 	for(auto tx_blob_it = arg.txs.begin(); tx_blob_it != arg.txs.end();)
 	{
 		cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
@@ -795,6 +860,7 @@ template <class t_core>
 int t_cryptonote_protocol_handler<t_core>::handle_response_get_objects(int command, NOTIFY_RESPONSE_GET_OBJECTS::request &arg, cryptonote_connection_context &context)
 {
 	MLOG_P2P_MESSAGE("Received NOTIFY_RESPONSE_GET_OBJECTS (" << arg.blocks.size() << " blocks, " << arg.txs.size() << " txes)");
+	TRACE_SCOPE_ARG(handle_response_get_objects, arg.blocks.size());
 
 	// calculate size of request
 	size_t size = 0;
@@ -916,6 +982,7 @@ int t_cryptonote_protocol_handler<t_core>::handle_response_get_objects(int comma
 		const float rate = size * 1e6 / (dt.total_microseconds() + 1);
 		MDEBUG(context << " adding span: " << arg.blocks.size() << " at height " << start_height << ", " << dt.total_microseconds() / 1e6 << " seconds, " << (rate / 1e3) << " kB/s, size now " << (m_block_queue.get_data_size() + blocks_size) / 1048576.f << " MB");
 		m_block_queue.add_blocks(start_height, arg.blocks, context.m_connection_id, rate, blocks_size);
+		m_block_queue.update_peer_stats(context.m_connection_id, size, arg.blocks.size(), dt.total_microseconds() / 1e6f);
 
 		context.m_last_known_hash = last_block_hash;
 
@@ -933,6 +1000,7 @@ skip:
 template <class t_core>
 int t_cryptonote_protocol_handler<t_core>::try_add_next_blocks(cryptonote_connection_context &context)
 {
+	TRACE_SCOPE(try_add_next_blocks);
 	bool force_next_span = false;
 
 	{
@@ -1262,6 +1330,14 @@ bool t_cryptonote_protocol_handler<t_core>::should_download_next_span(cryptonote
 		MDEBUG(context << " we should download it as this span was requested long ago");
 		return true;
 	}
+	//  - the other one is late on its own measured throughput, or we'd be done well before it
+	const float elapsed = (now - request_time).total_microseconds() / 1e6f;
+	if(m_block_queue.is_straggler(span_connection_id, span.second, elapsed, context.m_connection_id))
+	{
+		MDEBUG(context << " we should download it as the peer it is scheduled for is straggling (" << elapsed << " sec, expected "
+					   << m_block_queue.get_expected_time(span_connection_id, span.second) << ", ours " << m_block_queue.get_expected_time(context.m_connection_id, span.second) << ")");
+		return true;
+	}
 	return false;
 }
 //------------------------------------------------------------------------------------------------------------------------
@@ -1284,8 +1360,8 @@ bool t_cryptonote_protocol_handler<t_core>::request_missing_objects(cryptonote_c
 		while(1)
 		{
 			size_t nblocks = m_block_queue.get_num_filled_spans();
-			size_t size = m_block_queue.get_data_size();
-			if(nblocks < BLOCK_QUEUE_NBLOCKS_THRESHOLD || size < BLOCK_QUEUE_SIZE_THRESHOLD)
+			size_t size = m_block_queue.get_data_size() + m_block_queue.get_scheduled_size();
+			if(nblocks < BLOCK_QUEUE_NBLOCKS_THRESHOLD || size < m_block_queue.get_download_target())
 			{
 				if(!first)
 				{
@@ -1344,7 +1420,7 @@ bool t_cryptonote_protocol_handler<t_core>::request_missing_objects(cryptonote_c
 		NOTIFY_REQUEST_GET_OBJECTS::request req;
 		bool is_next = false;
 		size_t count = 0;
-		const size_t count_limit = m_core.get_block_sync_size(m_core.get_current_blockchain_height());
+		const size_t count_limit = m_block_queue.get_span_size(context.m_connection_id, m_core.get_block_sync_size(m_core.get_current_blockchain_height()), BLOCKS_SYNCHRONIZING_MAX_COUNT);
 		std::pair<uint64_t, uint64_t> span = std::make_pair(0, 0);
 		{
 			MDEBUG(context << " checking for gap");
@@ -1629,11 +1705,56 @@ bool t_cryptonote_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::reques
 	epee::serialization::store_t_to_binary(arg, fullBlob);
 	epee::serialization::store_t_to_binary(fluffy_arg, fluffyBlob);
 
-	// sort peers between fluffy ones and others
+	// compact blocks differ per peer, parsed on the first peer that takes them
+	block b;
+	crypto::hash block_hash = crypto::null_hash;
+	std::unordered_map<crypto::hash, blobdata> txs;
+	std::unordered_map<crypto::hash, crypto::hash> tx_blob_hashes;
+	bool compact_parsed = false, compact_ok = m_core.fluffy_blocks_enabled();
+	const uint64_t salt = crypto::rand<uint64_t>();
+	std::list<std::pair<boost::uuids::uuid, std::string>> compactBlobs;
+
+	// sort peers between compact, fluffy ones and others
 	std::list<boost::uuids::uuid> fullConnections, fluffyConnections;
-	m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections](connection_context &context, nodetool::peerid_type peer_id, uint32_t support_flags) {
+	CRITICAL_REGION_BEGIN(m_tx_relay_lock);
+	m_p2p->for_each_connection([&](connection_context &context, nodetool::peerid_type peer_id, uint32_t support_flags) {
 		if(peer_id && exclude_context.m_connection_id != context.m_connection_id)
 		{
+			if(compact_ok && (support_flags & P2P_SUPPORT_FLAG_COMPACT_BLOCKS))
+			{
+				if(!compact_parsed)
+				{
+					compact_parsed = true;
+					compact_ok = parse_and_validate_block_from_blob(arg.b.block, b);
+					block_hash = get_block_hash(b);
+					for(const blobdata &tx_blob : arg.b.txs)
+					{
+						transaction tx;
+						crypto::hash tx_hash, tx_prefix_hash;
+						if(!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash))
+						{
+							compact_ok = false;
+							break;
+						}
+						txs.emplace(tx_hash, tx_blob);
+						tx_blob_hashes.emplace(tx_hash, get_blob_hash(tx_blob));
+					}
+				}
+
+				NOTIFY_NEW_COMPACT_BLOCK::request compact_arg;
+				const auto peer_has = [&context, &tx_blob_hashes](const crypto::hash &txid) { return context.m_known_txs.contains(tx_blob_hashes[txid]); };
+				if(compact_ok && make_compact_block(b, block_hash, txs, salt, peer_has, arg.current_blockchain_height, compact_arg))
+				{
+					for(const auto &tx_blob_hash : tx_blob_hashes)
+						context.m_known_txs.insert(tx_blob_hash.second);
+					LOG_DEBUG_CC(context, "PEER SUPPORTS COMPACT BLOCKS - RELAYING " << compact_arg.prefilled_txs.size() << "/" << compact_arg.tx_count << " TXES IN FULL");
+					compactBlobs.emplace_back(context.m_connection_id, std::string());
+					epee::serialization::store_t_to_binary(compact_arg, compactBlobs.back().second);
+					return true;
+				}
+				compact_ok = false;
+			}
+
 			if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
 			{
 				LOG_DEBUG_CC(context, "PEER SUPPORTS FLUFFY BLOCKS - RELAYING THIN/COMPACT WHATEVER BLOCK");
@@ -1647,8 +1768,11 @@ bool t_cryptonote_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::reques
 		}
 		return true;
 	});
+	CRITICAL_REGION_END();
 
-	// send fluffy ones first, we want to encourage people to run that
+	// send compact and fluffy ones first, we want to encourage people to run that
+	for(const auto &compact : compactBlobs)
+		m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, compact.second, std::list<boost::uuids::uuid>{compact.first});
 	m_p2p->relay_notify_to_list(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffyBlob, fluffyConnections);
 	m_p2p->relay_notify_to_list(NOTIFY_NEW_BLOCK::ID, fullBlob, fullConnections);
 
@@ -1659,9 +1783,65 @@ template <class t_core>
 bool t_cryptonote_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request &arg, cryptonote_connection_context &exclude_context)
 {
 	// no check for success, so tell core they're relayed unconditionally
-	for(auto tx_blob_it = arg.txs.begin(); tx_blob_it != arg.txs.end(); ++tx_blob_it)
-		m_core.on_transaction_relayed(*tx_blob_it);
-	return relay_post_notify<NOTIFY_NEW_TRANSACTIONS>(arg, exclude_context);
+	std::vector<crypto::hash> blob_hashes;
+	blob_hashes.reserve(arg.txs.size());
+	for(const blobdata &tx_blob : arg.txs)
+	{
+		m_core.on_transaction_relayed(tx_blob);
+		blob_hashes.push_back(get_blob_hash(tx_blob));
+	}
+
+	// queue for each peer what it does not have yet, on_tx_relay_timer sends the batches
+	const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+	CRITICAL_REGION_LOCAL(m_tx_relay_lock);
+	m_p2p->for_each_connection([&](cryptonote_connection_context &context, nodetool::peerid_type peer_id, uint32_t support_flags) {
+		if(!peer_id || context.m_connection_id == exclude_context.m_connection_id)
+			return true;
+
+		auto tx_blob_it = arg.txs.begin();
+		for(size_t i = 0; i < blob_hashes.size(); ++i, ++tx_blob_it)
+		{
+			if(context.m_known_txs.contains(blob_hashes[i]))
+				continue;
+			context.m_known_txs.insert(blob_hashes[i]);
+			if(context.m_pending_txs.empty())
+				context.m_next_tx_relay_time = now + boost::posix_time::milliseconds(crypto::rand<uint32_t>() % (2 * P2P_TX_RELAY_INTERVAL_MS + 1));
+			context.m_pending_txs.push_back(*tx_blob_it);
+		}
+		return true;
+	});
+
+	return true;
+}
+//------------------------------------------------------------------------------------------------------------------------
+template <class t_core>
+bool t_cryptonote_protocol_handler<t_core>::on_tx_relay_timer()
+{
+	if(m_stopping)
+		return true;
+
+	// each peer has its own randomized deadline, so the order txs reach peers says little about where they came from
+	const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+	std::list<std::pair<boost::uuids::uuid, std::string>> batches;
+	{
+		CRITICAL_REGION_LOCAL(m_tx_relay_lock);
+		m_p2p->for_each_connection([&](cryptonote_connection_context &context, nodetool::peerid_type peer_id, uint32_t support_flags) {
+			if(context.m_pending_txs.empty() || now < context.m_next_tx_relay_time)
+				return true;
+
+			NOTIFY_NEW_TRANSACTIONS::request batch;
+			batch.txs.assign(std::make_move_iterator(context.m_pending_txs.begin()), std::make_move_iterator(context.m_pending_txs.end()));
+			context.m_pending_txs.clear();
+			LOG_DEBUG_CC(context, "relaying a batch of " << batch.txs.size() << " txes");
+			batches.emplace_back(context.m_connection_id, std::string());
+			epee::serialization::store_t_to_binary(batch, batches.back().second);
+			return true;
+		});
+	}
+
+	for(const auto &batch : batches)
+		m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, batch.second, std::list<boost::uuids::uuid>{batch.first});
+	return true;
 }
 //------------------------------------------------------------------------------------------------------------------------
 template <class t_core>
@@ -1691,6 +1871,7 @@ void t_cryptonote_protocol_handler<t_core>::on_connection_close(cryptonote_conne
 	}
 
 	m_block_queue.flush_spans(context.m_connection_id, false);
+	m_block_queue.remove_peer_stats(context.m_connection_id);
 }
 
 //------------------------------------------------------------------------------------------------------------------------
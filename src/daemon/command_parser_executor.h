@@ -60,6 +60,8 @@ class t_command_parser_executor final
 
 	bool print_connections(const std::vector<std::string> &args);
 
+	bool print_net_stats(const std::vector<std::string> &args);
+
 	bool print_blockchain_info(const std::vector<std::string> &args);
 
 	bool set_log_level(const std::vector<std::string> &args);
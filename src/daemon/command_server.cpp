@@ -42,6 +42,8 @@ t_command_server::t_command_server(
 		"print_pl_stats", std::bind(&t_command_parser_executor::print_peer_list_stats, &m_parser, p::_1), "Print the peer list statistics.");
 	m_command_lookup.set_handler(
 		"print_cn", std::bind(&t_command_parser_executor::print_connections, &m_parser, p::_1), "Print the current connections.");
+	m_command_lookup.set_handler(
+		"print_net_stats", std::bind(&t_command_parser_executor::print_net_stats, &m_parser, p::_1), "Print the p2p compression ratio and CPU cost per command.");
 	m_command_lookup.set_handler(
 		"print_bc", std::bind(&t_command_parser_executor::print_blockchain_info, &m_parser, p::_1), "print_bc <begin_height> [<end_height>]", "Print the blockchain info in a given blocks range.");
 	m_command_lookup.set_handler(
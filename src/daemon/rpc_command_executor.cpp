@@ -501,6 +501,59 @@ bool t_rpc_command_executor::print_connections()
 	return true;
 }
 
+bool t_rpc_command_executor::print_net_stats()
+{
+	cryptonote::COMMAND_RPC_GET_NET_STATS::request req;
+	cryptonote::COMMAND_RPC_GET_NET_STATS::response res;
+	epee::json_rpc::error error_resp;
+
+	std::string fail_message = "Unsuccessful";
+
+	if(m_is_rpc)
+	{
+		if(!m_rpc_client->json_rpc_request(req, res, "get_net_stats", fail_message.c_str()))
+		{
+			return true;
+		}
+	}
+	else
+	{
+		if(!m_rpc_server->on_get_net_stats(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+		{
+			tools::fail_msg_writer() << make_error(fail_message, res.status);
+			return true;
+		}
+	}
+
+	tools::msg_writer() << std::setw(10) << std::left << "Command"
+						<< std::setw(12) << "Sent"
+						<< std::setw(12) << "Skipped"
+						<< std::setw(16) << "Sent MB"
+						<< std::setw(10) << "Ratio"
+						<< std::setw(14) << "Pack us/msg"
+						<< std::setw(12) << "Received"
+						<< std::setw(16) << "Received MB"
+						<< std::setw(10) << "Ratio"
+						<< std::setw(14) << "Unpack us/msg";
+
+	for(const auto &s : res.compression)
+	{
+		const uint64_t packs = s.sent_messages + s.sent_uncompressed;
+		tools::msg_writer() << std::setw(10) << std::left << s.command
+							<< std::setw(12) << s.sent_messages
+							<< std::setw(12) << s.sent_uncompressed
+							<< std::setw(16) << std::fixed << std::setprecision(2) << s.sent_raw_bytes / 1048576.0
+							<< std::setw(10) << std::setprecision(3) << (s.sent_raw_bytes ? (double)s.sent_packed_bytes / s.sent_raw_bytes : 0.0)
+							<< std::setw(14) << (packs ? s.compress_us / packs : 0)
+							<< std::setw(12) << s.received_messages
+							<< std::setw(16) << std::setprecision(2) << s.received_raw_bytes / 1048576.0
+							<< std::setw(10) << std::setprecision(3) << (s.received_raw_bytes ? (double)s.received_packed_bytes / s.received_raw_bytes : 0.0)
+							<< std::setw(14) << (s.received_messages ? s.decompress_us / s.received_messages : 0);
+	}
+
+	return true;
+}
+
 bool t_rpc_command_executor::print_blockchain_info(uint64_t start_block_index, uint64_t end_block_index)
 {
 	cryptonote::COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::request req;
@@ -1823,8 +1876,10 @@ bool t_rpc_command_executor::sync_info()
 		for(const auto &s : res.spans)
 			if(s.rate > 0.0f && s.connection_id == p.info.connection_id)
 				nblocks += s.nblocks, size += s.size;
-		tools::success_msg_writer() << address << "  " << epee::string_tools::pad_string(p.info.peer_id, 16, '0', true) << "  " << p.info.height << "  " << p.info.current_download << " kB/s, " << nblocks << " blocks / " << size / 1e6 << " MB queued";
+		tools::success_msg_writer() << address << "  " << epee::string_tools::pad_string(p.info.peer_id, 16, '0', true) << "  " << p.info.height << "  " << p.info.current_download << " kB/s, " << nblocks << " blocks / " << size / 1e6 << " MB queued"
+									<< ", measured " << p.bandwidth / 1000 << " kB/s / " << p.latency << " ms, next span " << p.span_size << " blocks";
 	}
+	tools::success_msg_writer() << "Queued " << res.queue_size / 1e6 << " MB, target " << res.queue_target_size / 1e6 << " MB";
 
 	uint64_t total_size = 0;
 	for(const auto &s : res.spans)
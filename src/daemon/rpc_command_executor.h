@@ -67,6 +67,8 @@ class t_rpc_command_executor final
 
 	bool print_connections();
 
+	bool print_net_stats();
+
 	bool print_blockchain_info(uint64_t start_block_index, uint64_t end_block_index);
 
 	bool set_log_level(int8_t level);
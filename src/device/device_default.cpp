@@ -150,8 +150,7 @@ std::vector<crypto::public_key> device_default::get_subaddress_spend_public_keys
 {
 	CHECK_AND_ASSERT_THROW_MES(begin <= end, "begin > end");
 
-	std::vector<crypto::public_key> pkeys;
-	pkeys.reserve(end - begin);
+	std::vector<crypto::public_key> pkeys(end - begin);
 	cryptonote::subaddress_index index = {account, begin};
 
 	ge_p3 p3;
@@ -160,28 +159,33 @@ std::vector<crypto::public_key> device_default::get_subaddress_spend_public_keys
 							   "ge_frombytes_vartime failed to convert spend public key");
 	ge_p3_to_cached(&cached, &p3);
 
+	// every D shares B, so points are kept projective and encoded together with a single inversion
+	std::vector<ge_p3> points(end - begin);
 	for(uint32_t idx = begin; idx < end; ++idx)
 	{
 		index.minor = idx;
 		if(index.is_zero())
 		{
-			pkeys.push_back(keys.m_account_address.m_spend_public_key);
+			points[idx - begin] = p3;
 			continue;
 		}
 		crypto::secret_key m = get_subaddress_secret_key(keys.m_view_secret_key, index);
 
 		// M = m*G
-		ge_scalarmult_base(&p3, (const unsigned char *)m.data);
+		ge_p3 M;
+		ge_scalarmult_base(&M, (const unsigned char *)m.data);
 
 		// D = B + M
-		crypto::public_key D;
 		ge_p1p1 p1p1;
-		ge_add(&p1p1, &p3, &cached);
-		ge_p1p1_to_p3(&p3, &p1p1);
-		ge_p3_tobytes((unsigned char *)D.data, &p3);
-
-		pkeys.push_back(D);
+		ge_add(&p1p1, &M, &cached);
+		ge_p1p1_to_p3(&points[idx - begin], &p1p1);
 	}
+
+	static_assert(sizeof(crypto::public_key) == 32, "Unexpected public key size");
+	std::vector<int32_t> scratch(points.size() * sizeof(fe) / sizeof(int32_t));
+	ge_p3_batch_tobytes((unsigned char *)pkeys.data(), points.data(), (fe *)scratch.data(), points.size());
+	if(account == 0 && begin == 0 && end > 0)
+		pkeys[0] = keys.m_account_address.m_spend_public_key;
 	return pkeys;
 }
 
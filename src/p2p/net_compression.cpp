@@ -0,0 +1,195 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+// Copyright (c) 2018, Ryo Currency Project
+// Portions copyright (c) 2014-2018, The Monero Project
+//
+// Portions of this file are available under BSD-3 license. Please see ORIGINAL-LICENSE for details
+// All rights reserved.
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <string.h>
+#include <zlib.h>
+
+#include "cryptonote_config.h"
+#include "misc_log_ex.h"
+#include "net/levin_base.h"
+#include "net_compression.h"
+#include "storages/portable_storage_base.h"
+
+#undef RYO_DEFAULT_LOG_CATEGORY
+#define RYO_DEFAULT_LOG_CATEGORY "net.p2p"
+
+namespace nodetool
+{
+namespace
+{
+void add_bytes(std::string &dict, std::initializer_list<uint8_t> bytes)
+{
+	for(uint8_t b : bytes)
+		dict.push_back((char)b);
+}
+
+// a section entry as epee's binary format writes it: name length, name, type
+void add_key(std::string &dict, const char *name, uint8_t type)
+{
+	dict.push_back((char)strlen(name));
+	dict.append(name);
+	dict.push_back((char)type);
+}
+
+std::string make_dictionary()
+{
+	std::string dict;
+
+	// transaction prefix and block header fragments: v2 tx with one key input,
+	// tx extra with a pubkey and an encrypted payment id, v2 miner tx
+	add_bytes(dict, {0x02, 0x00, 0x01, 0x02, 0x00, 0x0b});
+	add_bytes(dict, {0x02, 0x02, 0x02, 0x00, 0x02, 0x02, 0x00, 0x2c, 0x01});
+	add_bytes(dict, {0x02, 0x09, 0x01});
+	add_bytes(dict, {0x02, 0x3c, 0x01, 0xff, 0x00, 0x01, 0x02, 0x00, 0x21, 0x01});
+
+	// the top level of every storage, then the keys of the bulk notifications,
+	// most frequent last since zlib reaches the end of the dictionary cheapest
+	uint32_t sig_a = PORTABLE_STORAGE_SIGNATUREA, sig_b = PORTABLE_STORAGE_SIGNATUREB;
+	dict.append((const char *)&sig_a, sizeof(sig_a));
+	dict.append((const char *)&sig_b, sizeof(sig_b));
+	dict.push_back((char)PORTABLE_STORAGE_FORMAT_VER);
+	add_key(dict, "start_height", SERIALIZE_TYPE_UINT64);
+	add_key(dict, "total_height", SERIALIZE_TYPE_UINT64);
+	add_key(dict, "cumulative_difficulty", SERIALIZE_TYPE_UINT64);
+	add_key(dict, "m_block_ids", SERIALIZE_TYPE_STRING);
+	add_key(dict, "missed_ids", SERIALIZE_TYPE_STRING);
+	add_key(dict, "current_blockchain_height", SERIALIZE_TYPE_UINT64);
+	add_key(dict, "b", SERIALIZE_TYPE_OBJECT);
+	add_key(dict, "blocks", SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY);
+	add_key(dict, "txs", SERIALIZE_TYPE_STRING | SERIALIZE_FLAG_ARRAY);
+	add_key(dict, "block", SERIALIZE_TYPE_STRING);
+	return dict;
+}
+}
+
+const std::string &get_compression_dictionary()
+{
+	static const std::string dict = make_dictionary();
+	return dict;
+}
+
+bool compress_payload(const std::string &in, std::string &out)
+{
+	const std::string &dict = get_compression_dictionary();
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if(deflateInit(&zs, P2P_COMPRESSION_LEVEL) != Z_OK)
+		return false;
+	if(deflateSetDictionary(&zs, (const Bytef *)dict.data(), dict.size()) != Z_OK)
+	{
+		deflateEnd(&zs);
+		return false;
+	}
+
+	out.resize(deflateBound(&zs, in.size()));
+	zs.next_in = (Bytef *)in.data();
+	zs.avail_in = in.size();
+	zs.next_out = (Bytef *)&out[0];
+	zs.avail_out = out.size();
+	int ret = deflate(&zs, Z_FINISH);
+	out.resize(zs.total_out);
+	deflateEnd(&zs);
+	CHECK_AND_ASSERT_MES(ret == Z_STREAM_END, false, "Failed to deflate payload, err = " << ret);
+	return true;
+}
+
+bool decompress_payload(const std::string &in, uint64_t raw_size, uint64_t max_size, std::string &out)
+{
+	// deflate cannot expand a byte to more than 1032, so a larger announced size is a lie told to make us allocate
+	static constexpr uint64_t DEFLATE_MAX_RATIO = 1032;
+	CHECK_AND_ASSERT_MES(raw_size <= std::min<uint64_t>(max_size, LEVIN_DEFAULT_MAX_PACKET_SIZE), false, "Compressed payload announces " << raw_size << " bytes");
+	CHECK_AND_ASSERT_MES(raw_size <= in.size() * DEFLATE_MAX_RATIO, false, "Compressed payload announces " << raw_size << " bytes from " << in.size());
+
+	const std::string &dict = get_compression_dictionary();
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if(inflateInit(&zs) != Z_OK)
+		return false;
+
+	// one spare byte so that a stream longer than announced is caught
+	out.resize(raw_size + 1);
+	zs.next_in = (Bytef *)in.data();
+	zs.avail_in = in.size();
+	zs.next_out = (Bytef *)&out[0];
+	zs.avail_out = out.size();
+	int ret = inflate(&zs, Z_FINISH);
+	if(ret == Z_NEED_DICT)
+	{
+		if(inflateSetDictionary(&zs, (const Bytef *)dict.data(), dict.size()) == Z_OK)
+			ret = inflate(&zs, Z_FINISH);
+	}
+	const uint64_t total = zs.total_out;
+	inflateEnd(&zs);
+	CHECK_AND_ASSERT_MES(ret == Z_STREAM_END, false, "Failed to inflate payload, err = " << ret);
+	CHECK_AND_ASSERT_MES(total == raw_size, false, "Compressed payload expanded to " << total << " bytes, " << raw_size << " announced");
+	out.resize(raw_size);
+	return true;
+}
+
+compression_stat &compression_stats::entry(uint32_t command)
+{
+	auto it = m_stats.find(command);
+	if(it == m_stats.end())
+	{
+		compression_stat s = {0};
+		s.command = command;
+		it = m_stats.emplace(command, s).first;
+	}
+	return it->second;
+}
+
+void compression_stats::add_compressed(uint32_t command, uint64_t raw_bytes, uint64_t packed_bytes, uint64_t us)
+{
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	compression_stat &s = entry(command);
+	++s.sent_messages;
+	s.sent_raw_bytes += raw_bytes;
+	s.sent_packed_bytes += packed_bytes;
+	s.compress_us += us;
+}
+
+void compression_stats::add_uncompressed(uint32_t command, uint64_t us)
+{
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	compression_stat &s = entry(command);
+	++s.sent_uncompressed;
+	s.compress_us += us;
+}
+
+void compression_stats::add_decompressed(uint32_t command, uint64_t raw_bytes, uint64_t packed_bytes, uint64_t us)
+{
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	compression_stat &s = entry(command);
+	++s.received_messages;
+	s.received_raw_bytes += raw_bytes;
+	s.received_packed_bytes += packed_bytes;
+	s.decompress_us += us;
+}
+
+std::vector<compression_stat> compression_stats::get() const
+{
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	std::vector<compression_stat> stats;
+	stats.reserve(m_stats.size());
+	for(const auto &s : m_stats)
+		stats.push_back(s.second);
+	return stats;
+}
+}
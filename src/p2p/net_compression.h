@@ -0,0 +1,97 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+// Copyright (c) 2018, Ryo Currency Project
+// Portions copyright (c) 2014-2018, The Monero Project
+//
+// Portions of this file are available under BSD-3 license. Please see ORIGINAL-LICENSE for details
+// All rights reserved.
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace nodetool
+{
+/**
+ * @brief compress a levin payload with the shared p2p dictionary
+ *
+ * @param in the serialized payload
+ * @param out the zlib stream, valid only if the function returns true
+ *
+ * @return false if zlib failed
+ */
+bool compress_payload(const std::string &in, std::string &out);
+
+/**
+ * @brief decompress a payload produced by compress_payload
+ *
+ * The stream must expand to exactly raw_size bytes. raw_size is checked
+ * against max_size and against what deflate can produce from in before
+ * anything is allocated, so a peer cannot make us allocate more than the
+ * command could carry uncompressed, or more than its stream can fill.
+ *
+ * @param in the zlib stream
+ * @param raw_size the announced size of the payload
+ * @param max_size the largest payload the wrapped command may have
+ * @param out the payload
+ *
+ * @return false if the stream is corrupt or does not match raw_size
+ */
+bool decompress_payload(const std::string &in, uint64_t raw_size, uint64_t max_size, std::string &out);
+
+/**
+ * @brief the preset dictionary both sides of a compressed connection use
+ */
+const std::string &get_compression_dictionary();
+
+struct compression_stat
+{
+	uint32_t command;
+	uint64_t sent_messages;
+	uint64_t sent_uncompressed; //messages which were offered but did not compress well enough
+	uint64_t sent_raw_bytes;
+	uint64_t sent_packed_bytes;
+	uint64_t compress_us;
+	uint64_t received_messages;
+	uint64_t received_raw_bytes;
+	uint64_t received_packed_bytes;
+	uint64_t decompress_us;
+};
+
+/**
+ * @brief per command compression counters
+ *
+ * Sent figures are counted once per message, however many peers it was
+ * relayed to, which is what the CPU cost scales with.
+ */
+class compression_stats
+{
+  public:
+	void add_compressed(uint32_t command, uint64_t raw_bytes, uint64_t packed_bytes, uint64_t us);
+	void add_uncompressed(uint32_t command, uint64_t us);
+	void add_decompressed(uint32_t command, uint64_t raw_bytes, uint64_t packed_bytes, uint64_t us);
+	std::vector<compression_stat> get() const;
+
+  private:
+	compression_stat &entry(uint32_t command);
+
+	mutable boost::mutex m_lock;
+	std::map<uint32_t, compression_stat> m_stats;
+};
+}
@@ -20,6 +20,8 @@
 
 #include "net_node.h"
 #include "common/command_line.h"
+#include "common/metrics.h"
+#include <unordered_map>
 
 namespace nodetool
 {
@@ -48,4 +50,19 @@ const command_line::arg_descriptor<int> arg_tos_flag = {"tos-flag", "set TOS fla
 const command_line::arg_descriptor<int64_t> arg_limit_rate_up = {"limit-rate-up", "set limit-rate-up [kB/s]", -1};
 const command_line::arg_descriptor<int64_t> arg_limit_rate_down = {"limit-rate-down", "set limit-rate-down [kB/s]", -1};
 const command_line::arg_descriptor<int64_t> arg_limit_rate = {"limit-rate", "set limit-rate [kB/s]", -1};
+
+void count_p2p_bytes(int command, bool sent, size_t bytes)
+{
+	// the registry lookup takes a lock, keep what this thread has already looked up
+	static thread_local std::unordered_map<int, const tools::metrics::counter *> sent_counters, received_counters;
+	std::unordered_map<int, const tools::metrics::counter *> &counters = sent ? sent_counters : received_counters;
+	const tools::metrics::counter *&c = counters[command];
+	if(c == nullptr)
+	{
+		const std::string label = "command=\"" + std::to_string(command) + "\"";
+		c = sent ? &tools::metrics::get_counter("ombre_p2p_sent_bytes_total", label, "P2P payload bytes sent, by levin command")
+				 : &tools::metrics::get_counter("ombre_p2p_received_bytes_total", label, "P2P payload bytes received, by levin command");
+	}
+	c->inc(bytes);
+}
 }
@@ -30,6 +30,7 @@
 #include "cryptonote_config.h"
 #include "math_helper.h"
 #include "net/levin_server_cp2.h"
+#include "net_compression.h"
 #include "net_node_common.h"
 #include "net_peerlist.h"
 #include "p2p_protocol_defs.h"
@@ -41,6 +42,11 @@ DISABLE_VS_WARNINGS(4355)
 
 namespace nodetool
 {
+/**
+ * @brief adds to the ombre_p2p_{sent,received}_bytes_total counters of a levin command
+ */
+void count_p2p_bytes(int command, bool sent, size_t bytes);
+
 template <class base_type>
 struct p2p_connection_context_t : base_type //t_payload_net_handler::connection_context //public net_utils::connection_context_base
 {
@@ -119,6 +125,7 @@ class node_server : public epee::levin::levin_commands_handler<p2p_connection_co
 	peerlist_manager &get_peerlist_manager() { return m_peerlist; }
 	void delete_out_connections(size_t count);
 	void delete_in_connections(size_t count);
+	std::vector<compression_stat> get_compression_stats() const { return m_compression_stats.get(); }
 	virtual bool block_host(const epee::net_utils::network_address &adress, time_t seconds = P2P_IP_BLOCKTIME);
 	virtual bool unblock_host(const epee::net_utils::network_address &address);
 	virtual std::map<std::string, time_t> get_blocked_hosts()
@@ -143,8 +150,23 @@ class node_server : public epee::levin::levin_commands_handler<p2p_connection_co
 
 	typedef COMMAND_REQUEST_STAT_INFO_T<typename t_payload_net_handler::stat_info> COMMAND_REQUEST_STAT_INFO;
 
-	CHAIN_LEVIN_INVOKE_MAP2(p2p_connection_context); //move levin_commands_handler interface invoke(...) callbacks into invoke map
-	CHAIN_LEVIN_NOTIFY_MAP2(p2p_connection_context); //move levin_commands_handler interface notify(...) callbacks into nothing
+	//levin_commands_handler interface, counts the traffic and moves the callbacks into the invoke map
+	int invoke(int command, const std::string &in_buff, std::string &buff_out, p2p_connection_context &context)
+	{
+		bool handled = false;
+		count_p2p_bytes(command, false, in_buff.size());
+		int r = handle_invoke_map(false, command, in_buff, buff_out, context, handled);
+		count_p2p_bytes(command, true, buff_out.size());
+		return r;
+	}
+
+	int notify(int command, const std::string &in_buff, p2p_connection_context &context)
+	{
+		bool handled = false;
+		std::string fake_str;
+		count_p2p_bytes(command, false, in_buff.size());
+		return handle_invoke_map(true, command, in_buff, fake_str, context, handled);
+	}
 
 	BEGIN_INVOKE_MAP2(node_server)
 	HANDLE_INVOKE_T2(COMMAND_HANDSHAKE, &node_server::handle_handshake)
@@ -156,6 +178,7 @@ class node_server : public epee::levin::levin_commands_handler<p2p_connection_co
 	HANDLE_INVOKE_T2(COMMAND_REQUEST_PEER_ID, &node_server::handle_get_peer_id)
 #endif
 	HANDLE_INVOKE_T2(COMMAND_REQUEST_SUPPORT_FLAGS, &node_server::handle_get_support_flags)
+	HANDLE_NOTIFY_T2(NOTIFY_COMPRESSED, &node_server::handle_compressed)
 	CHAIN_INVOKE_MAP_TO_OBJ_FORCE_CONTEXT(m_payload_handler, typename t_payload_net_handler::connection_context &)
 	END_INVOKE_MAP2()
 
@@ -176,6 +199,7 @@ class node_server : public epee::levin::levin_commands_handler<p2p_connection_co
 	int handle_get_peer_id(int command, COMMAND_REQUEST_PEER_ID::request &arg, COMMAND_REQUEST_PEER_ID::response &rsp, p2p_connection_context &context);
 #endif
 	int handle_get_support_flags(int command, COMMAND_REQUEST_SUPPORT_FLAGS::request &arg, COMMAND_REQUEST_SUPPORT_FLAGS::response &rsp, p2p_connection_context &context);
+	int handle_compressed(int command, NOTIFY_COMPRESSED::request &arg, p2p_connection_context &context);
 	bool init_config();
 	bool make_default_peer_id();
 	bool make_default_config();
@@ -227,6 +251,8 @@ class node_server : public epee::levin::levin_commands_handler<p2p_connection_co
 	template <class t_callback>
 	bool try_ping(basic_node_data &node_data, p2p_connection_context &context, const t_callback &cb);
 	bool try_get_support_flags(const p2p_connection_context &context, std::function<void(p2p_connection_context &, const uint32_t &)> f);
+	bool peer_supports_compression(const boost::uuids::uuid &connection_id);
+	bool compress_notify(int command, const std::string &data_buff, std::string &compressed_buff);
 	bool make_expected_connections_count(PeerType peer_type, size_t expected_connections);
 	void cache_connect_fail_info(const epee::net_utils::network_address &addr);
 	bool is_addr_recently_failed(const epee::net_utils::network_address &addr);
@@ -333,6 +359,8 @@ class node_server : public epee::levin::levin_commands_handler<p2p_connection_co
 	epee::critical_section m_host_fails_score_lock;
 	std::map<std::string, uint64_t> m_host_fails_score;
 
+	compression_stats m_compression_stats;
+
 	cryptonote::network_type m_nettype;
 };
 
@@ -25,6 +25,7 @@
 #include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread/thread.hpp>
+#include <chrono>
 
 #include "common/dns_utils.h"
 #include "common/util.h"
@@ -570,6 +571,7 @@ bool node_server<t_payload_net_handler>::run()
 
 	m_net_server.add_idle_handler(boost::bind(&node_server<t_payload_net_handler>::idle_worker, this), 1000);
 	m_net_server.add_idle_handler(boost::bind(&t_payload_net_handler::on_idle, &m_payload_handler), 1000);
+	m_net_server.add_idle_handler(boost::bind(&t_payload_net_handler::on_tx_relay_timer, &m_payload_handler), P2P_TX_RELAY_TICK_MS);
 
 	boost::thread::attributes attrs;
 	attrs.set_stack_size(THREAD_STACK_SIZE);
@@ -1439,6 +1441,67 @@ int node_server<t_payload_net_handler>::handle_get_support_flags(int command, CO
 }
 //-----------------------------------------------------------------------------------
 template <class t_payload_net_handler>
+int node_server<t_payload_net_handler>::handle_compressed(int command, NOTIFY_COMPRESSED::request &arg, p2p_connection_context &context)
+{
+	if(arg.command == NOTIFY_COMPRESSED::ID)
+	{
+		LOG_WARNING_CC(context, "NOTIFY_COMPRESSED came wrapping another NOTIFY_COMPRESSED");
+		drop_connection(context);
+		add_host_fail(context.m_remote_address);
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::string data_buff;
+	if(!decompress_payload(arg.data, arg.raw_size, m_net_server.get_config_object().m_max_packet_size, data_buff))
+	{
+		LOG_WARNING_CC(context, "Failed to decompress command " << arg.command);
+		drop_connection(context);
+		add_host_fail(context.m_remote_address);
+		return 1;
+	}
+	m_compression_stats.add_decompressed(arg.command, data_buff.size(), arg.data.size(),
+		std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+	arg.data.clear();
+	arg.data.shrink_to_fit();
+
+	std::string buff_out;
+	bool handled = false;
+	return handle_invoke_map(true, arg.command, data_buff, buff_out, context, handled);
+}
+//-----------------------------------------------------------------------------------
+template <class t_payload_net_handler>
+bool node_server<t_payload_net_handler>::peer_supports_compression(const boost::uuids::uuid &connection_id)
+{
+	bool supported = false;
+	m_net_server.get_config_object().for_connection(connection_id, [&](const p2p_connection_context &cntxt) {
+		supported = (cntxt.support_flags & P2P_SUPPORT_FLAG_COMPRESSION) != 0;
+		return true;
+	});
+	return supported;
+}
+//-----------------------------------------------------------------------------------
+template <class t_payload_net_handler>
+bool node_server<t_payload_net_handler>::compress_notify(int command, const std::string &data_buff, std::string &compressed_buff)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	NOTIFY_COMPRESSED::request req;
+	req.command = command;
+	req.raw_size = data_buff.size();
+	bool r = compress_payload(data_buff, req.data);
+	if(r && req.data.size() <= data_buff.size() * (1.0f - P2P_COMPRESSION_MIN_SAVING))
+	{
+		epee::serialization::store_t_to_binary(req, compressed_buff);
+		m_compression_stats.add_compressed(command, data_buff.size(), compressed_buff.size(),
+			std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+		return true;
+	}
+	m_compression_stats.add_uncompressed(command,
+		std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+	return false;
+}
+//-----------------------------------------------------------------------------------
+template <class t_payload_net_handler>
 void node_server<t_payload_net_handler>::request_callback(const epee::net_utils::connection_context_base &context)
 {
 	m_net_server.get_config_object().request_callback(context.m_connection_id);
@@ -1447,9 +1510,30 @@ void node_server<t_payload_net_handler>::request_callback(const epee::net_utils:
 template <class t_payload_net_handler>
 bool node_server<t_payload_net_handler>::relay_notify_to_list(int command, const std::string &data_buff, const std::list<boost::uuids::uuid> &connections)
 {
+	// compressed at most once, on the first peer that can take it
+	enum
+	{
+		not_tried,
+		compressed,
+		incompressible
+	} state = data_buff.size() < P2P_COMPRESSION_MIN_SIZE ? incompressible : not_tried;
+	std::string compressed_buff;
+
 	for(const auto &c_id : connections)
 	{
-		m_net_server.get_config_object().notify(command, data_buff, c_id);
+		if(state != incompressible && peer_supports_compression(c_id))
+		{
+			if(state == not_tried)
+				state = compress_notify(command, data_buff, compressed_buff) ? compressed : incompressible;
+			if(state == compressed)
+			{
+				if(m_net_server.get_config_object().notify(NOTIFY_COMPRESSED::ID, compressed_buff, c_id) > 0)
+					count_p2p_bytes(NOTIFY_COMPRESSED::ID, true, compressed_buff.size());
+				continue;
+			}
+		}
+		if(m_net_server.get_config_object().notify(command, data_buff, c_id) > 0)
+			count_p2p_bytes(command, true, data_buff.size());
 	}
 	return true;
 }
@@ -1475,7 +1559,20 @@ void node_server<t_payload_net_handler>::callback(p2p_connection_context &contex
 template <class t_payload_net_handler>
 bool node_server<t_payload_net_handler>::invoke_notify_to_peer(int command, const std::string &req_buff, const epee::net_utils::connection_context_base &context)
 {
-	int res = m_net_server.get_config_object().notify(command, req_buff, context.m_connection_id);
+	int res;
+	std::string compressed_buff;
+	if(req_buff.size() >= P2P_COMPRESSION_MIN_SIZE && peer_supports_compression(context.m_connection_id) && compress_notify(command, req_buff, compressed_buff))
+	{
+		res = m_net_server.get_config_object().notify(NOTIFY_COMPRESSED::ID, compressed_buff, context.m_connection_id);
+		if(res > 0)
+			count_p2p_bytes(NOTIFY_COMPRESSED::ID, true, compressed_buff.size());
+	}
+	else
+	{
+		res = m_net_server.get_config_object().notify(command, req_buff, context.m_connection_id);
+		if(res > 0)
+			count_p2p_bytes(command, true, req_buff.size());
+	}
 	return res > 0;
 }
 //-----------------------------------------------------------------------------------
@@ -1483,6 +1580,8 @@ template <class t_payload_net_handler>
 bool node_server<t_payload_net_handler>::invoke_command_to_peer(int command, const std::string &req_buff, std::string &resp_buff, const epee::net_utils::connection_context_base &context)
 {
 	int res = m_net_server.get_config_object().invoke(command, req_buff, resp_buff, context.m_connection_id);
+	count_p2p_bytes(command, true, req_buff.size());
+	count_p2p_bytes(command, false, resp_buff.size());
 	return res > 0;
 }
 //-----------------------------------------------------------------------------------
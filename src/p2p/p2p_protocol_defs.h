@@ -435,6 +435,28 @@ struct COMMAND_REQUEST_SUPPORT_FLAGS
 
 #endif
 
+/************************************************************************/
+/* A notification of another command, compressed with the shared p2p    */
+/* dictionary. Only sent to peers with P2P_SUPPORT_FLAG_COMPRESSION.    */
+/************************************************************************/
+struct NOTIFY_COMPRESSED
+{
+	const static int ID = P2P_COMMANDS_POOL_BASE + 8;
+
+	struct request
+	{
+		uint32_t command;
+		uint64_t raw_size;
+		std::string data;
+
+		BEGIN_KV_SERIALIZE_MAP()
+		KV_SERIALIZE(command)
+		KV_SERIALIZE(raw_size)
+		KV_SERIALIZE(data)
+		END_KV_SERIALIZE_MAP()
+	};
+};
+
 inline crypto::hash get_proof_of_trust_hash(const nodetool::proof_of_trust &pot)
 {
 	std::string s;
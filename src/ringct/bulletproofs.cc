@@ -89,15 +89,6 @@ static void sub_acc_p3(ge_p3 *acc_p3, const rct::key &point)
 	ge_p1p1_to_p3(acc_p3, &p1);
 }
 
-static rct::key scalarmultKey(const ge_p3 &P, const rct::key &a)
-{
-	ge_p2 R;
-	ge_scalarmult(&R, a.bytes, &P);
-	rct::key aP;
-	ge_tobytes(aP.bytes, &R);
-	return aP;
-}
-
 /* Given a scalar, construct a vector of powers */
 static rct::keyV vector_powers(const rct::key &x, size_t n)
 {
@@ -308,6 +299,47 @@ static rct::keyV slice(const rct::keyV &a, size_t start, size_t stop)
 	return res;
 }
 
+/* L or R of the first inner product round. The generators are still Gi and Hi*y^-i there,
+ * so the y^-i factors go into the scalars and the precomputed Gi/Hi tables are used.
+ * L pairs a[0..n) with G[n..2n) and b[n..2n) with H[0..n), R pairs the other halves. */
+static rct::key first_round_exponent(bp_cache &exp_cache, const rct::keyV &a, const rct::keyV &b, const rct::keyV &yinvpow, size_t n, bool right)
+{
+	exp_cache.clear_pad(4 * n);
+	for(size_t j = 0; j < 2 * n; ++j)
+	{
+		const size_t partner = j < n ? j + n : j - n;
+		const bool on_g = right ? j < n : j >= n;
+		rct::key hs = rct::zero();
+		if(!on_g)
+			sc_mul(hs.bytes, b[partner].bytes, yinvpow[j].bytes);
+		exp_cache.me_pad.emplace_back(on_g ? a[partner] : rct::zero(), multiexp_cache::Gi_p3(j));
+		exp_cache.me_pad.emplace_back(hs, multiexp_cache::Hi_p3(j));
+	}
+	return exp_cache.multiexp_higi();
+}
+
+/* Fold Gi and Hi*y^-i down to the second round generators without materialising Hi*y^-i */
+static void first_round_fold(rct::keyV &Gprime, rct::keyV &Hprime, const rct::keyV &yinvpow, const rct::key &w, const rct::key &winv, size_t n)
+{
+	Gprime.resize(n);
+	Hprime.resize(n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		ge_dsmp precomp;
+		ge_p2 p2;
+		ge_dsm_precomp(precomp, &multiexp_cache::Gi_p3(n + i));
+		ge_double_scalarmult_precomp_vartime(&p2, winv.bytes, &multiexp_cache::Gi_p3(i), w.bytes, precomp);
+		ge_tobytes(Gprime[i].bytes, &p2);
+
+		rct::key lo, hi;
+		sc_mul(lo.bytes, w.bytes, yinvpow[i].bytes);
+		sc_mul(hi.bytes, winv.bytes, yinvpow[n + i].bytes);
+		ge_dsm_precomp(precomp, &multiexp_cache::Hi_p3(n + i));
+		ge_double_scalarmult_precomp_vartime(&p2, lo.bytes, &multiexp_cache::Hi_p3(i), hi.bytes, precomp);
+		ge_tobytes(Hprime[i].bytes, &p2);
+	}
+}
+
 static rct::key hash_cache_mash(rct::key &hash_cache, const rct::key &mash0, const rct::key &mash1)
 {
 	rct::keyV data;
@@ -526,20 +558,10 @@ try_again:
 
 	// These are used in the inner product rounds
 	size_t nprime = N;
-	rct::keyV Gprime(N);
-	rct::keyV Hprime(N);
-	rct::keyV aprime(N);
-	rct::keyV bprime(N);
-	const rct::key yinv = invert(y);
-	rct::key yinvpow = rct::identity();
-	for(size_t i = 0; i < N; ++i)
-	{
-		Gprime[i] = multiexp_cache::Gi(i);
-		Hprime[i] = scalarmultKey(multiexp_cache::Hi_p3(i), yinvpow);
-		sc_mul(yinvpow.bytes, yinvpow.bytes, yinv.bytes);
-		aprime[i] = l[i];
-		bprime[i] = r[i];
-	}
+	rct::keyV Gprime, Hprime;
+	rct::keyV aprime = l;
+	rct::keyV bprime = r;
+	const rct::keyV yinvpow = vector_powers(invert(y), N);
 	rct::keyV L(logN);
 	rct::keyV R(logN);
 	int round = 0;
@@ -558,11 +580,17 @@ try_again:
 		rct::key cR = inner_product(slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
 
 		// PAPER LINES 18-19
-		L[round] = exp_cache.vector_exponent_custom(slice(Gprime, nprime, Gprime.size()), slice(Hprime, 0, nprime), slice(aprime, 0, nprime), slice(bprime, nprime, bprime.size()));
+		if(round == 0)
+			L[round] = first_round_exponent(exp_cache, aprime, bprime, yinvpow, nprime, false);
+		else
+			L[round] = exp_cache.vector_exponent_custom(slice(Gprime, nprime, Gprime.size()), slice(Hprime, 0, nprime), slice(aprime, 0, nprime), slice(bprime, nprime, bprime.size()));
 		sc_mul(tmp.bytes, cL.bytes, x_ip.bytes);
 		rct::addKeys(L[round], L[round], rct::scalarmultH(tmp));
 		L[round] = rct::scalarmultKey(L[round], INV_EIGHT);
-		R[round] = exp_cache.vector_exponent_custom(slice(Gprime, 0, nprime), slice(Hprime, nprime, Hprime.size()), slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
+		if(round == 0)
+			R[round] = first_round_exponent(exp_cache, aprime, bprime, yinvpow, nprime, true);
+		else
+			R[round] = exp_cache.vector_exponent_custom(slice(Gprime, 0, nprime), slice(Hprime, nprime, Hprime.size()), slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
 		sc_mul(tmp.bytes, cR.bytes, x_ip.bytes);
 		rct::addKeys(R[round], R[round], rct::scalarmultH(tmp));
 		R[round] = rct::scalarmultKey(R[round], INV_EIGHT);
@@ -578,8 +606,15 @@ try_again:
 
 		// PAPER LINES 24-25
 		const rct::key winv = invert(w[round]);
-		Gprime = hadamard2(vector_scalar2(slice(Gprime, 0, nprime), winv), vector_scalar2(slice(Gprime, nprime, Gprime.size()), w[round]));
-		Hprime = hadamard2(vector_scalar2(slice(Hprime, 0, nprime), w[round]), vector_scalar2(slice(Hprime, nprime, Hprime.size()), winv));
+		if(round == 0)
+		{
+			first_round_fold(Gprime, Hprime, yinvpow, w[round], winv, nprime);
+		}
+		else
+		{
+			Gprime = hadamard2(vector_scalar2(slice(Gprime, 0, nprime), winv), vector_scalar2(slice(Gprime, nprime, Gprime.size()), w[round]));
+			Hprime = hadamard2(vector_scalar2(slice(Hprime, 0, nprime), w[round]), vector_scalar2(slice(Hprime, nprime, Hprime.size()), winv));
+		}
 
 		// PAPER LINES 28-29
 		aprime = vector_add(vector_scalar(slice(aprime, 0, nprime), w[round]), vector_scalar(slice(aprime, nprime, aprime.size()), winv));
@@ -821,20 +856,10 @@ try_again:
 
 	// These are used in the inner product rounds
 	size_t nprime = MN;
-	rct::keyV Gprime(MN);
-	rct::keyV Hprime(MN);
-	rct::keyV aprime(MN);
-	rct::keyV bprime(MN);
-	const rct::key yinv = invert(y);
-	rct::key yinvpow = rct::identity();
-	for(size_t i = 0; i < MN; ++i)
-	{
-		Gprime[i] = multiexp_cache::Gi(i);
-		Hprime[i] = scalarmultKey(multiexp_cache::Hi_p3(i), yinvpow);
-		sc_mul(yinvpow.bytes, yinvpow.bytes, yinv.bytes);
-		aprime[i] = l[i];
-		bprime[i] = r[i];
-	}
+	rct::keyV Gprime, Hprime;
+	rct::keyV aprime = l;
+	rct::keyV bprime = r;
+	const rct::keyV yinvpow = vector_powers(invert(y), MN);
 	rct::keyV L(logMN);
 	rct::keyV R(logMN);
 	int round = 0;
@@ -853,11 +878,17 @@ try_again:
 		rct::key cR = inner_product(slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
 
 		// PAPER LINES 18-19
-		L[round] = exp_cache.vector_exponent_custom(slice(Gprime, nprime, Gprime.size()), slice(Hprime, 0, nprime), slice(aprime, 0, nprime), slice(bprime, nprime, bprime.size()));
+		if(round == 0)
+			L[round] = first_round_exponent(exp_cache, aprime, bprime, yinvpow, nprime, false);
+		else
+			L[round] = exp_cache.vector_exponent_custom(slice(Gprime, nprime, Gprime.size()), slice(Hprime, 0, nprime), slice(aprime, 0, nprime), slice(bprime, nprime, bprime.size()));
 		sc_mul(tmp.bytes, cL.bytes, x_ip.bytes);
 		rct::addKeys(L[round], L[round], rct::scalarmultH(tmp));
 		L[round] = rct::scalarmultKey(L[round], INV_EIGHT);
-		R[round] = exp_cache.vector_exponent_custom(slice(Gprime, 0, nprime), slice(Hprime, nprime, Hprime.size()), slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
+		if(round == 0)
+			R[round] = first_round_exponent(exp_cache, aprime, bprime, yinvpow, nprime, true);
+		else
+			R[round] = exp_cache.vector_exponent_custom(slice(Gprime, 0, nprime), slice(Hprime, nprime, Hprime.size()), slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
 		sc_mul(tmp.bytes, cR.bytes, x_ip.bytes);
 		rct::addKeys(R[round], R[round], rct::scalarmultH(tmp));
 		R[round] = rct::scalarmultKey(R[round], INV_EIGHT);
@@ -873,8 +904,15 @@ try_again:
 
 		// PAPER LINES 24-25
 		const rct::key winv = invert(w[round]);
-		Gprime = hadamard2(vector_scalar2(slice(Gprime, 0, nprime), winv), vector_scalar2(slice(Gprime, nprime, Gprime.size()), w[round]));
-		Hprime = hadamard2(vector_scalar2(slice(Hprime, 0, nprime), w[round]), vector_scalar2(slice(Hprime, nprime, Hprime.size()), winv));
+		if(round == 0)
+		{
+			first_round_fold(Gprime, Hprime, yinvpow, w[round], winv, nprime);
+		}
+		else
+		{
+			Gprime = hadamard2(vector_scalar2(slice(Gprime, 0, nprime), winv), vector_scalar2(slice(Gprime, nprime, Gprime.size()), w[round]));
+			Hprime = hadamard2(vector_scalar2(slice(Hprime, 0, nprime), w[round]), vector_scalar2(slice(Hprime, nprime, Hprime.size()), winv));
+		}
 
 		// PAPER LINES 28-29
 		aprime = vector_add(vector_scalar(slice(aprime, 0, nprime), w[round]), vector_scalar(slice(aprime, nprime, aprime.size()), winv));
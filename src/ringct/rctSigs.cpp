@@ -886,10 +886,37 @@ rctSig genRctSimple(const key &message, const ctkeyV &inSk, const keyV &destinat
 	key full_message = get_pre_mlsag_hash(rv, hwdev);
 	if(msout)
 		msout->c.resize(inamounts.size());
+
+	// the per input signatures are independent, but a hardware device has to be driven one at a time
+	tools::threadpool &tpool = tools::threadpool::getInstance();
+	if(&hwdev != &hw::get_device("default") || inamounts.size() < 2 || tpool.get_max_concurrency() < 2)
+	{
+		for(i = 0; i < inamounts.size(); i++)
+		{
+			rv.p.MGs[i] = proveRctMGSimple(full_message, rv.mixRing[i], inSk[i], a[i], pseudoOuts[i], kLRki ? &(*kLRki)[i] : NULL, msout ? &msout->c[i] : NULL, index[i], hwdev);
+		}
+		return rv;
+	}
+
+	std::vector<std::exception_ptr> errors(inamounts.size());
+	tools::threadpool::waiter waiter;
 	for(i = 0; i < inamounts.size(); i++)
 	{
-		rv.p.MGs[i] = proveRctMGSimple(full_message, rv.mixRing[i], inSk[i], a[i], pseudoOuts[i], kLRki ? &(*kLRki)[i] : NULL, msout ? &msout->c[i] : NULL, index[i], hwdev);
+		tpool.submit(&waiter, [&, i] {
+			try
+			{
+				rv.p.MGs[i] = proveRctMGSimple(full_message, rv.mixRing[i], inSk[i], a[i], pseudoOuts[i], kLRki ? &(*kLRki)[i] : NULL, msout ? &msout->c[i] : NULL, index[i], hwdev);
+			}
+			catch(...)
+			{
+				errors[i] = std::current_exception();
+			}
+		});
 	}
+	waiter.wait();
+	for(const std::exception_ptr &e : errors)
+		if(e)
+			std::rethrow_exception(e);
 	return rv;
 }
 
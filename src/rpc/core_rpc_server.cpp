@@ -39,6 +39,7 @@ using namespace epee;
 #include "rpc/rpc_args.h"
 #include "storages/http_abstract_invoke.h"
 #include "version.h"
+#include <boost/uuid/nil_generator.hpp>
 
 //#undef RYO_DEFAULT_LOG_CATEGORY
 //#define RYO_DEFAULT_LOG_CATEGORY "daemon.rpc"
@@ -888,6 +889,7 @@ bool core_rpc_server::on_mining_status(const COMMAND_RPC_MINING_STATUS::request
 	if(lMiner.is_mining())
 	{
 		res.speed = lMiner.get_speed();
+		res.threads_speed = lMiner.get_threads_speed();
 		res.threads_count = lMiner.get_threads_count();
 		const account_public_address &lMiningAdr = lMiner.get_mining_address();
 		res.address = get_public_address_as_str(m_nettype, false, lMiningAdr);
@@ -975,6 +977,26 @@ bool core_rpc_server::on_set_log_categories(const COMMAND_RPC_SET_LOG_CATEGORIES
 	return true;
 }
 //------------------------------------------------------------------------------------------------------------------------------
+bool core_rpc_server::on_set_trace(const COMMAND_RPC_SET_TRACE::request &req, COMMAND_RPC_SET_TRACE::response &res)
+{
+	PERF_TIMER(on_set_trace);
+	if(req.enable)
+	{
+		if(req.events_per_thread == 0 || req.events_per_thread > tools::trace::MAX_EVENTS_PER_THREAD)
+		{
+			res.status = "Error: events_per_thread not valid";
+			return true;
+		}
+		tools::trace::start(req.events_per_thread);
+	}
+	else
+	{
+		tools::trace::stop();
+	}
+	res.status = CORE_RPC_STATUS_OK;
+	return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------
 bool core_rpc_server::on_get_transaction_pool(const COMMAND_RPC_GET_TRANSACTION_POOL::request &req, COMMAND_RPC_GET_TRANSACTION_POOL::response &res, bool request_has_rpc_origin)
 {
 	PERF_TIMER(on_get_transaction_pool);
@@ -1541,6 +1563,31 @@ bool core_rpc_server::on_get_connections(const COMMAND_RPC_GET_CONNECTIONS::requ
 	return true;
 }
 //------------------------------------------------------------------------------------------------------------------------------
+bool core_rpc_server::on_get_net_stats(const COMMAND_RPC_GET_NET_STATS::request &req, COMMAND_RPC_GET_NET_STATS::response &res, epee::json_rpc::error &error_resp)
+{
+	PERF_TIMER(on_get_net_stats);
+
+	for(const nodetool::compression_stat &s : m_p2p.get_compression_stats())
+	{
+		net_compression_stat stat;
+		stat.command = s.command;
+		stat.sent_messages = s.sent_messages;
+		stat.sent_uncompressed = s.sent_uncompressed;
+		stat.sent_raw_bytes = s.sent_raw_bytes;
+		stat.sent_packed_bytes = s.sent_packed_bytes;
+		stat.compress_us = s.compress_us;
+		stat.received_messages = s.received_messages;
+		stat.received_raw_bytes = s.received_raw_bytes;
+		stat.received_packed_bytes = s.received_packed_bytes;
+		stat.decompress_us = s.decompress_us;
+		res.compression.push_back(stat);
+	}
+
+	res.status = CORE_RPC_STATUS_OK;
+
+	return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------
 bool core_rpc_server::on_get_info_json(const COMMAND_RPC_GET_INFO::request &req, COMMAND_RPC_GET_INFO::response &res, epee::json_rpc::error &error_resp)
 {
 	PERF_TIMER(on_get_info_json);
@@ -2018,9 +2065,25 @@ bool core_rpc_server::on_sync_info(const COMMAND_RPC_SYNC_INFO::request &req, CO
 	++res.height; // turn top block height into blockchain height
 	res.target_height = m_core.get_target_blockchain_height();
 
-	for(const auto &c : m_p2p.get_payload_object().get_connections())
-		res.peers.push_back({c});
 	const cryptonote::block_queue &block_queue = m_p2p.get_payload_object().get_block_queue();
+	const uint64_t default_span_size = m_core.get_block_sync_size(res.height);
+	for(const auto &c : m_p2p.get_payload_object().get_connections())
+	{
+		res.peers.push_back({c, 0, 0, 0});
+		COMMAND_RPC_SYNC_INFO::peer &p = res.peers.back();
+		boost::uuids::uuid connection_id = boost::uuids::nil_uuid();
+		block_queue.foreach_peer([&](const boost::uuids::uuid &id, const cryptonote::block_queue::peer_stats &stats) {
+			if(epee::string_tools::pod_to_hex(id) != c.connection_id)
+				return true;
+			connection_id = id;
+			p.bandwidth = stats.bandwidth + 0.5f;
+			p.latency = stats.latency * 1000 + 0.5f;
+			return false;
+		});
+		p.span_size = block_queue.get_span_size(connection_id, default_span_size, BLOCKS_SYNCHRONIZING_MAX_COUNT);
+	}
+	res.queue_size = block_queue.get_data_size() + block_queue.get_scheduled_size();
+	res.queue_target_size = block_queue.get_download_target();
 	block_queue.foreach([&](const cryptonote::block_queue::span &span) {
 		const std::string span_connection_id = epee::string_tools::pod_to_hex(span.connection_id);
 		uint32_t speed = (uint32_t)(100.0f * block_queue.get_speed(span.connection_id) + 0.5f);
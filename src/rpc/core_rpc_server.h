@@ -29,6 +29,7 @@
 #include "net/http_client.h"
 #include "net/http_server_impl_base.h"
 #include "p2p/net_node.h"
+#include "rpc_metrics.h"
 
 // yes, epee doesn't properly use its full namespace when calling its
 // functions from macros.  *sigh*
@@ -61,7 +62,38 @@ class core_rpc_server : public epee::http_server_impl_base<core_rpc_server>
 		const std::string &port);
 	network_type nettype() const { return m_nettype; }
 
-	CHAIN_HTTP_TO_MAP2(connection_context); //forward http requests to uri map
+	//forward http requests to uri map, timing the ones it handles
+	bool handle_http_request(const epee::net_utils::http::http_request_info &query_info,
+							 epee::net_utils::http::http_response_info &response,
+							 connection_context &m_conn_context)
+	{
+		LOG_PRINT_L2("HTTP [" << m_conn_context.m_remote_address.host_str() << "] " << query_info.m_http_method_str << " " << query_info.m_URI);
+		response.m_response_code = 200;
+		response.m_response_comment = "Ok";
+		if(query_info.m_URI == "/metrics" || query_info.m_URI == "/trace.json")
+		{
+			if(m_restricted)
+			{
+				response.m_response_code = 403;
+				response.m_response_comment = "Forbidden";
+				return true;
+			}
+			if(query_info.m_URI == "/metrics")
+				fill_metrics_response(response);
+			else
+				fill_trace_response(response);
+			return true;
+		}
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if(!handle_http_request_map(query_info, response, m_conn_context))
+		{
+			response.m_response_code = 404;
+			response.m_response_comment = "Not found";
+			return true;
+		}
+		observe_rpc_request("daemon", query_info, response, std::chrono::steady_clock::now() - start);
+		return true;
+	}
 
 	BEGIN_URI_MAP2()
 	MAP_URI_AUTO_JON2("/get_height", on_get_height, COMMAND_RPC_GET_HEIGHT)
@@ -92,6 +124,7 @@ class core_rpc_server : public epee::http_server_impl_base<core_rpc_server>
 	MAP_URI_AUTO_JON2_IF("/set_log_hash_rate", on_set_log_hash_rate, COMMAND_RPC_SET_LOG_HASH_RATE, !m_restricted)
 	MAP_URI_AUTO_JON2_IF("/set_log_level", on_set_log_level, COMMAND_RPC_SET_LOG_LEVEL, !m_restricted)
 	MAP_URI_AUTO_JON2_IF("/set_log_categories", on_set_log_categories, COMMAND_RPC_SET_LOG_CATEGORIES, !m_restricted)
+	MAP_URI_AUTO_JON2_IF("/set_trace", on_set_trace, COMMAND_RPC_SET_TRACE, !m_restricted)
 	MAP_URI_AUTO_JON2("/get_transaction_pool", on_get_transaction_pool, COMMAND_RPC_GET_TRANSACTION_POOL)
 	MAP_URI_AUTO_JON2("/get_transaction_pool_hashes.bin", on_get_transaction_pool_hashes, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES)
 	MAP_URI_AUTO_JON2("/get_transaction_pool_stats", on_get_transaction_pool_stats, COMMAND_RPC_GET_TRANSACTION_POOL_STATS)
@@ -124,6 +157,7 @@ class core_rpc_server : public epee::http_server_impl_base<core_rpc_server>
 	MAP_JON_RPC_WE("get_block", on_get_block, COMMAND_RPC_GET_BLOCK)
 	MAP_JON_RPC_WE("getblock", on_get_block, COMMAND_RPC_GET_BLOCK)
 	MAP_JON_RPC_WE_IF("get_connections", on_get_connections, COMMAND_RPC_GET_CONNECTIONS, !m_restricted)
+	MAP_JON_RPC_WE_IF("get_net_stats", on_get_net_stats, COMMAND_RPC_GET_NET_STATS, !m_restricted)
 	MAP_JON_RPC_WE("get_info", on_get_info_json, COMMAND_RPC_GET_INFO)
 	MAP_JON_RPC_WE("hard_fork_info", on_hard_fork_info, COMMAND_RPC_HARD_FORK_INFO)
 	MAP_JON_RPC_WE_IF("set_bans", on_set_bans, COMMAND_RPC_SETBANS, !m_restricted)
@@ -162,6 +196,7 @@ class core_rpc_server : public epee::http_server_impl_base<core_rpc_server>
 	bool on_set_log_hash_rate(const COMMAND_RPC_SET_LOG_HASH_RATE::request &req, COMMAND_RPC_SET_LOG_HASH_RATE::response &res);
 	bool on_set_log_level(const COMMAND_RPC_SET_LOG_LEVEL::request &req, COMMAND_RPC_SET_LOG_LEVEL::response &res);
 	bool on_set_log_categories(const COMMAND_RPC_SET_LOG_CATEGORIES::request &req, COMMAND_RPC_SET_LOG_CATEGORIES::response &res);
+	bool on_set_trace(const COMMAND_RPC_SET_TRACE::request &req, COMMAND_RPC_SET_TRACE::response &res);
 	bool on_get_transaction_pool(const COMMAND_RPC_GET_TRANSACTION_POOL::request &req, COMMAND_RPC_GET_TRANSACTION_POOL::response &res, bool request_has_rpc_origin = true);
 	bool on_get_transaction_pool_hashes(const COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::request &req, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::response &res, bool request_has_rpc_origin = true);
 	bool on_get_transaction_pool_stats(const COMMAND_RPC_GET_TRANSACTION_POOL_STATS::request &req, COMMAND_RPC_GET_TRANSACTION_POOL_STATS::response &res, bool request_has_rpc_origin = true);
@@ -183,6 +218,7 @@ class core_rpc_server : public epee::http_server_impl_base<core_rpc_server>
 	bool on_get_block_headers_range(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::request &req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::response &res, epee::json_rpc::error &error_resp);
 	bool on_get_block(const COMMAND_RPC_GET_BLOCK::request &req, COMMAND_RPC_GET_BLOCK::response &res, epee::json_rpc::error &error_resp);
 	bool on_get_connections(const COMMAND_RPC_GET_CONNECTIONS::request &req, COMMAND_RPC_GET_CONNECTIONS::response &res, epee::json_rpc::error &error_resp);
+	bool on_get_net_stats(const COMMAND_RPC_GET_NET_STATS::request &req, COMMAND_RPC_GET_NET_STATS::response &res, epee::json_rpc::error &error_resp);
 	bool on_get_info_json(const COMMAND_RPC_GET_INFO::request &req, COMMAND_RPC_GET_INFO::response &res, epee::json_rpc::error &error_resp);
 	bool on_hard_fork_info(const COMMAND_RPC_HARD_FORK_INFO::request &req, COMMAND_RPC_HARD_FORK_INFO::response &res, epee::json_rpc::error &error_resp);
 	bool on_set_bans(const COMMAND_RPC_SETBANS::request &req, COMMAND_RPC_SETBANS::response &res, epee::json_rpc::error &error_resp);
@@ -19,6 +19,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #pragma once
+#include "common/trace.h"
 #include "crypto/hash.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "cryptonote_basic/difficulty.h"
@@ -39,7 +40,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 1
-#define CORE_RPC_VERSION_MINOR 19
+#define CORE_RPC_VERSION_MINOR 22
 #define MAKE_CORE_RPC_VERSION(major, minor) (((major) << 16) | (minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -1015,6 +1016,7 @@ struct COMMAND_RPC_MINING_STATUS
 		std::string status;
 		bool active;
 		uint64_t speed;
+		std::vector<uint64_t> threads_speed;
 		uint32_t threads_count;
 		std::string address;
 		bool is_background_mining_enabled;
@@ -1023,6 +1025,7 @@ struct COMMAND_RPC_MINING_STATUS
 		KV_SERIALIZE(status)
 		KV_SERIALIZE(active)
 		KV_SERIALIZE(speed)
+		KV_SERIALIZE(threads_speed)
 		KV_SERIALIZE(threads_count)
 		KV_SERIALIZE(address)
 		KV_SERIALIZE(is_background_mining_enabled)
@@ -1380,6 +1383,29 @@ struct COMMAND_RPC_SET_LOG_CATEGORIES
 	};
 };
 
+struct COMMAND_RPC_SET_TRACE
+{
+	struct request
+	{
+		bool enable;
+		uint64_t events_per_thread;
+
+		BEGIN_KV_SERIALIZE_MAP()
+		KV_SERIALIZE(enable)
+		KV_SERIALIZE_OPT(events_per_thread, (uint64_t)tools::trace::DEFAULT_EVENTS_PER_THREAD)
+		END_KV_SERIALIZE_MAP()
+	};
+
+	struct response
+	{
+		std::string status;
+
+		BEGIN_KV_SERIALIZE_MAP()
+		KV_SERIALIZE(status)
+		END_KV_SERIALIZE_MAP()
+	};
+};
+
 struct tx_info
 {
 	std::string id_hash;
@@ -1606,6 +1632,53 @@ struct COMMAND_RPC_GET_CONNECTIONS
 	};
 };
 
+struct net_compression_stat
+{
+	uint32_t command;
+	uint64_t sent_messages;
+	uint64_t sent_uncompressed;
+	uint64_t sent_raw_bytes;
+	uint64_t sent_packed_bytes;
+	uint64_t compress_us;
+	uint64_t received_messages;
+	uint64_t received_raw_bytes;
+	uint64_t received_packed_bytes;
+	uint64_t decompress_us;
+
+	BEGIN_KV_SERIALIZE_MAP()
+	KV_SERIALIZE(command)
+	KV_SERIALIZE(sent_messages)
+	KV_SERIALIZE(sent_uncompressed)
+	KV_SERIALIZE(sent_raw_bytes)
+	KV_SERIALIZE(sent_packed_bytes)
+	KV_SERIALIZE(compress_us)
+	KV_SERIALIZE(received_messages)
+	KV_SERIALIZE(received_raw_bytes)
+	KV_SERIALIZE(received_packed_bytes)
+	KV_SERIALIZE(decompress_us)
+	END_KV_SERIALIZE_MAP()
+};
+
+struct COMMAND_RPC_GET_NET_STATS
+{
+	struct request
+	{
+		BEGIN_KV_SERIALIZE_MAP()
+		END_KV_SERIALIZE_MAP()
+	};
+
+	struct response
+	{
+		std::string status;
+		std::vector<net_compression_stat> compression;
+
+		BEGIN_KV_SERIALIZE_MAP()
+		KV_SERIALIZE(status)
+		KV_SERIALIZE(compression)
+		END_KV_SERIALIZE_MAP()
+	};
+};
+
 struct COMMAND_RPC_GET_BLOCK_HEADERS_RANGE
 {
 	struct request
@@ -2091,9 +2164,15 @@ struct COMMAND_RPC_SYNC_INFO
 	struct peer
 	{
 		connection_info info;
+		uint64_t bandwidth; // bytes per second, as measured by the download scheduler
+		uint32_t latency;	// milliseconds
+		uint64_t span_size; // blocks requested in this peer's next span
 
 		BEGIN_KV_SERIALIZE_MAP()
 		KV_SERIALIZE(info)
+		KV_SERIALIZE(bandwidth)
+		KV_SERIALIZE(latency)
+		KV_SERIALIZE(span_size)
 		END_KV_SERIALIZE_MAP()
 	};
 
@@ -2125,6 +2204,8 @@ struct COMMAND_RPC_SYNC_INFO
 		uint64_t target_height;
 		std::list<peer> peers;
 		std::list<span> spans;
+		uint64_t queue_size;
+		uint64_t queue_target_size;
 
 		BEGIN_KV_SERIALIZE_MAP()
 		KV_SERIALIZE(status)
@@ -2132,6 +2213,8 @@ struct COMMAND_RPC_SYNC_INFO
 		KV_SERIALIZE(target_height)
 		KV_SERIALIZE(peers)
 		KV_SERIALIZE(spans)
+		KV_SERIALIZE(queue_size)
+		KV_SERIALIZE(queue_target_size)
 		END_KV_SERIALIZE_MAP()
 	};
 };
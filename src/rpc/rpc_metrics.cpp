@@ -0,0 +1,55 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "rpc_metrics.h"
+#include "common/metrics.h"
+#include "common/trace.h"
+#include <unordered_map>
+
+namespace cryptonote
+{
+void observe_rpc_request(const char *server, const epee::net_utils::http::http_request_info &query_info,
+	const epee::net_utils::http::http_response_info &response, std::chrono::steady_clock::duration elapsed)
+{
+	// only matched URIs and methods get here, so the label set stays bounded
+	const std::string &method = response.m_handler.empty() ? query_info.m_URI : response.m_handler;
+	const std::string key = std::string(server) + " " + method;
+
+	// the registry lookup takes a lock, keep what this thread has already looked up
+	static thread_local std::unordered_map<std::string, const tools::metrics::histogram *> histograms;
+	const tools::metrics::histogram *&h = histograms[key];
+	if(h == nullptr)
+		h = &tools::metrics::get_histogram("ombre_rpc_request_seconds", std::string("server=\"") + server + "\",method=\"" + method + "\"",
+			"Latency of RPC requests, by server and method");
+	h->observe(elapsed);
+}
+
+void fill_metrics_response(epee::net_utils::http::http_response_info &response)
+{
+	response.m_response_code = 200;
+	response.m_response_comment = "Ok";
+	response.m_body = tools::metrics::export_text();
+	response.m_mime_tipe = "text/plain; version=0.0.4";
+	response.m_header_info.m_content_type = " text/plain; version=0.0.4";
+}
+
+void fill_trace_response(epee::net_utils::http::http_response_info &response)
+{
+	response.m_response_code = 200;
+	response.m_response_comment = "Ok";
+	response.m_body = tools::trace::dump_json();
+	response.m_mime_tipe = "application/json";
+	response.m_header_info.m_content_type = " application/json";
+}
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "net/http_base.h"
+
+namespace cryptonote
+{
+/**
+ * @brief records a request the URI map of an RPC server handled
+ *
+ * Goes to ombre_rpc_request_seconds, labelled with the server and the JSON-RPC method,
+ * or the URI for the other calls.
+ */
+void observe_rpc_request(const char *server, const epee::net_utils::http::http_request_info &query_info,
+	const epee::net_utils::http::http_response_info &response, std::chrono::steady_clock::duration elapsed);
+
+/**
+ * @brief fills the response with the metrics registry in the Prometheus text format
+ */
+void fill_metrics_response(epee::net_utils::http::http_response_info &response);
+
+/**
+ * @brief fills the response with the recorded trace events, as Chrome trace JSON
+ */
+void fill_trace_response(epee::net_utils::http::http_response_info &response);
+}
@@ -41,9 +41,12 @@ using namespace epee;
 #include "common/command_line.h"
 #include "common/dns_utils.h"
 #include "common/i18n.h"
+#include "common/int-util.h"
 #include "common/json_util.h"
 #include "common/threadpool.h"
+#include "common/trace.h"
 #include "common/util.h"
+#include "common/varint.h"
 #include "crypto/crypto.h"
 #include "cryptonote_basic/blobdatatype.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
@@ -103,6 +106,9 @@ using namespace cryptonote;
 
 #define SUBADDRESS_LOOKAHEAD_MAJOR 50
 #define SUBADDRESS_LOOKAHEAD_MINOR 200
+#define SUBADDRESS_BATCH_SIZE 1024 // subaddresses derived per threadpool job
+
+#define SUBADDRESS_TABLE_MAGIC "Ombre subaddress table\001"
 
 #define KEY_IMAGE_EXPORT_FILE_MAGIC_LEGACY "Sumokoin key image export\002"
 #define KEY_IMAGE_EXPORT_FILE_MAGIC "Ryo key image export\003"
@@ -504,6 +510,20 @@ static void emplace_or_replace(std::unordered_multimap<crypto::hash, tools::wall
 	container.emplace(key, pd);
 }
 
+template <typename T>
+static void erase_index_entry(std::multimap<uint64_t, const T *> &index, uint64_t height, const T *p)
+{
+	auto range = index.equal_range(height);
+	for(auto i = range.first; i != range.second; ++i)
+	{
+		if(i->second == p)
+		{
+			index.erase(i);
+			return;
+		}
+	}
+}
+
 void drop_from_short_history(std::list<crypto::hash> &short_chain_history, size_t N)
 {
 	std::list<crypto::hash>::iterator right;
@@ -624,6 +644,9 @@ wallet2::wallet2(network_type nettype, bool restricted) : m_multisig_rescan_info
 														  m_node_rpc_proxy(m_http_client, m_daemon_rpc_mutex),
 														  m_subaddress_lookahead_major(SUBADDRESS_LOOKAHEAD_MAJOR),
 														  m_subaddress_lookahead_minor(SUBADDRESS_LOOKAHEAD_MINOR),
+														  m_subaddress_table_dirty(true),
+														  m_subaddress_table_size(0),
+														  m_subaddress_table_hash(crypto::null_hash),
 														  m_key_on_device(false),
 														  m_ring_history_saved(false),
 														  m_ringdb()
@@ -878,41 +901,191 @@ void wallet2::add_subaddress(uint32_t index_major, const std::string &label)
 //----------------------------------------------------------------------------------------------------
 void wallet2::expand_subaddresses(const cryptonote::subaddress_index &index)
 {
-	hw::device &hwdev = m_account.get_device();
 	if(m_subaddress_labels.size() <= index.major)
 	{
 		// add new accounts
-		cryptonote::subaddress_index index2;
 		const uint32_t major_end = get_subaddress_clamped_sum(index.major, m_subaddress_lookahead_major);
-		for(index2.major = m_subaddress_labels.size(); index2.major < major_end; ++index2.major)
-		{
-			const uint32_t end = get_subaddress_clamped_sum((index2.major == index.major ? index.minor : 0), m_subaddress_lookahead_minor);
-			const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index2.major, 0, end);
-			for(index2.minor = 0; index2.minor < end; ++index2.minor)
-			{
-				const crypto::public_key &D = pkeys[index2.minor];
-				m_subaddresses[D] = index2;
-			}
-		}
+		for(uint32_t major = m_subaddress_labels.size(); major < major_end; ++major)
+			add_subaddresses(major, 0, get_subaddress_clamped_sum((major == index.major ? index.minor : 0), m_subaddress_lookahead_minor));
 		m_subaddress_labels.resize(index.major + 1, {"Untitled account"});
 		m_subaddress_labels[index.major].resize(index.minor + 1);
 	}
 	else if(m_subaddress_labels[index.major].size() <= index.minor)
 	{
 		// add new subaddresses
-		const uint32_t end = get_subaddress_clamped_sum(index.minor, m_subaddress_lookahead_minor);
-		const uint32_t begin = m_subaddress_labels[index.major].size();
-		cryptonote::subaddress_index index2 = {index.major, begin};
-		const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index2.major, index2.minor, end);
-		for(; index2.minor < end; ++index2.minor)
-		{
-			const crypto::public_key &D = pkeys[index2.minor - begin];
-			m_subaddresses[D] = index2;
-		}
+		add_subaddresses(index.major, m_subaddress_labels[index.major].size(), get_subaddress_clamped_sum(index.minor, m_subaddress_lookahead_minor));
 		m_subaddress_labels[index.major].resize(index.minor + 1);
 	}
 }
 //----------------------------------------------------------------------------------------------------
+std::vector<crypto::public_key> wallet2::get_subaddress_spend_public_keys(uint32_t index_major, uint32_t begin, uint32_t end) const
+{
+	hw::device &hwdev = m_account.get_device();
+	tools::threadpool &tpool = tools::threadpool::getInstance();
+
+	// hardware devices derive one key at a time, the software one is split across the threadpool
+	if(&hwdev != &hw::get_device("default") || tpool.get_max_concurrency() < 2 || begin >= end || end - begin < 2 * SUBADDRESS_BATCH_SIZE)
+		return hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index_major, begin, end);
+
+	std::vector<crypto::public_key> pkeys(end - begin);
+	std::atomic<bool> failed(false);
+	tools::threadpool::waiter waiter;
+	for(uint32_t batch = begin; batch < end;)
+	{
+		const uint32_t batch_end = batch + std::min<uint32_t>(SUBADDRESS_BATCH_SIZE, end - batch);
+		tpool.submit(&waiter, [&, batch, batch_end] {
+			try
+			{
+				const std::vector<crypto::public_key> keys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index_major, batch, batch_end);
+				std::copy(keys.begin(), keys.end(), pkeys.begin() + (batch - begin));
+			}
+			catch(const std::exception &e)
+			{
+				MERROR("Failed to derive subaddresses: " << e.what());
+				failed = true;
+			}
+		});
+		batch = batch_end;
+	}
+	waiter.wait();
+	THROW_WALLET_EXCEPTION_IF(failed, error::wallet_internal_error, "Failed to derive subaddresses");
+	return pkeys;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::add_subaddresses(uint32_t index_major, uint32_t begin, uint32_t end)
+{
+	if(begin >= end)
+		return;
+	const std::vector<crypto::public_key> pkeys = get_subaddress_spend_public_keys(index_major, begin, end);
+	m_subaddresses.reserve(m_subaddresses.size() + pkeys.size());
+	cryptonote::subaddress_index index = {index_major, begin};
+	for(; index.minor < end; ++index.minor)
+		m_subaddresses[pkeys[index.minor - begin]] = index;
+	m_subaddress_table_dirty = true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::rebuild_subaddresses()
+{
+	// the same ranges expand_subaddresses would have reached for the subaddresses in use
+	m_subaddresses.clear();
+	const uint32_t accounts = m_subaddress_labels.size();
+	const uint32_t major_end = get_subaddress_clamped_sum(accounts - 1, m_subaddress_lookahead_major);
+	for(uint32_t major = 0; major < major_end; ++major)
+	{
+		const uint32_t used = major < accounts && !m_subaddress_labels[major].empty() ? m_subaddress_labels[major].size() - 1 : 0;
+		add_subaddresses(major, 0, get_subaddress_clamped_sum(used, m_subaddress_lookahead_minor));
+	}
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::load_subaddress_table()
+{
+	// layout: iv, then encrypted magic, count, sorted (key, major, minor) entries and a hash of all that
+	const std::string path = m_wallet_file + ".subaddr";
+	const size_t magic_size = sizeof(SUBADDRESS_TABLE_MAGIC) - 1;
+	const size_t entry_size = sizeof(crypto::public_key) + 2 * sizeof(uint32_t);
+	std::string buf;
+	if(m_wallet_file.empty() || !boost::filesystem::exists(path) || !epee::file_io_utils::load_file_to_string(path, buf))
+		return false;
+	if(buf.size() < sizeof(crypto::chacha_iv) + magic_size + sizeof(uint64_t) + sizeof(crypto::hash))
+	{
+		MWARNING("Subaddress table " << path << " is truncated, regenerating it");
+		return false;
+	}
+
+	crypto::chacha_key key;
+	generate_chacha_key_from_secret_keys(key);
+	crypto::chacha_iv iv;
+	memcpy(&iv, buf.data(), sizeof(iv));
+	std::string data(buf.size() - sizeof(iv), '\0');
+	crypto::chacha20(buf.data() + sizeof(iv), data.size(), key, iv, &data[0]);
+
+	crypto::hash hash;
+	crypto::cn_fast_hash(data.data(), data.size() - sizeof(hash), hash);
+	uint64_t count;
+	memcpy(&count, data.data() + magic_size, sizeof(count));
+	count = SWAP64LE(count);
+	if(memcmp(hash.data, data.data() + data.size() - sizeof(hash), sizeof(hash)) || data.compare(0, magic_size, SUBADDRESS_TABLE_MAGIC) ||
+	   count > (data.size() - magic_size - sizeof(count) - sizeof(hash)) / entry_size || data.size() != magic_size + sizeof(count) + count * entry_size + sizeof(hash))
+	{
+		MWARNING("Subaddress table " << path << " is corrupt or belongs to another wallet, regenerating it");
+		return false;
+	}
+	// a store that failed between the two files, or a cache restored from a backup, leaves a table of other subaddresses
+	if(count != m_subaddress_table_size || hash != m_subaddress_table_hash)
+	{
+		MWARNING("Subaddress table " << path << " was not written with the wallet cache, regenerating it");
+		return false;
+	}
+
+	std::unordered_map<crypto::public_key, cryptonote::subaddress_index> subaddresses;
+	subaddresses.reserve(count);
+	const char *entry = data.data() + magic_size + sizeof(count);
+	for(uint64_t i = 0; i < count; ++i, entry += entry_size)
+	{
+		crypto::public_key pkey;
+		cryptonote::subaddress_index index;
+		memcpy(&pkey, entry, sizeof(pkey));
+		memcpy(&index.major, entry + sizeof(pkey), sizeof(uint32_t));
+		memcpy(&index.minor, entry + sizeof(pkey) + sizeof(uint32_t), sizeof(uint32_t));
+		index.major = SWAP32LE(index.major);
+		index.minor = SWAP32LE(index.minor);
+		subaddresses.emplace(pkey, index);
+	}
+
+	auto primary = subaddresses.find(m_account.get_keys().m_account_address.m_spend_public_key);
+	if(primary == subaddresses.end() || !primary->second.is_zero())
+	{
+		MWARNING("Subaddress table " << path << " does not match the wallet, regenerating it");
+		return false;
+	}
+
+	m_subaddresses.swap(subaddresses);
+	m_subaddress_table_dirty = false;
+	return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::store_subaddress_table(const std::string &wallet_file)
+{
+	const std::string path = wallet_file + ".subaddr";
+	if(wallet_file.empty() || (!m_subaddress_table_dirty && wallet_file == m_wallet_file && boost::filesystem::exists(path)))
+		return;
+
+	std::vector<std::pair<crypto::public_key, cryptonote::subaddress_index>> entries(m_subaddresses.begin(), m_subaddresses.end());
+	std::sort(entries.begin(), entries.end(), [](const std::pair<crypto::public_key, cryptonote::subaddress_index> &a, const std::pair<crypto::public_key, cryptonote::subaddress_index> &b) {
+		return memcmp(a.first.data, b.first.data, sizeof(a.first.data)) < 0;
+	});
+
+	std::string data(SUBADDRESS_TABLE_MAGIC);
+	data.reserve(data.size() + sizeof(uint64_t) + entries.size() * (sizeof(crypto::public_key) + 2 * sizeof(uint32_t)) + sizeof(crypto::hash));
+	const uint64_t count = SWAP64LE((uint64_t)entries.size());
+	data.append((const char *)&count, sizeof(count));
+	for(const auto &e : entries)
+	{
+		const uint32_t major = SWAP32LE(e.second.major), minor = SWAP32LE(e.second.minor);
+		data.append(e.first.data, sizeof(e.first.data));
+		data.append((const char *)&major, sizeof(major));
+		data.append((const char *)&minor, sizeof(minor));
+	}
+	crypto::hash hash;
+	crypto::cn_fast_hash(data.data(), data.size(), hash);
+	data.append(hash.data, sizeof(hash.data));
+	m_subaddress_table_size = entries.size();
+	m_subaddress_table_hash = hash;
+
+	crypto::chacha_key key;
+	generate_chacha_key_from_secret_keys(key);
+	const crypto::chacha_iv iv = crypto::rand<crypto::chacha_iv>();
+	std::string buf(sizeof(iv) + data.size(), '\0');
+	memcpy(&buf[0], &iv, sizeof(iv));
+	crypto::chacha20(data.data(), data.size(), key, iv, &buf[sizeof(iv)]);
+
+	const std::string new_file = path + ".new";
+	THROW_WALLET_EXCEPTION_IF(!epee::file_io_utils::save_string_to_file(new_file, buf), error::file_save_error, new_file);
+	std::error_code e = tools::replace_file(new_file, path);
+	THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, path, e);
+	m_subaddress_table_dirty = wallet_file != m_wallet_file;
+}
+//----------------------------------------------------------------------------------------------------
 std::string wallet2::get_subaddress_label(const cryptonote::subaddress_index &index) const
 {
 	if(index.major >= m_subaddress_labels.size() || index.minor >= m_subaddress_labels[index.major].size())
@@ -952,6 +1125,7 @@ void wallet2::set_spent(size_t idx, uint64_t height)
 	LOG_PRINT_L2("Setting SPENT at " << height << ": ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
 	td.m_spent = true;
 	td.m_spent_height = height;
+	count_balance(idx);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::set_unspent(size_t idx)
@@ -960,6 +1134,123 @@ void wallet2::set_unspent(size_t idx)
 	LOG_PRINT_L2("Setting UNSPENT: ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
 	td.m_spent = false;
 	td.m_spent_height = 0;
+	count_balance(idx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::count_balance(size_t idx)
+{
+	uncount_balance(idx);
+
+	const transfer_details &td = m_transfers[idx];
+	if(td.m_spent)
+		return;
+
+	if(m_balance_entries.size() <= idx)
+		m_balance_entries.resize(idx + 1, balance_entry{false});
+	balance_entry &entry = m_balance_entries[idx];
+	entry.counted = true;
+	entry.index = td.m_subaddr_index;
+	entry.amount = td.amount();
+	entry.unlock_height = get_transfer_unlock_height(td);
+	m_balances[entry.index.major][entry.index.minor] += entry.amount;
+	m_unlock_schedule.emplace(entry.unlock_height, idx);
+
+	spendable_outputs &spendable = m_spendable[entry.index.major][entry.index.minor];
+	spendable.transfers.insert(idx);
+	if(td.is_rct())
+		spendable.rct_by_amount.emplace(entry.amount, idx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::uncount_balance(size_t idx)
+{
+	if(idx >= m_balance_entries.size() || !m_balance_entries[idx].counted)
+		return;
+
+	balance_entry &entry = m_balance_entries[idx];
+	entry.counted = false;
+
+	std::map<uint32_t, uint64_t> &account = m_balances[entry.index.major];
+	auto subaddr = account.find(entry.index.minor);
+	if(subaddr != account.end())
+	{
+		subaddr->second -= std::min(subaddr->second, entry.amount);
+		if(subaddr->second == 0)
+			account.erase(subaddr);
+	}
+	if(account.empty())
+		m_balances.erase(entry.index.major);
+
+	auto range = m_unlock_schedule.equal_range(entry.unlock_height);
+	for(auto it = range.first; it != range.second; ++it)
+	{
+		if(it->second == idx)
+		{
+			m_unlock_schedule.erase(it);
+			break;
+		}
+	}
+
+	std::map<uint32_t, spendable_outputs> &spendable_account = m_spendable[entry.index.major];
+	auto spendable = spendable_account.find(entry.index.minor);
+	if(spendable != spendable_account.end())
+	{
+		spendable->second.transfers.erase(idx);
+		spendable->second.rct_by_amount.erase(std::make_pair(entry.amount, idx));
+		if(spendable->second.transfers.empty())
+			spendable_account.erase(spendable);
+	}
+	if(spendable_account.empty())
+		m_spendable.erase(entry.index.major);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::rebuild_balances()
+{
+	m_balance_entries.clear();
+	m_balances.clear();
+	m_unlock_schedule.clear();
+	m_spendable.clear();
+	m_balance_entries.resize(m_transfers.size(), balance_entry{false});
+	for(size_t i = 0; i < m_transfers.size(); ++i)
+		count_balance(i);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_payment(const payment_container::value_type &p)
+{
+	m_payments_by_height.emplace(p.second.m_block_height, &p);
+	m_payments_by_id[p.first].emplace(p.second.m_block_height, &p);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::unindex_payment(const payment_container::value_type &p)
+{
+	erase_index_entry(m_payments_by_height, p.second.m_block_height, &p);
+	auto i = m_payments_by_id.find(p.first);
+	if(i != m_payments_by_id.end())
+	{
+		erase_index_entry(i->second, p.second.m_block_height, &p);
+		if(i->second.empty())
+			m_payments_by_id.erase(i);
+	}
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &p)
+{
+	m_confirmed_txs_by_height.emplace(p.second.m_block_height, &p);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::unindex_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &p)
+{
+	erase_index_entry(m_confirmed_txs_by_height, p.second.m_block_height, &p);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::rebuild_history_index()
+{
+	m_payments_by_height.clear();
+	m_payments_by_id.clear();
+	m_confirmed_txs_by_height.clear();
+	for(const auto &p : m_payments)
+		index_payment(p);
+	for(const auto &p : m_confirmed_txs)
+		index_confirmed_tx(p);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::check_acc_out_precomp(const tx_out &o, const crypto::key_derivation &derivation, const std::vector<crypto::key_derivation> &additional_derivations, size_t i, tx_scan_info_t &tx_scan_info) const
@@ -1050,6 +1341,7 @@ void wallet2::scan_output(const cryptonote::transaction &tx, const crypto::publi
 //----------------------------------------------------------------------------------------------------
 void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote::transaction &tx, const std::vector<uint64_t> &o_indices, uint64_t height, uint64_t ts, bool miner_tx, bool pool, bool double_spend_seen)
 {
+	TRACE_SCOPE_ARG(wallet_process_new_transaction, height);
 	//ensure device is let in NONE mode in any case
 	hw::device &hwdev = m_account.get_device();
 
@@ -1339,6 +1631,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
 						}
 						THROW_WALLET_EXCEPTION_IF(td.get_public_key() != tx_scan_info[o].in_ephemeral.pub, error::wallet_internal_error, "Inconsistent public keys");
 						THROW_WALLET_EXCEPTION_IF(td.m_spent, error::wallet_internal_error, "Inconsistent spent status");
+						count_balance(kit->second);
 
 						LOG_PRINT_L0("Received money: " << print_money(td.amount()) << ", with tx: " << txid);
 						if(0 != m_callback)
@@ -1375,6 +1668,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
 					//   2) the wallet set the highest amount among them to transfer_details::m_amount, and
 					//   3) the wallet somehow spent that output with an amount smaller than the above amount, causing inconsistency
 					td.m_amount = amount;
+					count_balance(it->second);
 				}
 			}
 			else
@@ -1509,7 +1803,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
 					m_callback->on_unconfirmed_money_received(height, txid, tx, payment.m_amount, payment.m_subaddr_index);
 			}
 			else
-				m_payments.emplace(payment_id, payment);
+				index_payment(*m_payments.emplace(payment_id, payment));
 			LOG_PRINT_L2("Payment found in " << (pool ? "pool" : "block") << ": " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_amount);
 		}
 	}
@@ -1527,7 +1821,9 @@ void wallet2::process_unconfirmed(const crypto::hash &txid, const cryptonote::tr
 		{
 			try
 			{
-				m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+				auto entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+				if(entry.second)
+					index_confirmed_tx(*entry.first);
 			}
 			catch(...)
 			{
@@ -1543,7 +1839,9 @@ void wallet2::process_outgoing(const crypto::hash &txid, const cryptonote::trans
 {
 	std::pair<std::unordered_map<crypto::hash, confirmed_transfer_details>::iterator, bool> entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details()));
 	// fill with the info we know, some info might already be there
-	if(entry.second)
+	if(!entry.second)
+		unindex_confirmed_tx(*entry.first);
+	else
 	{
 		// this case will happen if the tx is from our outputs, but was sent by another
 		// wallet (eg, we're a cold wallet and the hot wallet sent it). For RCT transactions,
@@ -1574,12 +1872,14 @@ void wallet2::process_outgoing(const crypto::hash &txid, const cryptonote::trans
 	entry.first->second.m_block_height = height;
 	entry.first->second.m_timestamp = ts;
 	entry.first->second.m_unlock_time = tx.unlock_time;
+	index_confirmed_tx(*entry.first);
 
 	add_rings(tx);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::process_new_blockchain_entry(const cryptonote::block &b, const cryptonote::block_complete_entry &bche, const crypto::hash &bl_id, uint64_t height, const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices &o_indices)
 {
+	TRACE_SCOPE_ARG(wallet_process_blockchain_entry, height);
 	size_t txidx = 0;
 	THROW_WALLET_EXCEPTION_IF(bche.txs.size() + 1 != o_indices.indices.size(), error::wallet_internal_error,
 							  "block transactions=" + std::to_string(bche.txs.size()) +
@@ -1655,6 +1955,7 @@ void wallet2::get_short_chain_history(std::list<crypto::hash> &ids) const
 //----------------------------------------------------------------------------------------------------
 void wallet2::parse_block_round(const cryptonote::blobdata &blob, cryptonote::block &bl, crypto::hash &bl_id, bool &error) const
 {
+	TRACE_SCOPE(wallet_parse_block);
 	error = !cryptonote::parse_and_validate_block_from_blob(blob, bl);
 	if(!error)
 		bl_id = get_block_hash(bl);
@@ -1662,6 +1963,7 @@ void wallet2::parse_block_round(const cryptonote::blobdata &blob, cryptonote::bl
 //----------------------------------------------------------------------------------------------------
 void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::list<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
 {
+	TRACE_SCOPE_ARG(wallet_pull_blocks, start_height);
 	cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
 	cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
 	req.block_ids = short_chain_history;
@@ -1730,6 +2032,7 @@ void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height,
 //----------------------------------------------------------------------------------------------------
 void wallet2::process_blocks(uint64_t start_height, const std::list<cryptonote::block_complete_entry> &blocks, const std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t &blocks_added)
 {
+	TRACE_SCOPE_ARG(wallet_process_blocks, blocks.size());
 	size_t current_index = start_height;
 	blocks_added = 0;
 	size_t tx_o_indices_idx = 0;
@@ -1845,6 +2148,7 @@ void wallet2::refresh(uint64_t start_height, uint64_t &blocks_fetched)
 //----------------------------------------------------------------------------------------------------
 void wallet2::pull_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::list<cryptonote::block_complete_entry> &prev_blocks, std::list<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, bool &error)
 {
+	TRACE_SCOPE_ARG(wallet_pull_next_blocks, start_height);
 	error = false;
 
 	try
@@ -1902,6 +2206,7 @@ void wallet2::remove_obsolete_pool_txs(const std::vector<crypto::hash> &tx_hashe
 void wallet2::update_pool_state(bool refreshed)
 {
 	MDEBUG("update_pool_state start");
+	TRACE_SCOPE(wallet_update_pool_state);
 
 	// get the pool state
 	cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::request req;
@@ -2120,6 +2425,7 @@ void wallet2::update_pool_state(bool refreshed)
 //----------------------------------------------------------------------------------------------------
 void wallet2::fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history)
 {
+	TRACE_SCOPE_ARG(wallet_fast_refresh, stop_height);
 	std::list<crypto::hash> hashes;
 
 	const uint64_t checkpoint_height = m_checkpoints.get_max_height();
@@ -2211,8 +2517,14 @@ bool wallet2::delete_address_book_row(std::size_t row_id)
 }
 
 //----------------------------------------------------------------------------------------------------
-void wallet2::refresh(uint64_t start_height, uint64_t &blocks_fetched, bool &received_money)
+void wallet2::refresh(uint64_t start_height, uint64_t &blocks_fetched, bool &received_money, boost::shared_mutex *state_lock)
 {
+	TRACE_SCOPE_ARG(wallet_refresh, start_height);
+	auto lock_state = [state_lock]() {
+		return state_lock ? boost::unique_lock<boost::shared_mutex>(*state_lock) : boost::unique_lock<boost::shared_mutex>();
+	};
+	boost::unique_lock<boost::shared_mutex> lock = lock_state();
+
 	received_money = false;
 	blocks_fetched = 0;
 	uint64_t added_blocks = 0;
@@ -2245,6 +2557,8 @@ void wallet2::refresh(uint64_t start_height, uint64_t &blocks_fetched, bool &rec
 	// If stop() is called during fast refresh we don't need to continue
 	if(!m_run.load(std::memory_order_relaxed))
 		return;
+	if(lock.owns_lock())
+		lock.unlock();
 	pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices);
 	// always reset start_height to 0 to force short_chain_ history to be used on
 	// subsequent pulls in this refresh.
@@ -2266,11 +2580,15 @@ void wallet2::refresh(uint64_t start_height, uint64_t &blocks_fetched, bool &rec
 			}
 			tpool.submit(&waiter, [&] { pull_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks, next_blocks, next_o_indices, error); });
 
+			lock = lock_state();
 			process_blocks(blocks_start_height, blocks, o_indices, added_blocks);
 			blocks_fetched += added_blocks;
+			if(lock.owns_lock())
+				lock.unlock();
 			waiter.wait();
 			if(blocks_start_height == next_blocks_start_height)
 			{
+				lock = lock_state();
 				m_node_rpc_proxy.set_height(m_blockchain.size());
 				refreshed = true;
 				break;
@@ -2289,6 +2607,8 @@ void wallet2::refresh(uint64_t start_height, uint64_t &blocks_fetched, bool &rec
 		}
 		catch(const std::exception &)
 		{
+			if(lock.owns_lock())
+				lock.unlock();
 			blocks_fetched += added_blocks;
 			waiter.wait();
 			if(try_count < 3)
@@ -2303,6 +2623,8 @@ void wallet2::refresh(uint64_t start_height, uint64_t &blocks_fetched, bool &rec
 			}
 		}
 	}
+	if(!lock.owns_lock())
+		lock = lock_state();
 	if(last_tx_hash_id != (m_transfers.size() ? m_transfers.back().m_txid : null_hash))
 		received_money = true;
 
@@ -2441,27 +2763,38 @@ void wallet2::detach_blockchain(uint64_t height)
 		THROW_WALLET_EXCEPTION_IF(it_pk == m_pub_keys.end(), error::wallet_internal_error, "public key not found");
 		m_pub_keys.erase(it_pk);
 	}
+	for(size_t i = i_start; i != m_transfers.size(); i++)
+		uncount_balance(i);
 	m_transfers.erase(it, m_transfers.end());
+	m_balance_entries.resize(std::min(m_balance_entries.size(), m_transfers.size()));
 
 	size_t blocks_detached = m_blockchain.size() - height;
 	m_blockchain.crop(height);
 	m_local_bc_height -= blocks_detached;
 
-	for(auto it = m_payments.begin(); it != m_payments.end();)
+	std::vector<const payment_container::value_type *> detached_payments;
+	for(auto it = m_payments_by_height.lower_bound(height); it != m_payments_by_height.end(); ++it)
+		detached_payments.push_back(it->second);
+	for(const payment_container::value_type *p : detached_payments)
 	{
-		if(height <= it->second.m_block_height)
-			it = m_payments.erase(it);
-		else
-			++it;
+		unindex_payment(*p);
+		auto range = m_payments.equal_range(p->first);
+		for(auto it = range.first; it != range.second; ++it)
+		{
+			if(&*it == p)
+			{
+				m_payments.erase(it);
+				break;
+			}
+		}
 	}
 
-	for(auto it = m_confirmed_txs.begin(); it != m_confirmed_txs.end();)
-	{
-		if(height <= it->second.m_block_height)
-			it = m_confirmed_txs.erase(it);
-		else
-			++it;
-	}
+	std::vector<crypto::hash> detached_txs;
+	for(auto it = m_confirmed_txs_by_height.lower_bound(height); it != m_confirmed_txs_by_height.end(); ++it)
+		detached_txs.push_back(it->second->first);
+	m_confirmed_txs_by_height.erase(m_confirmed_txs_by_height.lower_bound(height), m_confirmed_txs_by_height.end());
+	for(const crypto::hash &txid : detached_txs)
+		m_confirmed_txs.erase(txid);
 
 	LOG_PRINT_L0("Detached blockchain on height " << height << ", transfers detached " << transfers_detached << ", blocks detached " << blocks_detached);
 }
@@ -2476,13 +2809,20 @@ bool wallet2::clear()
 {
 	m_blockchain.clear();
 	m_transfers.clear();
+	m_balance_entries.clear();
+	m_balances.clear();
+	m_unlock_schedule.clear();
+	m_spendable.clear();
 	m_key_images.clear();
 	m_pub_keys.clear();
 	m_unconfirmed_txs.clear();
 	m_payments.clear();
+	m_payments_by_height.clear();
+	m_payments_by_id.clear();
 	m_tx_keys.clear();
 	m_additional_tx_keys.clear();
 	m_confirmed_txs.clear();
+	m_confirmed_txs_by_height.clear();
 	m_unconfirmed_payments.clear();
 	m_scanned_pool_txs[0].clear();
 	m_scanned_pool_txs[1].clear();
@@ -2490,6 +2830,9 @@ bool wallet2::clear()
 	m_local_bc_height = 1;
 	m_subaddresses.clear();
 	m_subaddress_labels.clear();
+	m_subaddress_table_dirty = true;
+	m_subaddress_table_size = 0;
+	m_subaddress_table_hash = crypto::null_hash;
 	return true;
 }
 
@@ -3910,6 +4253,11 @@ void wallet2::load(const std::string &wallet_, const epee::wipeable_string &pass
 			m_account_public_address.m_spend_public_key != m_account.get_keys().m_account_address.m_spend_public_key ||
 				m_account_public_address.m_view_public_key != m_account.get_keys().m_account_address.m_view_public_key,
 			error::wallet_files_doesnt_correspond, m_keys_file, m_wallet_file);
+
+		// caches from before the subaddress table still carry the map, it is written out on the next store
+		m_subaddress_table_dirty = true;
+		if(m_subaddresses.empty() && !m_subaddress_labels.empty() && !load_subaddress_table())
+			rebuild_subaddresses();
 	}
 
 	cryptonote::block genesis;
@@ -3931,6 +4279,8 @@ void wallet2::load(const std::string &wallet_, const epee::wipeable_string &pass
 		add_subaddress_account(tr("Primary account"));
 
 	m_local_bc_height = m_blockchain.size();
+	rebuild_balances();
+	rebuild_history_index();
 
 	try
 	{
@@ -4030,6 +4380,12 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
 			}
 		}
 	}
+	// the subaddress table goes first and the cache names it, so a crash in between leaves a table the next load refuses
+	std::string keys_file, wallet_file = m_wallet_file;
+	if(!same_file)
+		do_prepare_file_names(path, keys_file, wallet_file);
+	store_subaddress_table(wallet_file);
+
 	// preparing wallet data
 	std::stringstream oss;
 	boost::archive::portable_binary_oarchive ar(oss);
@@ -4049,6 +4405,7 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
 	const std::string old_file = m_wallet_file;
 	const std::string old_keys_file = m_keys_file;
 	const std::string old_address_file = m_wallet_file + ".address.txt";
+	const std::string old_subaddress_file = m_wallet_file + ".subaddr";
 
 	// save keys to the new file
 	// if we here, main wallet file is saved and we only need to save keys and address files
@@ -4082,6 +4439,10 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
 		{
 			LOG_ERROR("error removing file: " << old_address_file);
 		}
+		// the subaddress table was already written at the new path
+		boost::system::error_code ec;
+		boost::filesystem::remove(old_subaddress_file, ec);
+		m_subaddress_table_dirty = false;
 	}
 	else
 	{
@@ -4131,17 +4492,9 @@ uint64_t wallet2::unlocked_balance(uint32_t index_major) const
 std::map<uint32_t, uint64_t> wallet2::balance_per_subaddress(uint32_t index_major) const
 {
 	std::map<uint32_t, uint64_t> amount_per_subaddr;
-	for(const auto &td : m_transfers)
-	{
-		if(td.m_subaddr_index.major == index_major && !td.m_spent)
-		{
-			auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
-			if(found == amount_per_subaddr.end())
-				amount_per_subaddr[td.m_subaddr_index.minor] = td.amount();
-			else
-				found->second += td.amount();
-		}
-	}
+	auto account = m_balances.find(index_major);
+	if(account != m_balances.end())
+		amount_per_subaddr = account->second;
 	for(const auto &utx : m_unconfirmed_txs)
 	{
 		if(utx.second.m_subaddr_account == index_major && utx.second.m_state != wallet2::unconfirmed_transfer_details::failed)
@@ -4160,16 +4513,23 @@ std::map<uint32_t, uint64_t> wallet2::balance_per_subaddress(uint32_t index_majo
 std::map<uint32_t, uint64_t> wallet2::unlocked_balance_per_subaddress(uint32_t index_major) const
 {
 	std::map<uint32_t, uint64_t> amount_per_subaddr;
-	for(const transfer_details &td : m_transfers)
+	auto account = m_balances.find(index_major);
+	if(account == m_balances.end())
+		return amount_per_subaddr;
+	amount_per_subaddr = account->second;
+
+	// only the transfers still locked at this height need looking at
+	for(auto it = m_unlock_schedule.upper_bound(m_local_bc_height); it != m_unlock_schedule.end(); ++it)
 	{
-		if(td.m_subaddr_index.major == index_major && !td.m_spent && is_transfer_unlocked(td))
-		{
-			auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
-			if(found == amount_per_subaddr.end())
-				amount_per_subaddr[td.m_subaddr_index.minor] = td.amount();
-			else
-				found->second += td.amount();
-		}
+		const balance_entry &entry = m_balance_entries[it->second];
+		if(entry.index.major != index_major)
+			continue;
+		auto found = amount_per_subaddr.find(entry.index.minor);
+		if(found == amount_per_subaddr.end())
+			continue;
+		found->second -= std::min(found->second, entry.amount);
+		if(found->second == 0)
+			amount_per_subaddr.erase(found);
 	}
 	return amount_per_subaddr;
 }
@@ -4177,16 +4537,23 @@ std::map<uint32_t, uint64_t> wallet2::unlocked_balance_per_subaddress(uint32_t i
 uint64_t wallet2::balance_all() const
 {
 	uint64_t r = 0;
-	for(uint32_t index_major = 0; index_major < get_num_subaddress_accounts(); ++index_major)
-		r += balance(index_major);
+	for(const auto &account : m_balances)
+		for(const auto &subaddr : account.second)
+			r += subaddr.second;
+	for(const auto &utx : m_unconfirmed_txs)
+		if(utx.second.m_state != wallet2::unconfirmed_transfer_details::failed)
+			r += utx.second.m_change;
 	return r;
 }
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::unlocked_balance_all() const
 {
 	uint64_t r = 0;
-	for(uint32_t index_major = 0; index_major < get_num_subaddress_accounts(); ++index_major)
-		r += unlocked_balance(index_major);
+	for(const auto &account : m_balances)
+		for(const auto &subaddr : account.second)
+			r += subaddr.second;
+	for(auto it = m_unlock_schedule.upper_bound(m_local_bc_height); it != m_unlock_schedule.end(); ++it)
+		r -= std::min(r, m_balance_entries[it->second].amount);
 	return r;
 }
 //----------------------------------------------------------------------------------------------------
@@ -4195,45 +4562,93 @@ void wallet2::get_transfers(wallet2::transfer_container &incoming_transfers) con
 	incoming_transfers = m_transfers;
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::get_payments(const crypto::uniform_payment_id &payment_id, std::list<wallet2::payment_details> &payments, uint64_t min_height, const boost::optional<uint32_t> &subaddr_account, const std::set<uint32_t> &subaddr_indices) const
+bool wallet2::get_payments(const crypto::uniform_payment_id &payment_id, std::list<wallet2::payment_details> &payments, uint64_t min_height, const boost::optional<uint32_t> &subaddr_account, const std::set<uint32_t> &subaddr_indices, size_t max_count) const
 {
-	auto range = m_payments.equal_range(payment_id.payment_id);
-	std::for_each(range.first, range.second, [&payments, &min_height, &subaddr_account, &subaddr_indices](const payment_container::value_type &x) {
-		if(min_height < x.second.m_block_height &&
-		   (!subaddr_account || *subaddr_account == x.second.m_subaddr_index.major) &&
-		   (subaddr_indices.empty() || subaddr_indices.count(x.second.m_subaddr_index.minor) == 1))
+	auto index = m_payments_by_id.find(payment_id.payment_id);
+	if(index == m_payments_by_id.end())
+		return false;
+
+	size_t count = 0;
+	for(auto i = index->second.upper_bound(min_height); i != index->second.end(); ++i)
+	{
+		const payment_details &pd = i->second->second;
+		if((!subaddr_account || *subaddr_account == pd.m_subaddr_index.major) &&
+		   (subaddr_indices.empty() || subaddr_indices.count(pd.m_subaddr_index.minor) == 1))
 		{
-			payments.push_back(x.second);
+			// only stop on a block boundary, so resuming from the last height returned loses nothing
+			if(max_count != 0 && count >= max_count && payments.back().m_block_height != i->first)
+				return true;
+			payments.push_back(pd);
+			++count;
 		}
-	});
+	}
+	return false;
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::get_payments(std::list<std::pair<crypto::hash, wallet2::payment_details>> &payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t> &subaddr_account, const std::set<uint32_t> &subaddr_indices) const
+bool wallet2::get_payments(std::list<std::pair<crypto::hash, wallet2::payment_details>> &payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t> &subaddr_account, const std::set<uint32_t> &subaddr_indices, size_t max_count) const
 {
-	auto range = std::make_pair(m_payments.begin(), m_payments.end());
-	std::for_each(range.first, range.second, [&payments, &min_height, &max_height, &subaddr_account, &subaddr_indices](const payment_container::value_type &x) {
-		if(min_height < x.second.m_block_height && max_height >= x.second.m_block_height &&
-		   (!subaddr_account || *subaddr_account == x.second.m_subaddr_index.major) &&
+	size_t count = 0;
+	for(auto i = m_payments_by_height.upper_bound(min_height); i != m_payments_by_height.end() && i->first <= max_height; ++i)
+	{
+		const payment_container::value_type &x = *i->second;
+		if((!subaddr_account || *subaddr_account == x.second.m_subaddr_index.major) &&
 		   (subaddr_indices.empty() || subaddr_indices.count(x.second.m_subaddr_index.minor) == 1))
 		{
+			if(max_count != 0 && count >= max_count && payments.back().second.m_block_height != i->first)
+				return true;
 			payments.push_back(x);
+			++count;
 		}
-	});
+	}
+	return false;
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::get_payments_out(std::list<std::pair<crypto::hash, wallet2::confirmed_transfer_details>> &confirmed_payments,
-							   uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t> &subaddr_account, const std::set<uint32_t> &subaddr_indices) const
+bool wallet2::get_payments_out(std::list<std::pair<crypto::hash, wallet2::confirmed_transfer_details>> &confirmed_payments,
+							   uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t> &subaddr_account, const std::set<uint32_t> &subaddr_indices, size_t max_count) const
 {
-	for(auto i = m_confirmed_txs.begin(); i != m_confirmed_txs.end(); ++i)
+	size_t count = 0;
+	for(auto i = m_confirmed_txs_by_height.upper_bound(min_height); i != m_confirmed_txs_by_height.end() && i->first <= max_height; ++i)
 	{
-		if(i->second.m_block_height <= min_height || i->second.m_block_height > max_height)
-			continue;
-		if(subaddr_account && *subaddr_account != i->second.m_subaddr_account)
+		const confirmed_transfer_details &pd = i->second->second;
+		if(subaddr_account && *subaddr_account != pd.m_subaddr_account)
 			continue;
-		if(!subaddr_indices.empty() && std::count_if(i->second.m_subaddr_indices.begin(), i->second.m_subaddr_indices.end(), [&subaddr_indices](uint32_t index) { return subaddr_indices.count(index) == 1; }) == 0)
+		if(!subaddr_indices.empty() && std::count_if(pd.m_subaddr_indices.begin(), pd.m_subaddr_indices.end(), [&subaddr_indices](uint32_t index) { return subaddr_indices.count(index) == 1; }) == 0)
 			continue;
-		confirmed_payments.push_back(*i);
+		if(max_count != 0 && count >= max_count && confirmed_payments.back().second.m_block_height != i->first)
+			return true;
+		confirmed_payments.push_back(*i->second);
+		++count;
 	}
+	return false;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::get_payments_page(std::list<std::pair<crypto::hash, wallet2::payment_details>> *payments, std::list<std::pair<crypto::hash, wallet2::confirmed_transfer_details>> *confirmed_payments,
+								uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t> &subaddr_account, const std::set<uint32_t> &subaddr_indices, size_t max_count, uint64_t &next_min_height) const
+{
+	bool in_more = false, out_more = false;
+	if(payments)
+	{
+		in_more = get_payments(*payments, min_height, max_height, subaddr_account, subaddr_indices, max_count);
+		if(in_more)
+			max_height = payments->back().second.m_block_height;
+	}
+	if(confirmed_payments)
+	{
+		out_more = get_payments_out(*confirmed_payments, min_height, max_height, subaddr_account, subaddr_indices, max_count);
+		if(out_more)
+			max_height = confirmed_payments->back().second.m_block_height;
+	}
+
+	// out was cut below the in boundary, drop the incoming payments past it
+	while(out_more && payments && !payments->empty() && payments->back().second.m_block_height > max_height)
+		payments->pop_back();
+
+	next_min_height = min_height;
+	if(payments && !payments->empty())
+		next_min_height = std::max(next_min_height, payments->back().second.m_block_height);
+	if(confirmed_payments && !confirmed_payments->empty())
+		next_min_height = std::max(next_min_height, confirmed_payments->back().second.m_block_height);
+	return in_more || out_more;
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_unconfirmed_payments_out(std::list<std::pair<crypto::hash, wallet2::unconfirmed_transfer_details>> &unconfirmed_payments, const boost::optional<uint32_t> &subaddr_account, const std::set<uint32_t> &subaddr_indices) const
@@ -4330,6 +4745,14 @@ bool wallet2::is_transfer_unlocked(const transfer_details &td) const
 	return is_transfer_unlocked(td.m_tx.unlock_time, td.m_block_height);
 }
 //----------------------------------------------------------------------------------------------------
+uint64_t wallet2::get_transfer_unlock_height(const transfer_details &td) const
+{
+	// the first m_local_bc_height at which is_transfer_unlocked(td) holds
+	const uint64_t unlock_time = td.m_tx.unlock_time;
+	const uint64_t spendtime_height = unlock_time >= CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS ? unlock_time - CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS + 1 : 0;
+	return std::max(spendtime_height, td.m_block_height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE);
+}
+//----------------------------------------------------------------------------------------------------
 bool wallet2::is_transfer_unlocked(uint64_t unlock_time, uint64_t block_height) const
 {
 	if(!is_tx_spendtime_unlocked(unlock_time, block_height))
@@ -4395,6 +4818,46 @@ void pop_if_present(std::vector<T> &vec, T e)
 		}
 	}
 }
+
+// Max tree over a list of amounts, finds the last entry of a range holding at least a given amount
+// in O(log n) instead of walking past all the smaller ones
+class amount_max_tree
+{
+  public:
+	explicit amount_max_tree(const std::vector<uint64_t> &amounts) : m_leaves(1)
+	{
+		while(m_leaves < amounts.size())
+			m_leaves <<= 1;
+		m_tree.assign(2 * m_leaves, 0);
+		std::copy(amounts.begin(), amounts.end(), m_tree.begin() + m_leaves);
+		for(size_t n = m_leaves - 1; n > 0; --n)
+			m_tree[n] = std::max(m_tree[2 * n], m_tree[2 * n + 1]);
+	}
+
+	// returns end if no entry in [begin, end) holds min_amount
+	size_t find_last(size_t begin, size_t end, uint64_t min_amount) const
+	{
+		size_t found = find_last(1, 0, m_leaves, begin, end, min_amount);
+		return found == npos ? end : found;
+	}
+
+  private:
+	static constexpr size_t npos = (size_t)-1;
+
+	size_t find_last(size_t node, size_t lo, size_t hi, size_t begin, size_t end, uint64_t min_amount) const
+	{
+		if(hi <= begin || end <= lo || m_tree[node] < min_amount)
+			return npos;
+		if(hi - lo == 1)
+			return lo;
+		const size_t mid = lo + (hi - lo) / 2;
+		size_t found = find_last(2 * node + 1, mid, hi, begin, end, min_amount);
+		return found != npos ? found : find_last(2 * node, lo, mid, begin, end, min_amount);
+	}
+
+	size_t m_leaves;
+	std::vector<uint64_t> m_tree;
+};
 }
 //----------------------------------------------------------------------------------------------------
 // This returns a handwavy estimation of how much two outputs are related
@@ -4430,21 +4893,26 @@ float wallet2::get_output_relatedness(const transfer_details &td0, const transfe
 //----------------------------------------------------------------------------------------------------
 size_t wallet2::pop_best_value_from(const transfer_container &transfers, std::vector<size_t> &unused_indices, const std::vector<size_t> &selected_transfers, bool smallest) const
 {
+	// relatedness only grows as block heights get closer, so the most related selected output
+	// is one at the candidate's height or a nearest neighbour, found by bisecting the selection
+	std::vector<size_t> selected_by_height(selected_transfers);
+	std::sort(selected_by_height.begin(), selected_by_height.end(), [&transfers](size_t a, size_t b) { return transfers[a].m_block_height < transfers[b].m_block_height; });
+
 	std::vector<size_t> candidates;
 	float best_relatedness = 1.0f;
 	for(size_t n = 0; n < unused_indices.size(); ++n)
 	{
 		const transfer_details &candidate = transfers[unused_indices[n]];
 		float relatedness = 0.0f;
-		for(std::vector<size_t>::const_iterator i = selected_transfers.begin(); i != selected_transfers.end(); ++i)
-		{
-			float r = get_output_relatedness(candidate, transfers[*i]);
-			if(r > relatedness)
-			{
-				relatedness = r;
-				if(relatedness == 1.0f)
-					break;
-			}
+		auto i = std::lower_bound(selected_by_height.begin(), selected_by_height.end(), candidate.m_block_height,
+								  [&transfers](size_t idx, uint64_t height) { return transfers[idx].m_block_height < height; });
+		if(i != selected_by_height.begin())
+			relatedness = get_output_relatedness(candidate, transfers[*std::prev(i)]);
+		for(; i != selected_by_height.end() && relatedness < 1.0f; ++i)
+		{
+			relatedness = std::max(relatedness, get_output_relatedness(candidate, transfers[*i]));
+			if(transfers[*i].m_block_height != candidate.m_block_height)
+				break;
 		}
 
 		if(relatedness < best_relatedness)
@@ -5664,6 +6132,79 @@ bool wallet2::tx_add_fake_output(std::vector<std::vector<tools::wallet2::get_out
 	return true;
 }
 
+// Rings for the inputs of selected_transfers that outs does not cover yet, made of the real output only, so
+// transactions can be sized before any decoy is requested. No real ring has a gap this wide between members,
+// so the key offsets of a placeholder ring never encode shorter than those of the ring that replaces it.
+void wallet2::add_placeholder_outs(std::vector<std::vector<get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count) const
+{
+	static const uint64_t placeholder_spacing = (uint64_t)1 << 56;
+	THROW_WALLET_EXCEPTION_IF(fake_outputs_count >= 255, error::wallet_internal_error, "Too many fake outputs for placeholder rings");
+
+	if(outs.size() > selected_transfers.size())
+		outs.clear();
+	for(size_t i = outs.size(); i < selected_transfers.size(); ++i)
+	{
+		const transfer_details &td = m_transfers[selected_transfers[i]];
+		THROW_WALLET_EXCEPTION_IF(td.m_global_output_index >= placeholder_spacing, error::wallet_internal_error, "Output index too large for placeholder rings");
+		const rct::key mask = rct::commit(td.amount(), td.m_mask);
+		outs.emplace_back();
+		for(size_t n = 0; n <= fake_outputs_count; ++n)
+			outs.back().push_back(std::make_tuple(td.m_global_output_index + n * placeholder_spacing, td.get_public_key(), mask));
+	}
+}
+
+static size_t get_varint_size(uint64_t value)
+{
+	std::string varint;
+	tools::write_varint(std::back_inserter(varint), value);
+	return varint.size();
+}
+
+// bytes taken by the key offsets of these rings in a transaction
+size_t wallet2::get_key_offsets_size(const std::vector<std::vector<get_outs_entry>> &outs, size_t fake_outputs_count)
+{
+	size_t size = 0;
+	for(const std::vector<wallet2::get_outs_entry> &ring : outs)
+	{
+		std::vector<uint64_t> offsets;
+		for(size_t n = 0; n <= fake_outputs_count && n < ring.size(); ++n)
+			offsets.push_back(std::get<0>(ring[n]));
+		for(uint64_t offset : cryptonote::absolute_output_offsets_to_relative(offsets))
+			size += get_varint_size(offset);
+	}
+	return size;
+}
+
+// Size of a tx that was sized with placeholder rings, once they are swapped for the real ones. Real rings
+// encode no longer, and room is left for a fee that was raised after the sizing to encode longer.
+size_t wallet2::get_size_with_real_rings(size_t bytes, const std::vector<std::vector<get_outs_entry>> &placeholders, const std::vector<std::vector<get_outs_entry>> &rings,
+										 size_t fake_outputs_count, uint64_t sized_fee, uint64_t fee)
+{
+	bytes -= get_key_offsets_size(placeholders, fake_outputs_count);
+	bytes += get_key_offsets_size(rings, fake_outputs_count);
+	return bytes + get_varint_size(fee) - std::min(get_varint_size(fee), get_varint_size(sized_fee));
+}
+
+// One decoy request for the inputs of every tx of a split, the rings come back per tx
+void wallet2::get_split_outs(std::vector<std::vector<std::vector<get_outs_entry>>> &outs, const std::vector<std::vector<size_t>> &selected_transfers, size_t fake_outputs_count)
+{
+	std::vector<size_t> all_selected_transfers;
+	for(const std::vector<size_t> &tx_selected_transfers : selected_transfers)
+		all_selected_transfers.insert(all_selected_transfers.end(), tx_selected_transfers.begin(), tx_selected_transfers.end());
+
+	std::vector<std::vector<get_outs_entry>> all_outs;
+	get_outs(all_outs, all_selected_transfers, fake_outputs_count);
+	THROW_WALLET_EXCEPTION_IF(all_outs.size() != all_selected_transfers.size(), error::wallet_internal_error, "Unexpected number of rings");
+
+	outs.clear();
+	auto rings = std::make_move_iterator(all_outs.begin());
+	for(const std::vector<size_t> &tx_selected_transfers : selected_transfers)
+	{
+		outs.emplace_back(rings, rings + tx_selected_transfers.size());
+		rings += tx_selected_transfers.size();
+	}
+}
+
 void wallet2::get_outs(std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count)
 {
 	LOG_PRINT_L2("fake_outputs_count: " << fake_outputs_count);
@@ -6174,8 +6715,16 @@ void wallet2::transfer_selected_rct(std::vector<cryptonote::tx_destination_entry
 	for(auto i = ++selected_transfers.begin(); i != selected_transfers.end(); ++i)
 		THROW_WALLET_EXCEPTION_IF(subaddr_account != m_transfers[*i].m_subaddr_index.major, error::wallet_internal_error, "the tx uses funds from multiple accounts");
 
-	if(outs.empty())
-		get_outs(outs, selected_transfers, fake_outputs_count); // may throw
+	// outs holds the rings of a prefix of selected_transfers, only fetch those of inputs added since
+	if(outs.size() > selected_transfers.size())
+		outs.clear();
+	if(outs.size() < selected_transfers.size())
+	{
+		std::vector<size_t> missing(selected_transfers.begin() + outs.size(), selected_transfers.end());
+		std::vector<std::vector<tools::wallet2::get_outs_entry>> missing_outs;
+		get_outs(missing_outs, missing, fake_outputs_count); // may throw
+		outs.insert(outs.end(), std::make_move_iterator(missing_outs.begin()), std::make_move_iterator(missing_outs.end()));
+	}
 
 	//prepare inputs
 	LOG_PRINT_L2("preparing outputs");
@@ -6380,42 +6929,56 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money, ui
 	std::vector<size_t> picks;
 	float current_output_relatdness = 1.0f;
 	std::vector<pick_out> pick_list;
-	pick_list.reserve(m_transfers.size());
 
 	LOG_PRINT_L2("pick_preferred_rct_inputs: needed_money " << print_money(needed_money));
 
+	auto spendable_account = m_spendable.find(subaddr_account);
+	if(spendable_account == m_spendable.end())
+		return picks;
+	std::vector<const spendable_outputs *> spendable;
+	for(uint32_t index_minor : subaddr_indices)
+	{
+		auto subaddr = spendable_account->second.find(index_minor);
+		if(subaddr != spendable_account->second.end())
+			spendable.push_back(&subaddr->second);
+	}
+	auto usable = [this](size_t idx) {
+		const transfer_details &td = m_transfers[idx];
+		return !td.m_key_image_partial && is_transfer_unlocked(td);
+	};
+
+	// try to find a rct input of enough size, the oldest one as a full scan would
+	size_t alone = m_transfers.size();
+	for(const spendable_outputs *subaddr : spendable)
+	{
+		for(auto it = subaddr->rct_by_amount.lower_bound(std::make_pair(needed_money, size_t(0))); it != subaddr->rct_by_amount.end(); ++it)
+			if(it->second < alone && usable(it->second))
+				alone = it->second;
+	}
+	if(alone != m_transfers.size())
+	{
+		LOG_PRINT_L2("We can use " << alone << " alone: " << print_money(m_transfers[alone].amount()));
+		picks.push_back(alone);
+		return picks;
+	}
+
 	// Highest and second highest available amounts
 	uint64_t amount_a = 0;
 	uint64_t amount_b = 0;
-	// Check if the pick_list is sorted (sorting a sorted list is a worst case scenario usually)
-	uint64_t last_block = 0;
-	bool sorted = true;
-
-	// try to find a rct input of enough size
-	for(size_t i = 0; i < m_transfers.size(); ++i)
+	for(const spendable_outputs *subaddr : spendable)
 	{
-		const transfer_details &td = m_transfers[i];
-		if(!td.m_spent && !td.m_key_image_partial && td.is_rct() && is_transfer_unlocked(td) && 
-				td.m_subaddr_index.major == subaddr_account && subaddr_indices.count(td.m_subaddr_index.minor) == 1)
+		for(const std::pair<uint64_t, size_t> &out : subaddr->rct_by_amount)
 		{
-			uint64_t amt = td.amount();
-			if(amt >= needed_money)
-			{
-				LOG_PRINT_L2("We can use " << i << " alone: " << print_money(amt));
-				picks.push_back(i);
-				return picks;
-			}
-
-			pick_list.emplace_back(i, amt, td.m_block_height);
-			if(amt > amount_a)
+			if(!usable(out.second))
+				continue;
+			pick_list.emplace_back(out.second, out.first, m_transfers[out.second].m_block_height);
+			if(out.first > amount_a)
 			{
 				amount_b = amount_a;
-				amount_a = amt;
+				amount_a = out.first;
 			}
-
-			if(td.m_block_height < last_block)
-				sorted = false;
-			last_block = td.m_block_height;
+			else if(out.first > amount_b)
+				amount_b = out.first;
 		}
 	}
 
@@ -6423,46 +6986,51 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money, ui
 	if(amount_a + amount_b < needed_money)
 		return picks;
 
-	// This makes the O(n^2) below the worst possible case and limited to small n's (otherwise they will naturally spead out)
-	if(!sorted)
-		std::sort(pick_list.begin(), pick_list.end(), [](const pick_out& a, const pick_out& b) { return a.blk_height < b.blk_height; });
-	else
-		LOG_PRINT_L2("pick_preferred_rct_inputs: sort skipped, we are sorted already");
+	// oldest first, in transfer order within a block, as the scan of m_transfers gave them
+	std::sort(pick_list.begin(), pick_list.end(), [](const pick_out &a, const pick_out &b) {
+		return a.blk_height < b.blk_height || (a.blk_height == b.blk_height && a.idx < b.idx);
+	});
 
 	// then try to find two outputs
 	// this could be made better by picking one of the outputs to be a small one, since those
 	// are less useful since often below the needed money, so if one can be used in a pair,
 	// it gets rid of it for the future
+	// the tree jumps straight to the partners large enough, so a wallet full of dust outputs does not
+	// make this quadratic. Partners are still visited newest first, as the plain scan did.
+	std::vector<uint64_t> amounts;
+	amounts.reserve(pick_list.size());
+	for(const pick_out &p : pick_list)
+		amounts.push_back(p.amount);
+	const amount_max_tree partners(amounts);
+
 	for(size_t i = 0; i < pick_list.size(); i++)
 	{
 		LOG_PRINT_L2("Considering input " << pick_list[i].idx << ", " << print_money(pick_list[i].amount));
-		for(size_t j = pick_list.size(); j-- > i+1;)
-		{
-			if(pick_list[i].amount + pick_list[j].amount >= needed_money)
-			{
-				size_t i_idx = pick_list[i].idx;
-				size_t j_idx = pick_list[j].idx;
-				const transfer_details &td = m_transfers[i_idx];
-				const transfer_details &td2 = m_transfers[j_idx];
-				
-				// update our picks if those outputs are less related than any we
-				// already found. If the same, don't update, and oldest suitable outputs
-				// will be used in preference.
-				float relatedness = get_output_relatedness(td, td2);
-				LOG_PRINT_L2("  with input " << j_idx  << ", " << pick_list[j].amount << ", relatedness " << relatedness);
-				if(relatedness < current_output_relatdness)
-				{
-					// reset the current picks with those, and return them directly
-					// if they're unrelated. If they are related, we'll end up returning
-					// them if we find nothing better
-					picks.clear();
-					picks.push_back(i_idx);
-					picks.push_back(j_idx);
-					LOG_PRINT_L0("we could use " << i_idx << " and " << j_idx);
-					if(relatedness == 0.0f)
-						return picks;
-					current_output_relatdness = relatedness;
-				}
+		const uint64_t partner_amount = needed_money - pick_list[i].amount; // > 0, or it would have been used alone
+		for(size_t end = pick_list.size(), j; (j = partners.find_last(i + 1, end, partner_amount)) != end; end = j)
+		{
+			size_t i_idx = pick_list[i].idx;
+			size_t j_idx = pick_list[j].idx;
+			const transfer_details &td = m_transfers[i_idx];
+			const transfer_details &td2 = m_transfers[j_idx];
+
+			// update our picks if those outputs are less related than any we
+			// already found. If the same, don't update, and oldest suitable outputs
+			// will be used in preference.
+			float relatedness = get_output_relatedness(td, td2);
+			LOG_PRINT_L2("  with input " << j_idx  << ", " << pick_list[j].amount << ", relatedness " << relatedness);
+			if(relatedness < current_output_relatdness)
+			{
+				// reset the current picks with those, and return them directly
+				// if they're unrelated. If they are related, we'll end up returning
+				// them if we find nothing better
+				picks.clear();
+				picks.push_back(i_idx);
+				picks.push_back(j_idx);
+				LOG_PRINT_L0("we could use " << i_idx << " and " << j_idx);
+				if(relatedness == 0.0f)
+					return picks;
+				current_output_relatdness = relatedness;
 			}
 		}
 	}
@@ -6642,40 +7210,31 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
 	// gather all dust and non-dust outputs belonging to specified subaddresses
 	size_t num_nondust_outputs = 0;
 	size_t num_dust_outputs = 0;
-	for(size_t i = 0; i < m_transfers.size(); ++i)
+	auto spendable_account = m_spendable.find(subaddr_account);
+	for(uint32_t index_minor : subaddr_indices)
 	{
-		const transfer_details &td = m_transfers[i];
-		if(!td.m_spent && !td.m_key_image_partial && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && subaddr_indices.count(td.m_subaddr_index.minor) == 1)
+		if(spendable_account == m_spendable.end())
+			break;
+		auto spendable = spendable_account->second.find(index_minor);
+		if(spendable == spendable_account->second.end())
+			continue;
+		std::vector<size_t> nondust, dust;
+		for(size_t i : spendable->second.transfers)
 		{
-			const uint32_t index_minor = td.m_subaddr_index.minor;
-			auto find_predicate = [&index_minor](const std::pair<uint32_t, std::vector<size_t>> &x) { return x.first == index_minor; };
-			if((td.is_rct()) || is_valid_decomposed_amount(td.amount()))
-			{
-				auto found = std::find_if(unused_transfers_indices_per_subaddr.begin(), unused_transfers_indices_per_subaddr.end(), find_predicate);
-				if(found == unused_transfers_indices_per_subaddr.end())
-				{
-					unused_transfers_indices_per_subaddr.push_back({index_minor, {i}});
-				}
-				else
-				{
-					found->second.push_back(i);
-				}
-				++num_nondust_outputs;
-			}
+			const transfer_details &td = m_transfers[i];
+			if(td.m_key_image_partial || !is_transfer_unlocked(td))
+				continue;
+			if(td.is_rct() || is_valid_decomposed_amount(td.amount()))
+				nondust.push_back(i);
 			else
-			{
-				auto found = std::find_if(unused_dust_indices_per_subaddr.begin(), unused_dust_indices_per_subaddr.end(), find_predicate);
-				if(found == unused_dust_indices_per_subaddr.end())
-				{
-					unused_dust_indices_per_subaddr.push_back({index_minor, {i}});
-				}
-				else
-				{
-					found->second.push_back(i);
-				}
-				++num_dust_outputs;
-			}
+				dust.push_back(i);
 		}
+		num_nondust_outputs += nondust.size();
+		num_dust_outputs += dust.size();
+		if(!nondust.empty())
+			unused_transfers_indices_per_subaddr.push_back({index_minor, std::move(nondust)});
+		if(!dust.empty())
+			unused_dust_indices_per_subaddr.push_back({index_minor, std::move(dust)});
 	}
 
 	// shuffle & sort output indices
@@ -6824,9 +7383,6 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
 		uint64_t available_amount = td.amount();
 		accumulated_outputs += available_amount;
 
-		// clear any fake outs we'd already gathered, since we'll need a new set
-		outs.clear();
-
 		if(adding_fee)
 		{
 			LOG_PRINT_L2("We need more fee, adding it to fee");
@@ -6905,6 +7461,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
 
 			LOG_PRINT_L2("Trying to create a tx now, with " << tx.dsts.size() << " outputs and " << tx.selected_transfers.size() << " inputs");
 
+			add_placeholder_outs(outs, tx.selected_transfers, fake_outs_count);
 			transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, outs, unlock_time, needed_fee, payment_id, test_tx, test_ptx, bulletproof, uniform_pid);
 			auto txBlob = t_serializable_object_to_blob(test_ptx.tx);
 			needed_fee = calculate_fee(fake_outs_count+1, txBlob.size(), fee_multiplier);
@@ -6961,6 +7518,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
 				{
 					LOG_PRINT_L2("We have more to pay, starting another tx");
 					txes.push_back(TX());
+					outs.clear();
 					original_output_index = 0;
 				}
 			}
@@ -6992,28 +7550,55 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
 
 	LOG_PRINT_L1("Done creating " << txes.size() << " transactions, " << print_money(accumulated_fee) << " total fee, " << print_money(accumulated_change) << " total change");
 
+	// the txes were sized with placeholder rings, fetch the decoys of all of them at once
+	std::vector<std::vector<size_t>> split_transfers;
+	for(const TX &tx : txes)
+		split_transfers.push_back(tx.selected_transfers);
+	std::vector<std::vector<std::vector<get_outs_entry>>> split_outs;
+	get_split_outs(split_outs, split_transfers, fake_outs_count);
+	std::vector<uint64_t> sized_fees(txes.size());
+	for(size_t n = 0; n < txes.size(); ++n)
+	{
+		TX &tx = txes[n];
+		THROW_WALLET_EXCEPTION_IF(tx.outs.size() != tx.selected_transfers.size(), error::wallet_internal_error, "tx was not sized with all its inputs");
+		const size_t bytes = get_size_with_real_rings(tx.bytes, tx.outs, split_outs[n], fake_outs_count, tx.tx.rct_signatures.txnFee, tx.fee);
+		const uint64_t fee = calculate_fee(fake_outs_count+1, bytes, fee_multiplier);
+		tx.outs = std::move(split_outs[n]);
+		sized_fees[n] = tx.fee;
+
+		// what the shorter rings save goes to change, unless that would add a change output
+		uint64_t inputs = 0, outputs = tx.fee;
+		for(size_t idx : tx.selected_transfers)
+			inputs += m_transfers[idx].amount();
+		for(const auto &o : tx.dsts)
+			outputs += o.amount;
+		if(fee < tx.fee && (inputs > outputs || tx.dsts.size() == 1))
+			tx.fee = fee;
+	}
+
 	hwdev.set_mode(hw::device::TRANSACTION_CREATE_REAL);
-	for(std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
-	{
-		TX &tx = *i;
+	construct_split_txes(txes.size(), [&](size_t n) {
+		TX &tx = txes[n];
 		cryptonote::transaction test_tx;
 		pending_tx test_ptx;
-		transfer_selected_rct(tx.dsts,				 /* NOMOD std::vector<cryptonote::tx_destination_entry> dsts,*/
-							  tx.selected_transfers, /* const std::list<size_t> selected_transfers */
-							  fake_outs_count,		 /* CONST size_t fake_outputs_count, */
-							  tx.outs,				 /* MOD   std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, */
-							  unlock_time,			 /* CONST uint64_t unlock_time,  */
-							  tx.fee,				 /* CONST uint64_t fee, */
-							  payment_id,			 /* const crypto::uniform_payment_id* */
-							  test_tx,				 /* OUT   cryptonote::transaction& tx, */
-							  test_ptx,				 /* OUT   cryptonote::transaction& tx, */
-							  bulletproof,
-							  uniform_pid);
+		transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, tx.outs, unlock_time, tx.fee, payment_id,
+							  test_tx, test_ptx, bulletproof, uniform_pid);
 		auto txBlob = t_serializable_object_to_blob(test_ptx.tx);
+		if(tx.fee < sized_fees[n] && calculate_fee(fake_outs_count+1, txBlob.size(), fee_multiplier) > test_ptx.fee)
+		{
+			// the lowered fee came from a size estimate that fell short, go back to the fee the tx was sized with
+			MWARNING("Transaction " << n << " came out larger than estimated, keeping its original fee");
+			tx.fee = sized_fees[n];
+			transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, tx.outs, unlock_time, tx.fee, payment_id,
+								  test_tx, test_ptx, bulletproof, uniform_pid);
+			txBlob = t_serializable_object_to_blob(test_ptx.tx);
+		}
+		THROW_WALLET_EXCEPTION_IF(calculate_fee(fake_outs_count+1, txBlob.size(), fee_multiplier) > test_ptx.fee, error::wallet_internal_error,
+								  "Transaction fee is below the fee for its size");
 		tx.tx = test_tx;
 		tx.ptx = test_ptx;
 		tx.bytes = txBlob.size();
-	}
+	});
 
 	std::vector<wallet2::pending_tx> ptx_vector;
 	for(std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
@@ -7041,18 +7626,26 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_all(uint64_t below
 
 	// gather all dust and non-dust outputs of specified subaddress (if any) and below specified threshold (if any)
 	bool fund_found = false;
-	for(size_t i = 0; i < m_transfers.size(); ++i)
+	auto spendable_account = m_spendable.find(subaddr_account);
+	if(spendable_account != m_spendable.end())
 	{
-		const transfer_details &td = m_transfers[i];
-		if(!td.m_spent && !td.m_key_image_partial && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && (subaddr_indices.empty() || subaddr_indices.count(td.m_subaddr_index.minor) == 1))
+		for(const auto &spendable : spendable_account->second)
 		{
-			fund_found = true;
-			if(below == 0 || td.amount() < below)
+			if(!subaddr_indices.empty() && subaddr_indices.count(spendable.first) == 0)
+				continue;
+			for(size_t i : spendable.second.transfers)
 			{
-				if((td.is_rct()) || is_valid_decomposed_amount(td.amount()))
-					unused_transfer_dust_indices_per_subaddr[td.m_subaddr_index.minor].first.push_back(i);
-				else
-					unused_transfer_dust_indices_per_subaddr[td.m_subaddr_index.minor].second.push_back(i);
+				const transfer_details &td = m_transfers[i];
+				if(td.m_key_image_partial || !is_transfer_unlocked(td))
+					continue;
+				fund_found = true;
+				if(below == 0 || td.amount() < below)
+				{
+					if((td.is_rct()) || is_valid_decomposed_amount(td.amount()))
+						unused_transfer_dust_indices_per_subaddr[spendable.first].first.push_back(i);
+					else
+						unused_transfer_dust_indices_per_subaddr[spendable.first].second.push_back(i);
+				}
 			}
 		}
 	}
@@ -7170,9 +7763,6 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_from(const crypton
 		uint64_t available_amount = td.amount();
 		accumulated_outputs += available_amount;
 
-		// clear any fake outs we'd already gathered, since we'll need a new set
-		outs.clear();
-
 		// here, check if we need to sent tx and start a new one
 		LOG_PRINT_L2("Considering whether to create a tx now, " << tx.selected_transfers.size() << " inputs, tx limit "
 																<< upper_transaction_size_limit);
@@ -7190,6 +7780,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_from(const crypton
 			tx.dsts.push_back(tx_destination_entry(1, address, is_subaddress));
 
 			LOG_PRINT_L2("Trying to create a tx now, with " << tx.dsts.size() << " destinations and " << tx.selected_transfers.size() << " outputs");
+			add_placeholder_outs(outs, tx.selected_transfers, fake_outs_count);
 			transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, outs, unlock_time, needed_fee, payment_id,
 								  test_tx, test_ptx, bulletproof, uniform_pid);
 			auto txBlob = t_serializable_object_to_blob(test_ptx.tx);
@@ -7223,25 +7814,61 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_from(const crypton
 			{
 				LOG_PRINT_L2("We have more to pay, starting another tx");
 				txes.push_back(TX());
+				outs.clear();
 			}
 		}
 	}
 
 	LOG_PRINT_L1("Done creating " << txes.size() << " transactions, " << print_money(accumulated_fee) << " total fee, " << print_money(accumulated_change) << " total change");
 
-	hwdev.set_mode(hw::device::TRANSACTION_CREATE_REAL);
-	for(std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
+	// the txes were sized with placeholder rings, fetch the decoys of all of them at once
+	std::vector<std::vector<size_t>> split_transfers;
+	for(const TX &tx : txes)
+		split_transfers.push_back(tx.selected_transfers);
+	std::vector<std::vector<std::vector<get_outs_entry>>> split_outs;
+	get_split_outs(split_outs, split_transfers, fake_outs_count);
+	std::vector<uint64_t> sized_fees(txes.size());
+	for(size_t n = 0; n < txes.size(); ++n)
 	{
-		TX &tx = *i;
+		TX &tx = txes[n];
+		THROW_WALLET_EXCEPTION_IF(tx.outs.size() != tx.selected_transfers.size(), error::wallet_internal_error, "tx was not sized with all its inputs");
+		const size_t bytes = get_size_with_real_rings(tx.bytes, tx.outs, split_outs[n], fake_outs_count, tx.tx.rct_signatures.txnFee, tx.fee);
+		const uint64_t fee = calculate_fee(fake_outs_count+1, bytes, fee_multiplier);
+		tx.outs = std::move(split_outs[n]);
+		sized_fees[n] = tx.fee;
+
+		// what the shorter rings save goes to the destination
+		if(fee < tx.fee)
+		{
+			tx.dsts[0].amount += tx.fee - fee;
+			tx.fee = fee;
+		}
+	}
+
+	hwdev.set_mode(hw::device::TRANSACTION_CREATE_REAL);
+	construct_split_txes(txes.size(), [&](size_t n) {
+		TX &tx = txes[n];
 		cryptonote::transaction test_tx;
 		pending_tx test_ptx;
 		transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, tx.outs, unlock_time, tx.fee, payment_id,
 							  test_tx, test_ptx, bulletproof, uniform_pid);
 		auto txBlob = t_serializable_object_to_blob(test_ptx.tx);
+		if(tx.fee < sized_fees[n] && calculate_fee(fake_outs_count+1, txBlob.size(), fee_multiplier) > test_ptx.fee)
+		{
+			// the lowered fee came from a size estimate that fell short, go back to the fee the tx was sized with
+			MWARNING("Transaction " << n << " came out larger than estimated, keeping its original fee");
+			tx.dsts[0].amount -= sized_fees[n] - tx.fee;
+			tx.fee = sized_fees[n];
+			transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, tx.outs, unlock_time, tx.fee, payment_id,
+								  test_tx, test_ptx, bulletproof, uniform_pid);
+			txBlob = t_serializable_object_to_blob(test_ptx.tx);
+		}
+		THROW_WALLET_EXCEPTION_IF(calculate_fee(fake_outs_count+1, txBlob.size(), fee_multiplier) > test_ptx.fee, error::wallet_internal_error,
+								  "Transaction fee is below the fee for its size");
 		tx.tx = test_tx;
 		tx.ptx = test_ptx;
 		tx.bytes = txBlob.size();
-	}
+	});
 
 	std::vector<wallet2::pending_tx> ptx_vector;
 	for(std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
@@ -7258,6 +7885,40 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_from(const crypton
 	return ptx_vector;
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::construct_split_txes(size_t count, const std::function<void(size_t)> &construct)
+{
+	tools::threadpool &tpool = tools::threadpool::getInstance();
+
+	// the txes of a split only read wallet state, but hardware devices and multisig
+	// signing (which asks the daemon for fork rules) are kept to one tx at a time
+	if(&m_account.get_device() != &hw::get_device("default") || m_multisig || count < 2 || tpool.get_max_concurrency() < 2)
+	{
+		for(size_t n = 0; n < count; ++n)
+			construct(n);
+		return;
+	}
+
+	std::vector<std::exception_ptr> errors(count);
+	tools::threadpool::waiter waiter;
+	for(size_t n = 0; n < count; ++n)
+	{
+		tpool.submit(&waiter, [&, n] {
+			try
+			{
+				construct(n);
+			}
+			catch(...)
+			{
+				errors[n] = std::current_exception();
+			}
+		});
+	}
+	waiter.wait();
+	for(const std::exception_ptr &e : errors)
+		if(e)
+			std::rethrow_exception(e);
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::get_hard_fork_info(uint8_t version, uint64_t &earliest_height) const
 {
 	boost::optional<std::string> result = m_node_rpc_proxy.get_earliest_height(version, earliest_height);
@@ -8677,6 +9338,7 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
 	{
 		transfer_details &td = m_transfers[n];
 		td.m_spent = daemon_resp.spent_status[n] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT;
+		count_balance(n);
 	}
 
 	std::unordered_set<crypto::hash> spent_txids; // For each spent key image, search for a tx in m_transfers that uses it as input.
@@ -8823,6 +9485,7 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
 		{
 			if(j->second.m_tx_hash == *spent_txid)
 			{
+				unindex_payment(*j);
 				m_payments.erase(j);
 				break;
 			}
@@ -8842,7 +9505,9 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
 
 		crypto::hash spent_txid = crypto::null_hash; // spent txid is unknown
 		memcpy(&spent_txid, &n, sizeof(uint64_t));
-		m_confirmed_txs.insert(std::make_pair(spent_txid, pd));
+		auto entry = m_confirmed_txs.insert(std::make_pair(spent_txid, pd));
+		if(entry.second)
+			index_confirmed_tx(*entry.first);
 	}
 
 	return m_transfers[signed_key_images.size() - 1].m_block_height;
@@ -8863,6 +9528,7 @@ void wallet2::import_payments(const payment_container &payments)
 	{
 		m_payments.emplace(p);
 	}
+	rebuild_history_index();
 }
 void wallet2::import_payments_out(const std::list<std::pair<crypto::hash, wallet2::confirmed_transfer_details>> &confirmed_payments)
 {
@@ -8871,6 +9537,7 @@ void wallet2::import_payments_out(const std::list<std::pair<crypto::hash, wallet
 	{
 		m_confirmed_txs.emplace(p);
 	}
+	rebuild_history_index();
 }
 
 std::tuple<size_t, crypto::hash, std::vector<crypto::hash>> wallet2::export_blockchain() const
@@ -8948,6 +9615,7 @@ size_t wallet2::import_outputs(const std::vector<tools::wallet2::transfer_detail
 		m_pub_keys[td.get_public_key()] = m_transfers.size();
 		m_transfers.push_back(td);
 	}
+	rebuild_balances();
 
 	return m_transfers.size();
 }
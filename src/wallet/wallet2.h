@@ -31,6 +31,7 @@
 #include <boost/serialization/deque.hpp>
 #include <boost/serialization/list.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include "checkpoints/checkpoints.h"
 #include "common/unordered_containers_boost_serialization.h"
@@ -56,6 +57,7 @@
 //#define RYO_DEFAULT_LOG_CATEGORY "wallet.wallet2"
 
 class Serialization_portability_wallet_Test;
+class wallet_accessor_test;
 
 namespace tools
 {
@@ -136,6 +138,7 @@ class hashchain
 class wallet2
 {
 	friend class ::Serialization_portability_wallet_Test;
+	friend class ::wallet_accessor_test;
 
   public:
 	static constexpr const std::chrono::seconds rpc_timeout = std::chrono::minutes(3) + std::chrono::seconds(30);
@@ -641,7 +644,9 @@ class wallet2
 	bool is_deprecated() const;
 	void refresh();
 	void refresh(uint64_t start_height, uint64_t &blocks_fetched);
-	void refresh(uint64_t start_height, uint64_t &blocks_fetched, bool &received_money);
+	// With a state_lock the wallet state is only locked while a block batch is processed,
+	// so readers holding it shared get in between batches.
+	void refresh(uint64_t start_height, uint64_t &blocks_fetched, bool &received_money, boost::shared_mutex *state_lock = nullptr);
 	bool refresh(uint64_t &blocks_fetched, bool &received_money, bool &ok);
 
 	void set_refresh_type(RefreshType refresh_type) { m_refresh_type = refresh_type; }
@@ -694,10 +699,17 @@ class wallet2
 	bool sign_multisig_tx_to_file(multisig_tx_set &exported_txs, const std::string &filename, std::vector<crypto::hash> &txids);
 	bool check_connection(uint32_t *version = NULL, uint32_t timeout = 200000);
 	void get_transfers(wallet2::transfer_container &incoming_transfers) const;
-	void get_payments(const crypto::uniform_payment_id &payment_id, std::list<wallet2::payment_details> &payments, uint64_t min_height = 0, const boost::optional<uint32_t> &subaddr_account = boost::none, const std::set<uint32_t> &subaddr_indices = {}) const;
-	void get_payments(std::list<std::pair<crypto::hash, wallet2::payment_details>> &payments, uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t> &subaddr_account = boost::none, const std::set<uint32_t> &subaddr_indices = {}) const;
-	void get_payments_out(std::list<std::pair<crypto::hash, wallet2::confirmed_transfer_details>> &confirmed_payments,
-						  uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t> &subaddr_account = boost::none, const std::set<uint32_t> &subaddr_indices = {}) const;
+	// The height ranged queries return entries in block height order. With a non zero max_count they stop
+	// after the block in which max_count entries were reached and return true if more entries remain,
+	// so the caller can resume with min_height set to the height of the last entry returned.
+	bool get_payments(const crypto::uniform_payment_id &payment_id, std::list<wallet2::payment_details> &payments, uint64_t min_height = 0, const boost::optional<uint32_t> &subaddr_account = boost::none, const std::set<uint32_t> &subaddr_indices = {}, size_t max_count = 0) const;
+	bool get_payments(std::list<std::pair<crypto::hash, wallet2::payment_details>> &payments, uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t> &subaddr_account = boost::none, const std::set<uint32_t> &subaddr_indices = {}, size_t max_count = 0) const;
+	bool get_payments_out(std::list<std::pair<crypto::hash, wallet2::confirmed_transfer_details>> &confirmed_payments,
+						  uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t> &subaddr_account = boost::none, const std::set<uint32_t> &subaddr_indices = {}, size_t max_count = 0) const;
+	// Pages incoming and outgoing history together (either list may be null), cutting both on the same block
+	// boundary so that resuming with min_height set to next_min_height misses neither. Returns true if either was cut.
+	bool get_payments_page(std::list<std::pair<crypto::hash, wallet2::payment_details>> *payments, std::list<std::pair<crypto::hash, wallet2::confirmed_transfer_details>> *confirmed_payments,
+						   uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t> &subaddr_account, const std::set<uint32_t> &subaddr_indices, size_t max_count, uint64_t &next_min_height) const;
 	void get_unconfirmed_payments_out(std::list<std::pair<crypto::hash, wallet2::unconfirmed_transfer_details>> &unconfirmed_payments, const boost::optional<uint32_t> &subaddr_account = boost::none, const std::set<uint32_t> &subaddr_indices = {}) const;
 	void get_unconfirmed_payments(std::list<std::pair<crypto::hash, wallet2::pool_payment_details>> &unconfirmed_payments, const boost::optional<uint32_t> &subaddr_account = boost::none, const std::set<uint32_t> &subaddr_indices = {}) const;
 
@@ -790,7 +802,16 @@ class wallet2
 		a &m_scanned_pool_txs[1];
 		if(ver < 20)
 			return;
-		a &m_subaddresses;
+		if(ver < 25)
+		{
+			a &m_subaddresses;
+		}
+		else
+		{
+			// kept in the .subaddr table file instead, this names the table written with the cache
+			a &m_subaddress_table_size;
+			a &m_subaddress_table_hash;
+		}
 		std::unordered_map<cryptonote::subaddress_index, crypto::public_key> dummy_subaddresses_inv;
 		a &dummy_subaddresses_inv;
 		a &m_subaddress_labels;
@@ -1092,7 +1113,26 @@ class wallet2
 	std::vector<size_t> pick_preferred_rct_inputs(uint64_t needed_money, uint32_t subaddr_account, const std::set<uint32_t> &subaddr_indices) const;
 	void set_spent(size_t idx, uint64_t height);
 	void set_unspent(size_t idx);
+	void add_subaddresses(uint32_t index_major, uint32_t begin, uint32_t end);
+	void rebuild_subaddresses();
+	bool load_subaddress_table();
+	void store_subaddress_table(const std::string &wallet_file);
+	void count_balance(size_t idx);
+	void uncount_balance(size_t idx);
+	void rebuild_balances();
+	void index_payment(const payment_container::value_type &p);
+	void unindex_payment(const payment_container::value_type &p);
+	void index_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &p);
+	void unindex_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &p);
+	void rebuild_history_index();
+	uint64_t get_transfer_unlock_height(const transfer_details &td) const;
 	void get_outs(std::vector<std::vector<get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count);
+	void add_placeholder_outs(std::vector<std::vector<get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count) const;
+	static size_t get_key_offsets_size(const std::vector<std::vector<get_outs_entry>> &outs, size_t fake_outputs_count);
+	static size_t get_size_with_real_rings(size_t bytes, const std::vector<std::vector<get_outs_entry>> &placeholders, const std::vector<std::vector<get_outs_entry>> &rings,
+										   size_t fake_outputs_count, uint64_t sized_fee, uint64_t fee);
+	void get_split_outs(std::vector<std::vector<std::vector<get_outs_entry>>> &outs, const std::vector<std::vector<size_t>> &selected_transfers, size_t fake_outputs_count);
+	void construct_split_txes(size_t count, const std::function<void(size_t)> &construct);
 	bool tx_add_fake_output(std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, uint64_t global_index, const crypto::public_key &tx_public_key, const rct::key &mask, uint64_t real_index, bool unlocked) const;
 	crypto::public_key get_tx_pub_key_from_received_outs(const tools::wallet2::transfer_details &td) const;
 	bool should_pick_a_second_output(bool use_rct, size_t n_transfers, const std::vector<size_t> &unused_transfers_indices, const std::vector<size_t> &unused_dust_indices) const;
@@ -1130,6 +1170,33 @@ class wallet2
 
 	transfer_container m_transfers;
 	payment_container m_payments;
+
+	// height ordered views of m_payments and m_confirmed_txs, so history queries only touch the requested range.
+	// Elements of the unordered containers keep their address across rehashes, so they are indexed by pointer.
+	typedef std::multimap<uint64_t, const payment_container::value_type *> payment_height_index;
+	typedef std::multimap<uint64_t, const std::pair<const crypto::hash, confirmed_transfer_details> *> confirmed_tx_height_index;
+	payment_height_index m_payments_by_height;
+	std::unordered_map<crypto::hash, payment_height_index> m_payments_by_id;
+	confirmed_tx_height_index m_confirmed_txs_by_height;
+
+	// running totals of the unspent transfers, so balance queries do not walk m_transfers
+	struct balance_entry
+	{
+		bool counted;
+		cryptonote::subaddress_index index;
+		uint64_t amount;
+		uint64_t unlock_height;
+	};
+	std::vector<balance_entry> m_balance_entries;						   // what each transfer adds to m_balances
+	std::unordered_map<uint32_t, std::map<uint32_t, uint64_t>> m_balances; // major -> minor -> unspent amount
+	std::multimap<uint64_t, size_t> m_unlock_schedule;					   // unlock height -> counted transfer
+	// the counted transfers again, indexed for coin selection so it only visits outputs it could spend
+	struct spendable_outputs
+	{
+		std::set<size_t> transfers;							 // by transfer index
+		std::set<std::pair<uint64_t, size_t>> rct_by_amount; // rct transfers only, by amount then index
+	};
+	std::unordered_map<uint32_t, std::map<uint32_t, spendable_outputs>> m_spendable; // major -> minor -> unspent transfers
 	std::unordered_map<crypto::key_image, size_t> m_key_images;
 	std::unordered_map<crypto::public_key, size_t> m_pub_keys;
 	cryptonote::account_public_address m_account_public_address;
@@ -1186,6 +1253,9 @@ class wallet2
 	NodeRPCProxy m_node_rpc_proxy;
 	std::unordered_set<crypto::hash> m_scanned_pool_txs[2];
 	size_t m_subaddress_lookahead_major, m_subaddress_lookahead_minor;
+	bool m_subaddress_table_dirty; // m_subaddresses differs from the .subaddr file
+	uint64_t m_subaddress_table_size;
+	crypto::hash m_subaddress_table_hash;
 
 #if 0
    // Light wallet
@@ -1206,7 +1276,7 @@ class wallet2
 	std::unique_ptr<ringdb> m_ringdb;
 };
 }
-BOOST_CLASS_VERSION(tools::wallet2, 24)
+BOOST_CLASS_VERSION(tools::wallet2, 25)
 BOOST_CLASS_VERSION(tools::wallet2::transfer_details, 9)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info, 1)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info::LR, 0)
@@ -53,7 +53,7 @@ const command_line::arg_descriptor<std::string, true> arg_rpc_bind_port = {"rpc-
 const command_line::arg_descriptor<bool> arg_disable_rpc_login = {"disable-rpc-login", "Disable HTTP authentication for RPC connections served by this process"};
 const command_line::arg_descriptor<bool> arg_trusted_daemon = {"trusted-daemon", "Enable commands which rely on a trusted daemon", false};
 const command_line::arg_descriptor<std::string> arg_wallet_dir = {"wallet-dir", "Directory for newly created wallets"};
-const command_line::arg_descriptor<bool> arg_prompt_for_password = {"prompt-for-password", "Prompts for password when not provided", false};
+const command_line::arg_descriptor<unsigned> arg_rpc_threads = {"rpc-threads", "Number of threads serving RPC requests, one of them runs the auto refresh", 4};
 
 constexpr const char default_rpc_username[] = "ryo";
 
@@ -75,6 +75,21 @@ const char *wallet_rpc_server::tr(const char *str)
 	return i18n_translate(str, "tools::wallet_rpc_server");
 }
 
+//------------------------------------------------------------------------------------------------------------------------------
+void wallet_rpc_server::init_options(boost::program_options::options_description &desc)
+{
+	command_line::add_arg(desc, arg_rpc_bind_port);
+	command_line::add_arg(desc, arg_disable_rpc_login);
+	command_line::add_arg(desc, arg_trusted_daemon);
+	cryptonote::rpc_args::init_options(desc);
+	command_line::add_arg(desc, arg_wallet_dir);
+	command_line::add_arg(desc, arg_rpc_threads);
+}
+//------------------------------------------------------------------------------------------------------------------------------
+bool wallet_rpc_server::has_wallet_dir(const boost::program_options::variables_map &vm)
+{
+	return !command_line::get_arg(vm, arg_wallet_dir).empty();
+}
 //------------------------------------------------------------------------------------------------------------------------------
 wallet_rpc_server::wallet_rpc_server(cryptonote::network_type nettype) : m_wallet(nullptr), rpc_login_file(), m_stop(false), m_trusted_daemon(false), m_vm(NULL), m_nettype(nettype)
 {
@@ -89,10 +104,18 @@ bool wallet_rpc_server::run()
 {
 	m_stop = false;
 	m_net_server.add_idle_handler([this]() {
+		// a call replacing or rescanning the wallet holds this, the next round picks it up
+		boost::unique_lock<boost::mutex> lock(m_refresh_mutex, boost::try_to_lock);
+		if(!lock.owns_lock())
+			return true;
 		try
 		{
 			if(m_wallet)
-				m_wallet->refresh();
+			{
+				uint64_t blocks_fetched = 0;
+				bool received_money = false;
+				m_wallet->refresh(0, blocks_fetched, received_money, &m_wallet_mutex);
+			}
 		}
 		catch(const std::exception &ex)
 		{
@@ -111,8 +134,16 @@ bool wallet_rpc_server::run()
 	},
 								  500);
 
-	//DO NOT START THIS SERVER IN MORE THEN 1 THREADS WITHOUT REFACTORING
-	return epee::http_server_impl_base<wallet_rpc_server, connection_context>::run(1, true);
+	const unsigned threads = m_vm ? std::max(command_line::get_arg(*m_vm, arg_rpc_threads), 1u) : 1;
+	return epee::http_server_impl_base<wallet_rpc_server, connection_context>::run(threads, true);
+}
+//------------------------------------------------------------------------------------------------------------------------------
+void wallet_rpc_server::stop_refresh()
+{
+	// the refresh leaves m_wallet_mutex free between batches, and m_wallet only changes under it
+	boost::shared_lock<boost::shared_mutex> lock(m_wallet_mutex);
+	if(m_wallet)
+		m_wallet->stop();
 }
 //------------------------------------------------------------------------------------------------------------------------------
 bool wallet_rpc_server::init(const boost::program_options::variables_map *vm)
@@ -315,8 +346,13 @@ bool wallet_rpc_server::on_getbalance(const wallet_rpc::COMMAND_RPC_GET_BALANCE:
 		res.multisig_import_needed = m_wallet->multisig() && m_wallet->has_multisig_partial_key_images();
 		std::map<uint32_t, uint64_t> balance_per_subaddress = m_wallet->balance_per_subaddress(req.account_index);
 		std::map<uint32_t, uint64_t> unlocked_balance_per_subaddress = m_wallet->unlocked_balance_per_subaddress(req.account_index);
-		std::vector<tools::wallet2::transfer_details> transfers;
-		m_wallet->get_transfers(transfers);
+		std::map<uint32_t, size_t> num_unspent_outputs;
+		for(size_t n = 0; n < m_wallet->get_num_transfer_details(); ++n)
+		{
+			const tools::wallet2::transfer_details &td = m_wallet->get_transfer_details(n);
+			if(!td.m_spent && td.m_subaddr_index.major == req.account_index)
+				++num_unspent_outputs[td.m_subaddr_index.minor];
+		}
 		for(const auto &i : balance_per_subaddress)
 		{
 			wallet_rpc::COMMAND_RPC_GET_BALANCE::per_subaddress_info info;
@@ -326,7 +362,7 @@ bool wallet_rpc_server::on_getbalance(const wallet_rpc::COMMAND_RPC_GET_BALANCE:
 			info.balance = i.second;
 			info.unlocked_balance = unlocked_balance_per_subaddress[i.first];
 			info.label = m_wallet->get_subaddress_label(index);
-			info.num_unspent_outputs = std::count_if(transfers.begin(), transfers.end(), [&](const tools::wallet2::transfer_details &td) { return !td.m_spent && td.m_subaddr_index == index; });
+			info.num_unspent_outputs = num_unspent_outputs[i.first];
 			res.per_subaddress.push_back(info);
 		}
 	}
@@ -355,8 +391,13 @@ bool wallet_rpc_server::on_getaddress(const wallet_rpc::COMMAND_RPC_GET_ADDRESS:
 		{
 			req_address_index = req.address_index;
 		}
-		tools::wallet2::transfer_container transfers;
-		m_wallet->get_transfers(transfers);
+		std::set<uint32_t> used;
+		for(size_t n = 0; n < m_wallet->get_num_transfer_details(); ++n)
+		{
+			const tools::wallet2::transfer_details &td = m_wallet->get_transfer_details(n);
+			if(td.m_subaddr_index.major == req.account_index)
+				used.insert(td.m_subaddr_index.minor);
+		}
 		for(uint32_t i : req_address_index)
 		{
 			res.addresses.resize(res.addresses.size() + 1);
@@ -365,7 +406,7 @@ bool wallet_rpc_server::on_getaddress(const wallet_rpc::COMMAND_RPC_GET_ADDRESS:
 			info.address = m_wallet->get_subaddress_as_str(index);
 			info.label = m_wallet->get_subaddress_label(index);
 			info.address_index = index.minor;
-			info.used = std::find_if(transfers.begin(), transfers.end(), [&](const tools::wallet2::transfer_details &td) { return td.m_subaddr_index == index; }) != transfers.end();
+			info.used = used.count(i) != 0;
 		}
 		res.address = m_wallet->get_subaddress_as_str({req.account_index, 0});
 	}
@@ -1136,6 +1177,8 @@ bool wallet_rpc_server::on_get_payments(const wallet_rpc::COMMAND_RPC_GET_PAYMEN
 bool wallet_rpc_server::on_get_bulk_payments(const wallet_rpc::COMMAND_RPC_GET_BULK_PAYMENTS::request &req, wallet_rpc::COMMAND_RPC_GET_BULK_PAYMENTS::response &res, epee::json_rpc::error &er)
 {
 	res.payments.clear();
+	res.more = false;
+	res.next_min_block_height = req.min_block_height;
 	if(!m_wallet)
 		return not_open(er);
 
@@ -1143,7 +1186,9 @@ bool wallet_rpc_server::on_get_bulk_payments(const wallet_rpc::COMMAND_RPC_GET_B
 	if(req.payment_ids.empty())
 	{
 		std::list<std::pair<crypto::hash, wallet2::payment_details>> payment_list;
-		m_wallet->get_payments(payment_list, req.min_block_height);
+		res.more = m_wallet->get_payments(payment_list, req.min_block_height, (uint64_t)-1, boost::none, {}, req.max_results);
+		if(!payment_list.empty())
+			res.next_min_block_height = payment_list.back().second.m_block_height;
 
 		for(auto &payment : payment_list)
 		{
@@ -1161,6 +1206,7 @@ bool wallet_rpc_server::on_get_bulk_payments(const wallet_rpc::COMMAND_RPC_GET_B
 		return true;
 	}
 
+	uint64_t cut_height = (uint64_t)-1;
 	for(auto &payment_id_str : req.payment_ids)
 	{
 		crypto::uniform_payment_id payment_id;
@@ -1171,8 +1217,13 @@ bool wallet_rpc_server::on_get_bulk_payments(const wallet_rpc::COMMAND_RPC_GET_B
 			return false;
 		}
 
+		// max_results applies per payment id, results past the lowest cut are dropped below
 		std::list<wallet2::payment_details> payment_list;
-		m_wallet->get_payments(payment_id, payment_list, req.min_block_height);
+		if(m_wallet->get_payments(payment_id, payment_list, req.min_block_height, boost::none, {}, req.max_results))
+		{
+			cut_height = std::min(cut_height, payment_list.back().m_block_height);
+			res.more = true;
+		}
 
 		for(auto &payment : payment_list)
 		{
@@ -1188,6 +1239,12 @@ bool wallet_rpc_server::on_get_bulk_payments(const wallet_rpc::COMMAND_RPC_GET_B
 		}
 	}
 
+	// every payment id must resume from the same height, so drop what lies past the lowest cut
+	if(res.more)
+		res.payments.remove_if([cut_height](const wallet_rpc::payment_details &pd) { return pd.block_height > cut_height; });
+	for(const auto &payment : res.payments)
+		res.next_min_block_height = std::max(res.next_min_block_height, payment.block_height);
+
 	return true;
 }
 //------------------------------------------------------------------------------------------------------------------------------
@@ -1215,20 +1272,17 @@ bool wallet_rpc_server::on_incoming_transfers(const wallet_rpc::COMMAND_RPC_INCO
 		available = false;
 	}
 
-	wallet2::transfer_container transfers;
-	m_wallet->get_transfers(transfers);
-
-	bool transfers_found = false;
-	for(const auto &td : transfers)
+	const size_t num_transfers = m_wallet->get_num_transfer_details();
+	size_t i = req.start_index;
+	for(; i < num_transfers; ++i)
 	{
+		const wallet2::transfer_details &td = m_wallet->get_transfer_details(i);
 		if(!filter || available != td.m_spent)
 		{
 			if(req.account_index != td.m_subaddr_index.major || (!req.subaddr_indices.empty() && req.subaddr_indices.count(td.m_subaddr_index.minor) == 0))
 				continue;
-			if(!transfers_found)
-			{
-				transfers_found = true;
-			}
+			if(req.max_results != 0 && res.transfers.size() >= req.max_results)
+				break;
 			auto txBlob = t_serializable_object_to_blob(td.m_tx);
 			wallet_rpc::transfer_details rpc_transfers;
 			rpc_transfers.amount = td.amount();
@@ -1241,6 +1295,7 @@ bool wallet_rpc_server::on_incoming_transfers(const wallet_rpc::COMMAND_RPC_INCO
 			res.transfers.push_back(rpc_transfers);
 		}
 	}
+	res.next_index = std::max<uint64_t>(i, req.start_index);
 
 	return true;
 }
@@ -1370,6 +1425,32 @@ bool wallet_rpc_server::on_stop_wallet(const wallet_rpc::COMMAND_RPC_STOP_WALLET
 	return true;
 }
 //------------------------------------------------------------------------------------------------------------------------------
+bool wallet_rpc_server::on_set_trace(const wallet_rpc::COMMAND_RPC_SET_TRACE::request &req, wallet_rpc::COMMAND_RPC_SET_TRACE::response &res, epee::json_rpc::error &er)
+{
+	if(!m_wallet)
+		return not_open(er);
+	if(m_wallet->restricted())
+	{
+		er.code = WALLET_RPC_ERROR_CODE_DENIED;
+		er.message = "Command unavailable in restricted mode.";
+		return false;
+	}
+
+	if(!req.enable)
+	{
+		tools::trace::stop();
+		return true;
+	}
+	if(req.events_per_thread == 0 || req.events_per_thread > tools::trace::MAX_EVENTS_PER_THREAD)
+	{
+		er.code = WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR;
+		er.message = "events_per_thread not valid";
+		return false;
+	}
+	tools::trace::start(req.events_per_thread);
+	return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------
 bool wallet_rpc_server::on_set_tx_notes(const wallet_rpc::COMMAND_RPC_SET_TX_NOTES::request &req, wallet_rpc::COMMAND_RPC_SET_TX_NOTES::response &res, epee::json_rpc::error &er)
 {
 	if(!m_wallet)
@@ -1763,26 +1844,20 @@ bool wallet_rpc_server::on_get_transfers(const wallet_rpc::COMMAND_RPC_GET_TRANS
 		max_height = req.max_height <= max_height ? req.max_height : max_height;
 	}
 
-	if(req.in)
+	// in and out are cut on one block boundary, so resuming from next_min_height misses neither
+	std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments;
+	std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> confirmed_payments;
+	res.more = m_wallet->get_payments_page(req.in ? &payments : nullptr, req.out ? &confirmed_payments : nullptr, min_height, max_height,
+										   req.account_index, req.subaddr_indices, req.max_results, res.next_min_height);
+	for(std::list<std::pair<crypto::hash, tools::wallet2::payment_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i)
 	{
-		std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments;
-		m_wallet->get_payments(payments, min_height, max_height, req.account_index, req.subaddr_indices);
-		for(std::list<std::pair<crypto::hash, tools::wallet2::payment_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i)
-		{
-			res.in.push_back(wallet_rpc::transfer_entry());
-			fill_transfer_entry(res.in.back(), i->second.m_tx_hash, i->first, i->second);
-		}
+		res.in.push_back(wallet_rpc::transfer_entry());
+		fill_transfer_entry(res.in.back(), i->second.m_tx_hash, i->first, i->second);
 	}
-
-	if(req.out)
+	for(std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>>::const_iterator i = confirmed_payments.begin(); i != confirmed_payments.end(); ++i)
 	{
-		std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> payments;
-		m_wallet->get_payments_out(payments, min_height, max_height, req.account_index, req.subaddr_indices);
-		for(std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i)
-		{
-			res.out.push_back(wallet_rpc::transfer_entry());
-			fill_transfer_entry(res.out.back(), i->first, i->second);
-		}
+		res.out.push_back(wallet_rpc::transfer_entry());
+		fill_transfer_entry(res.out.back(), i->first, i->second);
 	}
 
 	if(req.pending || req.failed)
@@ -2941,169 +3016,3 @@ bool wallet_rpc_server::on_submit_multisig(const wallet_rpc::COMMAND_RPC_SUBMIT_
 }
 //------------------------------------------------------------------------------------------------------------------------------
 }
-
-int main(int argc, char **argv)
-{
-#ifdef WIN32
-	std::vector<char*> argptrs;
-	command_line::set_console_utf8();
-	if(command_line::get_windows_args(argptrs))
-	{
-		argc = argptrs.size();
-		argv = argptrs.data();
-	}
-#endif
-
-	namespace po = boost::program_options;
-
-	const auto arg_wallet_file = wallet_args::arg_wallet_file();
-	const auto arg_from_json = wallet_args::arg_generate_from_json();
-
-	po::options_description desc_params(wallet_args::tr("Wallet options"));
-	tools::wallet2::init_options(desc_params);
-	command_line::add_arg(desc_params, arg_rpc_bind_port);
-	command_line::add_arg(desc_params, arg_disable_rpc_login);
-	command_line::add_arg(desc_params, arg_trusted_daemon);
-	cryptonote::rpc_args::init_options(desc_params);
-	command_line::add_arg(desc_params, arg_wallet_file);
-	command_line::add_arg(desc_params, arg_from_json);
-	command_line::add_arg(desc_params, arg_wallet_dir);
-	command_line::add_arg(desc_params, arg_prompt_for_password);
-
-	int vm_error_code = 1;
-	const auto vm = wallet_args::main(
-		argc, argv,
-		"ryo-wallet-rpc [--wallet-file=<file>|--generate-from-json=<file>|--wallet-dir=<directory>] [--rpc-bind-port=<port>]",
-		tools::wallet_rpc_server::tr("This is the RPC ryo wallet. It needs to connect to a ryo daemon to work correctly."),
-		desc_params,
-		po::positional_options_description(),
-		[](const std::string &s, bool emphasis) { epee::set_console_color(emphasis ? epee::console_color_white : epee::console_color_default, true); std::cout << s << std::endl; if (emphasis) epee::reset_console_color(); },
-		"ryo-wallet-rpc.log",
-		vm_error_code,
-		true);
-	if(!vm)
-	{
-		return vm_error_code;
-	}
-
-	cryptonote::network_type net_type = cryptonote::UNDEFINED;
-	std::unique_ptr<tools::wallet2> wal;
-	try
-	{
-		const bool testnet = tools::wallet2::has_testnet_option(*vm);
-		const bool stagenet = tools::wallet2::has_stagenet_option(*vm);
-		if(testnet && stagenet)
-		{
-			MERROR(tools::wallet_rpc_server::tr("Can't specify more than one of --testnet and --stagenet"));
-			return 1;
-		}
-		
-		if(testnet)
-			net_type = cryptonote::TESTNET;
-		else if(stagenet)
-			net_type = cryptonote::STAGENET;
-		else
-			net_type = cryptonote::MAINNET;
-
-		const auto wallet_file = command_line::get_arg(*vm, arg_wallet_file);
-		const auto from_json = command_line::get_arg(*vm, arg_from_json);
-		const auto wallet_dir = command_line::get_arg(*vm, arg_wallet_dir);
-		const auto prompt_for_password = command_line::get_arg(*vm, arg_prompt_for_password);
-		const auto password_prompt = prompt_for_password ? password_prompter : nullptr;
-
-		if(!wallet_file.empty() && !from_json.empty())
-		{
-			LOG_ERROR(tools::wallet_rpc_server::tr("Can't specify more than one of --wallet-file and --generate-from-json"));
-			return 1;
-		}
-
-		if(!wallet_dir.empty())
-		{
-			wal = NULL;
-			goto just_dir;
-		}
-
-		if(wallet_file.empty() && from_json.empty())
-		{
-			LOG_ERROR(tools::wallet_rpc_server::tr("Must specify --wallet-file or --generate-from-json or --wallet-dir"));
-			return 1;
-		}
-
-		LOG_PRINT_L0(tools::wallet_rpc_server::tr("Loading wallet..."));
-		if(!wallet_file.empty())
-		{
-			wal = tools::wallet2::make_from_file(*vm, wallet_file, password_prompt).first;
-		}
-		else
-		{
-			try
-			{
-				wal = tools::wallet2::make_from_json(*vm, from_json, password_prompt);
-			}
-			catch(const std::exception &e)
-			{
-				MERROR("Error creating wallet: " << e.what());
-				return 1;
-			}
-		}
-		if(!wal)
-		{
-			return 1;
-		}
-
-		bool quit = false;
-		tools::signal_handler::install([&wal, &quit](int) {
-			assert(wal);
-			quit = true;
-			wal->stop();
-		});
-
-		wal->refresh();
-		// if we ^C during potentially length load/refresh, there's no server loop yet
-		if(quit)
-		{
-			MINFO(tools::wallet_rpc_server::tr("Saving wallet..."));
-			wal->store();
-			MINFO(tools::wallet_rpc_server::tr("Successfully saved"));
-			return 1;
-		}
-		MINFO(tools::wallet_rpc_server::tr("Successfully loaded"));
-	}
-	catch(const std::exception &e)
-	{
-		LOG_ERROR(tools::wallet_rpc_server::tr("Wallet initialization failed: ") << e.what());
-		return 1;
-	}
-just_dir:
-	tools::wallet_rpc_server wrpc(net_type);
-	if(wal)
-		wrpc.start_wallet_backend(std::move(wal));
-	bool r = wrpc.init(&(vm.get()));
-	CHECK_AND_ASSERT_MES(r, 1, tools::wallet_rpc_server::tr("Failed to initialize wallet RPC server"));
-	tools::signal_handler::install([&wrpc](int) {
-		wrpc.send_stop_signal();
-	});
-	LOG_PRINT_L0(tools::wallet_rpc_server::tr("Starting wallet RPC server"));
-	try
-	{
-		wrpc.run();
-	}
-	catch(const std::exception &e)
-	{
-		LOG_ERROR(tools::wallet_rpc_server::tr("Failed to run wallet: ") << e.what());
-		return 1;
-	}
-	LOG_PRINT_L0(tools::wallet_rpc_server::tr("Stopped wallet RPC server"));
-	try
-	{
-		LOG_PRINT_L0(tools::wallet_rpc_server::tr("Saving wallet..."));
-		wrpc.stop_wallet_backend();
-		LOG_PRINT_L0(tools::wallet_rpc_server::tr("Successfully saved"));
-	}
-	catch(const std::exception &e)
-	{
-		LOG_ERROR(tools::wallet_rpc_server::tr("Failed to save wallet: ") << e.what());
-		return 1;
-	}
-	return 0;
-}
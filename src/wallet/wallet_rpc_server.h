@@ -24,16 +24,25 @@
 
 #include "common/util.h"
 #include "net/http_server_impl_base.h"
+#include "rpc/rpc_metrics.h"
 #include "wallet2.h"
 #include "wallet_rpc_server_commands_defs.h"
 #include "cryptonote_config.h"
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <string>
 
 //#undef RYO_DEFAULT_LOG_CATEGORY
 //#define RYO_DEFAULT_LOG_CATEGORY "wallet.rpc"
 
+// Read only calls share the wallet, so they run concurrently between refresh batches. Calls that
+// change it queue for exclusive access, and calls that replace or rescan it also wait out the refresh.
+#define MAP_WALLET_RPC_READ(method_name, callback_f, command_type) MAP_JON_RPC_WE(method_name, locked(read_access, &wallet_rpc_server::callback_f), command_type)
+#define MAP_WALLET_RPC_WRITE(method_name, callback_f, command_type) MAP_JON_RPC_WE(method_name, locked(write_access, &wallet_rpc_server::callback_f), command_type)
+#define MAP_WALLET_RPC_REFRESH(method_name, callback_f, command_type) MAP_JON_RPC_WE(method_name, locked(refresh_access, &wallet_rpc_server::callback_f), command_type)
+
 namespace tools
 {
 /************************************************************************/
@@ -45,6 +54,8 @@ class wallet_rpc_server : public epee::http_server_impl_base<wallet_rpc_server>
 	typedef epee::net_utils::connection_context_base connection_context;
 
 	static const char *tr(const char *str);
+	static void init_options(boost::program_options::options_description &desc);
+	static bool has_wallet_dir(const boost::program_options::variables_map &vm);
 
 	wallet_rpc_server(cryptonote::network_type nettype);
 	~wallet_rpc_server();
@@ -67,80 +78,148 @@ class wallet_rpc_server : public epee::http_server_impl_base<wallet_rpc_server>
 	};
 
   private:
-	CHAIN_HTTP_TO_MAP2(connection_context); //forward http requests to uri map
+	enum access_mode
+	{
+		read_access,
+		write_access,
+		refresh_access
+	};
+
+	template <typename Req, typename Res>
+	struct locked_handler
+	{
+		wallet_rpc_server *self;
+		access_mode mode;
+		bool (wallet_rpc_server::*callback)(const Req &, Res &, epee::json_rpc::error &);
+
+		bool operator()(const Req &req, Res &res, epee::json_rpc::error &er) const
+		{
+			if(mode == read_access)
+			{
+				boost::shared_lock<boost::shared_mutex> lock(self->m_wallet_mutex);
+				return (self->*callback)(req, res, er);
+			}
+			boost::unique_lock<boost::mutex> refresh_lock(self->m_refresh_mutex, boost::defer_lock);
+			if(mode == refresh_access)
+			{
+				self->stop_refresh();
+				refresh_lock.lock();
+			}
+			boost::unique_lock<boost::shared_mutex> lock(self->m_wallet_mutex);
+			return (self->*callback)(req, res, er);
+		}
+	};
+
+	template <typename Req, typename Res>
+	locked_handler<Req, Res> locked(access_mode mode, bool (wallet_rpc_server::*callback)(const Req &, Res &, epee::json_rpc::error &))
+	{
+		return locked_handler<Req, Res>{this, mode, callback};
+	}
+
+	void stop_refresh();
+
+	//forward http requests to uri map, timing the ones it handles
+	bool handle_http_request(const epee::net_utils::http::http_request_info &query_info,
+							 epee::net_utils::http::http_response_info &response,
+							 connection_context &m_conn_context)
+	{
+		LOG_PRINT_L2("HTTP [" << m_conn_context.m_remote_address.host_str() << "] " << query_info.m_http_method_str << " " << query_info.m_URI);
+		response.m_response_code = 200;
+		response.m_response_comment = "Ok";
+		if(query_info.m_URI == "/metrics")
+		{
+			cryptonote::fill_metrics_response(response);
+			return true;
+		}
+		if(query_info.m_URI == "/trace.json")
+		{
+			cryptonote::fill_trace_response(response);
+			return true;
+		}
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if(!handle_http_request_map(query_info, response, m_conn_context))
+		{
+			response.m_response_code = 404;
+			response.m_response_comment = "Not found";
+			return true;
+		}
+		cryptonote::observe_rpc_request("wallet", query_info, response, std::chrono::steady_clock::now() - start);
+		return true;
+	}
 
 	BEGIN_URI_MAP2()
 	BEGIN_JSON_RPC_MAP("/json_rpc")
-	MAP_JON_RPC_WE("get_balance", on_getbalance, wallet_rpc::COMMAND_RPC_GET_BALANCE)
-	MAP_JON_RPC_WE("get_address", on_getaddress, wallet_rpc::COMMAND_RPC_GET_ADDRESS)
-	MAP_JON_RPC_WE("getbalance", on_getbalance, wallet_rpc::COMMAND_RPC_GET_BALANCE)
-	MAP_JON_RPC_WE("getaddress", on_getaddress, wallet_rpc::COMMAND_RPC_GET_ADDRESS)
-	MAP_JON_RPC_WE("create_address", on_create_address, wallet_rpc::COMMAND_RPC_CREATE_ADDRESS)
-	MAP_JON_RPC_WE("label_address", on_label_address, wallet_rpc::COMMAND_RPC_LABEL_ADDRESS)
-	MAP_JON_RPC_WE("get_accounts", on_get_accounts, wallet_rpc::COMMAND_RPC_GET_ACCOUNTS)
-	MAP_JON_RPC_WE("create_account", on_create_account, wallet_rpc::COMMAND_RPC_CREATE_ACCOUNT)
-	MAP_JON_RPC_WE("label_account", on_label_account, wallet_rpc::COMMAND_RPC_LABEL_ACCOUNT)
-	MAP_JON_RPC_WE("get_account_tags", on_get_account_tags, wallet_rpc::COMMAND_RPC_GET_ACCOUNT_TAGS)
-	MAP_JON_RPC_WE("tag_accounts", on_tag_accounts, wallet_rpc::COMMAND_RPC_TAG_ACCOUNTS)
-	MAP_JON_RPC_WE("untag_accounts", on_untag_accounts, wallet_rpc::COMMAND_RPC_UNTAG_ACCOUNTS)
-	MAP_JON_RPC_WE("set_account_tag_description", on_set_account_tag_description, wallet_rpc::COMMAND_RPC_SET_ACCOUNT_TAG_DESCRIPTION)
-	MAP_JON_RPC_WE("get_height", on_getheight, wallet_rpc::COMMAND_RPC_GET_HEIGHT)
-	MAP_JON_RPC_WE("getheight", on_getheight, wallet_rpc::COMMAND_RPC_GET_HEIGHT)
-	MAP_JON_RPC_WE("transfer", on_transfer, wallet_rpc::COMMAND_RPC_TRANSFER)
-	MAP_JON_RPC_WE("transfer_split", on_transfer_split, wallet_rpc::COMMAND_RPC_TRANSFER_SPLIT)
-	MAP_JON_RPC_WE("sweep_all", on_sweep_all, wallet_rpc::COMMAND_RPC_SWEEP_ALL)
-	MAP_JON_RPC_WE("sweep_single", on_sweep_single, wallet_rpc::COMMAND_RPC_SWEEP_SINGLE)
-	MAP_JON_RPC_WE("relay_tx", on_relay_tx, wallet_rpc::COMMAND_RPC_RELAY_TX)
-	MAP_JON_RPC_WE("store", on_store, wallet_rpc::COMMAND_RPC_STORE)
-	MAP_JON_RPC_WE("get_payments", on_get_payments, wallet_rpc::COMMAND_RPC_GET_PAYMENTS)
-	MAP_JON_RPC_WE("get_bulk_payments", on_get_bulk_payments, wallet_rpc::COMMAND_RPC_GET_BULK_PAYMENTS)
-	MAP_JON_RPC_WE("incoming_transfers", on_incoming_transfers, wallet_rpc::COMMAND_RPC_INCOMING_TRANSFERS)
-	MAP_JON_RPC_WE("query_key", on_query_key, wallet_rpc::COMMAND_RPC_QUERY_KEY)
-	MAP_JON_RPC_WE("make_integrated_address", on_make_integrated_address, wallet_rpc::COMMAND_RPC_MAKE_INTEGRATED_ADDRESS)
-	MAP_JON_RPC_WE("split_integrated_address", on_split_integrated_address, wallet_rpc::COMMAND_RPC_SPLIT_INTEGRATED_ADDRESS)
-	MAP_JON_RPC_WE("stop_wallet", on_stop_wallet, wallet_rpc::COMMAND_RPC_STOP_WALLET)
-	MAP_JON_RPC_WE("rescan_blockchain", on_rescan_blockchain, wallet_rpc::COMMAND_RPC_RESCAN_BLOCKCHAIN)
-	MAP_JON_RPC_WE("set_tx_notes", on_set_tx_notes, wallet_rpc::COMMAND_RPC_SET_TX_NOTES)
-	MAP_JON_RPC_WE("get_tx_notes", on_get_tx_notes, wallet_rpc::COMMAND_RPC_GET_TX_NOTES)
-	MAP_JON_RPC_WE("set_attribute", on_set_attribute, wallet_rpc::COMMAND_RPC_SET_ATTRIBUTE)
-	MAP_JON_RPC_WE("get_attribute", on_get_attribute, wallet_rpc::COMMAND_RPC_GET_ATTRIBUTE)
-	MAP_JON_RPC_WE("get_tx_key", on_get_tx_key, wallet_rpc::COMMAND_RPC_GET_TX_KEY)
-	MAP_JON_RPC_WE("check_tx_key", on_check_tx_key, wallet_rpc::COMMAND_RPC_CHECK_TX_KEY)
-	MAP_JON_RPC_WE("get_tx_proof", on_get_tx_proof, wallet_rpc::COMMAND_RPC_GET_TX_PROOF)
-	MAP_JON_RPC_WE("check_tx_proof", on_check_tx_proof, wallet_rpc::COMMAND_RPC_CHECK_TX_PROOF)
-	MAP_JON_RPC_WE("get_spend_proof", on_get_spend_proof, wallet_rpc::COMMAND_RPC_GET_SPEND_PROOF)
-	MAP_JON_RPC_WE("check_spend_proof", on_check_spend_proof, wallet_rpc::COMMAND_RPC_CHECK_SPEND_PROOF)
-	MAP_JON_RPC_WE("get_reserve_proof", on_get_reserve_proof, wallet_rpc::COMMAND_RPC_GET_RESERVE_PROOF)
-	MAP_JON_RPC_WE("check_reserve_proof", on_check_reserve_proof, wallet_rpc::COMMAND_RPC_CHECK_RESERVE_PROOF)
-	MAP_JON_RPC_WE("get_transfers", on_get_transfers, wallet_rpc::COMMAND_RPC_GET_TRANSFERS)
-	MAP_JON_RPC_WE("get_transfer_by_txid", on_get_transfer_by_txid, wallet_rpc::COMMAND_RPC_GET_TRANSFER_BY_TXID)
-	MAP_JON_RPC_WE("sign", on_sign, wallet_rpc::COMMAND_RPC_SIGN)
-	MAP_JON_RPC_WE("verify", on_verify, wallet_rpc::COMMAND_RPC_VERIFY)
-	MAP_JON_RPC_WE("export_key_images", on_export_key_images, wallet_rpc::COMMAND_RPC_EXPORT_KEY_IMAGES)
-	MAP_JON_RPC_WE("import_key_images", on_import_key_images, wallet_rpc::COMMAND_RPC_IMPORT_KEY_IMAGES)
-	MAP_JON_RPC_WE("make_uri", on_make_uri, wallet_rpc::COMMAND_RPC_MAKE_URI)
-	MAP_JON_RPC_WE("parse_uri", on_parse_uri, wallet_rpc::COMMAND_RPC_PARSE_URI)
-	MAP_JON_RPC_WE("get_address_book", on_get_address_book, wallet_rpc::COMMAND_RPC_GET_ADDRESS_BOOK_ENTRY)
-	MAP_JON_RPC_WE("add_address_book", on_add_address_book, wallet_rpc::COMMAND_RPC_ADD_ADDRESS_BOOK_ENTRY)
-	MAP_JON_RPC_WE("delete_address_book", on_delete_address_book, wallet_rpc::COMMAND_RPC_DELETE_ADDRESS_BOOK_ENTRY)
-	MAP_JON_RPC_WE("rescan_spent", on_rescan_spent, wallet_rpc::COMMAND_RPC_RESCAN_SPENT)
-	MAP_JON_RPC_WE("start_mining", on_start_mining, wallet_rpc::COMMAND_RPC_START_MINING)
-	MAP_JON_RPC_WE("stop_mining", on_stop_mining, wallet_rpc::COMMAND_RPC_STOP_MINING)
-	MAP_JON_RPC_WE("get_languages", on_get_languages, wallet_rpc::COMMAND_RPC_GET_LANGUAGES)
-	MAP_JON_RPC_WE("create_wallet", on_create_wallet, wallet_rpc::COMMAND_RPC_CREATE_WALLET)
-	MAP_JON_RPC_WE("restore_wallet", on_restore_wallet, wallet_rpc::COMMAND_RPC_RESTORE_WALLET)
-	MAP_JON_RPC_WE("restore_view_wallet", on_restore_view_wallet, wallet_rpc::COMMAND_RPC_RESTORE_VIEW_WALLET)
-	MAP_JON_RPC_WE("open_wallet", on_open_wallet, wallet_rpc::COMMAND_RPC_OPEN_WALLET)
-	MAP_JON_RPC_WE("change_wallet_password", on_change_wallet_password, wallet_rpc::COMMAND_RPC_CHANGE_WALLET_PASSWORD)
-	MAP_JON_RPC_WE("close_wallet", on_close_wallet, wallet_rpc::COMMAND_RPC_CLOSE_WALLET)
-	MAP_JON_RPC_WE("is_multisig", on_is_multisig, wallet_rpc::COMMAND_RPC_IS_MULTISIG)
-	MAP_JON_RPC_WE("prepare_multisig", on_prepare_multisig, wallet_rpc::COMMAND_RPC_PREPARE_MULTISIG)
-	MAP_JON_RPC_WE("make_multisig", on_make_multisig, wallet_rpc::COMMAND_RPC_MAKE_MULTISIG)
-	MAP_JON_RPC_WE("export_multisig_info", on_export_multisig, wallet_rpc::COMMAND_RPC_EXPORT_MULTISIG)
-	MAP_JON_RPC_WE("import_multisig_info", on_import_multisig, wallet_rpc::COMMAND_RPC_IMPORT_MULTISIG)
-	MAP_JON_RPC_WE("finalize_multisig", on_finalize_multisig, wallet_rpc::COMMAND_RPC_FINALIZE_MULTISIG)
-	MAP_JON_RPC_WE("sign_multisig", on_sign_multisig, wallet_rpc::COMMAND_RPC_SIGN_MULTISIG)
-	MAP_JON_RPC_WE("submit_multisig", on_submit_multisig, wallet_rpc::COMMAND_RPC_SUBMIT_MULTISIG)
+	MAP_WALLET_RPC_READ("get_balance", on_getbalance, wallet_rpc::COMMAND_RPC_GET_BALANCE)
+	MAP_WALLET_RPC_READ("get_address", on_getaddress, wallet_rpc::COMMAND_RPC_GET_ADDRESS)
+	MAP_WALLET_RPC_READ("getbalance", on_getbalance, wallet_rpc::COMMAND_RPC_GET_BALANCE)
+	MAP_WALLET_RPC_READ("getaddress", on_getaddress, wallet_rpc::COMMAND_RPC_GET_ADDRESS)
+	MAP_WALLET_RPC_WRITE("create_address", on_create_address, wallet_rpc::COMMAND_RPC_CREATE_ADDRESS)
+	MAP_WALLET_RPC_WRITE("label_address", on_label_address, wallet_rpc::COMMAND_RPC_LABEL_ADDRESS)
+	MAP_WALLET_RPC_WRITE("get_accounts", on_get_accounts, wallet_rpc::COMMAND_RPC_GET_ACCOUNTS)
+	MAP_WALLET_RPC_WRITE("create_account", on_create_account, wallet_rpc::COMMAND_RPC_CREATE_ACCOUNT)
+	MAP_WALLET_RPC_WRITE("label_account", on_label_account, wallet_rpc::COMMAND_RPC_LABEL_ACCOUNT)
+	MAP_WALLET_RPC_WRITE("get_account_tags", on_get_account_tags, wallet_rpc::COMMAND_RPC_GET_ACCOUNT_TAGS)
+	MAP_WALLET_RPC_WRITE("tag_accounts", on_tag_accounts, wallet_rpc::COMMAND_RPC_TAG_ACCOUNTS)
+	MAP_WALLET_RPC_WRITE("untag_accounts", on_untag_accounts, wallet_rpc::COMMAND_RPC_UNTAG_ACCOUNTS)
+	MAP_WALLET_RPC_WRITE("set_account_tag_description", on_set_account_tag_description, wallet_rpc::COMMAND_RPC_SET_ACCOUNT_TAG_DESCRIPTION)
+	MAP_WALLET_RPC_READ("get_height", on_getheight, wallet_rpc::COMMAND_RPC_GET_HEIGHT)
+	MAP_WALLET_RPC_READ("getheight", on_getheight, wallet_rpc::COMMAND_RPC_GET_HEIGHT)
+	MAP_WALLET_RPC_WRITE("transfer", on_transfer, wallet_rpc::COMMAND_RPC_TRANSFER)
+	MAP_WALLET_RPC_WRITE("transfer_split", on_transfer_split, wallet_rpc::COMMAND_RPC_TRANSFER_SPLIT)
+	MAP_WALLET_RPC_WRITE("sweep_all", on_sweep_all, wallet_rpc::COMMAND_RPC_SWEEP_ALL)
+	MAP_WALLET_RPC_WRITE("sweep_single", on_sweep_single, wallet_rpc::COMMAND_RPC_SWEEP_SINGLE)
+	MAP_WALLET_RPC_WRITE("relay_tx", on_relay_tx, wallet_rpc::COMMAND_RPC_RELAY_TX)
+	MAP_WALLET_RPC_WRITE("store", on_store, wallet_rpc::COMMAND_RPC_STORE)
+	MAP_WALLET_RPC_READ("get_payments", on_get_payments, wallet_rpc::COMMAND_RPC_GET_PAYMENTS)
+	MAP_WALLET_RPC_READ("get_bulk_payments", on_get_bulk_payments, wallet_rpc::COMMAND_RPC_GET_BULK_PAYMENTS)
+	MAP_WALLET_RPC_READ("incoming_transfers", on_incoming_transfers, wallet_rpc::COMMAND_RPC_INCOMING_TRANSFERS)
+	MAP_WALLET_RPC_READ("query_key", on_query_key, wallet_rpc::COMMAND_RPC_QUERY_KEY)
+	MAP_WALLET_RPC_READ("make_integrated_address", on_make_integrated_address, wallet_rpc::COMMAND_RPC_MAKE_INTEGRATED_ADDRESS)
+	MAP_WALLET_RPC_READ("split_integrated_address", on_split_integrated_address, wallet_rpc::COMMAND_RPC_SPLIT_INTEGRATED_ADDRESS)
+	MAP_WALLET_RPC_WRITE("stop_wallet", on_stop_wallet, wallet_rpc::COMMAND_RPC_STOP_WALLET)
+	MAP_WALLET_RPC_READ("set_trace", on_set_trace, wallet_rpc::COMMAND_RPC_SET_TRACE)
+	MAP_WALLET_RPC_REFRESH("rescan_blockchain", on_rescan_blockchain, wallet_rpc::COMMAND_RPC_RESCAN_BLOCKCHAIN)
+	MAP_WALLET_RPC_WRITE("set_tx_notes", on_set_tx_notes, wallet_rpc::COMMAND_RPC_SET_TX_NOTES)
+	MAP_WALLET_RPC_READ("get_tx_notes", on_get_tx_notes, wallet_rpc::COMMAND_RPC_GET_TX_NOTES)
+	MAP_WALLET_RPC_WRITE("set_attribute", on_set_attribute, wallet_rpc::COMMAND_RPC_SET_ATTRIBUTE)
+	MAP_WALLET_RPC_READ("get_attribute", on_get_attribute, wallet_rpc::COMMAND_RPC_GET_ATTRIBUTE)
+	MAP_WALLET_RPC_READ("get_tx_key", on_get_tx_key, wallet_rpc::COMMAND_RPC_GET_TX_KEY)
+	MAP_WALLET_RPC_WRITE("check_tx_key", on_check_tx_key, wallet_rpc::COMMAND_RPC_CHECK_TX_KEY)
+	MAP_WALLET_RPC_WRITE("get_tx_proof", on_get_tx_proof, wallet_rpc::COMMAND_RPC_GET_TX_PROOF)
+	MAP_WALLET_RPC_WRITE("check_tx_proof", on_check_tx_proof, wallet_rpc::COMMAND_RPC_CHECK_TX_PROOF)
+	MAP_WALLET_RPC_WRITE("get_spend_proof", on_get_spend_proof, wallet_rpc::COMMAND_RPC_GET_SPEND_PROOF)
+	MAP_WALLET_RPC_WRITE("check_spend_proof", on_check_spend_proof, wallet_rpc::COMMAND_RPC_CHECK_SPEND_PROOF)
+	MAP_WALLET_RPC_WRITE("get_reserve_proof", on_get_reserve_proof, wallet_rpc::COMMAND_RPC_GET_RESERVE_PROOF)
+	MAP_WALLET_RPC_WRITE("check_reserve_proof", on_check_reserve_proof, wallet_rpc::COMMAND_RPC_CHECK_RESERVE_PROOF)
+	MAP_WALLET_RPC_WRITE("get_transfers", on_get_transfers, wallet_rpc::COMMAND_RPC_GET_TRANSFERS)
+	MAP_WALLET_RPC_WRITE("get_transfer_by_txid", on_get_transfer_by_txid, wallet_rpc::COMMAND_RPC_GET_TRANSFER_BY_TXID)
+	MAP_WALLET_RPC_READ("sign", on_sign, wallet_rpc::COMMAND_RPC_SIGN)
+	MAP_WALLET_RPC_READ("verify", on_verify, wallet_rpc::COMMAND_RPC_VERIFY)
+	MAP_WALLET_RPC_READ("export_key_images", on_export_key_images, wallet_rpc::COMMAND_RPC_EXPORT_KEY_IMAGES)
+	MAP_WALLET_RPC_WRITE("import_key_images", on_import_key_images, wallet_rpc::COMMAND_RPC_IMPORT_KEY_IMAGES)
+	MAP_WALLET_RPC_READ("make_uri", on_make_uri, wallet_rpc::COMMAND_RPC_MAKE_URI)
+	MAP_WALLET_RPC_READ("parse_uri", on_parse_uri, wallet_rpc::COMMAND_RPC_PARSE_URI)
+	MAP_WALLET_RPC_READ("get_address_book", on_get_address_book, wallet_rpc::COMMAND_RPC_GET_ADDRESS_BOOK_ENTRY)
+	MAP_WALLET_RPC_WRITE("add_address_book", on_add_address_book, wallet_rpc::COMMAND_RPC_ADD_ADDRESS_BOOK_ENTRY)
+	MAP_WALLET_RPC_WRITE("delete_address_book", on_delete_address_book, wallet_rpc::COMMAND_RPC_DELETE_ADDRESS_BOOK_ENTRY)
+	MAP_WALLET_RPC_WRITE("rescan_spent", on_rescan_spent, wallet_rpc::COMMAND_RPC_RESCAN_SPENT)
+	MAP_WALLET_RPC_WRITE("start_mining", on_start_mining, wallet_rpc::COMMAND_RPC_START_MINING)
+	MAP_WALLET_RPC_WRITE("stop_mining", on_stop_mining, wallet_rpc::COMMAND_RPC_STOP_MINING)
+	MAP_WALLET_RPC_READ("get_languages", on_get_languages, wallet_rpc::COMMAND_RPC_GET_LANGUAGES)
+	MAP_WALLET_RPC_REFRESH("create_wallet", on_create_wallet, wallet_rpc::COMMAND_RPC_CREATE_WALLET)
+	MAP_WALLET_RPC_REFRESH("restore_wallet", on_restore_wallet, wallet_rpc::COMMAND_RPC_RESTORE_WALLET)
+	MAP_WALLET_RPC_REFRESH("restore_view_wallet", on_restore_view_wallet, wallet_rpc::COMMAND_RPC_RESTORE_VIEW_WALLET)
+	MAP_WALLET_RPC_REFRESH("open_wallet", on_open_wallet, wallet_rpc::COMMAND_RPC_OPEN_WALLET)
+	MAP_WALLET_RPC_WRITE("change_wallet_password", on_change_wallet_password, wallet_rpc::COMMAND_RPC_CHANGE_WALLET_PASSWORD)
+	MAP_WALLET_RPC_REFRESH("close_wallet", on_close_wallet, wallet_rpc::COMMAND_RPC_CLOSE_WALLET)
+	MAP_WALLET_RPC_READ("is_multisig", on_is_multisig, wallet_rpc::COMMAND_RPC_IS_MULTISIG)
+	MAP_WALLET_RPC_WRITE("prepare_multisig", on_prepare_multisig, wallet_rpc::COMMAND_RPC_PREPARE_MULTISIG)
+	MAP_WALLET_RPC_WRITE("make_multisig", on_make_multisig, wallet_rpc::COMMAND_RPC_MAKE_MULTISIG)
+	MAP_WALLET_RPC_WRITE("export_multisig_info", on_export_multisig, wallet_rpc::COMMAND_RPC_EXPORT_MULTISIG)
+	MAP_WALLET_RPC_WRITE("import_multisig_info", on_import_multisig, wallet_rpc::COMMAND_RPC_IMPORT_MULTISIG)
+	MAP_WALLET_RPC_WRITE("finalize_multisig", on_finalize_multisig, wallet_rpc::COMMAND_RPC_FINALIZE_MULTISIG)
+	MAP_WALLET_RPC_WRITE("sign_multisig", on_sign_multisig, wallet_rpc::COMMAND_RPC_SIGN_MULTISIG)
+	MAP_WALLET_RPC_WRITE("submit_multisig", on_submit_multisig, wallet_rpc::COMMAND_RPC_SUBMIT_MULTISIG)
 	END_JSON_RPC_MAP()
 	END_URI_MAP2()
 
@@ -170,6 +249,7 @@ class wallet_rpc_server : public epee::http_server_impl_base<wallet_rpc_server>
 	bool on_get_bulk_payments(const wallet_rpc::COMMAND_RPC_GET_BULK_PAYMENTS::request &req, wallet_rpc::COMMAND_RPC_GET_BULK_PAYMENTS::response &res, epee::json_rpc::error &er);
 	bool on_incoming_transfers(const wallet_rpc::COMMAND_RPC_INCOMING_TRANSFERS::request &req, wallet_rpc::COMMAND_RPC_INCOMING_TRANSFERS::response &res, epee::json_rpc::error &er);
 	bool on_stop_wallet(const wallet_rpc::COMMAND_RPC_STOP_WALLET::request &req, wallet_rpc::COMMAND_RPC_STOP_WALLET::response &res, epee::json_rpc::error &er);
+	bool on_set_trace(const wallet_rpc::COMMAND_RPC_SET_TRACE::request &req, wallet_rpc::COMMAND_RPC_SET_TRACE::response &res, epee::json_rpc::error &er);
 	bool on_rescan_blockchain(const wallet_rpc::COMMAND_RPC_RESCAN_BLOCKCHAIN::request &req, wallet_rpc::COMMAND_RPC_RESCAN_BLOCKCHAIN::response &res, epee::json_rpc::error &er);
 	bool on_set_tx_notes(const wallet_rpc::COMMAND_RPC_SET_TX_NOTES::request &req, wallet_rpc::COMMAND_RPC_SET_TX_NOTES::response &res, epee::json_rpc::error &er);
 	bool on_get_tx_notes(const wallet_rpc::COMMAND_RPC_GET_TX_NOTES::request &req, wallet_rpc::COMMAND_RPC_GET_TX_NOTES::response &res, epee::json_rpc::error &er);
@@ -233,6 +313,8 @@ class wallet_rpc_server : public epee::http_server_impl_base<wallet_rpc_server>
 	bool wallet_path_helper(const std::string& filename, epee::json_rpc::error &er);
 
 	wallet2 *m_wallet;
+	boost::shared_mutex m_wallet_mutex; // guards m_wallet and the wallet state
+	boost::mutex m_refresh_mutex;		 // held by the auto refresh and by calls that replace or rescan the wallet
 	std::string m_wallet_dir;
 	tools::private_file rpc_login_file;
 	std::atomic<bool> m_stop;
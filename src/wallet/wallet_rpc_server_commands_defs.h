@@ -21,6 +21,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #pragma once
+#include "common/trace.h"
 #include "crypto/hash.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "cryptonote_basic/subaddress_index.h"
@@ -698,19 +699,25 @@ struct COMMAND_RPC_GET_BULK_PAYMENTS
 	{
 		std::vector<std::string> payment_ids;
 		uint64_t min_block_height;
+		uint32_t max_results; // 0 for no limit
 
 		BEGIN_KV_SERIALIZE_MAP()
 		KV_SERIALIZE(payment_ids)
 		KV_SERIALIZE(min_block_height)
+		KV_SERIALIZE_OPT(max_results, (uint32_t)0)
 		END_KV_SERIALIZE_MAP()
 	};
 
 	struct response
 	{
 		std::list<payment_details> payments;
+		bool more;						 // results were cut at max_results
+		uint64_t next_min_block_height; // min_block_height to ask for the rest
 
 		BEGIN_KV_SERIALIZE_MAP()
 		KV_SERIALIZE(payments)
+		KV_SERIALIZE(more)
+		KV_SERIALIZE(next_min_block_height)
 		END_KV_SERIALIZE_MAP()
 	};
 };
@@ -744,21 +751,27 @@ struct COMMAND_RPC_INCOMING_TRANSFERS
 		uint32_t account_index;
 		std::set<uint32_t> subaddr_indices;
 		bool verbose;
+		uint64_t start_index; // position in the wallet's transfer list, as returned in next_index
+		uint32_t max_results; // 0 for no limit
 
 		BEGIN_KV_SERIALIZE_MAP()
 		KV_SERIALIZE(transfer_type)
 		KV_SERIALIZE(account_index)
 		KV_SERIALIZE(subaddr_indices)
 		KV_SERIALIZE(verbose)
+		KV_SERIALIZE_OPT(start_index, (uint64_t)0)
+		KV_SERIALIZE_OPT(max_results, (uint32_t)0)
 		END_KV_SERIALIZE_MAP()
 	};
 
 	struct response
 	{
 		std::list<transfer_details> transfers;
+		uint64_t next_index; // start_index to ask for transfers not returned yet
 
 		BEGIN_KV_SERIALIZE_MAP()
 		KV_SERIALIZE(transfers)
+		KV_SERIALIZE(next_index)
 		END_KV_SERIALIZE_MAP()
 	};
 };
@@ -848,6 +861,26 @@ struct COMMAND_RPC_STOP_WALLET
 	};
 };
 
+struct COMMAND_RPC_SET_TRACE
+{
+	struct request
+	{
+		bool enable;
+		uint64_t events_per_thread;
+
+		BEGIN_KV_SERIALIZE_MAP()
+		KV_SERIALIZE(enable)
+		KV_SERIALIZE_OPT(events_per_thread, (uint64_t)tools::trace::DEFAULT_EVENTS_PER_THREAD)
+		END_KV_SERIALIZE_MAP()
+	};
+
+	struct response
+	{
+		BEGIN_KV_SERIALIZE_MAP()
+		END_KV_SERIALIZE_MAP()
+	};
+};
+
 struct COMMAND_RPC_RESCAN_BLOCKCHAIN
 {
 	struct request
@@ -1208,6 +1241,7 @@ struct COMMAND_RPC_GET_TRANSFERS
 		uint64_t max_height;
 		uint32_t account_index;
 		std::set<uint32_t> subaddr_indices;
+		uint32_t max_results; // 0 for no limit, applies to in and out
 
 		BEGIN_KV_SERIALIZE_MAP()
 		KV_SERIALIZE(in);
@@ -1220,6 +1254,7 @@ struct COMMAND_RPC_GET_TRANSFERS
 		KV_SERIALIZE_OPT(max_height, cryptonote::common_config::CRYPTONOTE_MAX_BLOCK_NUMBER);
 		KV_SERIALIZE(account_index);
 		KV_SERIALIZE(subaddr_indices);
+		KV_SERIALIZE_OPT(max_results, (uint32_t)0);
 		END_KV_SERIALIZE_MAP()
 	};
 
@@ -1230,6 +1265,8 @@ struct COMMAND_RPC_GET_TRANSFERS
 		std::list<transfer_entry> pending;
 		std::list<transfer_entry> failed;
 		std::list<transfer_entry> pool;
+		bool more;				  // in or out were cut at max_results
+		uint64_t next_min_height; // min_height to ask for the rest, with filter_by_height set
 
 		BEGIN_KV_SERIALIZE_MAP()
 		KV_SERIALIZE(in);
@@ -1237,6 +1274,8 @@ struct COMMAND_RPC_GET_TRANSFERS
 		KV_SERIALIZE(pending);
 		KV_SERIALIZE(failed);
 		KV_SERIALIZE(pool);
+		KV_SERIALIZE(more);
+		KV_SERIALIZE(next_min_height);
 		END_KV_SERIALIZE_MAP()
 	};
 };
@@ -0,0 +1,202 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+// Copyright (c) 2018, Ryo Currency Project
+// Portions copyright (c) 2014-2018, The Monero Project
+//
+// Portions of this file are available under BSD-3 license. Please see ORIGINAL-LICENSE for details
+// All rights reserved.
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+// Ryo changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+#include "common/command_line.h"
+#include "common/util.h"
+#include "include_base_utils.h"
+#include "wallet/wallet_args.h"
+#include "wallet_rpc_server.h"
+
+namespace
+{
+const command_line::arg_descriptor<bool> arg_prompt_for_password = {"prompt-for-password", "Prompts for password when not provided", false};
+
+boost::optional<tools::password_container> password_prompter(const char *prompt, bool verify)
+{
+	auto pwd_container = tools::password_container::prompt(verify, prompt);
+	if(!pwd_container)
+	{
+		MERROR("failed to read wallet password");
+	}
+	return pwd_container;
+}
+}
+
+int main(int argc, char **argv)
+{
+#ifdef WIN32
+	std::vector<char*> argptrs;
+	command_line::set_console_utf8();
+	if(command_line::get_windows_args(argptrs))
+	{
+		argc = argptrs.size();
+		argv = argptrs.data();
+	}
+#endif
+
+	namespace po = boost::program_options;
+
+	const auto arg_wallet_file = wallet_args::arg_wallet_file();
+	const auto arg_from_json = wallet_args::arg_generate_from_json();
+
+	po::options_description desc_params(wallet_args::tr("Wallet options"));
+	tools::wallet2::init_options(desc_params);
+	tools::wallet_rpc_server::init_options(desc_params);
+	command_line::add_arg(desc_params, arg_wallet_file);
+	command_line::add_arg(desc_params, arg_from_json);
+	command_line::add_arg(desc_params, arg_prompt_for_password);
+
+	int vm_error_code = 1;
+	const auto vm = wallet_args::main(
+		argc, argv,
+		"ryo-wallet-rpc [--wallet-file=<file>|--generate-from-json=<file>|--wallet-dir=<directory>] [--rpc-bind-port=<port>]",
+		tools::wallet_rpc_server::tr("This is the RPC ryo wallet. It needs to connect to a ryo daemon to work correctly."),
+		desc_params,
+		po::positional_options_description(),
+		[](const std::string &s, bool emphasis) { epee::set_console_color(emphasis ? epee::console_color_white : epee::console_color_default, true); std::cout << s << std::endl; if (emphasis) epee::reset_console_color(); },
+		"ryo-wallet-rpc.log",
+		vm_error_code,
+		true);
+	if(!vm)
+	{
+		return vm_error_code;
+	}
+
+	cryptonote::network_type net_type = cryptonote::UNDEFINED;
+	std::unique_ptr<tools::wallet2> wal;
+	try
+	{
+		const bool testnet = tools::wallet2::has_testnet_option(*vm);
+		const bool stagenet = tools::wallet2::has_stagenet_option(*vm);
+		if(testnet && stagenet)
+		{
+			MERROR(tools::wallet_rpc_server::tr("Can't specify more than one of --testnet and --stagenet"));
+			return 1;
+		}
+		
+		if(testnet)
+			net_type = cryptonote::TESTNET;
+		else if(stagenet)
+			net_type = cryptonote::STAGENET;
+		else
+			net_type = cryptonote::MAINNET;
+
+		const auto wallet_file = command_line::get_arg(*vm, arg_wallet_file);
+		const auto from_json = command_line::get_arg(*vm, arg_from_json);
+		const auto prompt_for_password = command_line::get_arg(*vm, arg_prompt_for_password);
+		const auto password_prompt = prompt_for_password ? password_prompter : nullptr;
+
+		if(!wallet_file.empty() && !from_json.empty())
+		{
+			LOG_ERROR(tools::wallet_rpc_server::tr("Can't specify more than one of --wallet-file and --generate-from-json"));
+			return 1;
+		}
+
+		if(tools::wallet_rpc_server::has_wallet_dir(*vm))
+		{
+			wal = NULL;
+			goto just_dir;
+		}
+
+		if(wallet_file.empty() && from_json.empty())
+		{
+			LOG_ERROR(tools::wallet_rpc_server::tr("Must specify --wallet-file or --generate-from-json or --wallet-dir"));
+			return 1;
+		}
+
+		LOG_PRINT_L0(tools::wallet_rpc_server::tr("Loading wallet..."));
+		if(!wallet_file.empty())
+		{
+			wal = tools::wallet2::make_from_file(*vm, wallet_file, password_prompt).first;
+		}
+		else
+		{
+			try
+			{
+				wal = tools::wallet2::make_from_json(*vm, from_json, password_prompt);
+			}
+			catch(const std::exception &e)
+			{
+				MERROR("Error creating wallet: " << e.what());
+				return 1;
+			}
+		}
+		if(!wal)
+		{
+			return 1;
+		}
+
+		bool quit = false;
+		tools::signal_handler::install([&wal, &quit](int) {
+			assert(wal);
+			quit = true;
+			wal->stop();
+		});
+
+		wal->refresh();
+		// if we ^C during potentially length load/refresh, there's no server loop yet
+		if(quit)
+		{
+			MINFO(tools::wallet_rpc_server::tr("Saving wallet..."));
+			wal->store();
+			MINFO(tools::wallet_rpc_server::tr("Successfully saved"));
+			return 1;
+		}
+		MINFO(tools::wallet_rpc_server::tr("Successfully loaded"));
+	}
+	catch(const std::exception &e)
+	{
+		LOG_ERROR(tools::wallet_rpc_server::tr("Wallet initialization failed: ") << e.what());
+		return 1;
+	}
+just_dir:
+	tools::wallet_rpc_server wrpc(net_type);
+	if(wal)
+		wrpc.start_wallet_backend(std::move(wal));
+	bool r = wrpc.init(&(vm.get()));
+	CHECK_AND_ASSERT_MES(r, 1, tools::wallet_rpc_server::tr("Failed to initialize wallet RPC server"));
+	tools::signal_handler::install([&wrpc](int) {
+		wrpc.send_stop_signal();
+	});
+	LOG_PRINT_L0(tools::wallet_rpc_server::tr("Starting wallet RPC server"));
+	try
+	{
+		wrpc.run();
+	}
+	catch(const std::exception &e)
+	{
+		LOG_ERROR(tools::wallet_rpc_server::tr("Failed to run wallet: ") << e.what());
+		return 1;
+	}
+	LOG_PRINT_L0(tools::wallet_rpc_server::tr("Stopped wallet RPC server"));
+	try
+	{
+		LOG_PRINT_L0(tools::wallet_rpc_server::tr("Saving wallet..."));
+		wrpc.stop_wallet_backend();
+		LOG_PRINT_L0(tools::wallet_rpc_server::tr("Successfully saved"));
+	}
+	catch(const std::exception &e)
+	{
+		LOG_ERROR(tools::wallet_rpc_server::tr("Failed to save wallet: ") << e.what());
+		return 1;
+	}
+	return 0;
+}
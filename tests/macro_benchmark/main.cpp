@@ -0,0 +1,665 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "common/command_line.h"
+#include "common/metrics.h"
+#include "common/util.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "file_io_utils.h"
+#include "include_base_utils.h"
+#include "net/http_client.h"
+#include "net/jsonrpc_structs.h"
+#include "p2p/net_node.h"
+#include "ringct/rctOps.h"
+#include "rpc/core_rpc_server.h"
+#include "storages/http_abstract_invoke.h"
+#include "storages/portable_storage_template_helper.h"
+#include "string_tools.h"
+#include "synthetic_chain.h"
+#include "wallet/wallet_rpc_server.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <random>
+#include <thread>
+
+namespace po = boost::program_options;
+using namespace cryptonote;
+
+namespace
+{
+const command_line::arg_descriptor<std::string> arg_chain_file = {"chain-file", "Chain to replay; generated and saved there first if missing or made with other parameters", ""};
+const command_line::arg_descriptor<size_t> arg_blocks = {"blocks", "Blocks carrying transactions, after the warm-up blocks", 500};
+const command_line::arg_descriptor<size_t> arg_txs_per_block = {"txs-per-block", "Transactions per block", 4};
+const command_line::arg_descriptor<size_t> arg_ring_size = {"ring-size", "Ring size of every input", common_config::MIN_MIXIN_V1 + 1};
+const command_line::arg_descriptor<size_t> arg_min_inputs = {"min-inputs", "Fewest inputs per transaction", 1};
+const command_line::arg_descriptor<size_t> arg_max_inputs = {"max-inputs", "Most inputs per transaction, one input makes a full ringct signature, more a simple one", 2};
+const command_line::arg_descriptor<size_t> arg_outputs = {"outputs", "Outputs per transaction", 2};
+const command_line::arg_descriptor<uint64_t> arg_seed = {"seed", "Seed of the transaction mix and decoy selection", 1};
+const command_line::arg_descriptor<size_t> arg_sync_batch = {"sync-batch", "Blocks handed to the core at once, like a span from a peer", BLOCKS_SYNCHRONIZING_DEFAULT_COUNT};
+const command_line::arg_descriptor<size_t> arg_rpc_requests = {"rpc-requests", "Requests replayed per RPC method", 200};
+const command_line::arg_descriptor<size_t> arg_wallet_transfers = {"wallet-transfers", "Outputs held by the wallet behind the wallet RPC server", 2000};
+const command_line::arg_descriptor<size_t> arg_wallet_readers = {"wallet-readers", "Clients reading from the wallet RPC server at once", 4};
+const command_line::arg_descriptor<std::string> arg_output = {"output", "Also write the results there", ""};
+const command_line::arg_descriptor<std::string> arg_metrics_file = {"metrics-file", "Write the process metrics there after the run", ""};
+
+const std::pair<uint8_t, uint64_t> hard_forks[] = {std::make_pair((uint8_t)1, (uint64_t)0), std::make_pair((uint8_t)0, (uint64_t)0)};
+const test_options benchmark_test_options = {hard_forks};
+
+typedef nodetool::node_server<t_cryptonote_protocol_handler<core>> p2p_server;
+
+struct latency_stats
+{
+	uint64_t count;
+	double mean_us;
+	uint64_t p50_us;
+	uint64_t p90_us;
+	uint64_t p99_us;
+	uint64_t max_us;
+
+	BEGIN_KV_SERIALIZE_MAP()
+	KV_SERIALIZE(count)
+	KV_SERIALIZE(mean_us)
+	KV_SERIALIZE(p50_us)
+	KV_SERIALIZE(p90_us)
+	KV_SERIALIZE(p99_us)
+	KV_SERIALIZE(max_us)
+	END_KV_SERIALIZE_MAP()
+};
+
+struct sync_stats
+{
+	uint64_t blocks;
+	uint64_t txs;
+	double seconds;
+	double blocks_per_second;
+	double txs_per_second;
+	latency_stats batches;
+
+	BEGIN_KV_SERIALIZE_MAP()
+	KV_SERIALIZE(blocks)
+	KV_SERIALIZE(txs)
+	KV_SERIALIZE(seconds)
+	KV_SERIALIZE(blocks_per_second)
+	KV_SERIALIZE(txs_per_second)
+	KV_SERIALIZE(batches)
+	END_KV_SERIALIZE_MAP()
+};
+
+struct rpc_stats
+{
+	latency_stats get_blocks_bin;
+	latency_stats get_outs_bin;
+	latency_stats getblocktemplate;
+
+	BEGIN_KV_SERIALIZE_MAP()
+	KV_SERIALIZE(get_blocks_bin)
+	KV_SERIALIZE(get_outs_bin)
+	KV_SERIALIZE(getblocktemplate)
+	END_KV_SERIALIZE_MAP()
+};
+
+struct wallet_rpc_stats
+{
+	uint64_t transfers;
+	uint64_t readers;
+	latency_stats reads;
+	latency_stats contended_reads;
+	latency_stats writes;
+
+	BEGIN_KV_SERIALIZE_MAP()
+	KV_SERIALIZE(transfers)
+	KV_SERIALIZE(readers)
+	KV_SERIALIZE(reads)
+	KV_SERIALIZE(contended_reads)
+	KV_SERIALIZE(writes)
+	END_KV_SERIALIZE_MAP()
+};
+
+struct benchmark_report
+{
+	std::string chain;
+	uint64_t sync_batch;
+	sync_stats sync;
+	rpc_stats rpc;
+	wallet_rpc_stats wallet_rpc;
+
+	BEGIN_KV_SERIALIZE_MAP()
+	KV_SERIALIZE(chain)
+	KV_SERIALIZE(sync_batch)
+	KV_SERIALIZE(sync)
+	KV_SERIALIZE(rpc)
+	KV_SERIALIZE(wallet_rpc)
+	END_KV_SERIALIZE_MAP()
+};
+
+uint64_t elapsed_us(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+latency_stats summarize(std::vector<uint64_t> us)
+{
+	latency_stats s = AUTO_VAL_INIT(s);
+	if(us.empty())
+		return s;
+	std::sort(us.begin(), us.end());
+	uint64_t total = 0;
+	for(uint64_t v : us)
+		total += v;
+	s.count = us.size();
+	s.mean_us = (double)total / us.size();
+	s.p50_us = us[(us.size() - 1) * 50 / 100];
+	s.p90_us = us[(us.size() - 1) * 90 / 100];
+	s.p99_us = us[(us.size() - 1) * 99 / 100];
+	s.max_us = us.back();
+	return s;
+}
+
+bool get_chain(const po::variables_map &vm, macro_benchmark::synthetic_chain &chain)
+{
+	macro_benchmark::chain_params params;
+	params.blocks = command_line::get_arg(vm, arg_blocks);
+	params.txs_per_block = command_line::get_arg(vm, arg_txs_per_block);
+	params.ring_size = command_line::get_arg(vm, arg_ring_size);
+	params.min_inputs = command_line::get_arg(vm, arg_min_inputs);
+	params.max_inputs = command_line::get_arg(vm, arg_max_inputs);
+	params.outputs = command_line::get_arg(vm, arg_outputs);
+	params.seed = command_line::get_arg(vm, arg_seed);
+
+	const std::string filename = command_line::get_arg(vm, arg_chain_file);
+	if(!filename.empty() && boost::filesystem::exists(filename))
+	{
+		if(macro_benchmark::load_chain(filename, chain) && chain.params == params.describe())
+		{
+			MGINFO("Loaded chain " << chain.params << " from " << filename);
+			return true;
+		}
+		MGINFO(filename << " holds another chain, generating it again");
+	}
+
+	MGINFO("Generating chain " << params.describe());
+	if(!macro_benchmark::generate_chain(params, chain))
+		return false;
+	if(!filename.empty() && !macro_benchmark::store_chain(filename, chain))
+	{
+		MERROR("Failed to save the chain to " << filename);
+		return false;
+	}
+	return true;
+}
+
+// the sequence the p2p layer runs for every span it receives
+bool run_sync(core &c, const macro_benchmark::synthetic_chain &chain, size_t batch_size, sync_stats &stats)
+{
+	block genesis;
+	CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(chain.blocks.front().block, genesis), false, "Invalid genesis block");
+	CHECK_AND_ASSERT_MES(c.set_genesis_block(genesis), false, "Failed to add the genesis block");
+
+	stats = sync_stats();
+	std::vector<uint64_t> batch_us;
+	uint64_t total_us = 0;
+	std::list<block_complete_entry>::const_iterator it = std::next(chain.blocks.begin());
+	while(it != chain.blocks.end())
+	{
+		std::list<block_complete_entry> batch;
+		for(; it != chain.blocks.end() && batch.size() < batch_size; ++it)
+			batch.push_back(*it);
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		CHECK_AND_ASSERT_MES(c.prepare_handle_incoming_blocks(batch), false, "Failed to prepare blocks");
+		bool ok = true;
+		for(const block_complete_entry &entry : batch)
+		{
+			std::vector<tx_verification_context> tvc;
+			c.handle_incoming_txs(entry.txs, tvc, true, true, false);
+			for(const tx_verification_context &v : tvc)
+				ok &= !v.m_verifivation_failed;
+
+			block_verification_context bvc = boost::value_initialized<block_verification_context>();
+			if(ok)
+				c.handle_incoming_block(entry.block, bvc, false);
+			if(!ok || bvc.m_verifivation_failed || !bvc.m_added_to_main_chain)
+			{
+				MERROR("Block " << c.get_current_blockchain_height() << " was rejected");
+				ok = false;
+				break;
+			}
+			++stats.blocks;
+			stats.txs += entry.txs.size();
+		}
+		ok &= c.cleanup_handle_incoming_blocks();
+		if(!ok)
+			return false;
+
+		batch_us.push_back(elapsed_us(start));
+		total_us += batch_us.back();
+	}
+
+	stats.seconds = total_us / 1e6;
+	stats.blocks_per_second = total_us ? stats.blocks * 1e6 / total_us : 0;
+	stats.txs_per_second = total_us ? stats.txs * 1e6 / total_us : 0;
+	stats.batches = summarize(batch_us);
+	return true;
+}
+
+// calls the server's http handler directly, so requests go through the uri map and serialization but no socket
+class rpc_client
+{
+  public:
+	explicit rpc_client(core_rpc_server &server) : m_server(server) {}
+
+	template <typename t_command>
+	bool invoke_bin(const std::string &uri, typename t_command::request &req, typename t_command::response &res, std::vector<uint64_t> &us)
+	{
+		epee::net_utils::http::http_request_info query;
+		query.m_URI = uri;
+		query.m_http_method = epee::net_utils::http::http_method_post;
+		query.m_http_method_str = "POST";
+		CHECK_AND_ASSERT_MES(epee::serialization::store_t_to_binary(req, query.m_body), false, "Failed to serialize " << uri << " request");
+
+		std::string body;
+		if(!invoke(query, body, us))
+			return false;
+		CHECK_AND_ASSERT_MES(epee::serialization::load_t_from_binary(res, body), false, "Failed to parse " << uri << " response");
+		CHECK_AND_ASSERT_MES(res.status == CORE_RPC_STATUS_OK, false, uri << " failed: " << res.status);
+		return true;
+	}
+
+	template <typename t_command>
+	bool invoke_json_rpc(const std::string &method, const typename t_command::request &params, typename t_command::response &res, std::vector<uint64_t> &us)
+	{
+		epee::json_rpc::request<typename t_command::request> req = AUTO_VAL_INIT(req);
+		req.jsonrpc = "2.0";
+		req.id = epee::serialization::storage_entry(0);
+		req.method = method;
+		req.params = params;
+
+		epee::net_utils::http::http_request_info query;
+		query.m_URI = "/json_rpc";
+		query.m_http_method = epee::net_utils::http::http_method_post;
+		query.m_http_method_str = "POST";
+		CHECK_AND_ASSERT_MES(epee::serialization::store_t_to_json(req, query.m_body), false, "Failed to serialize " << method << " request");
+
+		std::string body;
+		if(!invoke(query, body, us))
+			return false;
+		epee::json_rpc::response<typename t_command::response, epee::json_rpc::error> resp = AUTO_VAL_INIT(resp);
+		CHECK_AND_ASSERT_MES(epee::serialization::load_t_from_json(resp, body), false, "Failed to parse " << method << " response");
+		CHECK_AND_ASSERT_MES(resp.error.code == 0, false, method << " failed: " << resp.error.message);
+		CHECK_AND_ASSERT_MES(resp.result.status == CORE_RPC_STATUS_OK, false, method << " failed: " << resp.result.status);
+		res = std::move(resp.result);
+		return true;
+	}
+
+  private:
+	bool invoke(const epee::net_utils::http::http_request_info &query, std::string &body, std::vector<uint64_t> &us)
+	{
+		epee::net_utils::http::http_response_info response;
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		m_server.handle_http_request(query, response, m_context);
+		us.push_back(elapsed_us(start));
+		CHECK_AND_ASSERT_MES(response.m_response_code == 200, false, query.m_URI << " returned " << response.m_response_code);
+		body = std::move(response.m_body);
+		return true;
+	}
+
+	core_rpc_server &m_server;
+	core_rpc_server::connection_context m_context;
+};
+
+// what a refreshing wallet, a wallet picking decoys and a pool ask for
+bool run_rpc(core &c, core_rpc_server &server, const macro_benchmark::synthetic_chain &chain, size_t requests, size_t outs_per_request, uint64_t seed, rpc_stats &stats)
+{
+	rpc_client client(server);
+	Blockchain &bc = c.get_blockchain_storage();
+	const uint64_t height = bc.get_current_blockchain_height();
+	const crypto::hash genesis = bc.get_block_id_by_height(0);
+
+	std::vector<uint64_t> us;
+	uint64_t start_height = 0;
+	for(size_t i = 0; i < requests; ++i)
+	{
+		COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
+		COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
+		req.block_ids.push_back(bc.get_block_id_by_height(start_height));
+		if(start_height != 0)
+			req.block_ids.push_back(genesis);
+		req.start_height = start_height;
+		req.prune = true;
+		if(!client.invoke_bin<COMMAND_RPC_GET_BLOCKS_FAST>("/getblocks.bin", req, res, us))
+			return false;
+		start_height = res.start_height + res.blocks.size() - 1;
+		if(res.blocks.size() <= 1 || start_height + 1 >= height)
+			start_height = 0;
+	}
+	stats.get_blocks_bin = summarize(us);
+
+	us.clear();
+	std::mt19937_64 rng(seed);
+	std::uniform_int_distribution<uint64_t> pick(0, bc.get_db().get_num_outputs(0) - 1);
+	for(size_t i = 0; i < requests; ++i)
+	{
+		COMMAND_RPC_GET_OUTPUTS_BIN::request req = AUTO_VAL_INIT(req);
+		COMMAND_RPC_GET_OUTPUTS_BIN::response res = AUTO_VAL_INIT(res);
+		for(size_t n = 0; n < outs_per_request; ++n)
+			req.outputs.push_back({0, pick(rng)});
+		if(!client.invoke_bin<COMMAND_RPC_GET_OUTPUTS_BIN>("/get_outs.bin", req, res, us))
+			return false;
+	}
+	stats.get_outs_bin = summarize(us);
+
+	us.clear();
+	for(size_t i = 0; i < requests; ++i)
+	{
+		COMMAND_RPC_GETBLOCKTEMPLATE::request req = AUTO_VAL_INIT(req);
+		COMMAND_RPC_GETBLOCKTEMPLATE::response res = AUTO_VAL_INIT(res);
+		req.reserve_size = 8;
+		req.wallet_address = chain.miner_address;
+		if(!client.invoke_json_rpc<COMMAND_RPC_GETBLOCKTEMPLATE>("getblocktemplate", req, res, us))
+			return false;
+	}
+	stats.getblocktemplate = summarize(us);
+	return true;
+}
+
+// a wallet holding transfers outputs over two accounts, as if received from random senders
+void make_wallet(const std::string &filename, size_t transfers, tools::wallet2 &wallet)
+{
+	wallet.generate_legacy(filename, "", crypto::secret_key(), false);
+	wallet.add_subaddress(0, "");
+	wallet.add_subaddress_account("");
+	wallet.add_subaddress(1, "");
+
+	std::vector<tools::wallet2::transfer_details> outputs;
+	for(size_t i = 0; i < transfers; ++i)
+	{
+		const subaddress_index index = {(uint32_t)(i % 4 / 2), (uint32_t)(i % 2)};
+		const account_public_address addr = wallet.get_subaddress(index);
+		const keypair tx_key = keypair::generate(hw::get_device("default"));
+		crypto::public_key tx_pub_key = tx_key.pub;
+		if(!index.is_zero())
+			tx_pub_key = rct::rct2pk(rct::scalarmultKey(rct::pk2rct(addr.m_spend_public_key), rct::sk2rct(tx_key.sec)));
+		crypto::key_derivation derivation;
+		crypto::public_key out_key;
+		crypto::generate_key_derivation(addr.m_view_public_key, tx_key.sec, derivation);
+		crypto::derive_public_key(derivation, 0, addr.m_spend_public_key, out_key);
+
+		tools::wallet2::transfer_details td = AUTO_VAL_INIT(td);
+		td.m_tx.vout.push_back(tx_out{(i + 1) * 1000000, txout_to_key(out_key)});
+		add_tx_pub_key_to_extra(td.m_tx, tx_pub_key);
+		td.m_txid = crypto::rand<crypto::hash>();
+		td.m_block_height = i + 1;
+		td.m_global_output_index = i;
+		td.m_amount = td.m_tx.vout[0].amount;
+		td.m_rct = i % 2 == 1;
+		td.m_subaddr_index = index;
+		outputs.push_back(td);
+	}
+	wallet.import_outputs(outputs);
+}
+
+// readers share the wallet lock, the writer takes it exclusively, requests go over the server's sockets
+bool run_wallet_rpc(const boost::filesystem::path &dir, size_t transfers, size_t readers, size_t requests, wallet_rpc_stats &stats)
+{
+	std::unique_ptr<tools::wallet2> wallet(new tools::wallet2(MAINNET));
+	make_wallet((dir / "wallet").string(), transfers, *wallet);
+
+	po::options_description desc;
+	tools::wallet_rpc_server::init_options(desc);
+	po::variables_map vm;
+	po::store(po::command_line_parser(std::vector<std::string>{"--rpc-bind-port=0", "--disable-rpc-login", "--rpc-threads=" + std::to_string(readers + 1)}).options(desc).run(), vm);
+	po::notify(vm);
+
+	tools::wallet_rpc_server server(MAINNET);
+	server.start_wallet_backend(std::move(wallet));
+	CHECK_AND_ASSERT_MES(server.init(&vm), false, "Failed to init the wallet RPC server");
+	const std::string port = std::to_string(server.get_binded_port());
+	std::thread server_thread([&server]() { server.run(); });
+
+	std::atomic<bool> ok(true);
+	std::atomic<size_t> readers_left(0);
+	auto read = [&](std::vector<uint64_t> &us) {
+		epee::net_utils::http::http_simple_client client;
+		client.set_server("127.0.0.1", port, boost::none);
+		for(size_t i = 0; i < requests && ok; ++i)
+		{
+			bool r;
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if(i % 3 == 0)
+			{
+				tools::wallet_rpc::COMMAND_RPC_GET_BALANCE::request req = AUTO_VAL_INIT(req);
+				tools::wallet_rpc::COMMAND_RPC_GET_BALANCE::response res = AUTO_VAL_INIT(res);
+				r = epee::net_utils::invoke_http_json_rpc("/json_rpc", "get_balance", req, res, client);
+			}
+			else if(i % 3 == 1)
+			{
+				tools::wallet_rpc::COMMAND_RPC_INCOMING_TRANSFERS::request req = AUTO_VAL_INIT(req);
+				tools::wallet_rpc::COMMAND_RPC_INCOMING_TRANSFERS::response res = AUTO_VAL_INIT(res);
+				req.transfer_type = "available";
+				r = epee::net_utils::invoke_http_json_rpc("/json_rpc", "incoming_transfers", req, res, client);
+			}
+			else
+			{
+				tools::wallet_rpc::COMMAND_RPC_GET_HEIGHT::request req = AUTO_VAL_INIT(req);
+				tools::wallet_rpc::COMMAND_RPC_GET_HEIGHT::response res = AUTO_VAL_INIT(res);
+				r = epee::net_utils::invoke_http_json_rpc("/json_rpc", "get_height", req, res, client);
+			}
+			us.push_back(elapsed_us(start));
+			if(!r)
+			{
+				MERROR("Wallet RPC read " << i << " failed");
+				ok = false;
+			}
+		}
+		--readers_left;
+	};
+	auto write = [&](std::vector<uint64_t> &us) {
+		epee::net_utils::http::http_simple_client client;
+		client.set_server("127.0.0.1", port, boost::none);
+		for(size_t i = 0; readers_left && ok; ++i)
+		{
+			bool r;
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if(i % 3 == 0)
+			{
+				tools::wallet_rpc::COMMAND_RPC_SET_ATTRIBUTE::request req = AUTO_VAL_INIT(req);
+				tools::wallet_rpc::COMMAND_RPC_SET_ATTRIBUTE::response res = AUTO_VAL_INIT(res);
+				req.key = "macro_benchmark";
+				req.value = std::to_string(i);
+				r = epee::net_utils::invoke_http_json_rpc("/json_rpc", "set_attribute", req, res, client);
+			}
+			else if(i % 3 == 1)
+			{
+				tools::wallet_rpc::COMMAND_RPC_LABEL_ADDRESS::request req = AUTO_VAL_INIT(req);
+				tools::wallet_rpc::COMMAND_RPC_LABEL_ADDRESS::response res = AUTO_VAL_INIT(res);
+				req.index = {0, 1};
+				req.label = std::to_string(i);
+				r = epee::net_utils::invoke_http_json_rpc("/json_rpc", "label_address", req, res, client);
+			}
+			else
+			{
+				tools::wallet_rpc::COMMAND_RPC_STORE::request req = AUTO_VAL_INIT(req);
+				tools::wallet_rpc::COMMAND_RPC_STORE::response res = AUTO_VAL_INIT(res);
+				r = epee::net_utils::invoke_http_json_rpc("/json_rpc", "store", req, res, client);
+			}
+			us.push_back(elapsed_us(start));
+			if(!r)
+			{
+				MERROR("Wallet RPC write " << i << " failed");
+				ok = false;
+			}
+		}
+	};
+
+	// readers alone first, then the same readers next to a writer
+	for(size_t phase = 0; phase < 2 && ok; ++phase)
+	{
+		std::vector<std::vector<uint64_t>> read_us(readers);
+		std::vector<uint64_t> write_us;
+		std::vector<std::thread> threads;
+		readers_left = readers;
+		for(size_t n = 0; n < readers; ++n)
+			threads.emplace_back(read, std::ref(read_us[n]));
+		if(phase == 1)
+			threads.emplace_back(write, std::ref(write_us));
+		for(std::thread &t : threads)
+			t.join();
+
+		std::vector<uint64_t> us;
+		for(const std::vector<uint64_t> &v : read_us)
+			us.insert(us.end(), v.begin(), v.end());
+		if(phase == 0)
+		{
+			stats.reads = summarize(us);
+		}
+		else
+		{
+			stats.contended_reads = summarize(us);
+			stats.writes = summarize(write_us);
+		}
+	}
+
+	server.send_stop_signal();
+	server_thread.join();
+	server.stop_wallet_backend();
+	stats.transfers = transfers;
+	stats.readers = readers;
+	return ok;
+}
+}
+
+int main(int argc, char *argv[])
+{
+	TRY_ENTRY();
+	tools::on_startup();
+	epee::string_tools::set_module_name_and_folder(argv[0]);
+	mlog_configure(mlog_get_default_log_path("macro_benchmark.log"), true);
+
+	po::options_description desc_options("Allowed options");
+	command_line::add_arg(desc_options, command_line::arg_help);
+	command_line::add_arg(desc_options, arg_chain_file);
+	command_line::add_arg(desc_options, arg_blocks);
+	command_line::add_arg(desc_options, arg_txs_per_block);
+	command_line::add_arg(desc_options, arg_ring_size);
+	command_line::add_arg(desc_options, arg_min_inputs);
+	command_line::add_arg(desc_options, arg_max_inputs);
+	command_line::add_arg(desc_options, arg_outputs);
+	command_line::add_arg(desc_options, arg_seed);
+	command_line::add_arg(desc_options, arg_sync_batch);
+	command_line::add_arg(desc_options, arg_rpc_requests);
+	command_line::add_arg(desc_options, arg_wallet_transfers);
+	command_line::add_arg(desc_options, arg_wallet_readers);
+	command_line::add_arg(desc_options, arg_output);
+	command_line::add_arg(desc_options, arg_metrics_file);
+	core::init_options(desc_options);
+	core_rpc_server::init_options(desc_options);
+
+	// without --data-dir the db goes to a temporary directory, removed after the run
+	const boost::filesystem::path temp_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	po::variables_map vm;
+	bool r = command_line::handle_error_helper(desc_options, [&]() {
+		po::store(po::parse_command_line(argc, argv, desc_options), vm);
+		if(command_line::is_arg_defaulted(vm, arg_data_dir))
+			po::store(po::command_line_parser(std::vector<std::string>{"--" + std::string(arg_data_dir.name) + "=" + temp_dir.string()}).options(desc_options).run(), vm);
+		po::notify(vm);
+		return true;
+	});
+	if(!r)
+		return 1;
+
+	if(command_line::get_arg(vm, command_line::arg_help))
+	{
+		std::cout << desc_options << std::endl;
+		return 0;
+	}
+
+	const size_t sync_batch = command_line::get_arg(vm, arg_sync_batch);
+	CHECK_AND_ASSERT_MES(sync_batch > 0, 1, "--sync-batch must be at least 1");
+
+	macro_benchmark::synthetic_chain chain;
+	if(!get_chain(vm, chain))
+	{
+		MERROR("Failed to get the chain");
+		return 1;
+	}
+
+	core c(nullptr);
+	t_cryptonote_protocol_handler<core> protocol(c, nullptr, true);
+	p2p_server p2p(protocol);
+	protocol.set_p2p_endpoint(&p2p);
+	c.set_cryptonote_protocol(&protocol);
+	if(!c.init(vm, nullptr, &benchmark_test_options))
+	{
+		MERROR("Failed to init core");
+		return 1;
+	}
+
+	benchmark_report report = AUTO_VAL_INIT(report);
+	report.chain = chain.params;
+	report.sync_batch = sync_batch;
+	bool ok = run_sync(c, chain, sync_batch, report.sync);
+	if(ok)
+	{
+		MGINFO("Synced " << report.sync.blocks << " blocks, " << report.sync.txs << " txs in " << report.sync.seconds << " s");
+		core_rpc_server rpc(c, p2p);
+		ok = rpc.init(vm, false, MAINNET, "0");
+		if(ok)
+		{
+			ok = run_rpc(c, rpc, chain, command_line::get_arg(vm, arg_rpc_requests), command_line::get_arg(vm, arg_ring_size) * command_line::get_arg(vm, arg_max_inputs),
+						 command_line::get_arg(vm, arg_seed), report.rpc);
+			rpc.deinit();
+		}
+		else
+		{
+			MERROR("Failed to init the RPC server");
+		}
+	}
+	if(ok)
+	{
+		const boost::filesystem::path wallet_dir = temp_dir / "wallet";
+		boost::filesystem::create_directories(wallet_dir);
+		ok = run_wallet_rpc(wallet_dir, command_line::get_arg(vm, arg_wallet_transfers), std::max<size_t>(command_line::get_arg(vm, arg_wallet_readers), 1),
+							command_line::get_arg(vm, arg_rpc_requests), report.wallet_rpc);
+	}
+
+	c.deinit();
+	c.set_cryptonote_protocol(nullptr);
+	protocol.set_p2p_endpoint(nullptr);
+	boost::system::error_code ec;
+	boost::filesystem::remove_all(temp_dir, ec);
+	if(!ok)
+		return 1;
+
+	const std::string json = epee::serialization::store_t_to_json(report);
+	std::cout << json << std::endl;
+	const std::string output = command_line::get_arg(vm, arg_output);
+	if(!output.empty() && !epee::file_io_utils::save_string_to_file(output, json))
+	{
+		MERROR("Failed to write " << output);
+		return 1;
+	}
+	const std::string metrics_file = command_line::get_arg(vm, arg_metrics_file);
+	if(!metrics_file.empty() && !epee::file_io_utils::save_string_to_file(metrics_file, tools::metrics::export_text()))
+	{
+		MERROR("Failed to write " << metrics_file);
+		return 1;
+	}
+	return 0;
+
+	CATCH_ENTRY_L0("main", 1);
+}
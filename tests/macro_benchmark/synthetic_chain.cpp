@@ -0,0 +1,257 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "synthetic_chain.h"
+#include "../core_tests/chaingen.h"
+#include "device/device.hpp"
+#include "file_io_utils.h"
+#include "ringct/rctSigs.h"
+#include "storages/portable_storage_template_helper.h"
+#include <algorithm>
+#include <random>
+#include <set>
+#include <sstream>
+
+using namespace cryptonote;
+
+namespace macro_benchmark
+{
+namespace
+{
+constexpr uint64_t CHAIN_START_TIMESTAMP = 1338224400;
+constexpr uint64_t TX_FEE = common_config::FEE_PER_KB * 64;
+
+struct chain_output
+{
+	crypto::public_key key;
+	rct::key commitment;
+	uint64_t unlock_height; // first height whose transactions may use it
+};
+
+struct wallet_output
+{
+	uint64_t global_index;
+	crypto::public_key tx_pub_key;
+	size_t index_in_tx;
+	uint64_t amount;
+	rct::key mask;
+	bool coinbase;
+	uint64_t spendable_height;
+};
+
+class chain_builder
+{
+  public:
+	chain_builder(const chain_params &params, synthetic_chain &chain) : m_params(params), m_chain(chain), m_rng(params.seed), m_height(0)
+	{
+		m_wallet.generate_new(false);
+		m_subaddresses[m_wallet.get_keys().m_account_address.m_spend_public_key] = {0, 0};
+	}
+
+	bool build()
+	{
+		m_chain.params = m_params.describe();
+		m_chain.miner_address = m_wallet.get_public_address_str(MAINNET);
+		m_chain.txs = 0;
+		m_chain.blocks.clear();
+
+		const size_t total = 1 + m_params.warmup_blocks() + m_params.blocks;
+		while(m_height < total)
+		{
+			std::list<transaction> txs;
+			while(m_height > m_params.warmup_blocks() && txs.size() < m_params.txs_per_block)
+			{
+				transaction tx;
+				if(!build_tx(tx))
+					break;
+				txs.push_back(tx);
+			}
+			if(!add_block(txs))
+				return false;
+			if(m_height % 100 == 0)
+				MGINFO("Generated " << m_height << "/" << total << " blocks, " << m_chain.txs << " txs");
+		}
+		return true;
+	}
+
+  private:
+	bool add_block(const std::list<transaction> &txs)
+	{
+		block blk;
+		const bool r = m_height == 0 ? m_generator.construct_block(blk, m_wallet, CHAIN_START_TIMESTAMP) : m_generator.construct_block(blk, m_prev, m_wallet, txs);
+		CHECK_AND_ASSERT_MES(r, false, "Failed to construct block " << m_height);
+
+		// outputs in the order the db indexes them, miner tx first
+		for(size_t o = 0; o < blk.miner_tx.vout.size(); ++o)
+		{
+			const tx_out &out = blk.miner_tx.vout[o];
+			m_outputs.push_back({boost::get<txout_to_key>(out.target).key, rct::zeroCommit(out.amount), m_height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW});
+			if(o == 0) // the other output is the dev fund's
+				m_owned.push_back({m_outputs.size() - 1, get_tx_pub_key_from_extra(blk.miner_tx), o, out.amount, rct::identity(), true, m_height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW});
+		}
+
+		block_complete_entry entry;
+		entry.block = block_to_blob(blk);
+		for(const transaction &tx : txs)
+		{
+			if(!add_tx_outputs(tx))
+				return false;
+			entry.txs.push_back(tx_to_blob(tx));
+		}
+		m_chain.blocks.push_back(std::move(entry));
+		m_chain.txs += txs.size();
+		m_prev = blk;
+		++m_height;
+		return true;
+	}
+
+	bool add_tx_outputs(const transaction &tx)
+	{
+		const crypto::public_key tx_pub_key = get_tx_pub_key_from_extra(tx);
+		crypto::key_derivation derivation;
+		CHECK_AND_ASSERT_MES(crypto::generate_key_derivation(tx_pub_key, m_wallet.get_keys().m_view_secret_key, derivation), false, "Failed to generate key derivation");
+		for(size_t o = 0; o < tx.vout.size(); ++o)
+		{
+			m_outputs.push_back({boost::get<txout_to_key>(tx.vout[o].target).key, tx.rct_signatures.outPk[o].mask, m_height + 1});
+
+			crypto::secret_key amount_key;
+			crypto::derivation_to_scalar(derivation, o, amount_key);
+			rct::key mask;
+			const uint64_t amount = tx.rct_signatures.type == rct::RCTTypeFull ? rct::decodeRct(tx.rct_signatures, rct::sk2rct(amount_key), o, mask, hw::get_device("default")) : rct::decodeRctSimple(tx.rct_signatures, rct::sk2rct(amount_key), o, mask, hw::get_device("default"));
+			m_owned.push_back({m_outputs.size() - 1, tx_pub_key, o, amount, mask, false, m_height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE});
+		}
+		return true;
+	}
+
+	bool fill_ring(const wallet_output &real, tx_source_entry &src)
+	{
+		std::set<uint64_t> ring = {real.global_index};
+		std::uniform_int_distribution<uint64_t> pick(0, m_outputs.size() - 1);
+		for(size_t attempts = 0; ring.size() < m_params.ring_size; ++attempts)
+		{
+			if(attempts > 100 * m_params.ring_size)
+				return false;
+			const uint64_t gi = pick(m_rng);
+			if(m_outputs[gi].unlock_height <= m_height)
+				ring.insert(gi);
+		}
+
+		for(uint64_t gi : ring)
+		{
+			if(gi == real.global_index)
+				src.real_output = src.outputs.size();
+			src.outputs.push_back({gi, rct::ctkey({rct::pk2rct(m_outputs[gi].key), m_outputs[gi].commitment})});
+		}
+		src.real_out_tx_key = real.tx_pub_key;
+		src.real_output_in_tx_index = real.index_in_tx;
+		src.amount = real.amount;
+		src.rct = !real.coinbase;
+		src.mask = real.mask;
+		return true;
+	}
+
+	bool build_tx(transaction &tx)
+	{
+		std::vector<size_t> spendable;
+		for(size_t i = 0; i < m_owned.size(); ++i)
+		{
+			if(m_owned[i].spendable_height <= m_height && m_owned[i].amount > TX_FEE)
+				spendable.push_back(i);
+		}
+		const size_t inputs = std::uniform_int_distribution<size_t>(m_params.min_inputs, m_params.max_inputs)(m_rng);
+		if(spendable.size() < inputs)
+			return false;
+		std::shuffle(spendable.begin(), spendable.end(), m_rng);
+		spendable.resize(inputs);
+
+		std::vector<tx_source_entry> sources(inputs);
+		uint64_t amount_in = 0;
+		for(size_t i = 0; i < inputs; ++i)
+		{
+			if(!fill_ring(m_owned[spendable[i]], sources[i]))
+				return false;
+			amount_in += m_owned[spendable[i]].amount;
+		}
+
+		const uint64_t amount_out = amount_in - TX_FEE;
+		std::vector<tx_destination_entry> destinations;
+		for(size_t o = 0; o < m_params.outputs; ++o)
+		{
+			const uint64_t amount = o + 1 < m_params.outputs ? amount_out / m_params.outputs : amount_out - amount_out / m_params.outputs * o;
+			destinations.push_back(tx_destination_entry(amount, m_wallet.get_keys().m_account_address, false));
+		}
+
+		crypto::secret_key tx_key;
+		std::vector<crypto::secret_key> additional_tx_keys;
+		if(!construct_tx_and_get_tx_key(m_wallet.get_keys(), m_subaddresses, sources, destinations, boost::none, nullptr, tx, 0, tx_key, additional_tx_keys, false))
+		{
+			MERROR("Failed to construct transaction at height " << m_height);
+			return false;
+		}
+
+		std::sort(spendable.begin(), spendable.end(), std::greater<size_t>());
+		for(size_t i : spendable)
+			m_owned.erase(m_owned.begin() + i);
+		return true;
+	}
+
+	const chain_params &m_params;
+	synthetic_chain &m_chain;
+	std::mt19937_64 m_rng;
+	test_generator m_generator;
+	account_base m_wallet;
+	std::unordered_map<crypto::public_key, subaddress_index> m_subaddresses;
+	std::vector<chain_output> m_outputs; // by global index, all of them are amount 0 outputs
+	std::vector<wallet_output> m_owned;
+	block m_prev;
+	uint64_t m_height;
+};
+}
+
+size_t chain_params::warmup_blocks() const
+{
+	return CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW + std::max(ring_size, txs_per_block * max_inputs);
+}
+
+std::string chain_params::describe() const
+{
+	std::stringstream ss;
+	ss << "blocks=" << blocks << ",txs_per_block=" << txs_per_block << ",ring_size=" << ring_size
+	   << ",inputs=" << min_inputs << "-" << max_inputs << ",outputs=" << outputs << ",seed=" << seed;
+	return ss.str();
+}
+
+bool generate_chain(const chain_params &params, synthetic_chain &chain)
+{
+	CHECK_AND_ASSERT_MES(params.ring_size >= common_config::MIN_MIXIN_V1 + 1 && params.ring_size <= common_config::MAX_MIXIN + 1, false, "Ring size must be between " << common_config::MIN_MIXIN_V1 + 1 << " and " << common_config::MAX_MIXIN + 1);
+	CHECK_AND_ASSERT_MES(params.min_inputs >= 1 && params.min_inputs <= params.max_inputs, false, "Invalid input count range");
+	CHECK_AND_ASSERT_MES(params.outputs >= 1, false, "Transactions need at least one output");
+
+	chain_builder builder(params, chain);
+	return builder.build();
+}
+
+bool load_chain(const std::string &filename, synthetic_chain &chain)
+{
+	return epee::serialization::load_t_from_binary_file(chain, filename);
+}
+
+bool store_chain(const std::string &filename, synthetic_chain &chain)
+{
+	std::string blob;
+	if(!epee::serialization::store_t_to_binary(chain, blob))
+		return false;
+	return epee::file_io_utils::save_string_to_file(filename, blob);
+}
+}
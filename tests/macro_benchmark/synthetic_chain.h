@@ -0,0 +1,65 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "serialization/keyvalue_serialization.h"
+#include <list>
+#include <stdint.h>
+#include <string>
+
+namespace macro_benchmark
+{
+struct chain_params
+{
+	size_t blocks;		  // blocks carrying transactions, after the warm-up
+	size_t txs_per_block; // upper bound, a block gets fewer when the wallet runs short of unlocked outputs
+	size_t ring_size;
+	size_t min_inputs;
+	size_t max_inputs;
+	size_t outputs;
+	uint64_t seed; // transaction mix and decoy selection
+
+	// blocks mined before the first transaction, so that rings can be filled with unlocked outputs
+	size_t warmup_blocks() const;
+	std::string describe() const;
+};
+
+/*
+ * A chain built by the core_tests generator: every transaction spends outputs of a single
+ * wallet back to itself, with decoys picked from all the outputs unlocked at that height.
+ *
+ * Keys and signatures come from the system RNG, so a chain is only reproducible through its
+ * file; runs to be compared should replay the same file.
+ */
+struct synthetic_chain
+{
+	std::string params;
+	std::string miner_address; // the wallet, mainnet format, for getblocktemplate
+	uint64_t txs;
+	std::list<cryptonote::block_complete_entry> blocks; // genesis first
+
+	BEGIN_KV_SERIALIZE_MAP()
+	KV_SERIALIZE(params)
+	KV_SERIALIZE(miner_address)
+	KV_SERIALIZE(txs)
+	KV_SERIALIZE(blocks)
+	END_KV_SERIALIZE_MAP()
+};
+
+bool generate_chain(const chain_params &params, synthetic_chain &chain);
+bool load_chain(const std::string &filename, synthetic_chain &chain);
+bool store_chain(const std::string &filename, synthetic_chain &chain);
+}
@@ -0,0 +1,167 @@
+// Copyright (c) 2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <chrono>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "common/util.h"
+#include "include_base_utils.h"
+#include "misc_log_ex.h"
+
+#include "net_load_tests.h"
+
+using namespace net_load_tests;
+
+// Feeds pipelined levin packets straight into async_protocol_handler::handle_recv,
+// the way a connection does after each socket read, and reports how fast the
+// receive path gets through them. No sockets are involved, so the numbers are
+// the framing cost alone.
+namespace
+{
+const size_t SOCKET_READ_SIZE = 8192; // same as the read buffer in net::connection
+const int test_command = 38412;
+
+struct counting_commands_handler : public test_levin_commands_handler
+{
+	counting_commands_handler() : m_notify_count(0), m_notify_bytes(0) {}
+
+	virtual int notify(int command, const std::string &in_buff, test_connection_context &context)
+	{
+		if(command == test_command)
+		{
+			++m_notify_count;
+			m_notify_bytes += in_buff.size();
+		}
+		return LEVIN_OK;
+	}
+
+	size_t m_notify_count;
+	size_t m_notify_bytes;
+};
+
+class recv_endpoint : public epee::net_utils::i_service_endpoint
+{
+  public:
+	recv_endpoint(test_levin_protocol_handler_config &config) : m_protocol_handler(this, config, m_context) {}
+
+	virtual bool do_send(const void *ptr, size_t cb) { return true; }
+	virtual bool close() { return true; }
+	virtual bool call_run_once_service_io() { return true; }
+	virtual bool request_callback() { return true; }
+	virtual boost::asio::io_service &get_io_service() { return m_io_service; }
+	virtual bool add_ref() { return true; }
+	virtual bool release() { return true; }
+
+	test_levin_protocol_handler m_protocol_handler;
+
+  private:
+	boost::asio::io_service m_io_service;
+	test_connection_context m_context;
+};
+
+class net_load_test_recv : public ::testing::Test
+{
+  protected:
+	virtual void SetUp()
+	{
+		m_pcommands_handler = new counting_commands_handler();
+		m_handler_config.set_handler(m_pcommands_handler, [](epee::levin::levin_commands_handler<test_connection_context> *handler) { delete handler; });
+		m_handler_config.m_max_packet_size = LEVIN_DEFAULT_MAX_PACKET_SIZE;
+	}
+
+	static std::string make_burst(size_t packet_count, size_t body_size)
+	{
+		epee::levin::bucket_head2 head = AUTO_VAL_INIT(head);
+		head.m_signature = LEVIN_SIGNATURE;
+		head.m_cb = body_size;
+		head.m_have_to_return_data = false;
+		head.m_command = test_command;
+		head.m_flags = LEVIN_PACKET_REQUEST;
+		head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+
+		std::string packet((const char *)&head, sizeof(head));
+		packet.append(body_size, 'b');
+		std::string burst;
+		burst.reserve(packet.size() * packet_count);
+		for(size_t i = 0; i < packet_count; ++i)
+			burst += packet;
+		return burst;
+	}
+
+	// read_size == 0 hands the whole burst over in one call
+	void run(const char *name, size_t packet_count, size_t body_size, size_t read_size)
+	{
+		const std::string burst = make_burst(packet_count, body_size);
+		recv_endpoint endpoint(m_handler_config);
+
+		auto start = std::chrono::steady_clock::now();
+		if(read_size == 0)
+			read_size = burst.size();
+		for(size_t pos = 0; pos < burst.size(); pos += read_size)
+			ASSERT_TRUE(endpoint.m_protocol_handler.handle_recv(burst.data() + pos, std::min(read_size, burst.size() - pos)));
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+		ASSERT_EQ(packet_count, m_pcommands_handler->m_notify_count);
+		ASSERT_EQ(packet_count * body_size, m_pcommands_handler->m_notify_bytes);
+		double mb_per_s = elapsed ? burst.size() / (double)elapsed : 0;
+		MGINFO(name << ": " << packet_count << " packets of " << body_size << " bytes in " << elapsed << " us, " << mb_per_s << " MB/s");
+	}
+
+	test_levin_protocol_handler_config m_handler_config;
+	counting_commands_handler *m_pcommands_handler;
+};
+}
+
+TEST_F(net_load_test_recv, small_packets_in_socket_sized_reads)
+{
+	run("small packets", 200000, 128, SOCKET_READ_SIZE);
+}
+
+TEST_F(net_load_test_recv, large_packets_in_socket_sized_reads)
+{
+	run("large packets", 100, 2 * 1024 * 1024, SOCKET_READ_SIZE);
+}
+
+TEST_F(net_load_test_recv, pipelined_burst_in_one_read)
+{
+	// the shape of a sync burst of NOTIFY_RESPONSE_GET_OBJECTS: many packets
+	// already buffered, the whole lot delivered at once
+	run("one read burst", 20000, 4096, 0);
+}
+
+int main(int argc, char **argv)
+{
+	tools::on_startup();
+	epee::debug::get_set_enable_assert(true, false);
+	mlog_configure(mlog_get_default_log_path("net_load_tests_recv.log"), true);
+
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -54,6 +54,7 @@
 #include "generate_keypair.h"
 #include "is_out_to_acc.h"
 #include "multiexp.h"
+#include "portable_storage.h"
 #include "range_proof.h"
 #include "rct_mlsag.h"
 #include "rct_mlsag.h"
@@ -61,6 +62,7 @@
 #include "sc_reduce32.h"
 #include "signature.h"
 #include "subaddress_expand.h"
+#include "txpool_contention.h"
 
 namespace po = boost::program_options;
 
@@ -113,6 +115,12 @@ int main(int argc, char **argv)
 	TEST_PERFORMANCE2(filter, p, test_construct_tx, 100, 2);
 	TEST_PERFORMANCE2(filter, p, test_construct_tx, 100, 10);
 
+	// sweep sized: many inputs, and the widest bulletproof
+	TEST_PERFORMANCE2(filter, p, test_construct_tx, 150, 1);
+	TEST_PERFORMANCE2(filter, p, test_construct_tx, 150, 2);
+	TEST_PERFORMANCE2(filter, p, test_construct_tx, 2, 16);
+	TEST_PERFORMANCE2(filter, p, test_construct_tx, 10, 16);
+
 	TEST_PERFORMANCE3(filter, p, test_check_tx_signature, 2, 2, false);
 	TEST_PERFORMANCE3(filter, p, test_check_tx_signature, 10, 2, false);
 	TEST_PERFORMANCE3(filter, p, test_check_tx_signature, 100, 2, false);
@@ -148,8 +156,17 @@ int main(int argc, char **argv)
 	TEST_PERFORMANCE1(filter, p, test_signature, false);
 	TEST_PERFORMANCE1(filter, p, test_signature, true);
 
+	TEST_PERFORMANCE2(filter, p, test_txpool_contention, 4, 1);
+	TEST_PERFORMANCE2(filter, p, test_txpool_contention, 4, 4);
+	TEST_PERFORMANCE2(filter, p, test_txpool_contention, 1, 8);
+
 	TEST_PERFORMANCE2(filter, p, test_wallet2_expand_subaddresses, 50, 200);
 
+	TEST_PERFORMANCE2(filter, p, test_portable_storage_get_blocks, false, false);
+	TEST_PERFORMANCE2(filter, p, test_portable_storage_get_blocks, true, false);
+	TEST_PERFORMANCE2(filter, p, test_portable_storage_get_blocks, false, true);
+	TEST_PERFORMANCE2(filter, p, test_portable_storage_get_blocks, true, true);
+
 	TEST_PERFORMANCE1(filter, p, test_cn_slow_hash, false);
 	TEST_PERFORMANCE1(filter, p, test_cn_slow_hash, true);
 	TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 32);
@@ -0,0 +1,109 @@
+// Copyright (c) 2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+
+#include "crypto/crypto.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+// Stores (load = false) or loads (load = true) a get_blocks.bin response
+// carrying 1000 blocks, either through the portable_storage section tree
+// (streaming = false) or through portable_storage_writer/reader, which work
+// on the wire buffer directly (streaming = true).
+template <bool streaming, bool load>
+class test_portable_storage_get_blocks
+{
+  public:
+	static const size_t loop_count = 20;
+	static const size_t blocks = 1000;
+	static const size_t txs_per_block = 8;
+
+	bool init()
+	{
+		for(size_t n = 0; n < blocks; ++n)
+		{
+			cryptonote::block_complete_entry bce;
+			bce.block = random_blob(200 + crypto::rand<uint8_t>());
+			cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices indices;
+			indices.indices.resize(1 + txs_per_block);
+			indices.indices[0].indices.push_back(crypto::rand<uint64_t>());
+			for(size_t t = 0; t < txs_per_block; ++t)
+			{
+				bce.txs.push_back(random_blob(1500 + crypto::rand<uint16_t>() % 2048));
+				for(size_t o = 0; o < 2; ++o)
+					indices.indices[1 + t].indices.push_back(crypto::rand<uint64_t>());
+			}
+			m_response.blocks.push_back(bce);
+			m_response.output_indices.push_back(indices);
+		}
+		m_response.start_height = 1;
+		m_response.current_height = blocks + 1;
+		m_response.status = CORE_RPC_STATUS_OK;
+		m_response.untrusted = false;
+		return epee::serialization::store_t_to_binary(m_response, m_blob);
+	}
+
+	bool test()
+	{
+		if(load)
+		{
+			cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res;
+			if(streaming)
+			{
+				epee::serialization::portable_storage_reader stg;
+				return stg.load_from_binary(m_blob) && res.load(stg) && res.blocks.size() == blocks;
+			}
+			epee::serialization::portable_storage stg;
+			return stg.load_from_binary(m_blob) && res.load(stg) && res.blocks.size() == blocks;
+		}
+		std::string blob;
+		if(streaming)
+		{
+			epee::serialization::portable_storage_writer stg;
+			m_response.store(stg);
+			return stg.store_to_binary(blob) && blob.size() == m_blob.size();
+		}
+		epee::serialization::portable_storage stg;
+		m_response.store(stg);
+		return stg.store_to_binary(blob) && blob.size() == m_blob.size();
+	}
+
+  private:
+	static std::string random_blob(size_t size)
+	{
+		std::string blob(size, '\0');
+		crypto::rand(size, (uint8_t *)&blob[0]);
+		return blob;
+	}
+
+	cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response m_response;
+	std::string m_blob;
+};
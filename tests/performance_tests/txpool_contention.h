@@ -0,0 +1,178 @@
+// Copyright (c) 2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <memory>
+#include <vector>
+
+#include "blockchain_db/blockchain_db.h"
+#include "crypto/crypto.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/tx_pool.h"
+#include "device/device.hpp"
+#include "rpc/core_rpc_server_commands_defs.h"
+
+// Drives a tx_memory_pool on a fresh LMDB chain with "RPC" readers, which ask
+// for pool stats (served from the pool snapshot) and look txs up, and "P2P"
+// writers, which add txs and take them back out as a block would. Half of the
+// incoming txs reuse a key image of a pooled tx, so key images shared by
+// several pool txs are tracked too.
+//
+// The txs have a ring size of one, so their inputs check fails early and they
+// are added as kept_by_block, the way txs of a popped block are. Validation
+// stays cheap and the run measures the pool's own locking.
+template <size_t readers, size_t writers>
+class test_txpool_contention
+{
+  public:
+	static const size_t loop_count = 50;
+	static const size_t pool_size = 2000;
+	static const size_t reads_per_thread = 200;
+	static const size_t writes_per_thread = 500;
+
+	test_txpool_contention() : m_pool(m_chain), m_chain(m_pool), m_initialized(false) {}
+
+	~test_txpool_contention()
+	{
+		if(m_initialized)
+		{
+			m_pool.deinit();
+			m_chain.deinit();
+		}
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(m_dir, ec);
+	}
+
+	bool init()
+	{
+		m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+		cryptonote::BlockchainDB *db = cryptonote::new_db("lmdb");
+		if(db == nullptr)
+			return false;
+		try
+		{
+			db->open(m_dir.string(), DBF_FAST);
+		}
+		catch(const std::exception &e)
+		{
+			std::cerr << "Failed to open the db: " << e.what() << std::endl;
+			delete db;
+			return false;
+		}
+		static const std::pair<uint8_t, uint64_t> hard_forks[] = {std::make_pair((uint8_t)1, (uint64_t)0), std::make_pair((uint8_t)0, (uint64_t)0)};
+		static const cryptonote::test_options options = {hard_forks};
+		if(!m_chain.init(db, cryptonote::FAKECHAIN, true, &options))
+			return false;
+		m_initialized = true;
+		if(!m_pool.init())
+			return false;
+
+		m_out_key = cryptonote::keypair::generate(hw::get_device("default")).pub;
+		std::vector<crypto::key_image> pooled;
+		for(size_t n = 0; n < pool_size; ++n)
+		{
+			cryptonote::transaction tx = make_tx(crypto::rand<crypto::key_image>());
+			pooled.push_back(boost::get<cryptonote::txin_to_key>(tx.vin[0]).k_image);
+			if(!add(tx))
+				return false;
+		}
+		m_incoming.resize(writers);
+		for(auto &txes : m_incoming)
+			for(size_t n = 0; n < writes_per_thread; ++n)
+				txes.push_back(make_tx(n % 2 ? pooled[crypto::rand<size_t>() % pooled.size()] : crypto::rand<crypto::key_image>()));
+		return true;
+	}
+
+	bool test()
+	{
+		std::atomic<bool> ok(true);
+		boost::thread_group threads;
+		for(size_t n = 0; n < readers; ++n)
+			threads.create_thread([this]() {
+				for(size_t i = 0; i < reads_per_thread; ++i)
+				{
+					cryptonote::txpool_stats stats = AUTO_VAL_INIT(stats);
+					m_pool.get_transaction_stats(stats);
+					m_pool.have_tx(crypto::rand<crypto::hash>());
+				}
+			});
+		for(size_t n = 0; n < writers; ++n)
+			threads.create_thread([this, n, &ok]() {
+				for(auto &tx : m_incoming[n])
+					if(!add(tx))
+						ok = false;
+				for(auto &tx : m_incoming[n])
+					if(!take(tx))
+						ok = false;
+			});
+		threads.join_all();
+		return ok;
+	}
+
+  private:
+	cryptonote::transaction make_tx(const crypto::key_image &ki) const
+	{
+		cryptonote::transaction tx;
+		tx.version = 2;
+		tx.unlock_time = 0;
+		cryptonote::txin_to_key in;
+		in.amount = 0;
+		in.key_offsets.push_back(crypto::rand<uint32_t>());
+		in.k_image = ki;
+		tx.vin.push_back(in);
+		tx.vout.push_back({0, cryptonote::txout_to_key(m_out_key)});
+		tx.rct_signatures.type = rct::RCTTypeNull;
+		return tx;
+	}
+
+	bool add(cryptonote::transaction tx)
+	{
+		cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+		return m_pool.add_tx(tx, tvc, true, false, false) && tvc.m_added_to_pool;
+	}
+
+	bool take(const cryptonote::transaction &tx)
+	{
+		cryptonote::transaction taken;
+		size_t blob_size;
+		uint64_t fee;
+		bool relayed, do_not_relay, double_spend_seen;
+		return m_pool.take_tx(cryptonote::get_transaction_hash(tx), taken, blob_size, fee, relayed, do_not_relay, double_spend_seen);
+	}
+
+	cryptonote::tx_memory_pool m_pool;
+	cryptonote::Blockchain m_chain;
+	bool m_initialized;
+	boost::filesystem::path m_dir;
+	crypto::public_key m_out_key;
+	std::vector<std::vector<cryptonote::transaction>> m_incoming;
+};
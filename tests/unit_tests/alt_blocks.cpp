@@ -0,0 +1,215 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "../core_tests/chaingen.h"
+#include "blockchain_db/blockchain_db.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/tx_pool.h"
+#include <boost/filesystem.hpp>
+#include <memory>
+#include <unordered_set>
+
+using namespace cryptonote;
+
+namespace
+{
+const std::pair<uint8_t, uint64_t> hard_forks[] = {std::make_pair((uint8_t)1, (uint64_t)0), std::make_pair((uint8_t)0, (uint64_t)0)};
+const test_options alt_blocks_test_options = {hard_forks};
+
+// a Blockchain and its pool on an LMDB database, as the core sets them up
+struct node
+{
+	node() : pool(chain), chain(pool), initialized(false) {}
+	~node()
+	{
+		if(initialized)
+		{
+			pool.deinit();
+			chain.deinit();
+		}
+	}
+
+	tx_memory_pool pool;
+	Blockchain chain;
+	bool initialized;
+};
+
+class alt_blocks : public ::testing::Test
+{
+  protected:
+	void SetUp() override
+	{
+		m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+		boost::filesystem::create_directories(m_dir / "db");
+		m_miner.generate_new(false);
+		ASSERT_TRUE(m_generator.construct_block(m_genesis, m_miner, 1338224400));
+	}
+
+	void TearDown() override
+	{
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(m_dir, ec);
+	}
+
+	// opens the database, starting from m_genesis if it is new
+	std::unique_ptr<node> start(size_t max_alt_blocks, bool keep_alt_blocks)
+	{
+		std::unique_ptr<node> n(new node());
+		BlockchainDB *db = new_db("lmdb");
+		db->open((m_dir / "db").string());
+		const bool fresh = db->height() == 0;
+		n->chain.set_alt_blocks_options(max_alt_blocks, keep_alt_blocks ? (m_dir / CRYPTONOTE_ALT_BLOCKS_FILENAME).string() : std::string());
+		if(!n->chain.init(db, FAKECHAIN, true, &alt_blocks_test_options))
+			return nullptr;
+		n->initialized = true;
+		if(!n->pool.init() || (fresh && !n->chain.reset_and_set_genesis_block(m_genesis)) || !n->chain.load_alternative_blocks())
+			return nullptr;
+		return n;
+	}
+
+	// the next block after prev, on whichever branch prev is
+	block next(const block &prev)
+	{
+		block b;
+		m_generator.construct_block(b, prev, m_miner);
+		return b;
+	}
+
+	std::vector<block> extend(node &n, const block &from, size_t count)
+	{
+		std::vector<block> blocks;
+		const block *prev = &from;
+		for(size_t i = 0; i < count; ++i)
+		{
+			blocks.push_back(next(*prev));
+			add(n, blocks.back());
+			prev = &blocks.back();
+		}
+		return blocks;
+	}
+
+	static void add(node &n, const block &b)
+	{
+		block_verification_context bvc = boost::value_initialized<block_verification_context>();
+		n.chain.add_new_block(b, bvc);
+		ASSERT_FALSE(bvc.m_verifivation_failed);
+	}
+
+	static std::unordered_set<crypto::hash> alt_hashes(const node &n)
+	{
+		std::list<block> blocks;
+		n.chain.get_alternative_blocks(blocks);
+		std::unordered_set<crypto::hash> hashes;
+		for(const block &b : blocks)
+			hashes.insert(get_block_hash(b));
+		return hashes;
+	}
+
+	// every alt block must still lead back to the main chain
+	static void check_connected(const node &n)
+	{
+		std::list<block> blocks;
+		n.chain.get_alternative_blocks(blocks);
+		const std::unordered_set<crypto::hash> hashes = alt_hashes(n);
+		for(const block &b : blocks)
+			ASSERT_TRUE(hashes.count(b.prev_id) || n.chain.get_db().block_exists(b.prev_id)) << "orphaned alt block " << get_block_hash(b);
+	}
+
+	boost::filesystem::path m_dir;
+	account_base m_miner;
+	test_generator m_generator;
+	block m_genesis;
+};
+}
+
+TEST_F(alt_blocks, evicts_lowest_work_leaves_first)
+{
+	std::unique_ptr<node> n = start(10, false);
+	ASSERT_TRUE(n != nullptr);
+
+	const std::vector<block> main = extend(*n, m_genesis, 12);
+	const std::vector<block> a = extend(*n, main[0], 8);  // heights 2 to 9
+	const std::vector<block> b = extend(*n, main[8], 2);  // heights 10 and 11
+	ASSERT_EQ(n->chain.get_alternative_blocks_count(), 10);
+	ASSERT_EQ(n->chain.get_current_blockchain_height(), 13);
+
+	// one over the cap, down to 9: the lowest work leaf goes first, then the tip of a
+	const std::vector<block> c = extend(*n, main[4], 1); // height 6
+	const std::unordered_set<crypto::hash> left = alt_hashes(*n);
+	ASSERT_EQ(left.size(), 9);
+	ASSERT_FALSE(left.count(get_block_hash(c[0])));
+	ASSERT_FALSE(left.count(get_block_hash(a.back())));
+	for(size_t i = 0; i + 1 < a.size(); ++i)
+		ASSERT_TRUE(left.count(get_block_hash(a[i])));
+	for(const block &bl : b)
+		ASSERT_TRUE(left.count(get_block_hash(bl)));
+	check_connected(*n);
+}
+
+TEST_F(alt_blocks, reorg_counts_children_of_disconnected_blocks)
+{
+	std::unique_ptr<node> n = start(100, false);
+	ASSERT_TRUE(n != nullptr);
+
+	const std::vector<block> main = extend(*n, m_genesis, 5);
+	const std::vector<block> x = extend(*n, main[2], 1); // forks off main[2], which the reorg disconnects
+	const std::vector<block> r = extend(*n, main[0], 6); // outgrows main and takes over
+	ASSERT_EQ(n->chain.get_tail_id(), get_block_hash(r.back()));
+
+	// main[1..4] are alt blocks now, main[2] has two children
+	const std::unordered_set<crypto::hash> after_reorg = alt_hashes(*n);
+	ASSERT_EQ(after_reorg.size(), 5);
+	for(size_t i = 1; i < main.size(); ++i)
+		ASSERT_TRUE(after_reorg.count(get_block_hash(main[i])));
+	ASSERT_TRUE(after_reorg.count(get_block_hash(x[0])));
+
+	// pruning down to three leaves main[1..3], never main[3] without main[2]
+	n->chain.set_alt_blocks_options(3, std::string());
+	extend(*n, r[0], 1);
+	const std::unordered_set<crypto::hash> left = alt_hashes(*n);
+	ASSERT_EQ(left.size(), 3);
+	for(size_t i = 1; i < 4; ++i)
+		ASSERT_TRUE(left.count(get_block_hash(main[i])));
+	check_connected(*n);
+}
+
+TEST_F(alt_blocks, stored_alt_blocks_survive_restart)
+{
+	std::vector<block> main, a;
+	std::unordered_set<crypto::hash> stored;
+	{
+		std::unique_ptr<node> n = start(100, true);
+		ASSERT_TRUE(n != nullptr);
+		main = extend(*n, m_genesis, 4);
+		a = extend(*n, main[0], 2);
+		stored = alt_hashes(*n);
+		ASSERT_EQ(stored.size(), 2);
+	}
+
+	std::unique_ptr<node> n = start(100, true);
+	ASSERT_TRUE(n != nullptr);
+	ASSERT_EQ(n->chain.get_tail_id(), get_block_hash(main.back()));
+	ASSERT_EQ(alt_hashes(*n), stored);
+
+	// the reloaded branch carries on, and reorgs once it has more work
+	const std::vector<block> more = extend(*n, a.back(), 1);
+	ASSERT_EQ(n->chain.get_alternative_blocks_count(), 3);
+	const std::vector<block> top = extend(*n, more.back(), 1);
+	ASSERT_EQ(n->chain.get_tail_id(), get_block_hash(top.back()));
+	ASSERT_EQ(n->chain.get_current_blockchain_height(), 6);
+	check_connected(*n);
+}
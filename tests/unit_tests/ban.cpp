@@ -82,6 +82,7 @@ class test_core
 	virtual void on_transaction_relayed(const cryptonote::blobdata &tx) {}
 	cryptonote::network_type get_nettype() const { return cryptonote::MAINNET; }
 	bool get_pool_transaction(const crypto::hash &id, cryptonote::blobdata &tx_blob) const { return false; }
+	bool get_pool_transaction_hashes(std::vector<crypto::hash> &txs, bool include_unrelayed_txes = true) const { return false; }
 	bool pool_has_tx(const crypto::hash &txid) const { return false; }
 	bool get_blocks(uint64_t start_offset, size_t count, std::list<std::pair<cryptonote::blobdata, cryptonote::block>> &blocks, std::list<cryptonote::blobdata> &txs) const { return false; }
 	bool get_transactions(const std::vector<crypto::hash> &txs_ids, std::list<cryptonote::transaction> &txs, std::list<crypto::hash> &missed_txs) const { return false; }
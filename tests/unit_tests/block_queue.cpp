@@ -85,3 +85,72 @@ TEST(block_queue, flush_uuid)
 	bq.add_blocks(0, 200, uuid1());
 	ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+TEST(block_queue, peer_stats_fit_latency_and_bandwidth)
+{
+	cryptonote::block_queue bq;
+	cryptonote::block_queue::peer_stats stats;
+	ASSERT_FALSE(bq.get_peer_stats(uuid1(), stats));
+
+	// 100 ms round trip, 1 MB/s
+	for(size_t size : {100000, 400000, 200000, 800000})
+		bq.update_peer_stats(uuid1(), size, size / 1000, 0.1f + size / 1e6f);
+	ASSERT_TRUE(bq.get_peer_stats(uuid1(), stats));
+	ASSERT_EQ(stats.nspans, 4);
+	ASSERT_NEAR(stats.latency, 0.1f, 0.001f);
+	ASSERT_NEAR(stats.bandwidth, 1e6f, 1e4f);
+	ASSERT_NEAR(stats.block_size, 1000.0f, 1.0f);
+	ASSERT_NEAR(bq.get_expected_time(uuid1(), 500), 0.6f, 0.01f);
+
+	bq.remove_peer_stats(uuid1());
+	ASSERT_FALSE(bq.get_peer_stats(uuid1(), stats));
+	ASSERT_LT(bq.get_expected_time(uuid1(), 500), 0.0f);
+}
+
+TEST(block_queue, span_size_follows_peer_throughput)
+{
+	cryptonote::block_queue bq;
+
+	// unmeasured peers get the default
+	ASSERT_EQ(bq.get_span_size(uuid1(), 10, 2048), 10);
+
+	// 1 MB/s with 1000 byte blocks, no latency: 2 seconds worth
+	bq.update_peer_stats(uuid1(), 100000, 100, 0.1f);
+	bq.update_peer_stats(uuid1(), 200000, 200, 0.2f);
+	ASSERT_EQ(bq.get_span_size(uuid1(), 10, 2048), 2000);
+	ASSERT_EQ(bq.get_span_size(uuid1(), 10, 500), 500);
+
+	// 1 kB/s with 1000 byte blocks is a very slow peer
+	bq.update_peer_stats(uuid2(), 1000, 1, 1.0f);
+	bq.update_peer_stats(uuid2(), 2000, 2, 2.0f);
+	ASSERT_EQ(bq.get_span_size(uuid2(), 10, 2048), 2);
+}
+
+TEST(block_queue, straggler)
+{
+	cryptonote::block_queue bq;
+	bq.update_peer_stats(uuid1(), 10000, 10, 10.0f);
+	bq.update_peer_stats(uuid2(), 10000, 10, 0.1f);
+
+	// no measurements for the requesting peer
+	ASSERT_FALSE(bq.is_straggler(uuid1(), 10, 0.0f, boost::uuids::uuid()));
+	// the fast peer would be done well before the slow one
+	ASSERT_TRUE(bq.is_straggler(uuid1(), 10, 1.0f, uuid2()));
+	// the slow peer would not be done before the fast one
+	ASSERT_FALSE(bq.is_straggler(uuid2(), 10, 0.0f, uuid1()));
+	// the fast peer is late on its own numbers
+	ASSERT_TRUE(bq.is_straggler(uuid2(), 10, 1.0f, uuid1()));
+}
+
+TEST(block_queue, download_target)
+{
+	cryptonote::block_queue bq;
+	ASSERT_EQ(bq.get_download_target(), BLOCK_QUEUE_MIN_TARGET_SIZE);
+	bq.update_peer_stats(uuid1(), 1000000, 100, 1.0f);
+	ASSERT_NEAR(bq.get_download_target(), 1e6 * BLOCK_QUEUE_TARGET_TIME, 1e5);
+	bq.update_peer_stats(uuid2(), 100000000, 100, 1.0f);
+	ASSERT_EQ(bq.get_download_target(), BLOCK_QUEUE_MAX_TARGET_SIZE);
+
+	bq.add_blocks(0, 50, uuid1());
+	ASSERT_EQ(bq.get_scheduled_size(), 50 * 10000);
+}
@@ -36,6 +36,7 @@
 #include "gtest/gtest.h"
 
 #include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/blockchain_snapshot.h"
 #include "blockchain_db/lmdb/db_lmdb.h"
 #include "string_tools.h"
 #ifdef BERKELEY_DB
@@ -448,4 +449,115 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
 	ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), hashes[1]);
 }
 
+TEST(BlockchainLMDBTest, StateCommitmentAndSnapshot)
+{
+	const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	const std::string db_dir = (dir / "db").string(), db2_dir = (dir / "db2").string(), copy_dir = (dir / "copy").string();
+	const std::string snapshot = (dir / "snapshot").string(), snapshot_dir = (dir / "restored").string();
+	boost::filesystem::create_directories(copy_dir);
+
+	std::vector<block> blocks;
+	std::vector<std::vector<transaction>> txs(2);
+	for(size_t n = 0; n < 2; ++n)
+	{
+		block bl;
+		ASSERT_TRUE(parse_and_validate_block_from_blob(t_blocks[n], bl));
+		blocks.push_back(bl);
+		for(const auto &blob : t_transactions[n])
+		{
+			transaction tx;
+			ASSERT_TRUE(parse_and_validate_tx_from_blob(blob, tx));
+			txs[n].push_back(tx);
+		}
+	}
+	// chain the blocks with this chain's block hashing
+	blocks[1].prev_id = get_block_hash(blocks[0]);
+
+	crypto::hash commitment0, commitment1;
+	{
+		BlockchainLMDB db;
+		db.open(db_dir);
+		HardFork hardfork(db, 1, 0);
+		hardfork.init();
+		db.set_hard_fork(&hardfork);
+
+		const crypto::hash commitment_empty = db.get_state_commitment();
+		db.add_block(blocks[0], t_sizes[0], t_diffs[0], t_coins[0], txs[0]);
+		commitment0 = db.get_state_commitment();
+		ASSERT_EQ(commitment0, db.get_state_commitment());
+		ASSERT_NE(commitment_empty, commitment0);
+		db.add_block(blocks[1], t_sizes[1], t_diffs[1], t_coins[1], txs[1]);
+		commitment1 = db.get_state_commitment();
+		ASSERT_NE(commitment0, commitment1);
+
+		// blockchain_snapshot pops to its height, a popped db has to hash like one built to that height
+		block popped;
+		std::vector<transaction> popped_txs;
+		db.pop_block(popped, popped_txs);
+		ASSERT_EQ(commitment0, db.get_state_commitment());
+		// block 0 carries a tx, its outputs, key images and tx index go with it
+		db.pop_block(popped, popped_txs);
+		ASSERT_EQ(1, popped_txs.size());
+		ASSERT_EQ(commitment_empty, db.get_state_commitment());
+
+		db.add_block(blocks[0], t_sizes[0], t_diffs[0], t_coins[0], txs[0]);
+		ASSERT_EQ(commitment0, db.get_state_commitment());
+		db.add_block(blocks[1], t_sizes[1], t_diffs[1], t_coins[1], txs[1]);
+		ASSERT_EQ(commitment1, db.get_state_commitment());
+
+		db.copy(copy_dir, true);
+		db.close();
+	}
+
+	// the commitment depends on the chain only, not on how the db was built
+	{
+		BlockchainLMDB db(true);
+		db.open(db2_dir);
+		HardFork hardfork(db, 1, 0);
+		hardfork.init();
+		db.set_hard_fork(&hardfork);
+
+		db.batch_start();
+		db.add_block(blocks[0], t_sizes[0], t_diffs[0], t_coins[0], txs[0]);
+		db.add_block(blocks[1], t_sizes[1], t_diffs[1], t_coins[1], txs[1]);
+		db.batch_stop();
+		ASSERT_EQ(commitment1, db.get_state_commitment());
+		db.close();
+	}
+	{
+		BlockchainLMDB db;
+		db.open(copy_dir);
+		ASSERT_EQ(commitment1, db.get_state_commitment());
+		db.close();
+	}
+
+	blockchain_snapshot_header header = boost::value_initialized<blockchain_snapshot_header>();
+	header.nettype = MAINNET;
+	strcpy(header.db_name, "lmdb02");
+	header.height = 1;
+	header.top_hash = get_block_hash(blocks[1]);
+	header.commitment = commitment1;
+	ASSERT_TRUE(write_blockchain_snapshot(snapshot, header, copy_dir));
+
+	blockchain_snapshot_header read_header;
+	ASSERT_TRUE(read_blockchain_snapshot_header(snapshot, read_header));
+	ASSERT_EQ(read_header.commitment, commitment1);
+	ASSERT_TRUE(extract_blockchain_snapshot(snapshot, snapshot_dir, read_header));
+	ASSERT_FALSE(extract_blockchain_snapshot(snapshot, snapshot_dir, read_header));
+	{
+		BlockchainLMDB db;
+		db.open(snapshot_dir);
+		ASSERT_TRUE(check_blockchain_snapshot(db, read_header));
+		read_header.commitment = commitment0;
+		ASSERT_FALSE(check_blockchain_snapshot(db, read_header));
+		db.close();
+	}
+
+	// a truncated snapshot is rejected
+	boost::filesystem::resize_file(snapshot, boost::filesystem::file_size(snapshot) - 1);
+	ASSERT_FALSE(read_blockchain_snapshot_header(snapshot, read_header));
+
+	boost::filesystem::remove_all(dir);
+}
+
 } // anonymous namespace
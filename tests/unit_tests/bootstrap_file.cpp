@@ -0,0 +1,202 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "../core_tests/chaingen.h"
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_utilities/bootstrap_file.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/tx_pool.h"
+#include "serialization/binary_utils.h"
+#include <boost/filesystem.hpp>
+#include <memory>
+
+using namespace cryptonote;
+
+namespace
+{
+const std::pair<uint8_t, uint64_t> hard_forks[] = {std::make_pair((uint8_t)1, (uint64_t)0), std::make_pair((uint8_t)0, (uint64_t)0)};
+const test_options bootstrap_test_options = {hard_forks};
+
+// enough blocks for several export tasks, so every reader thread gets one
+const size_t source_blocks = 2 * EXPORT_BLOCKS_PER_TASK + 30;
+const uint32_t blocks_per_chunk = 7;
+const size_t export_threads = 4;
+
+struct node
+{
+	node() : pool(chain), chain(pool), initialized(false) {}
+	~node()
+	{
+		if(initialized)
+		{
+			pool.deinit();
+			chain.deinit();
+		}
+	}
+
+	tx_memory_pool pool;
+	Blockchain chain;
+	bool initialized;
+};
+
+class bootstrap_file : public ::testing::Test
+{
+  protected:
+	void SetUp() override
+	{
+		m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+		m_miner.generate_new(false);
+		ASSERT_TRUE(m_generator.construct_block(m_genesis, m_miner, 1338224400));
+
+		m_source = start("source");
+		ASSERT_TRUE(m_source != nullptr);
+		block prev = m_genesis;
+		for(size_t i = 0; i < source_blocks; ++i)
+		{
+			block b;
+			m_generator.construct_block(b, prev, m_miner);
+			block_verification_context bvc = boost::value_initialized<block_verification_context>();
+			ASSERT_TRUE(m_source->chain.add_new_block(b, bvc));
+			prev = b;
+		}
+	}
+
+	void TearDown() override
+	{
+		m_source.reset();
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(m_dir, ec);
+	}
+
+	std::unique_ptr<node> start(const std::string &name)
+	{
+		boost::filesystem::create_directories(m_dir / name);
+		std::unique_ptr<node> n(new node());
+		BlockchainDB *db = new_db("lmdb");
+		db->open((m_dir / name).string());
+		if(!n->chain.init(db, FAKECHAIN, true, &bootstrap_test_options))
+			return nullptr;
+		n->initialized = true;
+		if(!n->pool.init() || !n->chain.reset_and_set_genesis_block(m_genesis))
+			return nullptr;
+		return n;
+	}
+
+	bool export_to(boost::filesystem::path file, uint64_t stop)
+	{
+		BootstrapFile bootstrap;
+		return bootstrap.store_blockchain_raw(&m_source->chain, &m_source->pool, file, stop, 2, blocks_per_chunk, export_threads);
+	}
+
+	// reads the file as blockchain_import does, checking each chunk against its
+	// index checksum, and adds the blocks the node does not have yet
+	static bool import_from(node &n, const boost::filesystem::path &file)
+	{
+		BootstrapFile bootstrap;
+		bootstrap::chunk_index index;
+		if(!bootstrap.load_chunk_index(file.string(), index) || bootstrap.get_format_version() != 2)
+			return false;
+		std::ifstream import_file(file.string(), std::ios_base::binary | std::ifstream::in);
+		for(const bootstrap::chunk_index_entry &entry : index.chunks)
+		{
+			std::string str1(entry.size, '\0');
+			import_file.seekg(entry.offset);
+			import_file.read(&str1[0], entry.size);
+			if(!import_file || crypto::cn_fast_hash(str1.data(), str1.size()) != entry.checksum)
+				return false;
+			bootstrap::chunk_package cp;
+			if(!::serialization::parse_binary(str1, cp) || cp.blocks.size() != entry.num_blocks)
+				return false;
+			for(size_t i = 0; i < cp.blocks.size(); ++i)
+			{
+				if(entry.block_first + i < n.chain.get_current_blockchain_height())
+					continue;
+				block_verification_context bvc = boost::value_initialized<block_verification_context>();
+				if(!n.chain.add_new_block(cp.blocks[i].block, bvc) || !bvc.m_added_to_main_chain)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	void check_same_chain(const node &n)
+	{
+		ASSERT_EQ(m_source->chain.get_current_blockchain_height(), n.chain.get_current_blockchain_height());
+		ASSERT_EQ(m_source->chain.get_tail_id(), n.chain.get_tail_id());
+	}
+
+	boost::filesystem::path m_dir;
+	account_base m_miner;
+	test_generator m_generator;
+	block m_genesis;
+	std::unique_ptr<node> m_source;
+};
+}
+
+TEST_F(bootstrap_file, parallel_export_round_trip)
+{
+	const boost::filesystem::path file = m_dir / "blockchain.raw";
+	ASSERT_TRUE(export_to(file, 0));
+
+	BootstrapFile bootstrap;
+	bootstrap::chunk_index index;
+	ASSERT_TRUE(bootstrap.load_chunk_index(file.string(), index));
+	ASSERT_FALSE(index.chunks.empty());
+	ASSERT_EQ(source_blocks + 1, index.chunks.back().block_first + index.chunks.back().num_blocks);
+	for(const bootstrap::chunk_index_entry &entry : index.chunks)
+		ASSERT_LE(entry.num_blocks, blocks_per_chunk);
+
+	std::unique_ptr<node> dest = start("dest");
+	ASSERT_TRUE(dest != nullptr);
+	ASSERT_TRUE(import_from(*dest, file));
+	check_same_chain(*dest);
+}
+
+TEST_F(bootstrap_file, resumes_export_with_index)
+{
+	const boost::filesystem::path file = m_dir / "blockchain.raw";
+	ASSERT_TRUE(export_to(file, EXPORT_BLOCKS_PER_TASK + 3));
+	ASSERT_TRUE(export_to(file, 0));
+
+	std::unique_ptr<node> dest = start("dest");
+	ASSERT_TRUE(dest != nullptr);
+	ASSERT_TRUE(import_from(*dest, file));
+	check_same_chain(*dest);
+}
+
+TEST_F(bootstrap_file, resumes_interrupted_export)
+{
+	const boost::filesystem::path file = m_dir / "blockchain.raw";
+	ASSERT_TRUE(export_to(file, EXPORT_BLOCKS_PER_TASK + 3));
+
+	// drop the index and half of the last chunk, as a killed export would leave it
+	BootstrapFile bootstrap;
+	bootstrap::chunk_index index;
+	ASSERT_TRUE(bootstrap.load_chunk_index(file.string(), index));
+	ASSERT_GT(index.chunks.size(), 1u);
+	const bootstrap::chunk_index_entry &last = index.chunks.back();
+	boost::filesystem::resize_file(file, last.offset + last.size / 2);
+
+	ASSERT_TRUE(export_to(file, 0));
+	ASSERT_TRUE(bootstrap.load_chunk_index(file.string(), index));
+	ASSERT_EQ(source_blocks + 1, index.chunks.back().block_first + index.chunks.back().num_blocks);
+
+	std::unique_ptr<node> dest = start("dest");
+	ASSERT_TRUE(dest != nullptr);
+	ASSERT_TRUE(import_from(*dest, file));
+	check_same_chain(*dest);
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_protocol/compact_block.h"
+#include "gtest/gtest.h"
+#include "storages/portable_storage_template_helper.h"
+#include <vector>
+
+using namespace cryptonote;
+
+namespace
+{
+transaction make_tx(uint64_t n)
+{
+	transaction tx;
+	tx.version = 2;
+	tx.unlock_time = n;
+	txin_gen in;
+	in.height = n;
+	tx.vin.push_back(in);
+	tx.rct_signatures.type = rct::RCTTypeNull;
+	return tx;
+}
+
+struct test_block
+{
+	block b;
+	crypto::hash hash;
+	std::vector<crypto::hash> tx_hashes;
+	std::unordered_map<crypto::hash, blobdata> txs;
+
+	test_block(size_t count)
+	{
+		b.major_version = 1;
+		b.minor_version = 0;
+		b.timestamp = 1234;
+		b.prev_id = crypto::null_hash;
+		b.nonce = 42;
+		b.miner_tx = make_tx(1000);
+		for(size_t n = 0; n < count; ++n)
+		{
+			transaction tx = make_tx(n);
+			crypto::hash tx_hash = get_transaction_hash(tx);
+			tx_hashes.push_back(tx_hash);
+			txs.emplace(tx_hash, tx_to_blob(tx));
+		}
+		b.tx_hashes = tx_hashes;
+		hash = get_block_hash(b);
+	}
+};
+}
+
+TEST(compact_block, short_ids_depend_on_salt)
+{
+	const crypto::hash txid = crypto::cn_fast_hash("tx", 2);
+	ASSERT_EQ(get_short_tx_id(1, txid), get_short_tx_id(1, txid));
+	ASSERT_NE(get_short_tx_id(1, txid), get_short_tx_id(2, txid));
+	ASSERT_LT(get_short_tx_id(1, txid), 1ull << (8 * COMPACT_BLOCK_SHORT_ID_SIZE));
+}
+
+TEST(compact_block, reconstruct_from_pool)
+{
+	test_block tb(10);
+
+	// the peer is thought to have the first 6, prefill the rest
+	std::unordered_set<crypto::hash> peer_txs(tb.tx_hashes.begin(), tb.tx_hashes.begin() + 6);
+	NOTIFY_NEW_COMPACT_BLOCK::request arg;
+	ASSERT_TRUE(make_compact_block(tb.b, tb.hash, tb.txs, 77, [&](const crypto::hash &txid) { return peer_txs.count(txid) > 0; }, 5, arg));
+	ASSERT_EQ(arg.tx_count, 10);
+	ASSERT_EQ(arg.short_ids.size(), 6 * COMPACT_BLOCK_SHORT_ID_SIZE);
+	ASSERT_EQ(arg.prefilled_txs.size(), 4);
+	ASSERT_EQ(arg.prefilled_txs.front().index, 6);
+
+	// the message survives serialization
+	std::string blob;
+	ASSERT_TRUE(epee::serialization::store_t_to_binary(arg, blob));
+	NOTIFY_NEW_COMPACT_BLOCK::request arg2;
+	ASSERT_TRUE(epee::serialization::load_t_from_binary(arg2, blob));
+
+	block b;
+	std::list<blobdata> txs;
+	std::vector<uint64_t> missing;
+	std::vector<crypto::hash> pool(tb.tx_hashes.begin(), tb.tx_hashes.begin() + 6);
+	pool.push_back(crypto::cn_fast_hash("unrelated", 9));
+	ASSERT_TRUE(reconstruct_compact_block(arg2, pool, b, txs, missing));
+	ASSERT_TRUE(missing.empty());
+	ASSERT_EQ(txs.size(), 4);
+	ASSERT_EQ(b.tx_hashes, tb.tx_hashes);
+	ASSERT_EQ(get_block_hash(b), tb.hash);
+
+	// the peer had not seen two of them after all
+	pool.erase(pool.begin() + 2, pool.begin() + 4);
+	ASSERT_TRUE(reconstruct_compact_block(arg2, pool, b, txs, missing));
+	ASSERT_EQ(missing, std::vector<uint64_t>({2, 3}));
+}
+
+TEST(compact_block, reject_malformed)
+{
+	test_block tb(4);
+	NOTIFY_NEW_COMPACT_BLOCK::request arg;
+	ASSERT_TRUE(make_compact_block(tb.b, tb.hash, tb.txs, 1, [](const crypto::hash &) { return false; }, 5, arg));
+
+	block b;
+	std::list<blobdata> txs;
+	std::vector<uint64_t> missing;
+	ASSERT_TRUE(reconstruct_compact_block(arg, {}, b, txs, missing));
+	ASSERT_TRUE(missing.empty());
+	ASSERT_EQ(get_block_hash(b), tb.hash);
+
+	NOTIFY_NEW_COMPACT_BLOCK::request bad = arg;
+	bad.tx_count = 5;
+	ASSERT_FALSE(reconstruct_compact_block(bad, {}, b, txs, missing));
+
+	bad = arg;
+	bad.short_ids = "abc";
+	ASSERT_FALSE(reconstruct_compact_block(bad, {}, b, txs, missing));
+
+	bad = arg;
+	std::swap(bad.prefilled_txs.front().index, bad.prefilled_txs.back().index);
+	ASSERT_FALSE(reconstruct_compact_block(bad, {}, b, txs, missing));
+
+	bad = arg;
+	bad.prefilled_txs.back().tx = "garbage";
+	ASSERT_FALSE(reconstruct_compact_block(bad, {}, b, txs, missing));
+
+	// a tx which is neither prefilled nor given cannot be sent
+	tb.txs.erase(tb.tx_hashes[1]);
+	ASSERT_FALSE(make_compact_block(tb.b, tb.hash, tb.txs, 1, [](const crypto::hash &) { return false; }, 5, arg));
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "cryptonote_basic/difficulty.h"
+#include "gtest/gtest.h"
+#include <vector>
+
+using namespace cryptonote;
+
+namespace
+{
+static const size_t window_size = 10;
+static const size_t target = 60;
+
+uint64_t test_timestamp(size_t height)
+{
+	// irregular but deterministic solve times
+	return 1000000 + height * target + (height * 7919) % 97;
+}
+
+difficulty_type test_cumulative_difficulty(size_t height)
+{
+	return 1000 * (height + 1) + (height * height) % 13;
+}
+
+difficulty_type reference_difficulty(size_t first, size_t end)
+{
+	std::vector<uint64_t> timestamps;
+	std::vector<difficulty_type> difficulties;
+	for(size_t h = first; h < end; h++)
+	{
+		timestamps.push_back(test_timestamp(h));
+		difficulties.push_back(test_cumulative_difficulty(h));
+	}
+	return next_difficulty_v1(timestamps, difficulties, target);
+}
+}
+
+TEST(difficulty_window, push_back_drops_oldest)
+{
+	difficulty_window window(window_size);
+	for(size_t h = 0; h < 3 * window_size; h++)
+	{
+		window.push_back(test_timestamp(h), test_cumulative_difficulty(h));
+		size_t first = h + 1 > window_size ? h + 1 - window_size : 0;
+		ASSERT_EQ(window.size(), h + 1 - first);
+		ASSERT_EQ(window.timestamp(0), test_timestamp(first));
+		ASSERT_EQ(window.cumulative_difficulty(window.size() - 1), test_cumulative_difficulty(h));
+		ASSERT_EQ(next_difficulty_v1(window, target), reference_difficulty(first, h + 1));
+	}
+}
+
+TEST(difficulty_window, pop_back_and_push_front)
+{
+	difficulty_window window(window_size);
+	for(size_t h = 0; h < 2 * window_size + 3; h++)
+		window.push_back(test_timestamp(h), test_cumulative_difficulty(h));
+
+	// window covers [13, 22], move it back to [10, 19]
+	for(size_t end = 2 * window_size + 3; end > 2 * window_size; end--)
+	{
+		window.pop_back();
+		size_t first = end - 1 - window_size;
+		window.push_front(test_timestamp(first), test_cumulative_difficulty(first));
+	}
+	ASSERT_TRUE(window.full());
+	ASSERT_EQ(window.timestamp(0), test_timestamp(window_size));
+	ASSERT_EQ(next_difficulty_v1(window, target), reference_difficulty(window_size, 2 * window_size));
+}
+
+TEST(difficulty_window, fork_is_independent)
+{
+	difficulty_window window(window_size);
+	for(size_t h = 0; h < window_size; h++)
+		window.push_back(test_timestamp(h), test_cumulative_difficulty(h));
+
+	difficulty_window fork = window;
+	fork.pop_back();
+	fork.push_back(test_timestamp(100), test_cumulative_difficulty(100));
+
+	ASSERT_EQ(window.size(), window_size);
+	ASSERT_EQ(window.timestamp(window_size - 1), test_timestamp(window_size - 1));
+	ASSERT_EQ(fork.timestamp(window_size - 1), test_timestamp(100));
+}
+
+TEST(difficulty_window, small_windows)
+{
+	difficulty_window window(window_size);
+	ASSERT_EQ(next_difficulty_v1(window, target), 1);
+	window.push_back(test_timestamp(0), test_cumulative_difficulty(0));
+	ASSERT_EQ(next_difficulty_v1(window, target), 1);
+	window.clear();
+	ASSERT_TRUE(window.empty());
+}
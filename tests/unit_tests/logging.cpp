@@ -0,0 +1,161 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "misc_log_ex.h"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+int evaluated = 0;
+
+int count_evaluation()
+{
+	return ++evaluated;
+}
+
+std::string read_file(const std::string &filename)
+{
+	std::ifstream f(filename);
+	std::stringstream ss;
+	ss << f.rdbuf();
+	return ss.str();
+}
+
+class logging : public ::testing::Test
+{
+  protected:
+	void SetUp() override
+	{
+		m_categories = mlog_get_categories();
+	}
+
+	void TearDown() override
+	{
+		mlog_configure(mlog_get_default_log_path("unit_tests.log"), true);
+		mlog_set_categories(m_categories.c_str());
+	}
+
+	std::string m_categories;
+};
+}
+
+TEST_F(logging, enabled_follows_categories)
+{
+	mlog_set_categories("*:WARNING,logging.test:DEBUG");
+	ASSERT_TRUE(mlog_enabled(el::Level::Warning, "logging.other"));
+	ASSERT_FALSE(mlog_enabled(el::Level::Info, "logging.other"));
+	ASSERT_TRUE(mlog_enabled(el::Level::Debug, "logging.test"));
+	ASSERT_FALSE(mlog_enabled(el::Level::Trace, "logging.test"));
+
+	mlog_set_categories("*:WARNING,logging.test:TRACE,logging.other:ERROR");
+	ASSERT_FALSE(mlog_enabled(el::Level::Warning, "logging.other"));
+	ASSERT_TRUE(mlog_enabled(el::Level::Error, "logging.other"));
+	ASSERT_TRUE(mlog_enabled(el::Level::Trace, "logging.test"));
+}
+
+TEST_F(logging, disabled_lines_are_not_evaluated)
+{
+	mlog_set_categories("*:WARNING");
+	evaluated = 0;
+	MCINFO("logging.test", "value " << count_evaluation());
+	ASSERT_EQ(evaluated, 0);
+	MCWARNING("logging.test", "value " << count_evaluation());
+	ASSERT_EQ(evaluated, 1);
+}
+
+TEST_F(logging, file_lines_in_order)
+{
+	const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	ASSERT_TRUE(boost::filesystem::create_directory(dir));
+	const std::string filename = (dir / "logging.log").string();
+
+	mlog_configure(filename, false);
+	mlog_set_categories("*:WARNING,logging.test:INFO");
+	for(int i = 0; i < 100; ++i)
+		MCINFO("logging.test", "info line " << i);
+	// errors wait until they are written, so everything before is on disk too
+	MCERROR("logging.test", "error line");
+
+	const std::string contents = read_file(filename);
+	size_t pos = 0;
+	for(int i = 0; i < 100; ++i)
+	{
+		pos = contents.find("info line " + std::to_string(i) + "\n", pos);
+		ASSERT_NE(pos, std::string::npos);
+	}
+	ASSERT_NE(contents.find("error line", pos), std::string::npos);
+
+	mlog_configure(mlog_get_default_log_path("unit_tests.log"), true);
+	boost::filesystem::remove_all(dir);
+}
+
+#ifndef _WIN32
+// ryod --detach forks after the log is configured, the child has to write the file itself
+TEST_F(logging, forked_child_writes_file)
+{
+	const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	ASSERT_TRUE(boost::filesystem::create_directory(dir));
+	const std::string filename = (dir / "logging.log").string();
+
+	mlog_configure(filename, false);
+	mlog_set_categories("*:WARNING,logging.test:INFO");
+	MCINFO("logging.test", "parent line");
+
+	const pid_t pid = fork();
+	if(pid == 0)
+	{
+		for(int i = 0; i < 10; ++i)
+			MCINFO("logging.test", "child line " << i);
+		MCERROR("logging.test", "child error");
+		_exit(0);
+	}
+	ASSERT_GT(pid, 0);
+
+	// a child stuck waiting on a writer it does not have fails the test instead of hanging it
+	int status = 0;
+	pid_t r = 0;
+	for(int i = 0; i < 1000 && (r = waitpid(pid, &status, WNOHANG)) == 0; ++i)
+		usleep(10000);
+	if(r == 0)
+	{
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+	}
+	ASSERT_EQ(r, pid);
+	ASSERT_TRUE(WIFEXITED(status));
+	ASSERT_EQ(WEXITSTATUS(status), 0);
+
+	const std::string contents = read_file(filename);
+	size_t pos = 0;
+	for(int i = 0; i < 10; ++i)
+	{
+		pos = contents.find("child line " + std::to_string(i) + "\n", pos);
+		ASSERT_NE(pos, std::string::npos);
+	}
+	ASSERT_NE(contents.find("child error", pos), std::string::npos);
+
+	mlog_configure(mlog_get_default_log_path("unit_tests.log"), true);
+	boost::filesystem::remove_all(dir);
+}
+#endif
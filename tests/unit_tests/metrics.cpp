@@ -0,0 +1,80 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "common/metrics.h"
+#include "gtest/gtest.h"
+#include <boost/thread/thread.hpp>
+#include <vector>
+
+TEST(metrics, counter_sums_threads)
+{
+	const tools::metrics::counter &c = tools::metrics::get_counter("test_metrics_counter_total", "", "test counter");
+	const uint64_t before = c.value();
+
+	std::vector<boost::thread> threads;
+	for(int t = 0; t < 4; ++t)
+		threads.emplace_back([&c] {
+			for(int i = 0; i < 10000; ++i)
+				c.inc();
+		});
+	c.inc(5);
+	for(boost::thread &t : threads)
+		t.join();
+
+	// the threads are gone, what they counted was folded into the registry
+	ASSERT_EQ(c.value(), before + 40005);
+}
+
+TEST(metrics, same_series_same_metric)
+{
+	const tools::metrics::counter &a = tools::metrics::get_counter("test_metrics_series_total", "kind=\"a\"", "test series");
+	const tools::metrics::counter &b = tools::metrics::get_counter("test_metrics_series_total", "kind=\"b\"", "test series");
+	ASSERT_EQ(&a, &tools::metrics::get_counter("test_metrics_series_total", "kind=\"a\"", "test series"));
+	ASSERT_NE(&a, &b);
+	ASSERT_THROW(tools::metrics::get_gauge("test_metrics_series_total", "kind=\"a\"", "test series"), std::logic_error);
+}
+
+TEST(metrics, histogram_buckets)
+{
+	ASSERT_EQ(tools::metrics::histogram::bucket_of(0), 0);
+	ASSERT_EQ(tools::metrics::histogram::bucket_of(1), 1);
+	ASSERT_EQ(tools::metrics::histogram::bucket_of(3), 2);
+	ASSERT_EQ(tools::metrics::histogram::bucket_of(4), 3);
+	ASSERT_EQ(tools::metrics::histogram::bucket_of(uint64_t(1) << 40), tools::metrics::histogram::BUCKETS - 1);
+
+	const tools::metrics::histogram &h = tools::metrics::get_histogram("test_metrics_latency_seconds", "", "test histogram");
+	h.observe_us(3);
+	h.observe_us(3);
+	h.observe_us(1000);
+	ASSERT_EQ(h.count(), 3);
+	ASSERT_EQ(h.sum_us(), 1006);
+	ASSERT_EQ(h.bucket(2), 2);
+	ASSERT_EQ(h.bucket(10), 1);
+}
+
+TEST(metrics, export_text)
+{
+	tools::metrics::get_counter("test_metrics_export_total", "method=\"get_info\"", "exported counter").inc(7);
+	tools::metrics::get_gauge("test_metrics_export_gauge", "", "exported gauge").set(-3);
+	tools::metrics::get_histogram("test_metrics_export_seconds", "", "exported histogram").observe_us(3);
+
+	const std::string text = tools::metrics::export_text();
+	ASSERT_NE(text.find("# TYPE test_metrics_export_total counter\n"), std::string::npos);
+	ASSERT_NE(text.find("test_metrics_export_total{method=\"get_info\"} 7\n"), std::string::npos);
+	ASSERT_NE(text.find("test_metrics_export_gauge -3\n"), std::string::npos);
+	ASSERT_NE(text.find("test_metrics_export_seconds_bucket{le=\"2e-06\"} 0\n"), std::string::npos);
+	ASSERT_NE(text.find("test_metrics_export_seconds_bucket{le=\"4e-06\"} 1\n"), std::string::npos);
+	ASSERT_NE(text.find("test_metrics_export_seconds_bucket{le=\"+Inf\"} 1\n"), std::string::npos);
+	ASSERT_NE(text.find("test_metrics_export_seconds_count 1\n"), std::string::npos);
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "common/rolling_bloom_filter.h"
+#include "cryptonote_config.h"
+#include "gtest/gtest.h"
+#include <vector>
+
+namespace
+{
+crypto::hash make_hash(uint64_t n)
+{
+	return crypto::cn_fast_hash(&n, sizeof(n));
+}
+}
+
+TEST(rolling_bloom_filter, empty)
+{
+	tools::rolling_bloom_filter filter(1000, 0.001);
+	ASSERT_FALSE(filter.contains(crypto::null_hash));
+	ASSERT_FALSE(filter.contains(make_hash(0)));
+}
+
+TEST(rolling_bloom_filter, keeps_recent_forgets_old)
+{
+	tools::rolling_bloom_filter filter(1000, 0.000001);
+	for(uint64_t n = 0; n < 2000; ++n)
+		filter.insert(make_hash(n));
+
+	// the last half of the capacity is always there, older generations are gone
+	for(uint64_t n = 1500; n < 2000; ++n)
+		ASSERT_TRUE(filter.contains(make_hash(n)));
+	size_t old = 0;
+	for(uint64_t n = 0; n < 1000; ++n)
+		old += filter.contains(make_hash(n));
+	ASSERT_LT(old, 5);
+
+	filter.clear();
+	ASSERT_FALSE(filter.contains(make_hash(1999)));
+}
+
+TEST(rolling_bloom_filter, false_positive_rate)
+{
+	tools::rolling_bloom_filter filter(2000, 0.01);
+	for(uint64_t n = 0; n < 2000; ++n)
+		filter.insert(make_hash(n));
+
+	size_t false_positives = 0;
+	for(uint64_t n = 100000; n < 200000; ++n)
+		false_positives += filter.contains(make_hash(n));
+	ASSERT_LT(false_positives, 2000);
+}
+
+TEST(rolling_bloom_filter, peer_sized)
+{
+	tools::rolling_bloom_filter filter(P2P_KNOWN_TXS_PER_PEER, P2P_KNOWN_TXS_FALSE_POSITIVE_RATE);
+	ASSERT_LE(filter.get_bit_count() / 8, 64 * 1024);
+	ASSERT_GT(filter.get_hash_count(), 1);
+}
@@ -34,8 +34,10 @@
 #include "cryptonote_basic/account.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
 #include "include_base_utils.h"
+#include "ringct/rctOps.h"
 #include "wallet/api/subaddress.h"
 #include "wallet/wallet2.h"
+#include "wallet_accessor_test.h"
 
 class WalletSubaddress : public ::testing::Test
 {
@@ -82,6 +84,39 @@ TEST_F(WalletSubaddress, AddSubaddress)
 	EXPECT_EQ(label, w1.get_subaddress_label({0, 1}));
 }
 
+TEST_F(WalletSubaddress, BatchedSpendPublicKeys)
+{
+	hw::device &hwdev = hw::get_device("default");
+	const cryptonote::account_keys &keys = w1.get_account().get_keys();
+	for(uint32_t major = 0; major < 2; ++major)
+	{
+		const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(keys, major, 0, 40);
+		ASSERT_EQ(40, pkeys.size());
+		for(uint32_t minor = 0; minor < 40; ++minor)
+		{
+			const cryptonote::subaddress_index index = {major, minor};
+			EXPECT_EQ(hwdev.get_subaddress_spend_public_key(keys, index), pkeys[minor]);
+		}
+	}
+	EXPECT_EQ(keys.m_account_address.m_spend_public_key, hwdev.get_subaddress_spend_public_keys(keys, 0, 0, 1)[0]);
+	EXPECT_TRUE(hwdev.get_subaddress_spend_public_keys(keys, 0, 7, 7).empty());
+}
+
+TEST_F(WalletSubaddress, ParallelSpendPublicKeys)
+{
+	// several threadpool jobs, starting and ending off a batch boundary
+	hw::device &hwdev = hw::get_device("default");
+	const cryptonote::account_keys &keys = w1.get_account().get_keys();
+	const uint32_t begin = 100, end = begin + 3 * 1024 + 17;
+	const std::vector<crypto::public_key> pkeys = w1.get_subaddress_spend_public_keys(1, begin, end);
+	ASSERT_EQ(end - begin, pkeys.size());
+	for(uint32_t minor = begin; minor < end; ++minor)
+	{
+		const cryptonote::subaddress_index index = {1, minor};
+		ASSERT_EQ(hwdev.get_subaddress_spend_public_key(keys, index), pkeys[minor - begin]) << "minor " << minor;
+	}
+}
+
 TEST_F(WalletSubaddress, OutOfBoundsIndexes)
 {
 	try
@@ -101,3 +136,125 @@ TEST_F(WalletSubaddress, OutOfBoundsIndexes)
 		EXPECT_STREQ("index.minor is out of bound", e.what());
 	}
 }
+
+typedef std::unordered_map<crypto::public_key, cryptonote::subaddress_index> subaddress_map;
+
+class WalletSubaddressTable : public ::testing::Test
+{
+  protected:
+	void SetUp() override
+	{
+		m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+		boost::filesystem::create_directories(m_dir);
+		m_file = (m_dir / "wallet").string();
+		m_wallet.generate_legacy(m_file, password, crypto::secret_key(), false);
+		m_wallet.add_subaddress_account("second");
+		m_wallet.add_subaddress(0, "first");
+		m_wallet.store();
+	}
+
+	void TearDown() override
+	{
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(m_dir, ec);
+	}
+
+	// the subaddresses of the wallet as read back from the files, and whether they came from the table
+	subaddress_map load(bool &from_table) const
+	{
+		tools::wallet2 w;
+		w.load(m_file, password);
+		from_table = wallet_accessor_test::subaddress_table_loaded(w);
+		return wallet_accessor_test::get_subaddresses(w);
+	}
+
+	const subaddress_map &subaddresses() const { return wallet_accessor_test::get_subaddresses(m_wallet); }
+	std::string table() const { return m_file + ".subaddr"; }
+
+	const std::string password = "testpass";
+	boost::filesystem::path m_dir;
+	std::string m_file;
+	tools::wallet2 m_wallet;
+};
+
+TEST_F(WalletSubaddressTable, RoundTrip)
+{
+	ASSERT_TRUE(boost::filesystem::exists(table()));
+	bool from_table = false;
+	EXPECT_EQ(subaddresses(), load(from_table));
+	EXPECT_TRUE(from_table);
+}
+
+TEST_F(WalletSubaddressTable, TruncatedTableRegenerated)
+{
+	std::string buf;
+	ASSERT_TRUE(epee::file_io_utils::load_file_to_string(table(), buf));
+	ASSERT_TRUE(epee::file_io_utils::save_string_to_file(table(), buf.substr(0, 20)));
+	bool from_table = true;
+	EXPECT_EQ(subaddresses(), load(from_table));
+	EXPECT_FALSE(from_table);
+
+	ASSERT_TRUE(epee::file_io_utils::save_string_to_file(table(), buf.substr(0, buf.size() - 40)));
+	EXPECT_EQ(subaddresses(), load(from_table));
+	EXPECT_FALSE(from_table);
+}
+
+TEST_F(WalletSubaddressTable, CorruptTableRegenerated)
+{
+	std::string buf;
+	ASSERT_TRUE(epee::file_io_utils::load_file_to_string(table(), buf));
+	buf[buf.size() / 2] ^= 1;
+	ASSERT_TRUE(epee::file_io_utils::save_string_to_file(table(), buf));
+	bool from_table = true;
+	EXPECT_EQ(subaddresses(), load(from_table));
+	EXPECT_FALSE(from_table);
+}
+
+TEST_F(WalletSubaddressTable, ForeignTableRegenerated)
+{
+	const std::string other_file = (m_dir / "other").string();
+	tools::wallet2 other;
+	other.generate_legacy(other_file, password, rct::rct2sk(rct::skGen()), false);
+	other.add_subaddress_account("second");
+	other.add_subaddress(0, "first");
+	other.store();
+	boost::filesystem::copy_file(other_file + ".subaddr", table(), boost::filesystem::copy_option::overwrite_if_exists);
+
+	bool from_table = true;
+	EXPECT_EQ(subaddresses(), load(from_table));
+	EXPECT_FALSE(from_table);
+}
+
+TEST_F(WalletSubaddressTable, StaleTableRejected)
+{
+	// the table as it was before the next subaddress, as a failed store or a restored backup leaves it
+	const std::string stale = m_file + ".stale";
+	boost::filesystem::copy_file(table(), stale);
+	m_wallet.add_subaddress(0, "second");
+	m_wallet.store();
+	boost::filesystem::copy_file(stale, table(), boost::filesystem::copy_option::overwrite_if_exists);
+
+	bool from_table = true;
+	const subaddress_map loaded = load(from_table);
+	EXPECT_FALSE(from_table);
+	EXPECT_EQ(subaddresses(), loaded);
+	const uint32_t lookahead_end = 2 + m_wallet.get_subaddress_lookahead().second;
+	EXPECT_EQ(1, loaded.count(m_wallet.get_subaddress_spend_public_key({0, lookahead_end - 1})));
+}
+
+TEST_F(WalletSubaddressTable, OldCacheWritesTable)
+{
+	ASSERT_TRUE(wallet_accessor_test::store_cache_v24(m_wallet));
+	ASSERT_TRUE(boost::filesystem::remove(table()));
+
+	tools::wallet2 w;
+	w.load(m_file, password);
+	EXPECT_EQ(subaddresses(), wallet_accessor_test::get_subaddresses(w));
+	ASSERT_FALSE(boost::filesystem::exists(table()));
+	w.store();
+	ASSERT_TRUE(boost::filesystem::exists(table()));
+
+	bool from_table = false;
+	EXPECT_EQ(subaddresses(), load(from_table));
+	EXPECT_TRUE(from_table);
+}
@@ -32,7 +32,11 @@
 
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "include_base_utils.h"
+#include "net/levin_base.h"
+#include "p2p/net_compression.h"
+#include "p2p/p2p_protocol_defs.h"
 #include "storages/portable_storage_template_helper.h"
+#include <random>
 
 TEST(protocol_pack, protocol_pack_command)
 {
@@ -53,3 +57,240 @@ TEST(protocol_pack, protocol_pack_command)
 		ASSERT_TRUE(r.total_height == 3);
 	}
 }
+
+namespace
+{
+struct stream_test_inner
+{
+	std::string name;
+	std::vector<uint64_t> values;
+	std::list<std::string> blobs;
+
+	BEGIN_KV_SERIALIZE_MAP()
+	KV_SERIALIZE(name)
+	KV_SERIALIZE(values)
+	KV_SERIALIZE(blobs)
+	END_KV_SERIALIZE_MAP()
+};
+
+struct stream_test_struct
+{
+	uint32_t u32;
+	int8_t i8;
+	double d;
+	bool b;
+	stream_test_inner inner;
+	std::vector<stream_test_inner> inners;
+	uint64_t last;
+
+	BEGIN_KV_SERIALIZE_MAP()
+	KV_SERIALIZE(u32)
+	KV_SERIALIZE(i8)
+	KV_SERIALIZE(d)
+	KV_SERIALIZE(b)
+	KV_SERIALIZE(inner)
+	KV_SERIALIZE(inners)
+	KV_SERIALIZE(last)
+	END_KV_SERIALIZE_MAP()
+};
+
+stream_test_inner make_inner(size_t n)
+{
+	stream_test_inner inner;
+	inner.name = std::string(n, 'a' + n % 26);
+	for(size_t i = 0; i < n; ++i)
+	{
+		inner.values.push_back(i * 1000003);
+		inner.blobs.push_back(std::string(i, 'x'));
+	}
+	return inner;
+}
+
+void check_equal(const stream_test_inner &a, const stream_test_inner &b)
+{
+	ASSERT_EQ(a.name, b.name);
+	ASSERT_EQ(a.values, b.values);
+	ASSERT_EQ(a.blobs, b.blobs);
+}
+
+void check_equal(const stream_test_struct &a, const stream_test_struct &b)
+{
+	ASSERT_EQ(a.u32, b.u32);
+	ASSERT_EQ(a.i8, b.i8);
+	ASSERT_EQ(a.d, b.d);
+	ASSERT_EQ(a.b, b.b);
+	check_equal(a.inner, b.inner);
+	ASSERT_EQ(a.inners.size(), b.inners.size());
+	for(size_t i = 0; i < a.inners.size(); ++i)
+		check_equal(a.inners[i], b.inners[i]);
+	ASSERT_EQ(a.last, b.last);
+}
+
+stream_test_struct make_test_struct()
+{
+	stream_test_struct s;
+	s.u32 = 0xdeadbeef;
+	s.i8 = -7;
+	s.d = 3.25;
+	s.b = true;
+	// more than 63 entries so that counts need a wider varint than the one reserved
+	s.inner = make_inner(100);
+	for(size_t i = 1; i < 70; ++i)
+		s.inners.push_back(make_inner(i));
+	s.last = 42;
+	return s;
+}
+}
+
+TEST(protocol_pack, stream_storage_round_trip)
+{
+	stream_test_struct s = make_test_struct();
+
+	std::string streamed;
+	epee::serialization::portable_storage_writer writer;
+	s.store(writer);
+	ASSERT_TRUE(writer.store_to_binary(streamed));
+
+	std::string tree;
+	epee::serialization::portable_storage ps;
+	s.store(ps);
+	ASSERT_TRUE(ps.store_to_binary(tree));
+	ASSERT_EQ(streamed.size(), tree.size());
+
+	// each side must read what the other one wrote
+	stream_test_struct s1, s2, s3;
+	epee::serialization::portable_storage ps_in;
+	ASSERT_TRUE(ps_in.load_from_binary(streamed));
+	ASSERT_TRUE(s1.load(ps_in));
+	check_equal(s, s1);
+
+	epee::serialization::portable_storage_reader reader;
+	ASSERT_TRUE(reader.load_from_binary(tree));
+	ASSERT_TRUE(s2.load(reader));
+	check_equal(s, s2);
+
+	ASSERT_TRUE(epee::serialization::load_t_from_binary(s3, streamed));
+	check_equal(s, s3);
+}
+
+TEST(protocol_pack, stream_storage_protocol_command)
+{
+	cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+	r.current_blockchain_height = 1000;
+	for(size_t i = 0; i < 100; ++i)
+	{
+		cryptonote::block_complete_entry bce;
+		bce.block = std::string(200 + i, 'b');
+		for(size_t t = 0; t < i % 5; ++t)
+			bce.txs.push_back(std::string(1000 + t, 't'));
+		r.blocks.push_back(bce);
+	}
+	r.missed_ids.resize(3, boost::value_initialized<crypto::hash>());
+
+	std::string buff;
+	ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+
+	cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r2;
+	epee::serialization::portable_storage ps;
+	ASSERT_TRUE(ps.load_from_binary(buff));
+	ASSERT_TRUE(r2.load(ps));
+	ASSERT_EQ(r2.current_blockchain_height, 1000);
+	ASSERT_EQ(r2.missed_ids.size(), 3);
+	ASSERT_TRUE(r2.txs.empty());
+	ASSERT_EQ(r2.blocks.size(), r.blocks.size());
+	auto it = r.blocks.begin();
+	for(const auto &bce : r2.blocks)
+	{
+		ASSERT_EQ(bce.block, it->block);
+		ASSERT_EQ(bce.txs, it->txs);
+		++it;
+	}
+}
+
+TEST(protocol_pack, stream_storage_rejects_truncated_blob)
+{
+	stream_test_struct s = make_test_struct();
+	std::string buff;
+	ASSERT_TRUE(epee::serialization::store_t_to_binary(s, buff));
+	for(size_t len = 0; len < buff.size(); len += 1 + len / 16)
+	{
+		epee::serialization::portable_storage_reader reader;
+		ASSERT_FALSE(reader.load_from_binary(buff.substr(0, len)));
+	}
+}
+
+namespace
+{
+std::string make_objects_blob()
+{
+	// random keys inside repeated structure, roughly what a block span looks like
+	std::mt19937 rng(7);
+	auto random_bytes = [&](size_t n) {
+		std::string s(n, 0);
+		for(char &c : s)
+			c = (char)rng();
+		return s;
+	};
+	cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+	r.current_blockchain_height = 1000;
+	for(size_t i = 0; i < 100; ++i)
+	{
+		cryptonote::block_complete_entry bce;
+		bce.block = std::string("\x02\x02\x00", 3) + random_bytes(76) + std::string("\x02\x3c\x01\xff\x00\x01\x02\x00", 8) + random_bytes(64);
+		for(size_t t = 0; t < i % 5; ++t)
+			bce.txs.push_back(std::string("\x02\x00\x01\x02\x00\x0b", 6) + random_bytes(600) + std::string(64, '\0') + random_bytes(400));
+		r.blocks.push_back(bce);
+	}
+
+	std::string buff;
+	epee::serialization::store_t_to_binary(r, buff);
+	return buff;
+}
+}
+
+TEST(protocol_pack, compressed_payload_roundtrip)
+{
+	const std::string buff = make_objects_blob();
+	std::string packed, unpacked;
+	ASSERT_TRUE(nodetool::compress_payload(buff, packed));
+	ASSERT_LT(packed.size(), buff.size());
+	ASSERT_TRUE(nodetool::decompress_payload(packed, buff.size(), LEVIN_DEFAULT_MAX_PACKET_SIZE, unpacked));
+	ASSERT_EQ(unpacked, buff);
+
+	nodetool::NOTIFY_COMPRESSED::request req;
+	req.command = cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::ID;
+	req.raw_size = buff.size();
+	req.data = packed;
+	std::string wrapped;
+	ASSERT_TRUE(epee::serialization::store_t_to_binary(req, wrapped));
+	nodetool::NOTIFY_COMPRESSED::request req2;
+	ASSERT_TRUE(epee::serialization::load_t_from_binary(req2, wrapped));
+	ASSERT_EQ(req2.command, req.command);
+	ASSERT_TRUE(nodetool::decompress_payload(req2.data, req2.raw_size, LEVIN_DEFAULT_MAX_PACKET_SIZE, unpacked));
+	ASSERT_EQ(unpacked, buff);
+}
+
+TEST(protocol_pack, compressed_payload_rejects_bad_input)
+{
+	const std::string buff = make_objects_blob();
+	std::string packed, unpacked;
+	ASSERT_TRUE(nodetool::compress_payload(buff, packed));
+
+	// the announced size must match exactly, in both directions
+	ASSERT_FALSE(nodetool::decompress_payload(packed, buff.size() - 1, LEVIN_DEFAULT_MAX_PACKET_SIZE, unpacked));
+	ASSERT_FALSE(nodetool::decompress_payload(packed, buff.size() + 1, LEVIN_DEFAULT_MAX_PACKET_SIZE, unpacked));
+	ASSERT_FALSE(nodetool::decompress_payload(packed, LEVIN_DEFAULT_MAX_PACKET_SIZE + 1, LEVIN_DEFAULT_MAX_PACKET_SIZE, unpacked));
+
+	// the announced size must fit the command's limit and what the stream could expand to
+	ASSERT_FALSE(nodetool::decompress_payload(packed, buff.size(), buff.size() - 1, unpacked));
+	ASSERT_TRUE(nodetool::decompress_payload(packed, buff.size(), buff.size(), unpacked));
+	std::string zeros_packed;
+	ASSERT_TRUE(nodetool::compress_payload(std::string(1000, '\0'), zeros_packed));
+	ASSERT_FALSE(nodetool::decompress_payload(zeros_packed, zeros_packed.size() * 1032 + 1, LEVIN_DEFAULT_MAX_PACKET_SIZE, unpacked));
+
+	ASSERT_FALSE(nodetool::decompress_payload(packed.substr(0, packed.size() / 2), buff.size(), LEVIN_DEFAULT_MAX_PACKET_SIZE, unpacked));
+	std::string corrupt = packed;
+	corrupt[corrupt.size() / 2] ^= 0x55;
+	ASSERT_FALSE(nodetool::decompress_payload(corrupt, buff.size(), LEVIN_DEFAULT_MAX_PACKET_SIZE, unpacked));
+	ASSERT_FALSE(nodetool::decompress_payload(std::string(), buff.size(), LEVIN_DEFAULT_MAX_PACKET_SIZE, unpacked));
+}
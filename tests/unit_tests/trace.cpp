@@ -0,0 +1,114 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "common/trace.h"
+#include "gtest/gtest.h"
+#include <boost/thread/thread.hpp>
+
+namespace
+{
+size_t count_of(const std::string &s, const std::string &what)
+{
+	size_t n = 0;
+	for(size_t pos = s.find(what); pos != std::string::npos; pos = s.find(what, pos + 1))
+		++n;
+	return n;
+}
+}
+
+TEST(trace, disabled_records_nothing)
+{
+	tools::trace::start();
+	tools::trace::stop();
+	{
+		TRACE_SCOPE(test_trace_disabled);
+	}
+	ASSERT_EQ(tools::trace::dump_json().find("test_trace_disabled"), std::string::npos);
+}
+
+TEST(trace, nested_scopes)
+{
+	tools::trace::start();
+	{
+		TRACE_SCOPE_ARG(test_trace_outer, 42);
+		TRACE_SCOPE(test_trace_inner);
+	}
+	tools::trace::stop();
+
+	const std::string json = tools::trace::dump_json();
+	ASSERT_EQ(json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0);
+	ASSERT_EQ(count_of(json, "\"name\":\"test_trace_outer\""), 1);
+	ASSERT_EQ(count_of(json, "\"name\":\"test_trace_inner\""), 1);
+	ASSERT_NE(json.find("\"args\":{\"n\":42}"), std::string::npos);
+	// the inner scope exits first
+	ASSERT_LT(json.find("test_trace_inner"), json.find("test_trace_outer"));
+}
+
+TEST(trace, ring_keeps_last_events)
+{
+	tools::trace::start(4);
+	for(uint64_t i = 0; i < 10; ++i)
+	{
+		TRACE_SCOPE_ARG(test_trace_ring, i);
+	}
+	tools::trace::stop();
+
+	const std::string json = tools::trace::dump_json();
+	ASSERT_EQ(count_of(json, "test_trace_ring"), 4);
+	ASSERT_EQ(json.find("\"args\":{\"n\":5}"), std::string::npos);
+	ASSERT_NE(json.find("\"args\":{\"n\":6}"), std::string::npos);
+	ASSERT_NE(json.find("\"args\":{\"n\":9}"), std::string::npos);
+}
+
+TEST(trace, total_events_capped)
+{
+	const size_t rings = tools::trace::MAX_EVENTS_TOTAL / tools::trace::MAX_EVENTS_PER_THREAD;
+	tools::trace::start(tools::trace::MAX_EVENTS_PER_THREAD);
+	for(size_t i = 0; i < rings + 4; ++i)
+	{
+		boost::thread t([] { TRACE_SCOPE(test_trace_capped); });
+		t.join();
+	}
+	tools::trace::stop();
+
+	// the threads past the cap got no ring to record into
+	const size_t events = count_of(tools::trace::dump_json(), "test_trace_capped");
+	ASSERT_GT(events, 0u);
+	ASSERT_LE(events, rings);
+}
+
+TEST(trace, threads_and_sessions)
+{
+	tools::trace::start();
+	boost::thread t([] { TRACE_SCOPE(test_trace_thread); });
+	t.join();
+	{
+		TRACE_SCOPE(test_trace_main);
+	}
+	tools::trace::stop();
+
+	// the thread is gone, its events stay until the next session
+	std::string json = tools::trace::dump_json();
+	const size_t thread_event = json.find("test_trace_thread");
+	const size_t main_event = json.find("test_trace_main");
+	ASSERT_NE(thread_event, std::string::npos);
+	ASSERT_NE(main_event, std::string::npos);
+	ASSERT_NE(json.substr(json.find("\"tid\":", thread_event), 10), json.substr(json.find("\"tid\":", main_event), 10));
+
+	tools::trace::start();
+	tools::trace::stop();
+	json = tools::trace::dump_json();
+	ASSERT_EQ(json.find("test_trace_thread"), std::string::npos);
+	ASSERT_EQ(json.find("test_trace_main"), std::string::npos);
+}
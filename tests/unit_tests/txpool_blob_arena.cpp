@@ -0,0 +1,74 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "cryptonote_core/tx_pool.h"
+#include "gtest/gtest.h"
+#include <vector>
+
+using namespace cryptonote;
+
+namespace
+{
+blobdata make_blob(size_t size, char fill)
+{
+	return blobdata(size, fill);
+}
+}
+
+TEST(txpool_blob_arena, store_and_read_back)
+{
+	txpool_blob_arena arena;
+	std::vector<txpool_blob_arena::blob> blobs;
+	for(size_t n = 0; n < 100; ++n)
+		blobs.push_back(arena.store(make_blob(100 + n, 'a' + n % 26)));
+	for(size_t n = 0; n < 100; ++n)
+		ASSERT_EQ(blobs[n].str(), make_blob(100 + n, 'a' + n % 26));
+	ASSERT_TRUE(arena.store(blobdata()).empty());
+}
+
+TEST(txpool_blob_arena, live_bytes)
+{
+	txpool_blob_arena arena;
+	txpool_blob_arena::blob a = arena.store(make_blob(1000, 'a'));
+	txpool_blob_arena::blob b = arena.store(make_blob(txpool_blob_arena::CHUNK_SIZE, 'b'));
+	ASSERT_EQ(arena.live(), 1000 + txpool_blob_arena::CHUNK_SIZE);
+	arena.release(a);
+	ASSERT_EQ(arena.live(), txpool_blob_arena::CHUNK_SIZE);
+	arena.release(b);
+	ASSERT_EQ(arena.live(), 0);
+	// released bytes stay readable through the handle
+	ASSERT_EQ(b.str(), make_blob(txpool_blob_arena::CHUNK_SIZE, 'b'));
+}
+
+TEST(txpool_blob_arena, fragmentation)
+{
+	txpool_blob_arena arena;
+	const size_t blob_size = txpool_blob_arena::CHUNK_SIZE / 8;
+	std::vector<txpool_blob_arena::blob> blobs;
+	for(size_t n = 0; n < 16; ++n)
+		blobs.push_back(arena.store(make_blob(blob_size, 'x')));
+
+	// the first chunk is full and no longer current, but fully live
+	ASSERT_FALSE(arena.is_fragmented(blobs[0]));
+	for(size_t n = 1; n < 8; ++n)
+		arena.release(blobs[n]);
+	ASSERT_TRUE(arena.is_fragmented(blobs[0]));
+	// the current chunk is never fragmented
+	ASSERT_FALSE(arena.is_fragmented(blobs[15]));
+
+	txpool_blob_arena::blob moved = arena.store(blobs[0].data(), blobs[0].size());
+	arena.release(blobs[0]);
+	ASSERT_EQ(moved.str(), make_blob(blob_size, 'x'));
+	ASSERT_EQ(arena.live(), 9 * blob_size);
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "file_io_utils.h"
+#include "serialization/binary_utils.h"
+#include "wallet/wallet2.h"
+#include <boost/archive/portable_binary_oarchive.hpp>
+#include <sstream>
+
+// serializes a wallet the way cache version 24 did, before the subaddress table file
+struct wallet2_cache_v24
+{
+	tools::wallet2 &w;
+
+	template <class t_archive>
+	void serialize(t_archive &a, const unsigned int ver)
+	{
+		w.serialize(a, ver);
+	}
+};
+BOOST_CLASS_VERSION(wallet2_cache_v24, 24)
+
+// Reaches the wallet2 internals that have no public entry point, so tests can
+// drive them without a daemon
+class wallet_accessor_test
+{
+  public:
+	// extends the local chain with dummy hashes up to height and sets the local height
+	static void set_height(tools::wallet2 &w, uint64_t height)
+	{
+		while(w.m_blockchain.size() < height)
+			w.m_blockchain.push_back(crypto::null_hash);
+		w.m_local_bc_height = height;
+	}
+
+	static void set_spent(tools::wallet2 &w, size_t idx, uint64_t height) { w.set_spent(idx, height); }
+	static void set_unspent(tools::wallet2 &w, size_t idx) { w.set_unspent(idx); }
+	static void detach_blockchain(tools::wallet2 &w, uint64_t height) { w.detach_blockchain(height); }
+
+	// the unspent transfers coin selection sees for index, and the rct ones among them by amount
+	static std::set<size_t> get_spendable(const tools::wallet2 &w, const cryptonote::subaddress_index &index, std::set<std::pair<uint64_t, size_t>> &rct_by_amount)
+	{
+		rct_by_amount.clear();
+		auto account = w.m_spendable.find(index.major);
+		if(account == w.m_spendable.end())
+			return {};
+		auto subaddr = account->second.find(index.minor);
+		if(subaddr == account->second.end())
+			return {};
+		rct_by_amount = subaddr->second.rct_by_amount;
+		return subaddr->second.transfers;
+	}
+
+	static const std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &get_subaddresses(const tools::wallet2 &w)
+	{
+		return w.m_subaddresses;
+	}
+
+	// whether m_subaddresses is the one read from the .subaddr file
+	static bool subaddress_table_loaded(const tools::wallet2 &w) { return !w.m_subaddress_table_dirty; }
+
+	// overwrites the wallet cache with a version 24 one, which still carries the subaddress map
+	static bool store_cache_v24(tools::wallet2 &w)
+	{
+		std::stringstream oss;
+		{
+			boost::archive::portable_binary_oarchive ar(oss);
+			const wallet2_cache_v24 cache{w};
+			ar << cache;
+		}
+		const std::string data = oss.str();
+
+		tools::wallet2::cache_file_data cache_file_data = boost::value_initialized<tools::wallet2::cache_file_data>();
+		crypto::chacha_key key;
+		w.generate_chacha_key_from_secret_keys(key);
+		cache_file_data.iv = crypto::rand<crypto::chacha_iv>();
+		cache_file_data.cache_data.resize(data.size());
+		crypto::chacha20(data.data(), data.size(), key, cache_file_data.iv, &cache_file_data.cache_data[0]);
+
+		std::string buf;
+		return ::serialization::dump_binary(cache_file_data, buf) && epee::file_io_utils::save_string_to_file(w.m_wallet_file, buf);
+	}
+
+	static void add_transfer(tools::wallet2 &w, const tools::wallet2::transfer_details &td) { w.m_transfers.push_back(td); }
+
+	typedef std::vector<std::vector<tools::wallet2::get_outs_entry>> rings;
+
+	static void add_placeholder_outs(const tools::wallet2 &w, rings &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count)
+	{
+		w.add_placeholder_outs(outs, selected_transfers, fake_outputs_count);
+	}
+
+	static size_t get_key_offsets_size(const rings &outs, size_t fake_outputs_count)
+	{
+		return tools::wallet2::get_key_offsets_size(outs, fake_outputs_count);
+	}
+
+	static size_t get_size_with_real_rings(size_t bytes, const rings &placeholders, const rings &outs, size_t fake_outputs_count, uint64_t sized_fee, uint64_t fee)
+	{
+		return tools::wallet2::get_size_with_real_rings(bytes, placeholders, outs, fake_outputs_count, sized_fee, fee);
+	}
+
+	static uint64_t get_transfer_unlock_height(const tools::wallet2 &w, const tools::wallet2::transfer_details &td)
+	{
+		return w.get_transfer_unlock_height(td);
+	}
+};
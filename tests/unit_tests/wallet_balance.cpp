@@ -0,0 +1,269 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "net/http_server_impl_base.h"
+#include "ringct/rctOps.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "wallet/wallet2.h"
+#include "wallet_accessor_test.h"
+#include <map>
+#include <set>
+
+using namespace epee;
+
+namespace
+{
+// answers the two daemon calls import_key_images makes
+class fake_daemon : public epee::http_server_impl_base<fake_daemon>
+{
+  public:
+	typedef epee::net_utils::connection_context_base connection_context;
+
+	std::vector<int> spent_status;
+
+	CHAIN_HTTP_TO_MAP2(connection_context);
+
+	BEGIN_URI_MAP2()
+	MAP_URI_AUTO_JON2("/is_key_image_spent", on_is_key_image_spent, cryptonote::COMMAND_RPC_IS_KEY_IMAGE_SPENT)
+	MAP_URI_AUTO_JON2("/gettransactions", on_get_transactions, cryptonote::COMMAND_RPC_GET_TRANSACTIONS)
+	END_URI_MAP2()
+
+	bool on_is_key_image_spent(const cryptonote::COMMAND_RPC_IS_KEY_IMAGE_SPENT::request &req, cryptonote::COMMAND_RPC_IS_KEY_IMAGE_SPENT::response &res)
+	{
+		res.spent_status = spent_status;
+		res.spent_status.resize(req.key_images.size(), cryptonote::COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT);
+		res.status = CORE_RPC_STATUS_OK;
+		return true;
+	}
+
+	bool on_get_transactions(const cryptonote::COMMAND_RPC_GET_TRANSACTIONS::request &req, cryptonote::COMMAND_RPC_GET_TRANSACTIONS::response &res)
+	{
+		res.status = CORE_RPC_STATUS_OK;
+		return true;
+	}
+};
+
+typedef std::map<uint32_t, std::map<uint32_t, uint64_t>> balance_map;
+
+class wallet_balance : public ::testing::Test
+{
+  protected:
+	void SetUp() override
+	{
+		m_wallet.generate_legacy("", "", crypto::secret_key(), false);
+		m_wallet.add_subaddress(0, "");
+		m_wallet.add_subaddress_account("");
+		m_wallet.add_subaddress(1, "");
+		wallet_accessor_test::set_height(m_wallet, 110);
+
+		// spread over both accounts, some with an unlock time past the default spendable age
+		const cryptonote::subaddress_index subaddrs[] = {{0, 0}, {0, 1}, {1, 0}, {1, 1}};
+		std::vector<tools::wallet2::transfer_details> outputs;
+		for(size_t i = 0; i < 24; ++i)
+		{
+			const uint64_t height = 10 + 4 * i;
+			outputs.push_back(make_output(subaddrs[i % 4], (i + 1) * 1000000, height, i % 3 == 0 ? height + 20 : 0));
+			outputs.back().m_rct = i % 2 == 1;
+		}
+		m_wallet.import_outputs(outputs);
+	}
+
+	// a transfer of amount to index, as if received in a tx at height
+	tools::wallet2::transfer_details make_output(const cryptonote::subaddress_index &index, uint64_t amount, uint64_t height, uint64_t unlock_time)
+	{
+		const cryptonote::account_public_address addr = m_wallet.get_subaddress(index);
+		const cryptonote::keypair tx_key = cryptonote::keypair::generate(hw::get_device("default"));
+		crypto::public_key tx_pub_key = tx_key.pub;
+		if(!index.is_zero())
+			tx_pub_key = rct::rct2pk(rct::scalarmultKey(rct::pk2rct(addr.m_spend_public_key), rct::sk2rct(tx_key.sec)));
+		crypto::key_derivation derivation;
+		crypto::public_key out_key;
+		crypto::generate_key_derivation(addr.m_view_public_key, tx_key.sec, derivation);
+		crypto::derive_public_key(derivation, 0, addr.m_spend_public_key, out_key);
+
+		tools::wallet2::transfer_details td = AUTO_VAL_INIT(td);
+		td.m_tx.unlock_time = unlock_time;
+		td.m_tx.vout.push_back(cryptonote::tx_out{amount, cryptonote::txout_to_key(out_key)});
+		cryptonote::add_tx_pub_key_to_extra(td.m_tx, tx_pub_key);
+		td.m_txid = crypto::rand<crypto::hash>();
+		td.m_block_height = height;
+		td.m_internal_output_index = 0;
+		td.m_global_output_index = height;
+		td.m_amount = amount;
+		td.m_subaddr_index = index;
+		return td;
+	}
+
+	// the balances as the wallet computed them before it kept running totals
+	void recount(balance_map &balance, balance_map &unlocked) const
+	{
+		tools::wallet2::transfer_container transfers;
+		m_wallet.get_transfers(transfers);
+		for(const tools::wallet2::transfer_details &td : transfers)
+		{
+			if(td.m_spent)
+				continue;
+			balance[td.m_subaddr_index.major][td.m_subaddr_index.minor] += td.amount();
+			if(m_wallet.is_transfer_unlocked(td))
+				unlocked[td.m_subaddr_index.major][td.m_subaddr_index.minor] += td.amount();
+		}
+	}
+
+	void check_balances() const
+	{
+		balance_map balance, unlocked;
+		recount(balance, unlocked);
+		uint64_t total = 0, total_unlocked = 0;
+		for(uint32_t major = 0; major < m_wallet.get_num_subaddress_accounts(); ++major)
+		{
+			uint64_t sum = 0, sum_unlocked = 0;
+			for(const auto &subaddr : balance[major])
+				sum += subaddr.second;
+			for(const auto &subaddr : unlocked[major])
+				sum_unlocked += subaddr.second;
+			EXPECT_EQ(balance[major], m_wallet.balance_per_subaddress(major)) << "account " << major;
+			EXPECT_EQ(unlocked[major], m_wallet.unlocked_balance_per_subaddress(major)) << "account " << major;
+			EXPECT_EQ(sum, m_wallet.balance(major)) << "account " << major;
+			EXPECT_EQ(sum_unlocked, m_wallet.unlocked_balance(major)) << "account " << major;
+			total += sum;
+			total_unlocked += sum_unlocked;
+		}
+		EXPECT_EQ(total, m_wallet.balance_all());
+		EXPECT_EQ(total_unlocked, m_wallet.unlocked_balance_all());
+		check_spendable();
+	}
+
+	// coin selection sees the same unspent transfers as a scan of all of them
+	void check_spendable() const
+	{
+		tools::wallet2::transfer_container transfers;
+		m_wallet.get_transfers(transfers);
+		for(const cryptonote::subaddress_index &index : {cryptonote::subaddress_index{0, 0}, cryptonote::subaddress_index{0, 1}, cryptonote::subaddress_index{1, 0}, cryptonote::subaddress_index{1, 1}})
+		{
+			std::set<size_t> expected;
+			std::set<std::pair<uint64_t, size_t>> expected_rct, rct_by_amount;
+			for(size_t i = 0; i < transfers.size(); ++i)
+			{
+				if(transfers[i].m_spent || transfers[i].m_subaddr_index != index)
+					continue;
+				expected.insert(i);
+				if(transfers[i].is_rct())
+					expected_rct.emplace(transfers[i].amount(), i);
+			}
+			EXPECT_EQ(expected, wallet_accessor_test::get_spendable(m_wallet, index, rct_by_amount)) << "subaddress " << index.major << "/" << index.minor;
+			EXPECT_EQ(expected_rct, rct_by_amount) << "subaddress " << index.major << "/" << index.minor;
+		}
+	}
+
+	// checks the balances as the chain grows past every unlock height
+	void check_balances_over_heights()
+	{
+		for(uint64_t height = 1; height <= 160; height += 3)
+		{
+			wallet_accessor_test::set_height(m_wallet, height);
+			check_balances();
+		}
+		wallet_accessor_test::set_height(m_wallet, 160);
+	}
+
+	tools::wallet2 m_wallet;
+};
+}
+
+TEST_F(wallet_balance, unlock_height)
+{
+	tools::wallet2::transfer_container transfers;
+	m_wallet.get_transfers(transfers);
+	for(uint64_t height = 1; height <= 160; ++height)
+	{
+		wallet_accessor_test::set_height(m_wallet, height);
+		for(const tools::wallet2::transfer_details &td : transfers)
+			ASSERT_EQ(m_wallet.is_transfer_unlocked(td), height >= wallet_accessor_test::get_transfer_unlock_height(m_wallet, td)) << "height " << height;
+	}
+	check_balances_over_heights();
+}
+
+TEST_F(wallet_balance, spend_and_unspend)
+{
+	for(size_t i = 0; i < 24; i += 2)
+		wallet_accessor_test::set_spent(m_wallet, i, 105);
+	check_balances_over_heights();
+
+	for(size_t i = 0; i < 24; i += 4)
+		wallet_accessor_test::set_unspent(m_wallet, i);
+	check_balances_over_heights();
+
+	// spending twice must not count the transfer twice
+	wallet_accessor_test::set_spent(m_wallet, 1, 106);
+	wallet_accessor_test::set_spent(m_wallet, 1, 107);
+	wallet_accessor_test::set_unspent(m_wallet, 2);
+	check_balances_over_heights();
+}
+
+TEST_F(wallet_balance, detach_blockchain)
+{
+	wallet_accessor_test::set_spent(m_wallet, 3, 60);
+	wallet_accessor_test::set_spent(m_wallet, 5, 100);
+	wallet_accessor_test::set_spent(m_wallet, 20, 100);
+	wallet_accessor_test::detach_blockchain(m_wallet, 80);
+
+	tools::wallet2::transfer_container transfers;
+	m_wallet.get_transfers(transfers);
+	ASSERT_EQ(18u, transfers.size());
+	ASSERT_TRUE(transfers[3].m_spent);
+	ASSERT_FALSE(transfers[5].m_spent);
+	check_balances_over_heights();
+}
+
+TEST_F(wallet_balance, import_key_images)
+{
+	fake_daemon daemon;
+	ASSERT_TRUE(daemon.init([](size_t len, uint8_t *ptr) { crypto::rand(len, ptr); }, "0", "127.0.0.1"));
+	ASSERT_TRUE(daemon.run(1, false));
+	ASSERT_TRUE(m_wallet.init("http://127.0.0.1:" + std::to_string(daemon.get_binded_port())));
+
+	const std::vector<std::pair<crypto::key_image, crypto::signature>> key_images = m_wallet.export_key_images();
+	ASSERT_EQ(24u, key_images.size());
+	uint64_t spent, unspent;
+	for(size_t i = 0; i < key_images.size(); ++i)
+		daemon.spent_status.push_back(i % 3 == 1 ? cryptonote::COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL : cryptonote::COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT);
+	m_wallet.import_key_images(key_images, spent, unspent);
+	EXPECT_NE(0u, spent);
+	check_balances_over_heights();
+
+	// the daemon no longer sees some of them spent
+	for(size_t i = 0; i < key_images.size(); i += 2)
+		daemon.spent_status[i] = cryptonote::COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT;
+	m_wallet.import_key_images(key_images, spent, unspent);
+	check_balances_over_heights();
+
+	daemon.send_stop_signal();
+	daemon.timed_wait_server_stop(5000);
+	daemon.deinit();
+}
+
+TEST_F(wallet_balance, import_outputs)
+{
+	wallet_accessor_test::set_spent(m_wallet, 7, 100);
+	tools::wallet2::transfer_container transfers;
+	m_wallet.get_transfers(transfers);
+	std::vector<tools::wallet2::transfer_details> outputs(transfers.begin(), transfers.end() - 4);
+	outputs[2].m_spent = true;
+	outputs[7].m_spent = false;
+	m_wallet.import_outputs(outputs);
+	check_balances_over_heights();
+}
@@ -0,0 +1,232 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "wallet/wallet2.h"
+
+namespace
+{
+typedef std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payment_list;
+typedef std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> confirmed_list;
+
+const size_t num_blocks = 40;
+const uint64_t first_height = 100;
+
+class wallet_history : public ::testing::Test
+{
+  protected:
+	void SetUp() override
+	{
+		// every other height has a block, with zero to three incoming and zero to two
+		// outgoing transfers, so pages keep landing on blocks holding both
+		tools::wallet2::payment_container payments;
+		confirmed_list confirmed;
+		for(size_t b = 0; b < num_blocks; ++b)
+		{
+			const uint64_t height = first_height + 2 * b;
+			for(size_t i = 0; i < (b * 7) % 4; ++i)
+			{
+				tools::wallet2::payment_details pd = AUTO_VAL_INIT(pd);
+				pd.m_tx_hash = crypto::rand<crypto::hash>();
+				pd.m_amount = 1000 + b;
+				pd.m_block_height = height;
+				pd.m_subaddr_index = {(uint32_t)(i % 2), (uint32_t)b % 3};
+				payments.emplace(m_payment_ids[(b + i) % 3], pd);
+			}
+			for(size_t i = 0; i < (b * 5) % 3; ++i)
+			{
+				tools::wallet2::confirmed_transfer_details ctd;
+				ctd.m_block_height = height;
+				ctd.m_subaddr_account = (b + i) % 2;
+				ctd.m_subaddr_indices.insert(b % 3);
+				confirmed.emplace_back(crypto::rand<crypto::hash>(), ctd);
+			}
+		}
+		m_wallet.import_payments(payments);
+		m_wallet.import_payments_out(confirmed);
+	}
+
+	static std::vector<crypto::hash> ids(const payment_list &payments)
+	{
+		std::vector<crypto::hash> r;
+		for(const auto &p : payments)
+			r.push_back(p.second.m_tx_hash);
+		return r;
+	}
+
+	static std::vector<crypto::hash> ids(const std::list<tools::wallet2::payment_details> &payments)
+	{
+		std::vector<crypto::hash> r;
+		for(const auto &p : payments)
+			r.push_back(p.m_tx_hash);
+		return r;
+	}
+
+	static std::vector<crypto::hash> ids(const confirmed_list &confirmed)
+	{
+		std::vector<crypto::hash> r;
+		for(const auto &p : confirmed)
+			r.push_back(p.first);
+		return r;
+	}
+
+	tools::wallet2 m_wallet;
+	const crypto::hash m_payment_ids[3] = {crypto::rand<crypto::hash>(), crypto::rand<crypto::hash>(), crypto::rand<crypto::hash>()};
+};
+}
+
+// resuming after the last height returned only gives back the same entries if no page
+// ended inside a block
+TEST_F(wallet_history, payments_pages)
+{
+	for(const boost::optional<uint32_t> &account : {boost::optional<uint32_t>(), boost::optional<uint32_t>(1)})
+	{
+		payment_list all;
+		ASSERT_FALSE(m_wallet.get_payments(all, 0, (uint64_t)-1, account));
+		ASSERT_FALSE(all.empty());
+
+		for(size_t max_count = 1; max_count <= 8; ++max_count)
+		{
+			std::vector<crypto::hash> paged;
+			uint64_t min_height = 0;
+			bool more = true;
+			for(size_t n = 0; more; ++n)
+			{
+				ASSERT_LT(n, all.size());
+				payment_list page;
+				more = m_wallet.get_payments(page, min_height, (uint64_t)-1, account, {}, max_count);
+				if(more)
+					ASSERT_GE(page.size(), max_count);
+				for(const auto &p : page)
+					ASSERT_GT(p.second.m_block_height, min_height);
+				const std::vector<crypto::hash> page_ids = ids(page);
+				paged.insert(paged.end(), page_ids.begin(), page_ids.end());
+				if(!page.empty())
+					min_height = page.back().second.m_block_height;
+			}
+			ASSERT_EQ(ids(all), paged) << "max_count " << max_count;
+		}
+	}
+}
+
+TEST_F(wallet_history, payments_by_id_pages)
+{
+	for(const crypto::hash &id : m_payment_ids)
+	{
+		crypto::uniform_payment_id payment_id;
+		payment_id.zero = 0;
+		payment_id.payment_id = id;
+		std::list<tools::wallet2::payment_details> all;
+		ASSERT_FALSE(m_wallet.get_payments(payment_id, all));
+		ASSERT_FALSE(all.empty());
+
+		for(size_t max_count = 1; max_count <= 5; ++max_count)
+		{
+			std::vector<crypto::hash> paged;
+			uint64_t min_height = 0;
+			bool more = true;
+			for(size_t n = 0; more; ++n)
+			{
+				ASSERT_LT(n, all.size());
+				std::list<tools::wallet2::payment_details> page;
+				more = m_wallet.get_payments(payment_id, page, min_height, boost::none, {}, max_count);
+				if(more)
+					ASSERT_GE(page.size(), max_count);
+				const std::vector<crypto::hash> page_ids = ids(page);
+				paged.insert(paged.end(), page_ids.begin(), page_ids.end());
+				if(!page.empty())
+					min_height = page.back().m_block_height;
+			}
+			ASSERT_EQ(ids(all), paged) << "max_count " << max_count;
+		}
+	}
+}
+
+TEST_F(wallet_history, payments_out_pages)
+{
+	confirmed_list all;
+	ASSERT_FALSE(m_wallet.get_payments_out(all, 0));
+	ASSERT_FALSE(all.empty());
+
+	for(size_t max_count = 1; max_count <= 6; ++max_count)
+	{
+		std::vector<crypto::hash> paged;
+		uint64_t min_height = 0;
+		bool more = true;
+		for(size_t n = 0; more; ++n)
+		{
+			ASSERT_LT(n, all.size());
+			confirmed_list page;
+			more = m_wallet.get_payments_out(page, min_height, (uint64_t)-1, boost::none, {}, max_count);
+			if(more)
+				ASSERT_GE(page.size(), max_count);
+			const std::vector<crypto::hash> page_ids = ids(page);
+			paged.insert(paged.end(), page_ids.begin(), page_ids.end());
+			if(!page.empty())
+				min_height = page.back().second.m_block_height;
+		}
+		ASSERT_EQ(ids(all), paged) << "max_count " << max_count;
+	}
+}
+
+// in and out share most blocks, so one of them regularly fills its page inside a block
+// the other has entries in
+TEST_F(wallet_history, in_and_out_pages_share_block_boundary)
+{
+	const uint64_t max_height = first_height + 2 * num_blocks - 10;
+	for(const std::set<uint32_t> &subaddr_indices : {std::set<uint32_t>(), std::set<uint32_t>{1, 2}})
+	{
+		payment_list all_in;
+		confirmed_list all_out;
+		uint64_t next_min_height;
+		ASSERT_FALSE(m_wallet.get_payments_page(&all_in, &all_out, 5, max_height, boost::none, subaddr_indices, 0, next_min_height));
+		ASSERT_FALSE(all_in.empty());
+		ASSERT_FALSE(all_out.empty());
+		ASSERT_EQ(std::max(all_in.back().second.m_block_height, all_out.back().second.m_block_height), next_min_height);
+
+		for(size_t max_count = 1; max_count <= 8; ++max_count)
+		{
+			std::vector<crypto::hash> paged_in, paged_out;
+			uint64_t min_height = 5;
+			bool more = true;
+			for(size_t n = 0; more; ++n)
+			{
+				ASSERT_LT(n, all_in.size() + all_out.size());
+				payment_list in;
+				confirmed_list out;
+				more = m_wallet.get_payments_page(&in, &out, min_height, max_height, boost::none, subaddr_indices, max_count, next_min_height);
+				if(more)
+					ASSERT_GE(std::max(in.size(), out.size()), max_count);
+				for(const auto &p : in)
+					ASSERT_TRUE(p.second.m_block_height > min_height && p.second.m_block_height <= next_min_height);
+				for(const auto &p : out)
+					ASSERT_TRUE(p.second.m_block_height > min_height && p.second.m_block_height <= next_min_height);
+				const std::vector<crypto::hash> in_ids = ids(in), out_ids = ids(out);
+				paged_in.insert(paged_in.end(), in_ids.begin(), in_ids.end());
+				paged_out.insert(paged_out.end(), out_ids.begin(), out_ids.end());
+				ASSERT_TRUE(!more || next_min_height > min_height);
+				min_height = next_min_height;
+			}
+			ASSERT_EQ(ids(all_in), paged_in) << "max_count " << max_count;
+			ASSERT_EQ(ids(all_out), paged_out) << "max_count " << max_count;
+		}
+	}
+
+	// only one side asked for
+	confirmed_list out;
+	uint64_t next_min_height;
+	ASSERT_TRUE(m_wallet.get_payments_page(nullptr, &out, 0, (uint64_t)-1, boost::none, {}, 1, next_min_height));
+	ASSERT_EQ(out.back().second.m_block_height, next_min_height);
+}
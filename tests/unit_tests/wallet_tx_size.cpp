@@ -0,0 +1,132 @@
+// Copyright (c) 2018, Ombre Cryptocurrency Project
+//
+// Ombre changes to this code are in public domain. Please note, other licences may apply to the file.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "common/varint.h"
+#include "ringct/rctOps.h"
+#include "wallet/wallet2.h"
+#include "wallet_accessor_test.h"
+#include <algorithm>
+#include <random>
+
+typedef wallet_accessor_test::rings rings;
+
+namespace
+{
+// placeholder rings take indices up to here
+const uint64_t max_global_index = ((uint64_t)1 << 56) - 1;
+
+tools::wallet2::transfer_details make_transfer(uint64_t global_index)
+{
+	tools::wallet2::transfer_details td = AUTO_VAL_INIT(td);
+	td.m_tx.vout.push_back(cryptonote::tx_out{0, cryptonote::txout_to_key(rct::rct2pk(rct::pkGen()))});
+	td.m_global_output_index = global_index;
+	td.m_amount = 1000000;
+	td.m_mask = rct::skGen();
+	td.m_rct = true;
+	return td;
+}
+
+// a ring of these indices around the output the placeholder ring was made for
+rings make_ring(const rings &placeholder, std::vector<uint64_t> indices)
+{
+	indices.push_back(std::get<0>(placeholder[0][0]));
+	std::sort(indices.begin(), indices.end());
+	rings ring(1);
+	for(uint64_t index : indices)
+		ring[0].push_back(std::make_tuple(index, std::get<1>(placeholder[0][0]), std::get<2>(placeholder[0][0])));
+	return ring;
+}
+
+size_t varint_size(uint64_t value)
+{
+	std::string varint;
+	tools::write_varint(std::back_inserter(varint), value);
+	return varint.size();
+}
+}
+
+TEST(wallet_tx_size, real_rings_encode_no_longer_than_placeholders)
+{
+	tools::wallet2 w;
+	const uint64_t global_indices[] = {0, 1, 127, 128, 1 << 20, max_global_index / 2, max_global_index - 1, max_global_index};
+	for(uint64_t index : global_indices)
+		wallet_accessor_test::add_transfer(w, make_transfer(index));
+
+	std::mt19937_64 rng(1);
+	for(size_t fake : {1, 4, 10, 24})
+	{
+		for(size_t i = 0; i < sizeof(global_indices) / sizeof(global_indices[0]); ++i)
+		{
+			rings placeholder;
+			wallet_accessor_test::add_placeholder_outs(w, placeholder, {i}, fake);
+			ASSERT_EQ(1, placeholder.size());
+			ASSERT_EQ(fake + 1, placeholder[0].size());
+			const size_t placeholder_size = wallet_accessor_test::get_key_offsets_size(placeholder, fake);
+
+			// decoys spread evenly, at the top of the range, at the bottom, and anywhere
+			std::vector<uint64_t> spread, top, bottom, random;
+			std::uniform_int_distribution<uint64_t> pick(0, max_global_index);
+			for(size_t n = 1; n <= fake; ++n)
+			{
+				spread.push_back(max_global_index / fake * n);
+				top.push_back(max_global_index - n);
+				bottom.push_back(n);
+				random.push_back(pick(rng));
+			}
+			for(const std::vector<uint64_t> &decoys : {spread, top, bottom, random})
+			{
+				const rings ring = make_ring(placeholder, decoys);
+				EXPECT_LE(wallet_accessor_test::get_key_offsets_size(ring, fake), placeholder_size) << "index " << global_indices[i] << ", " << fake << " decoys";
+			}
+		}
+	}
+}
+
+TEST(wallet_tx_size, placeholder_limits)
+{
+	tools::wallet2 w;
+	wallet_accessor_test::add_transfer(w, make_transfer(max_global_index));
+	wallet_accessor_test::add_transfer(w, make_transfer(max_global_index + 1));
+	rings outs;
+	EXPECT_NO_THROW(wallet_accessor_test::add_placeholder_outs(w, outs, {0}, 254));
+	outs.clear();
+	EXPECT_THROW(wallet_accessor_test::add_placeholder_outs(w, outs, {0}, 255), tools::error::wallet_internal_error);
+	outs.clear();
+	EXPECT_THROW(wallet_accessor_test::add_placeholder_outs(w, outs, {1}, 24), tools::error::wallet_internal_error);
+}
+
+TEST(wallet_tx_size, fee_encoding_growth_is_covered)
+{
+	tools::wallet2 w;
+	wallet_accessor_test::add_transfer(w, make_transfer(max_global_index / 3));
+	rings placeholder;
+	wallet_accessor_test::add_placeholder_outs(w, placeholder, {0}, 24);
+	std::vector<uint64_t> decoys;
+	for(size_t n = 1; n <= 24; ++n)
+		decoys.push_back(n * 1000);
+	const rings ring = make_ring(placeholder, decoys);
+
+	const size_t bytes = 3000;
+	const size_t real_bytes = bytes - wallet_accessor_test::get_key_offsets_size(placeholder, 24) + wallet_accessor_test::get_key_offsets_size(ring, 24);
+	// fees around the points where their varint takes another byte, raised and lowered after sizing
+	const uint64_t fees[][2] = {{127, 128}, {16383, 16384}, {((uint64_t)1 << 35) - 1, (uint64_t)1 << 35}, {128, 127}, {1000, 1000}};
+	for(const auto &f : fees)
+	{
+		const size_t size = wallet_accessor_test::get_size_with_real_rings(bytes, placeholder, ring, 24, f[0], f[1]);
+		const size_t growth = varint_size(f[1]) > varint_size(f[0]) ? varint_size(f[1]) - varint_size(f[0]) : 0;
+		EXPECT_GE(size, real_bytes + growth) << "fee " << f[0] << " raised to " << f[1];
+	}
+}